@@ -12,7 +12,11 @@ const struct treecli_value test1_interface_ifN_enabled = {
 	.name = "enabled",
 	.value = &test_value,
 	.value_type = TREECLI_VALUE_DATA,
-	.next = NULL
+};
+
+const struct treecli_value *test1_interface_ifN_values[] = {
+	&test1_interface_ifN_enabled,
+	NULL
 };
 
 
@@ -23,13 +27,18 @@ int32_t test1_interface_print_exec(struct treecli_parser *parser, void *exec_con
 	char val[10];
 	treecli_parser_value_to_str(parser, val, &test1_interface_ifN_enabled, sizeof(val));
 	printf("test value = %s\n", val);
-};
+	return 0;
+}
 
 const struct treecli_command test1_interface_print = {
 	.name = "print",
 	.exec = test1_interface_print_exec,
 	.exec_context = (void *)1234,
-	.next = NULL
+};
+
+const struct treecli_command *test1_interface_commands[] = {
+	&test1_interface_print,
+	NULL
 };
 
 
@@ -41,7 +50,7 @@ int32_t test1_interface_ifN_create(struct treecli_parser *parser, uint32_t index
 		if (node->name != NULL) {
 			sprintf(node->name, "ethernet%d", index);
 		}
-		node->values = &test1_interface_ifN_enabled;
+		node->values = &test1_interface_ifN_values;
 		return 0;
 	}
 
@@ -53,37 +62,46 @@ const struct treecli_dnode test1_interface_ifN = {
 	.create = test1_interface_ifN_create,
 };
 
+const struct treecli_dnode *test1_interface_dnodes[] = {
+	&test1_interface_ifN,
+	NULL
+};
+
 
 /************************* /system/bootloader values **************************/
 
 const struct treecli_value test1_system_bootloader_postbootaction = {
 	.name = "postboot-action",
-	.next = NULL
 };
 
 const struct treecli_value test1_system_bootloader_image = {
 	.name = "image",
-	.next = &test1_system_bootloader_postbootaction
 };
 
 const struct treecli_value test1_system_bootloader_backupimage = {
 	.name = "backup-image",
-	.next = &test1_system_bootloader_image
 };
 
 const struct treecli_value test1_system_bootloader_prebootdelay = {
 	.name = "preboot-delay",
-	.next = &test1_system_bootloader_backupimage
 };
 
 const struct treecli_value test1_system_bootloader_verifyimage = {
 	.name = "verify-image",
-	.next = &test1_system_bootloader_prebootdelay
 };
 
 const struct treecli_value test1_system_bootloader_consolespeed = {
 	.name = "console-speed",
-	.next = &test1_system_bootloader_verifyimage
+};
+
+const struct treecli_value *test1_system_bootloader_values[] = {
+	&test1_system_bootloader_consolespeed,
+	&test1_system_bootloader_verifyimage,
+	&test1_system_bootloader_prebootdelay,
+	&test1_system_bootloader_backupimage,
+	&test1_system_bootloader_image,
+	&test1_system_bootloader_postbootaction,
+	NULL
 };
 
 
@@ -91,7 +109,8 @@ const struct treecli_value test1_system_bootloader_consolespeed = {
 
 int32_t test1_system_quit_exec(struct treecli_parser *parser, void *exec_context) {
 	quit_req = 1;
-};
+	return 0;
+}
 
 const struct treecli_command test1_system_quit = {
 	.name = "quit",
@@ -99,12 +118,22 @@ const struct treecli_command test1_system_quit = {
 	.exec = test1_system_quit_exec,
 };
 
+const struct treecli_command *test1_system_commands[] = {
+	&test1_system_quit,
+	NULL
+};
+
 
 /***************************** /system subnodes *******************************/
 
 const struct treecli_node test1_system_bootloader = {
 	.name = "bootloader",
-	.values = &test1_system_bootloader_consolespeed
+	.values = &test1_system_bootloader_values
+};
+
+const struct treecli_node *test1_system_subnodes[] = {
+	&test1_system_bootloader,
+	NULL
 };
 
 
@@ -116,12 +145,16 @@ const struct treecli_node test1_system_bootloader = {
 
 const struct treecli_command test1_power_reboot = {
 	.name = "reboot",
-	.next = NULL
 };
 
 const struct treecli_command test1_power_poweroff = {
 	.name = "poweroff",
-	.next = &test1_power_reboot
+};
+
+const struct treecli_command *test1_power_commands[] = {
+	&test1_power_poweroff,
+	&test1_power_reboot,
+	NULL
 };
 
 
@@ -131,35 +164,45 @@ const struct treecli_node test1_power_source = {
 	.name = "source",
 };
 
+const struct treecli_node *test1_power_subnodes[] = {
+	&test1_power_source,
+	NULL
+};
+
 
 /******************************* root subnodes ********************************/
 
 const struct treecli_node test1_power = {
 	.name = "inpower",
 	.help = "System power manipulation (poweroff, reboot, power mode)",
-	.commands = &test1_power_poweroff,
-	.subnodes = &test1_power_source
+	.commands = &test1_power_commands,
+	.subnodes = &test1_power_subnodes
 };
 
 const struct treecli_node test1_interface = {
 	.name = "interface",
-	.commands = &test1_interface_print,
-	.dsubnodes = &test1_interface_ifN,
-	.next = &test1_power
+	.commands = &test1_interface_commands,
+	.dsubnodes = &test1_interface_dnodes,
 };
 
 const struct treecli_node test1_system = {
 	.name = "system",
 	.help = "Various commands for system management",
-	.commands = &test1_system_quit,
-	.subnodes = &test1_system_bootloader,
-	.next = &test1_interface
+	.commands = &test1_system_commands,
+	.subnodes = &test1_system_subnodes,
+};
+
+const struct treecli_node *test1_subnodes[] = {
+	&test1_system,
+	&test1_interface,
+	&test1_power,
+	NULL
 };
 
 
 /********************************* root node **********************************/
 const struct treecli_node test1 = {
 	.name = "/",
-	.subnodes = &test1_system
+	.subnodes = &test1_subnodes
 };
 
@@ -1,6 +1,10 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "treecli_parser.h"
 #include "treecli_shell.h"
@@ -22,11 +26,51 @@ int32_t parser_output(const char *s, void *ctx) {
 }
 
 
+/* Session recorder writing to a file. Recordings can be replayed using the
+ * replay example. */
+int32_t recorder_write(const void *buf, size_t len, void *ctx) {
+	if (fwrite(buf, 1, len, (FILE *)ctx) != len) {
+		return -1;
+	}
+	return 0;
+}
+
+uint32_t recorder_time(void *ctx) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+
 int main(int argc, char *argv[]) {
 
-	/* Initialize the shell and set print callback */
+	/* Initialize the shell */
 	struct treecli_shell sh;
 	treecli_shell_init(&sh, &test1);
+
+	/* Record the session if requested (-r file). */
+	FILE *rec = NULL;
+	if (argc > 2 && !strcmp(argv[1], "-r")) {
+		rec = fopen(argv[2], "wb");
+		if (rec == NULL) {
+			fprintf(stderr, "%s: cannot open file\n", argv[2]);
+			return 1;
+		}
+		treecli_shell_set_recorder(&sh, recorder_write, recorder_time, (void *)rec);
+	}
+
+	/* Commands piped to the standard input are executed as a script
+	 * without line editing. The print callback is set directly, setting
+	 * it by treecli_shell_set_print_handler would draw the prompt. */
+	if (!isatty(fileno(stdin))) {
+		sh.print_handler = parser_output;
+		sh.print_handler_ctx = (void *)&sh;
+		int32_t ret = treecli_shell_run_script(&sh, "stdin", treecli_shell_read_file_line, (void *)stdin);
+		treecli_shell_free(&sh);
+		return (ret == TREECLI_SHELL_RUN_SCRIPT_OK) ? 0 : 1;
+	}
+
+	/* Set print callback, the prompt is displayed. */
 	treecli_shell_set_print_handler(&sh, parser_output, (void *)&sh);
 
 	/* loop while we have something to read from the input */
@@ -45,5 +89,8 @@ int main(int argc, char *argv[]) {
 
 	/* don't forget to free the shell context */
 	treecli_shell_free(&sh);
+	if (rec != NULL) {
+		fclose(rec);
+	}
 }
 
@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "treecli_parser.h"
+#include "treecli_shell.h"
+#include "lineedit.h"
+
+/* Replay a session recorded by example1 (-r option) to a fresh shell with the
+ * same configuration tree and report latency of individual keys. Exec
+ * callbacks of the example tree print to the standard output, the report
+ * is printed to the standard error output.
+ *
+ * usage: ./replay session.rec [iterations] > /dev/null */
+
+uint32_t quit_req = 0;
+
+#include "conf_tree1.c"
+
+
+/* Kinds of replayed input reported separately. */
+enum key_class {
+	KEY_TAB = 0,
+	KEY_ENTER,
+	KEY_OTHER,
+	KEY_CHUNK,
+	KEY_CLASSES,
+};
+
+static const char *key_class_name[KEY_CLASSES] = {
+	"tab", "enter", "other keys", "fed chunks"
+};
+
+/* Latencies are kept in nanoseconds. */
+struct samples {
+	uint32_t *latency;
+	uint32_t count;
+	uint64_t output;
+};
+
+static uint64_t output_bytes;
+
+
+int32_t replay_output(const char *s, void *ctx) {
+	(void)ctx;
+
+	output_bytes += strlen(s);
+	return 0;
+}
+
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+
+static int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+
+static enum key_class classify(const struct treecli_shell_record *r) {
+	if (r->type == TREECLI_SHELL_RECORD_FEED) {
+		return KEY_CHUNK;
+	}
+	if (r->data[0] == '\t') {
+		return KEY_TAB;
+	}
+	if (r->data[0] == '\r' || r->data[0] == '\n') {
+		return KEY_ENTER;
+	}
+	return KEY_OTHER;
+}
+
+
+static uint32_t percentile(const uint32_t *sorted, uint32_t count, uint32_t p) {
+	uint32_t i = (uint32_t)(((uint64_t)count * p + 99) / 100);
+	return sorted[(i > 0) ? i - 1 : 0];
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s session.rec [iterations]\n", argv[0]);
+		return 1;
+	}
+	uint32_t iterations = (argc > 2) ? (uint32_t)atoi(argv[2]) : 1;
+	if (iterations == 0) {
+		iterations = 1;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (f == NULL) {
+		fprintf(stderr, "%s: cannot open file\n", argv[1]);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *rec = malloc(size > 0 ? size : 1);
+	if (rec == NULL || fread(rec, 1, size, f) != (size_t)size) {
+		fprintf(stderr, "%s: cannot read file\n", argv[1]);
+		return 1;
+	}
+	fclose(f);
+
+	/* Count the input records and the recorded output. */
+	uint32_t inputs = 0;
+	uint64_t recorded_output = 0;
+	size_t off = 0;
+	struct treecli_shell_record r;
+	size_t used;
+	while (treecli_shell_record_decode(rec + off, size - off, &r, &used) == TREECLI_SHELL_RECORD_DECODE_OK) {
+		if (r.type == TREECLI_SHELL_RECORD_OUTPUT) {
+			recorded_output += r.len;
+		} else {
+			inputs++;
+		}
+		off += used;
+	}
+	if (off != (size_t)size) {
+		fprintf(stderr, "%s: recording is truncated at %lu\n", argv[1], (unsigned long)off);
+	}
+
+	struct samples samples[KEY_CLASSES];
+	for (uint32_t c = 0; c < KEY_CLASSES; c++) {
+		samples[c].latency = malloc(sizeof(uint32_t) * ((size_t)inputs * iterations + 1));
+		samples[c].count = 0;
+		samples[c].output = 0;
+		if (samples[c].latency == NULL) {
+			return 1;
+		}
+	}
+
+	/* Every iteration starts with a fresh shell. Output of the shell
+	 * initialization is not counted. */
+	uint64_t replayed_output = 0;
+	for (uint32_t it = 0; it < iterations; it++) {
+		struct treecli_shell sh;
+		treecli_shell_init(&sh, &test1);
+		treecli_shell_set_print_handler(&sh, replay_output, NULL);
+		output_bytes = 0;
+
+		off = 0;
+		while (treecli_shell_record_decode(rec + off, size - off, &r, &used) == TREECLI_SHELL_RECORD_DECODE_OK) {
+			off += used;
+			if (r.type == TREECLI_SHELL_RECORD_OUTPUT || (r.type == TREECLI_SHELL_RECORD_INPUT && r.len != 1)) {
+				continue;
+			}
+
+			enum key_class c = classify(&r);
+			uint64_t out_before = output_bytes;
+			uint64_t start = now_ns();
+			if (r.type == TREECLI_SHELL_RECORD_INPUT) {
+				treecli_shell_keypress(&sh, r.data[0]);
+			} else {
+				treecli_shell_feed(&sh, (const char *)r.data, r.len);
+			}
+			uint64_t ns = now_ns() - start;
+
+			samples[c].latency[samples[c].count++] = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+			samples[c].output += output_bytes - out_before;
+		}
+
+		replayed_output = output_bytes;
+		treecli_shell_free(&sh);
+	}
+
+	fprintf(stderr, "%u input records, %u iterations\n", inputs, iterations);
+	fprintf(stderr, "output bytes: %llu recorded, %llu replayed\n", (unsigned long long)recorded_output, (unsigned long long)replayed_output);
+	fprintf(stderr, "%-12s %8s %8s %8s %8s %8s %10s\n", "", "count", "p50 us", "p90 us", "p99 us", "max us", "out bytes");
+	for (uint32_t c = 0; c < KEY_CLASSES; c++) {
+		struct samples *s = &samples[c];
+		if (s->count == 0) {
+			continue;
+		}
+		qsort(s->latency, s->count, sizeof(uint32_t), cmp_u32);
+		fprintf(stderr, "%-12s %8u %8.1f %8.1f %8.1f %8.1f %10.1f\n", key_class_name[c], s->count,
+			percentile(s->latency, s->count, 50) / 1000.0, percentile(s->latency, s->count, 90) / 1000.0,
+			percentile(s->latency, s->count, 99) / 1000.0, s->latency[s->count - 1] / 1000.0,
+			(double)s->output / s->count);
+	}
+
+	for (uint32_t c = 0; c < KEY_CLASSES; c++) {
+		free(samples[c].latency);
+	}
+	free(rec);
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+#!/bin/bash
+#
+# Report worst case stack usage of treecli entry points. Library sources are
+# compiled with -fstack-usage and -fcallgraph-info (GCC 10 or newer), frame
+# sizes are summed along the deepest call chain of each entry point.
+#
+# usage: ./stack_report.sh [entry point...]
+#
+# Additional compiler flags can be passed in STACK_CFLAGS, eg.
+# STACK_CFLAGS="-Os -DTREECLI_PARSER_LOW_STACK=1" ./stack_report.sh
+
+CC=${CC:-gcc}
+STACK_CFLAGS=${STACK_CFLAGS:--O2}
+ENTRIES=${@:-treecli_parser_parse_line treecli_parser_resume_line treecli_parser_get_matches treecli_parser_help treecli_parser_help_more treecli_resolve_path treecli_handle_get treecli_handle_set treecli_handle_exec treecli_prepare treecli_execute treecli_shell_keypress}
+
+TMP=$(mktemp -d)
+trap "rm -rf $TMP" EXIT
+
+# Sources which do not compile (eg. the shell without lineedit) are skipped,
+# their entry points are missing from the report.
+SKIPPED=""
+for src in ../treecli_*.c; do
+	if ! $CC -I . -I .. -I ../lineedit --std=c99 -w $STACK_CFLAGS -fstack-usage -fcallgraph-info=su -c $src -o $TMP/$(basename $src .c).o 2> /dev/null; then
+		SKIPPED="$SKIPPED $(basename $src)"
+		rm -f $TMP/$(basename $src .c).ci
+	fi
+done
+
+echo "Worst case stack usage ($STACK_CFLAGS):"
+if [ -n "$SKIPPED" ]; then
+	echo "Skipped (failed to compile):$SKIPPED"
+fi
+cat $TMP/*.ci | awk -v entries="$ENTRIES" '
+	# Static functions are prefixed with their file name.
+	function short(name) {
+		sub(/^.*:/, "", name);
+		return name;
+	}
+
+	/^node:/ {
+		match($0, /title: "[^"]*"/);
+		name = short(substr($0, RSTART + 8, RLENGTH - 9));
+		if (match($0, /\\n[0-9]+ bytes/)) {
+			frame[name] = substr($0, RSTART + 2, RLENGTH - 8) + 0;
+		}
+	}
+	/^edge:/ {
+		match($0, /sourcename: "[^"]*"/);
+		src = short(substr($0, RSTART + 13, RLENGTH - 14));
+		match($0, /targetname: "[^"]*"/);
+		dst = short(substr($0, RSTART + 13, RLENGTH - 14));
+		if (!((src, dst) in seen)) {
+			seen[src, dst] = 1;
+			calls[src] = calls[src] " " dst;
+		}
+	}
+
+	# Merge two lists of flags without duplicates.
+	function merge(a, b,    n, i, fl) {
+		n = split(b, fl, " ");
+		for (i = 1; i <= n; i++) {
+			if (index(a " ", " " fl[i] " ") == 0) {
+				a = a " " fl[i];
+			}
+		}
+		return a;
+	}
+
+	# Deepest chain starting at f. Recursion and indirect calls (callbacks)
+	# cannot be bounded statically, they are reported as flags. Flags of
+	# the chains below f are left in wflags and memoized with the depth.
+	function worst(f,    n, i, c, w, best, bestc, acc) {
+		if (f in done) {
+			wflags = fflags[f];
+			return total[f];
+		}
+		if (f ~ /indirect_call/) {
+			wflags = " +callbacks";
+			return 0;
+		}
+		if (onpath[f]) {
+			wflags = " +recursion(" f ")";
+			return 0;
+		}
+		onpath[f] = 1;
+		best = 0;
+		bestc = "";
+		acc = "";
+		n = split(calls[f], c, " ");
+		for (i = 1; i <= n; i++) {
+			w = worst(c[i]);
+			acc = merge(acc, wflags);
+			if (w > best) {
+				best = w;
+				bestc = c[i];
+			}
+		}
+		onpath[f] = 0;
+		done[f] = 1;
+		total[f] = frame[f] + best;
+		via[f] = bestc;
+		fflags[f] = acc;
+		wflags = acc;
+		return total[f];
+	}
+
+	END {
+		n = split(entries, e, " ");
+		for (i = 1; i <= n; i++) {
+			if (!(e[i] in frame)) {
+				continue;
+			}
+			w = worst(e[i]);
+			chain = e[i];
+			for (f = via[e[i]]; f != ""; f = via[f]) {
+				chain = chain " > " f;
+			}
+			printf("%6u  %s%s\n        %s\n", w, e[i], wflags, chain);
+		}
+	}
+'
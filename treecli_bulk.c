@@ -0,0 +1,354 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "treecli_parser.h"
+#include "treecli_workspace.h"
+#include "treecli_bulk.h"
+
+
+struct treecli_bulk_collect_state {
+	struct treecli_bulk_item *items;
+	uint32_t max;
+	uint32_t count;
+	bool overflow;
+};
+
+/**
+ * Shared context of bulk read workers. Items are taken in order by the
+ * workers, next is protected by the lock.
+ */
+struct treecli_bulk_read_state {
+	const struct treecli_parser *parser;
+	struct treecli_bulk_item *items;
+	uint32_t count;
+
+	pthread_mutex_t lock;
+	uint32_t next;
+};
+
+
+/**
+ * Add all values of the node at the current parser position and recurse to
+ * its subnodes.
+ */
+static void treecli_bulk_walk(struct treecli_parser *parser, struct treecli_bulk_collect_state *st) {
+	struct treecli_node node;
+	int32_t res = treecli_parser_get_current_node(parser, &node);
+	if (res == TREECLI_PARSER_GET_CURRENT_NODE_ROOT) {
+		memcpy(&node, parser->top, sizeof(struct treecli_node));
+	} else if (res != TREECLI_PARSER_GET_CURRENT_NODE_OK) {
+		return;
+	}
+
+	if (node.values != NULL) {
+		const struct treecli_value *v;
+		for (size_t i = 0; (v = (*(node.values))[i]) != NULL; i++) {
+			if (st->count == st->max) {
+				st->overflow = true;
+				return;
+			}
+			struct treecli_bulk_item *item = &(st->items[st->count++]);
+			memset(item, 0, sizeof(struct treecli_bulk_item));
+			item->handle.type = TREECLI_HANDLE_VALUE;
+			treecli_parser_pos_copy(&(item->handle.pos), &(parser->pos));
+			item->handle.value = v;
+			item->result = TREECLI_BULK_ITEM_FAILED;
+		}
+	}
+
+	const struct treecli_node *const *subnodes;
+	treecli_parser_current_subnodes(parser, &node, &subnodes);
+	if (subnodes != NULL) {
+		const struct treecli_node *n;
+		for (size_t i = 0; !st->overflow && (n = subnodes[i]) != NULL; i++) {
+			struct treecli_parser_pos_level level = {.node = n, .dnode = NULL, .dnode_index = 0};
+			if (treecli_parser_pos_move(&(parser->pos), &level) != TREECLI_PARSER_POS_MOVE_OK) {
+				continue;
+			}
+			treecli_bulk_walk(parser, st);
+			treecli_parser_pos_up(&(parser->pos));
+		}
+	}
+
+	const struct treecli_compact *compact;
+	uint32_t index;
+	treecli_parser_current_compact(parser, &compact, &index);
+	if (compact != NULL) {
+		uint32_t first = compact->nodes[index].subnodes;
+		uint32_t end = first + compact->nodes[index].subnodes_count;
+		for (uint32_t i = first; !st->overflow && i < end; i++) {
+			struct treecli_parser_pos_level level = {.node = NULL, .dnode = NULL, .compact = compact, .compact_index = i};
+			if (treecli_parser_pos_move(&(parser->pos), &level) != TREECLI_PARSER_POS_MOVE_OK) {
+				continue;
+			}
+			treecli_bulk_walk(parser, st);
+			treecli_parser_pos_up(&(parser->pos));
+		}
+	}
+
+	if (node.dsubnodes != NULL) {
+		const struct treecli_dnode *d;
+		for (size_t j = 0; !st->overflow && (d = (*(node.dsubnodes))[j]) != NULL; j++) {
+			for (uint32_t i = 0; !st->overflow && i < TREECLI_DNODE_MAX_COUNT; i++) {
+				/* Dynamic nodes are enumerated until the first
+				 * one which cannot be created. */
+				char name[TREECLI_DNODE_MAX_NAME_LEN];
+				if (treecli_parser_dnode_get_name(parser, d, i, name) != TREECLI_PARSER_DNODE_GET_NAME_OK) {
+					break;
+				}
+
+				struct treecli_parser_pos_level level = {.node = NULL, .dnode = d, .dnode_index = i};
+				if (treecli_parser_pos_move(&(parser->pos), &level) != TREECLI_PARSER_POS_MOVE_OK) {
+					break;
+				}
+				treecli_bulk_walk(parser, st);
+				treecli_parser_pos_up(&(parser->pos));
+			}
+		}
+	}
+}
+
+
+int32_t treecli_bulk_collect(struct treecli_parser *parser, const struct treecli_handle *node, struct treecli_bulk_item *items, uint32_t max, uint32_t *count) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(items != NULL) ||
+	    u_assert(count != NULL)) {
+		return TREECLI_BULK_COLLECT_FAILED;
+	}
+
+	if (node != NULL && node->type != TREECLI_HANDLE_NODE) {
+		return TREECLI_BULK_COLLECT_FAILED;
+	}
+
+	treecli_parser_read_lock(parser);
+
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+	if (node != NULL) {
+		treecli_parser_pos_copy(&(parser->pos), (struct treecli_parser_pos *)&(node->pos));
+	} else {
+		treecli_parser_pos_root(&(parser->pos));
+	}
+
+	struct treecli_bulk_collect_state st;
+	memset(&st, 0, sizeof(st));
+	st.items = items;
+	st.max = max;
+	treecli_bulk_walk(parser, &st);
+
+	treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+	treecli_parser_read_unlock(parser);
+
+	*count = st.count;
+	if (st.overflow) {
+		return TREECLI_BULK_COLLECT_TOO_MANY;
+	}
+
+	return TREECLI_BULK_COLLECT_OK;
+}
+
+
+/**
+ * Read a single item using a parser owned by the calling thread.
+ */
+static void treecli_bulk_read_item(struct treecli_parser *parser, struct treecli_bulk_item *item) {
+	treecli_parser_pos_copy(&(parser->pos), &(item->handle.pos));
+
+	item->len = sizeof(item->data);
+	if (treecli_handle_get(parser, &(item->handle), item->data, &(item->len)) != TREECLI_HANDLE_GET_OK) {
+		item->result = TREECLI_BULK_ITEM_FAILED;
+		return;
+	}
+	item->result = TREECLI_BULK_ITEM_OK;
+}
+
+
+static void *treecli_bulk_worker(void *arg) {
+	struct treecli_bulk_read_state *st = (struct treecli_bulk_read_state *)arg;
+
+	/* Private parser of the worker, getters may use its position and
+	 * the user context. Nothing else is shared with the caller's parser.
+	 * Mounted subtrees are kept by the read-side section of the calling
+	 * thread. */
+	struct treecli_parser parser;
+	if (treecli_parser_init(&parser, st->parser->top) != TREECLI_PARSER_INIT_OK) {
+		return NULL;
+	}
+	parser.context = st->parser->context;
+#if TREECLI_PARSER_LOW_STACK
+	struct treecli_parser_workspace workspace;
+	parser.workspace = &workspace;
+#endif
+
+	while (true) {
+		pthread_mutex_lock(&(st->lock));
+		uint32_t i = st->next++;
+		pthread_mutex_unlock(&(st->lock));
+
+		if (i >= st->count) {
+			break;
+		}
+		treecli_bulk_read_item(&parser, &(st->items[i]));
+	}
+	treecli_parser_free(&parser);
+
+	return NULL;
+}
+
+
+int32_t treecli_bulk_read(struct treecli_parser *parser, struct treecli_bulk_item *items, uint32_t count, uint32_t threads) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(items != NULL || count == 0)) {
+		return TREECLI_BULK_READ_FAILED;
+	}
+
+	if (threads > TREECLI_BULK_MAX_THREADS) {
+		threads = TREECLI_BULK_MAX_THREADS;
+	}
+	if (threads > count) {
+		threads = count;
+	}
+
+	struct treecli_bulk_read_state st;
+	st.parser = parser;
+	st.items = items;
+	st.count = count;
+	st.next = 0;
+	if (pthread_mutex_init(&(st.lock), NULL) != 0) {
+		return TREECLI_BULK_READ_FAILED;
+	}
+
+	/* Start the pool. The calling thread works as one of the workers, it
+	 * does the whole work alone if no thread can be started. */
+	treecli_parser_read_lock(parser);
+	pthread_t pool[TREECLI_BULK_MAX_THREADS];
+	uint32_t started = 0;
+	for (uint32_t i = 1; i < threads; i++) {
+		if (pthread_create(&(pool[started]), NULL, treecli_bulk_worker, (void *)&st) != 0) {
+			break;
+		}
+		started++;
+	}
+	treecli_bulk_worker((void *)&st);
+
+	for (uint32_t i = 0; i < started; i++) {
+		pthread_join(pool[i], NULL);
+	}
+	treecli_parser_read_unlock(parser);
+	pthread_mutex_destroy(&(st.lock));
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (items[i].result != TREECLI_BULK_ITEM_OK) {
+			return TREECLI_BULK_READ_ITEM_FAILED;
+		}
+	}
+
+	return TREECLI_BULK_READ_OK;
+}
+
+
+/**
+ * Format a value read in bulk.
+ */
+static void treecli_bulk_format(const struct treecli_bulk_item *item, char *s, size_t max) {
+	const struct treecli_value *v = item->handle.value;
+
+	if (item->result != TREECLI_BULK_ITEM_OK) {
+		snprintf(s, max, "<error>");
+		return;
+	}
+
+	switch (v->value_type) {
+		case TREECLI_VALUE_INT32:
+		case TREECLI_VALUE_PHYS: {
+			int32_t i;
+			memcpy(&i, item->data, sizeof(i));
+			snprintf(s, max, "%ld%s", (long)i, (v->value_type == TREECLI_VALUE_PHYS && v->units != NULL) ? v->units : "");
+			break;
+		}
+
+		case TREECLI_VALUE_STR: {
+			size_t len = item->len;
+			if (len >= max) {
+				len = max - 1;
+			}
+			memcpy(s, item->data, len);
+			s[len] = '\0';
+			break;
+		}
+
+		case TREECLI_VALUE_BOOL: {
+			bool b;
+			memcpy(&b, item->data, sizeof(b));
+			snprintf(s, max, "%s", b ? "true" : "false");
+			break;
+		}
+
+		default: {
+			uint32_t u;
+			memcpy(&u, item->data, sizeof(u));
+			snprintf(s, max, "%lu", (unsigned long)u);
+			break;
+		}
+	}
+}
+
+
+int32_t treecli_bulk_print(struct treecli_parser *parser, const struct treecli_bulk_item *items, uint32_t count) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(items != NULL || count == 0) ||
+	    u_assert(parser->print_handler != NULL)) {
+		return TREECLI_BULK_PRINT_FAILED;
+	}
+
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+
+	for (uint32_t i = 0; i < count; i++) {
+		const struct treecli_bulk_item *item = &(items[i]);
+		char s[TREECLI_BULK_VALUE_LEN + 16];
+		treecli_bulk_format(item, s, sizeof(s));
+
+		treecli_parser_pos_copy(&(parser->pos), (struct treecli_parser_pos *)&(item->handle.pos));
+		treecli_parser_pos_print(parser, false);
+		if (parser->pos.depth > 0) {
+			treecli_parser_print(parser, "/");
+		}
+		treecli_parser_print(parser, item->handle.value->name);
+		treecli_parser_print(parser, " = ");
+		treecli_parser_print(parser, s);
+		treecli_parser_print(parser, "\n");
+	}
+
+	treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+
+	return TREECLI_BULK_PRINT_OK;
+}
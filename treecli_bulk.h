@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_BULK_H_
+#define _TREECLI_BULK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "treecli_parser.h"
+
+/**
+ * Maximum size of a value read in bulk (including strings).
+ */
+#ifndef TREECLI_BULK_VALUE_LEN
+#define TREECLI_BULK_VALUE_LEN 32
+#endif
+
+#ifndef TREECLI_BULK_MAX_THREADS
+#define TREECLI_BULK_MAX_THREADS 16
+#endif
+
+
+/**
+ * Single value read in bulk together with its result.
+ */
+struct treecli_bulk_item {
+	struct treecli_handle handle;
+
+	int32_t result;
+	size_t len;
+	uint8_t data[TREECLI_BULK_VALUE_LEN];
+};
+
+
+/**
+ * Collect handles of all values in a subtree. Values are collected in tree
+ * order: values of a node first, then its static subnodes, compact subnodes
+ * and dynamic subnodes, depth-first.
+ *
+ * @param parser A parser context.
+ * @param node Node handle of the subtree root or NULL for the whole tree.
+ * @param items Array of items to fill.
+ * @param max Size of the items array.
+ * @param count Number of collected values.
+ *
+ * @return TREECLI_BULK_COLLECT_OK if all values were collected or
+ *         TREECLI_BULK_COLLECT_TOO_MANY if the array is too small (max items
+ *         are filled) or
+ *         TREECLI_BULK_COLLECT_FAILED otherwise.
+ */
+int32_t treecli_bulk_collect(struct treecli_parser *parser, const struct treecli_handle *node, struct treecli_bulk_item *items, uint32_t max, uint32_t *count);
+#define TREECLI_BULK_COLLECT_OK 0
+#define TREECLI_BULK_COLLECT_FAILED -1
+#define TREECLI_BULK_COLLECT_TOO_MANY -2
+
+/**
+ * Read values of all items. Value getters are called in parallel from a pool
+ * of worker threads, each worker uses its own parser with the position of
+ * the read value sharing only the tree and the user context with the
+ * original one. Getters must be thread safe. Results are stored in the items,
+ * their order is not changed. The parser cache is not used.
+ *
+ * @param parser A parser context. It must not be used until the function
+ *               returns.
+ * @param items Items to read, usually filled by treecli_bulk_collect.
+ * @param count Number of items.
+ * @param threads Number of worker threads, values are read sequentially in
+ *                the calling thread if it is 0 or 1.
+ *
+ * @return TREECLI_BULK_READ_OK if all values were read or
+ *         TREECLI_BULK_READ_ITEM_FAILED if some value cannot be read or
+ *         TREECLI_BULK_READ_FAILED otherwise.
+ */
+int32_t treecli_bulk_read(struct treecli_parser *parser, struct treecli_bulk_item *items, uint32_t count, uint32_t threads);
+#define TREECLI_BULK_READ_OK 0
+#define TREECLI_BULK_READ_FAILED -1
+#define TREECLI_BULK_READ_ITEM_FAILED -2
+#define TREECLI_BULK_ITEM_OK 0
+#define TREECLI_BULK_ITEM_FAILED -1
+
+/**
+ * Print items read by treecli_bulk_read as "path/name = value" lines.
+ *
+ * @param parser A parser context with the print handler set.
+ * @param items Items to print.
+ * @param count Number of items.
+ *
+ * @return TREECLI_BULK_PRINT_OK or TREECLI_BULK_PRINT_FAILED.
+ */
+int32_t treecli_bulk_print(struct treecli_parser *parser, const struct treecli_bulk_item *items, uint32_t count);
+#define TREECLI_BULK_PRINT_OK 0
+#define TREECLI_BULK_PRINT_FAILED -1
+
+
+#endif
@@ -0,0 +1,481 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "treecli_parser.h"
+#include "treecli_compact.h"
+#include "treecli_help.h"
+
+#ifndef TREECLI_COMPACT_SYMBOL_LEN
+#define TREECLI_COMPACT_SYMBOL_LEN 64
+#endif
+
+#ifndef TREECLI_COMPACT_HELP_LEN
+#define TREECLI_COMPACT_HELP_LEN 256
+#endif
+
+/**
+ * State of the generator. The tree is walked multiple times in the same
+ * order (level order, subnodes sorted by names), each pass emits one of the
+ * generated arrays. Offsets are computed by running counters, no copy of the
+ * tree is made.
+ */
+struct treecli_compact_export_state {
+	const char *name;
+	int32_t (*print_handler)(const char *s, void *ctx);
+	int32_t (*symbol)(const void *item, enum treecli_compact_item type, char *buf, size_t len, void *ctx);
+	void *ctx;
+	const struct treecli_help_dict *dict;
+	int32_t error;
+
+	uint32_t index;
+	uint32_t strings;
+	uint32_t help_strings;
+	uint32_t subnodes;
+	uint32_t values;
+	uint32_t commands;
+	uint32_t dsubnodes;
+};
+
+
+static void treecli_compact_print(struct treecli_compact_export_state *st, const char *s) {
+	if (st->error == TREECLI_COMPACT_EXPORT_OK && st->print_handler(s, st->ctx) < 0) {
+		st->error = TREECLI_COMPACT_EXPORT_FAILED;
+	}
+}
+
+
+/**
+ * Print a string as a C string literal including the terminating zero.
+ */
+static void treecli_compact_print_str(struct treecli_compact_export_state *st, const char *s) {
+	char buf[8];
+
+	treecli_compact_print(st, "\t\"");
+	for (; *s != '\0'; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\') {
+			snprintf(buf, sizeof(buf), "\\%c", c);
+		} else if (c < 0x20 || c >= 0x7f) {
+			snprintf(buf, sizeof(buf), "\\%03o", c);
+		} else {
+			snprintf(buf, sizeof(buf), "%c", c);
+		}
+		treecli_compact_print(st, buf);
+	}
+	treecli_compact_print(st, "\\000\"\n");
+}
+
+
+/**
+ * Advance a 16 bit offset, offsets must not reach TREECLI_COMPACT_NONE.
+ */
+static uint32_t treecli_compact_advance(struct treecli_compact_export_state *st, uint32_t *counter, uint32_t n) {
+	uint32_t offset = *counter;
+	*counter += n;
+	if (*counter >= TREECLI_COMPACT_NONE) {
+		st->error = TREECLI_COMPACT_EXPORT_TOO_LARGE;
+	}
+	return offset;
+}
+
+
+static uint32_t treecli_compact_count(const void * const *array) {
+	uint32_t n = 0;
+	if (array != NULL) {
+		while (array[n] != NULL) {
+			n++;
+		}
+	}
+	return n;
+}
+
+
+/**
+ * Get the subnode following prev in the order of names (the first one if
+ * prev is NULL).
+ */
+static const struct treecli_node *treecli_compact_next(const struct treecli_node *node, const struct treecli_node *prev) {
+	const struct treecli_node *next = NULL;
+	if (node->subnodes == NULL) {
+		return NULL;
+	}
+
+	const struct treecli_node *n;
+	for (size_t i = 0; (n = (*(node->subnodes))[i]) != NULL; i++) {
+		if (prev != NULL && strcmp(n->name, prev->name) <= 0) {
+			continue;
+		}
+		if (next == NULL || strcmp(n->name, next->name) < 0) {
+			next = n;
+		}
+	}
+
+	return next;
+}
+
+
+/**
+ * Visit all nodes at the given depth of the subtree in order.
+ *
+ * @return Number of visited nodes.
+ */
+static uint32_t treecli_compact_level(struct treecli_compact_export_state *st, const struct treecli_node *node, uint32_t depth, void (*visit)(struct treecli_compact_export_state *st, const struct treecli_node *node)) {
+	if (depth == 0) {
+		if (visit != NULL) {
+			visit(st, node);
+		}
+		st->index++;
+		return 1;
+	}
+
+	uint32_t count = 0;
+	for (const struct treecli_node *n = treecli_compact_next(node, NULL); n != NULL; n = treecli_compact_next(node, n)) {
+		count += treecli_compact_level(st, n, depth - 1, visit);
+	}
+	return count;
+}
+
+
+/**
+ * Visit all nodes of the tree in level order. Nodes deeper than
+ * TREECLI_TREE_MAX_DEPTH cannot be reached by the parser, the export fails
+ * if there are any.
+ */
+static void treecli_compact_walk(struct treecli_compact_export_state *st, const struct treecli_node *top, void (*visit)(struct treecli_compact_export_state *st, const struct treecli_node *node)) {
+	st->index = 0;
+	st->strings = 0;
+	st->help_strings = 0;
+	st->subnodes = 1;
+	st->values = 0;
+	st->commands = 0;
+	st->dsubnodes = 0;
+
+	for (uint32_t depth = 0; depth < TREECLI_TREE_MAX_DEPTH + 1; depth++) {
+		if (treecli_compact_level(st, top, depth, visit) == 0) {
+			return;
+		}
+	}
+
+	uint32_t index = st->index;
+	if (treecli_compact_level(st, top, TREECLI_TREE_MAX_DEPTH + 1, NULL) > 0 && st->error == TREECLI_COMPACT_EXPORT_OK) {
+		st->error = TREECLI_COMPACT_EXPORT_TOO_DEEP;
+	}
+	st->index = index;
+}
+
+
+static void treecli_compact_visit_strings(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	treecli_compact_print_str(st, node->name);
+	treecli_compact_advance(st, &(st->strings), strlen(node->name) + 1);
+}
+
+
+/**
+ * Get a help string as it is stored in the help pool (compressed if
+ * a dictionary is used).
+ */
+static const char *treecli_compact_help(struct treecli_compact_export_state *st, const char *help, char *buf, size_t len) {
+	if (st->dict == NULL) {
+		return help;
+	}
+	if (treecli_help_compress(st->dict, help, buf, len) != TREECLI_HELP_COMPRESS_OK) {
+		st->error = TREECLI_COMPACT_EXPORT_FAILED;
+		buf[0] = '\0';
+	}
+	return buf;
+}
+
+
+/**
+ * Store a help string in the help pool. The string is printed if requested,
+ * its offset is returned (TREECLI_COMPACT_NONE if there is no help).
+ */
+static uint32_t treecli_compact_help_add(struct treecli_compact_export_state *st, const char *help, bool print) {
+	char buf[TREECLI_COMPACT_HELP_LEN];
+	if (help == NULL) {
+		return TREECLI_COMPACT_NONE;
+	}
+	const char *s = treecli_compact_help(st, help, buf, sizeof(buf));
+	if (print) {
+		treecli_compact_print_str(st, s);
+	}
+	return treecli_compact_advance(st, &(st->help_strings), strlen(s) + 1);
+}
+
+
+/**
+ * Help of a node is followed by help of its commands in the pool, all help
+ * passes must advance the pool offset the same way.
+ */
+static void treecli_compact_visit_help_strings(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	treecli_compact_help_add(st, node->help, true);
+
+	uint32_t n = treecli_compact_count((const void * const *)node->commands);
+	for (uint32_t i = 0; i < n; i++) {
+		treecli_compact_help_add(st, (*(node->commands))[i]->help, true);
+	}
+}
+
+
+static void treecli_compact_print_offset(struct treecli_compact_export_state *st, uint32_t offset) {
+	char buf[32];
+	if (offset == TREECLI_COMPACT_NONE) {
+		snprintf(buf, sizeof(buf), "\tTREECLI_COMPACT_NONE,\n");
+	} else {
+		snprintf(buf, sizeof(buf), "\t%lu,\n", (unsigned long)offset);
+	}
+	treecli_compact_print(st, buf);
+}
+
+
+static void treecli_compact_visit_help(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	treecli_compact_print_offset(st, treecli_compact_help_add(st, node->help, false));
+
+	uint32_t n = treecli_compact_count((const void * const *)node->commands);
+	for (uint32_t i = 0; i < n; i++) {
+		treecli_compact_help_add(st, (*(node->commands))[i]->help, false);
+	}
+}
+
+
+/**
+ * Print help offsets of a run of commands, the terminating NULL of the run
+ * has no help.
+ */
+static void treecli_compact_visit_command_help(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	treecli_compact_help_add(st, node->help, false);
+
+	uint32_t n = treecli_compact_count((const void * const *)node->commands);
+	if (n == 0) {
+		return;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		treecli_compact_print_offset(st, treecli_compact_help_add(st, (*(node->commands))[i]->help, false));
+	}
+	treecli_compact_print_offset(st, TREECLI_COMPACT_NONE);
+}
+
+
+/**
+ * Print a NULL terminated run of item references.
+ */
+static void treecli_compact_print_run(struct treecli_compact_export_state *st, const void * const *array, enum treecli_compact_item type) {
+	char sym[TREECLI_COMPACT_SYMBOL_LEN];
+	char buf[TREECLI_COMPACT_SYMBOL_LEN + 8];
+
+	uint32_t n = treecli_compact_count(array);
+	if (n == 0) {
+		return;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		if (st->symbol(array[i], type, sym, sizeof(sym), st->ctx) < 0) {
+			st->error = TREECLI_COMPACT_EXPORT_FAILED;
+			return;
+		}
+		sym[sizeof(sym) - 1] = '\0';
+		snprintf(buf, sizeof(buf), "\t&%s,\n", sym);
+		treecli_compact_print(st, buf);
+	}
+	treecli_compact_print(st, "\tNULL,\n");
+}
+
+
+/**
+ * Print extern declarations of all referenced items.
+ */
+static void treecli_compact_print_externs(struct treecli_compact_export_state *st, const void * const *array, enum treecli_compact_item type) {
+	static const char *types[] = {"treecli_value", "treecli_command", "treecli_dnode"};
+	char sym[TREECLI_COMPACT_SYMBOL_LEN];
+	char buf[TREECLI_COMPACT_SYMBOL_LEN + 48];
+
+	uint32_t n = treecli_compact_count(array);
+	for (uint32_t i = 0; i < n; i++) {
+		if (st->symbol(array[i], type, sym, sizeof(sym), st->ctx) < 0) {
+			st->error = TREECLI_COMPACT_EXPORT_FAILED;
+			return;
+		}
+		sym[sizeof(sym) - 1] = '\0';
+		snprintf(buf, sizeof(buf), "extern const struct %s %s;\n", types[type], sym);
+		treecli_compact_print(st, buf);
+	}
+}
+
+
+static void treecli_compact_visit_externs(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	treecli_compact_print_externs(st, (const void * const *)node->values, TREECLI_COMPACT_ITEM_VALUE);
+	treecli_compact_print_externs(st, (const void * const *)node->commands, TREECLI_COMPACT_ITEM_COMMAND);
+	treecli_compact_print_externs(st, (const void * const *)node->dsubnodes, TREECLI_COMPACT_ITEM_DNODE);
+}
+
+
+static void treecli_compact_visit_values(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	treecli_compact_print_run(st, (const void * const *)node->values, TREECLI_COMPACT_ITEM_VALUE);
+}
+
+
+static void treecli_compact_visit_commands(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	treecli_compact_print_run(st, (const void * const *)node->commands, TREECLI_COMPACT_ITEM_COMMAND);
+}
+
+
+static void treecli_compact_visit_dsubnodes(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	treecli_compact_print_run(st, (const void * const *)node->dsubnodes, TREECLI_COMPACT_ITEM_DNODE);
+}
+
+
+/**
+ * Get offset of a run in a table or TREECLI_COMPACT_NONE if it is empty.
+ */
+static uint32_t treecli_compact_run(struct treecli_compact_export_state *st, uint32_t *counter, const void * const *array) {
+	uint32_t n = treecli_compact_count(array);
+	if (n == 0) {
+		return TREECLI_COMPACT_NONE;
+	}
+	return treecli_compact_advance(st, counter, n + 1);
+}
+
+
+static void treecli_compact_visit_nodes(struct treecli_compact_export_state *st, const struct treecli_node *node) {
+	char buf[128];
+
+	uint32_t name = treecli_compact_advance(st, &(st->strings), strlen(node->name) + 1);
+	uint32_t count = treecli_compact_count((const void * const *)node->subnodes);
+	uint32_t subnodes = treecli_compact_advance(st, &(st->subnodes), count);
+	uint32_t values = treecli_compact_run(st, &(st->values), (const void * const *)node->values);
+	uint32_t commands = treecli_compact_run(st, &(st->commands), (const void * const *)node->commands);
+	uint32_t dsubnodes = treecli_compact_run(st, &(st->dsubnodes), (const void * const *)node->dsubnodes);
+
+	/* Nested compact trees cannot be packed again. */
+	if (node->subnodes == &treecli_compact_subnodes) {
+		st->error = TREECLI_COMPACT_EXPORT_FAILED;
+	}
+
+	snprintf(buf, sizeof(buf), "\t{%lu, %lu, %lu, %lu, %lu, %lu},\n",
+		(unsigned long)name, (unsigned long)subnodes, (unsigned long)count,
+		(unsigned long)values, (unsigned long)commands, (unsigned long)dsubnodes);
+	treecli_compact_print(st, buf);
+}
+
+
+/**
+ * Print a table of item references terminated by an additional NULL (the
+ * table cannot be empty).
+ */
+static void treecli_compact_print_table(struct treecli_compact_export_state *st, const struct treecli_node *top, const char *type, const char *suffix, void (*visit)(struct treecli_compact_export_state *st, const struct treecli_node *node)) {
+	char buf[TREECLI_COMPACT_SYMBOL_LEN + 64];
+
+	snprintf(buf, sizeof(buf), "static const struct %s *const %s_%s[] = {\n", type, st->name, suffix);
+	treecli_compact_print(st, buf);
+	treecli_compact_walk(st, top, visit);
+	treecli_compact_print(st, "\tNULL,\n};\n\n");
+}
+
+
+int32_t treecli_compact_export(const struct treecli_node *top, const char *name, const struct treecli_help_dict *dict, int32_t (*print_handler)(const char *s, void *ctx), int32_t (*symbol)(const void *item, enum treecli_compact_item type, char *buf, size_t len, void *ctx), void *ctx) {
+	if (u_assert(top != NULL) ||
+	    u_assert(name != NULL) ||
+	    u_assert(print_handler != NULL) ||
+	    u_assert(symbol != NULL)) {
+		return TREECLI_COMPACT_EXPORT_FAILED;
+	}
+
+	struct treecli_compact_export_state st;
+	memset(&st, 0, sizeof(st));
+	st.name = name;
+	st.print_handler = print_handler;
+	st.symbol = symbol;
+	st.ctx = ctx;
+	st.dict = dict;
+	st.error = TREECLI_COMPACT_EXPORT_OK;
+
+	char buf[TREECLI_COMPACT_SYMBOL_LEN + 128];
+
+	treecli_compact_print(&st, "/* Generated by treecli_compact_export, do not edit. */\n\n");
+	treecli_compact_walk(&st, top, treecli_compact_visit_externs);
+	treecli_compact_print(&st, "\n");
+
+	snprintf(buf, sizeof(buf), "static const char %s_strings[] =\n", name);
+	treecli_compact_print(&st, buf);
+	treecli_compact_walk(&st, top, treecli_compact_visit_strings);
+	treecli_compact_print(&st, "\t\"\";\n\n");
+
+	snprintf(buf, sizeof(buf), "static const char %s_help_strings[] =\n", name);
+	treecli_compact_print(&st, buf);
+	treecli_compact_walk(&st, top, treecli_compact_visit_help_strings);
+	treecli_compact_print(&st, "\t\"\";\n\n");
+
+	snprintf(buf, sizeof(buf), "static const uint16_t %s_help[] = {\n", name);
+	treecli_compact_print(&st, buf);
+	treecli_compact_walk(&st, top, treecli_compact_visit_help);
+	treecli_compact_print(&st, "};\n\n");
+
+	snprintf(buf, sizeof(buf), "static const uint16_t %s_command_help[] = {\n", name);
+	treecli_compact_print(&st, buf);
+	treecli_compact_walk(&st, top, treecli_compact_visit_command_help);
+	treecli_compact_print(&st, "\tTREECLI_COMPACT_NONE,\n};\n\n");
+
+	treecli_compact_print_table(&st, top, "treecli_value", "values", treecli_compact_visit_values);
+	treecli_compact_print_table(&st, top, "treecli_command", "commands", treecli_compact_visit_commands);
+	treecli_compact_print_table(&st, top, "treecli_dnode", "dsubnodes", treecli_compact_visit_dsubnodes);
+
+	snprintf(buf, sizeof(buf), "static const struct treecli_compact_node %s_nodes[] = {\n", name);
+	treecli_compact_print(&st, buf);
+	treecli_compact_walk(&st, top, treecli_compact_visit_nodes);
+	treecli_compact_print(&st, "};\n\n");
+
+	/* The top node is kept in the tree structure, values, commands and
+	 * dnodes of the top node are its own (first runs of the tables). */
+	snprintf(buf, sizeof(buf), "const struct treecli_compact %s = {\n", name);
+	treecli_compact_print(&st, buf);
+	snprintf(buf, sizeof(buf), "\t.top = {\n\t\t.name = (char *)&%s_strings[0],\n", name);
+	treecli_compact_print(&st, buf);
+	treecli_compact_print(&st, "\t\t.subnodes = &treecli_compact_subnodes,\n");
+	if (top->values != NULL && (*(top->values))[0] != NULL) {
+		snprintf(buf, sizeof(buf), "\t\t.values = (const struct treecli_value *(*)[])&%s_values[0],\n", name);
+		treecli_compact_print(&st, buf);
+	}
+	if (top->commands != NULL && (*(top->commands))[0] != NULL) {
+		snprintf(buf, sizeof(buf), "\t\t.commands = (const struct treecli_command *(*)[])&%s_commands[0],\n", name);
+		treecli_compact_print(&st, buf);
+	}
+	if (top->dsubnodes != NULL && (*(top->dsubnodes))[0] != NULL) {
+		snprintf(buf, sizeof(buf), "\t\t.dsubnodes = (const struct treecli_dnode *(*)[])&%s_dsubnodes[0],\n", name);
+		treecli_compact_print(&st, buf);
+	}
+	treecli_compact_print(&st, "\t},\n");
+	snprintf(buf, sizeof(buf), "\t.nodes = %s_nodes,\n\t.nodes_count = %lu,\n\t.strings = %s_strings,\n", name, (unsigned long)st.index, name);
+	treecli_compact_print(&st, buf);
+	snprintf(buf, sizeof(buf), "\t.help = %s_help,\n\t.help_strings = %s_help_strings,\n\t.command_help = %s_command_help,\n", name, name, name);
+	treecli_compact_print(&st, buf);
+	snprintf(buf, sizeof(buf), "\t.values = %s_values,\n\t.commands = %s_commands,\n\t.dsubnodes = %s_dsubnodes,\n};\n", name, name, name);
+	treecli_compact_print(&st, buf);
+
+	return st.error;
+}
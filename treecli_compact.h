@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_COMPACT_H_
+#define _TREECLI_COMPACT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "treecli_parser.h"
+#include "treecli_help.h"
+
+
+enum treecli_compact_item {
+	TREECLI_COMPACT_ITEM_VALUE = 0,
+	TREECLI_COMPACT_ITEM_COMMAND,
+	TREECLI_COMPACT_ITEM_DNODE,
+};
+
+
+/**
+ * Generate C source of a compact tree equivalent to a tree of statically
+ * defined nodes. It is meant to be run at build time on a host with the
+ * original tree linked in. The output defines a struct treecli_compact
+ * named name, its top member (&name.top) can be passed to
+ * treecli_parser_init instead of the original top node.
+ *
+ * On a 32-bit target a static node takes 28 bytes plus 4 bytes in the
+ * subnodes array of its parent. A compact node takes 12 bytes plus 2 bytes
+ * of help index, names and help strings take the same space in both layouts.
+ *
+ * Nodes are stored in level order with subnodes of each node sorted by their
+ * names, which allows binary search when matching. Help and completion list
+ * subnodes of a compact tree in this order, not in the order they were
+ * defined in. Values, commands and dnodes are kept as they are (they contain
+ * callbacks), the generated tables reference them by their C symbols which
+ * are provided by the symbol callback. Help of commands is copied to the
+ * help pool of the tree, command structures of the target don't need to
+ * keep their own help strings.
+ *
+ * @param top Top node of the original tree.
+ * @param name Name of the generated compact tree (C identifier).
+ * @param dict Dictionary used to compress help strings of nodes and commands
+ *             (eg. generated by treecli_help_dict_export) or NULL to store
+ *             them as plain text. The parser must use the same dictionary
+ *             (treecli_parser_set_help_dict).
+ * @param print_handler Handler receiving the generated source.
+ * @param symbol Callback writing a C symbol name of the item to buf. It
+ *               returns a negative value if the name is not known.
+ * @param ctx Context passed to both callbacks.
+ *
+ * @return TREECLI_COMPACT_EXPORT_OK if the whole tree was generated or
+ *         TREECLI_COMPACT_EXPORT_TOO_LARGE if the tree doesn't fit 16 bit
+ *         offsets or
+ *         TREECLI_COMPACT_EXPORT_TOO_DEEP if the tree has nodes deeper than
+ *         TREECLI_TREE_MAX_DEPTH or
+ *         TREECLI_COMPACT_EXPORT_FAILED otherwise.
+ */
+int32_t treecli_compact_export(const struct treecli_node *top, const char *name, const struct treecli_help_dict *dict, int32_t (*print_handler)(const char *s, void *ctx), int32_t (*symbol)(const void *item, enum treecli_compact_item type, char *buf, size_t len, void *ctx), void *ctx);
+#define TREECLI_COMPACT_EXPORT_OK 0
+#define TREECLI_COMPACT_EXPORT_FAILED -1
+#define TREECLI_COMPACT_EXPORT_TOO_LARGE -2
+#define TREECLI_COMPACT_EXPORT_TOO_DEEP -3
+
+
+#endif
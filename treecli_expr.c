@@ -0,0 +1,530 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "treecli_parser.h"
+#include "treecli_expr.h"
+#include "treecli_workspace.h"
+
+#ifndef TREECLI_EXPR_NAME_LEN
+#define TREECLI_EXPR_NAME_LEN 64
+#endif
+
+/**
+ * State of the expression compiler.
+ */
+struct treecli_expr_compiler {
+	struct treecli_parser *parser;
+	struct treecli_expr *expr;
+	const char *pos;
+	const char *end;
+	int32_t error;
+	uint32_t nesting;
+};
+
+/**
+ * Compiled subexpression. Its code starts at offset start, constant
+ * subexpressions are replaced by a single constant. stack is the number of
+ * stack slots needed to evaluate the subexpression.
+ */
+struct treecli_expr_operand {
+	uint32_t start;
+	bool constant;
+	int32_t value;
+	uint32_t stack;
+};
+
+/**
+ * Binary operators grouped by precedence, lowest first.
+ */
+static const struct {
+	const char *str;
+	enum treecli_expr_op op;
+	uint32_t level;
+} treecli_expr_binary_ops[] = {
+	{"|", TREECLI_EXPR_OP_OR, 0},
+	{"^", TREECLI_EXPR_OP_XOR, 1},
+	{"&", TREECLI_EXPR_OP_AND, 2},
+	{"<<", TREECLI_EXPR_OP_SHL, 3},
+	{">>", TREECLI_EXPR_OP_SHR, 3},
+	{"+", TREECLI_EXPR_OP_ADD, 4},
+	{"-", TREECLI_EXPR_OP_SUB, 4},
+	{"*", TREECLI_EXPR_OP_MUL, 5},
+	{"/", TREECLI_EXPR_OP_DIV, 5},
+	{"%", TREECLI_EXPR_OP_MOD, 5},
+};
+#define TREECLI_EXPR_LEVELS 6
+
+
+/**
+ * Apply an operator to its operands (b is ignored for unary operators). The
+ * same function is used for constant folding and evaluation.
+ *
+ * @return 0 on success or -1 on division by zero.
+ */
+static int32_t treecli_expr_apply(enum treecli_expr_op op, int32_t a, int32_t b, int32_t *r) {
+	/* Wrap around on overflow. */
+	uint32_t ua = (uint32_t)a;
+	uint32_t ub = (uint32_t)b;
+
+	switch (op) {
+		case TREECLI_EXPR_OP_NEG:
+			*r = (int32_t)(0 - ua);
+			break;
+		case TREECLI_EXPR_OP_NOT:
+			*r = (int32_t)(~ua);
+			break;
+		case TREECLI_EXPR_OP_MUL:
+			*r = (int32_t)(ua * ub);
+			break;
+		case TREECLI_EXPR_OP_DIV:
+		case TREECLI_EXPR_OP_MOD:
+			if (b == 0) {
+				return -1;
+			}
+			if (a == INT32_MIN && b == -1) {
+				*r = (op == TREECLI_EXPR_OP_DIV) ? a : 0;
+			} else {
+				*r = (op == TREECLI_EXPR_OP_DIV) ? (a / b) : (a % b);
+			}
+			break;
+		case TREECLI_EXPR_OP_ADD:
+			*r = (int32_t)(ua + ub);
+			break;
+		case TREECLI_EXPR_OP_SUB:
+			*r = (int32_t)(ua - ub);
+			break;
+		case TREECLI_EXPR_OP_SHL:
+			*r = (int32_t)(ua << (ub & 31));
+			break;
+		case TREECLI_EXPR_OP_SHR:
+			/* Arithmetic shift regardless of the compiler. */
+			*r = (a < 0) ? (int32_t)~(~ua >> (ub & 31)) : (int32_t)(ua >> (ub & 31));
+			break;
+		case TREECLI_EXPR_OP_AND:
+			*r = (int32_t)(ua & ub);
+			break;
+		case TREECLI_EXPR_OP_XOR:
+			*r = (int32_t)(ua ^ ub);
+			break;
+		case TREECLI_EXPR_OP_OR:
+			*r = (int32_t)(ua | ub);
+			break;
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+
+static void treecli_expr_skip_ws(struct treecli_expr_compiler *c) {
+	while (c->pos < c->end && (*c->pos == ' ' || *c->pos == '\t')) {
+		c->pos++;
+	}
+}
+
+
+static bool treecli_expr_emit(struct treecli_expr_compiler *c, const uint8_t *code, uint32_t len) {
+	if (c->expr->code_len + len > TREECLI_EXPR_MAX_CODE) {
+		c->error = TREECLI_EXPR_COMPILE_TOO_LONG;
+		return false;
+	}
+	memcpy(&(c->expr->code[c->expr->code_len]), code, len);
+	c->expr->code_len += len;
+
+	return true;
+}
+
+
+/**
+ * Replace code of a constant subexpression starting at start with a single
+ * constant.
+ */
+static bool treecli_expr_emit_const(struct treecli_expr_compiler *c, struct treecli_expr_operand *o, uint32_t start, int32_t value) {
+	uint32_t v = (uint32_t)value;
+	uint8_t code[5] = {TREECLI_EXPR_OP_CONST, v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, (v >> 24) & 0xff};
+
+	c->expr->code_len = start;
+	o->start = start;
+	o->constant = true;
+	o->value = value;
+	o->stack = 1;
+
+	return treecli_expr_emit(c, code, sizeof(code));
+}
+
+
+static bool treecli_expr_pos_equal(const struct treecli_parser_pos *a, const struct treecli_parser_pos *b) {
+	if (a->depth != b->depth) {
+		return false;
+	}
+	for (uint32_t i = 0; i < a->depth; i++) {
+		if (a->levels[i].node != b->levels[i].node ||
+		    a->levels[i].dnode != b->levels[i].dnode ||
+		    a->levels[i].dnode_index != b->levels[i].dnode_index ||
+		    a->levels[i].compact != b->levels[i].compact ||
+		    a->levels[i].compact_index != b->levels[i].compact_index) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/**
+ * Resolve a value reference and emit its load. Every value is resolved
+ * only once even if it is referenced multiple times.
+ */
+static bool treecli_expr_ref(struct treecli_expr_compiler *c, struct treecli_expr_operand *o, const char *name, uint32_t len) {
+	char path[TREECLI_EXPR_NAME_LEN];
+	if (len >= sizeof(path)) {
+		c->error = TREECLI_EXPR_COMPILE_TOO_LONG;
+		return false;
+	}
+	memcpy(path, name, len);
+	path[len] = '\0';
+
+	TREECLI_PARSER_SCRATCH(c->parser, struct treecli_handle, handle, ref);
+	if (treecli_resolve_path(c->parser, path, handle) != TREECLI_RESOLVE_PATH_OK || handle->type != TREECLI_HANDLE_VALUE) {
+		c->error = TREECLI_EXPR_COMPILE_NOT_FOUND;
+		return false;
+	}
+	if (handle->value->value_type == TREECLI_VALUE_STR) {
+		c->error = TREECLI_EXPR_COMPILE_SYNTAX;
+		return false;
+	}
+
+	uint32_t i = 0;
+	while (i < c->expr->refs_count &&
+	       !(c->expr->refs[i].value == handle->value && treecli_expr_pos_equal(&(c->expr->refs[i].pos), &(handle->pos)))) {
+		i++;
+	}
+	if (i == c->expr->refs_count) {
+		if (c->expr->refs_count >= TREECLI_EXPR_MAX_REFS) {
+			c->error = TREECLI_EXPR_COMPILE_TOO_LONG;
+			return false;
+		}
+		memcpy(&(c->expr->refs[c->expr->refs_count++]), handle, sizeof(struct treecli_handle));
+	}
+
+	o->start = c->expr->code_len;
+	o->constant = false;
+	o->stack = 1;
+
+	uint8_t code[2] = {TREECLI_EXPR_OP_REF, (uint8_t)i};
+	return treecli_expr_emit(c, code, sizeof(code));
+}
+
+
+static bool treecli_expr_binary(struct treecli_expr_compiler *c, struct treecli_expr_operand *o, uint32_t level);
+
+static bool treecli_expr_primary(struct treecli_expr_compiler *c, struct treecli_expr_operand *o) {
+	treecli_expr_skip_ws(c);
+	if (c->pos == c->end) {
+		c->error = TREECLI_EXPR_COMPILE_SYNTAX;
+		return false;
+	}
+
+	if (*c->pos == '(') {
+		if (c->nesting >= TREECLI_EXPR_STACK_SIZE) {
+			c->error = TREECLI_EXPR_COMPILE_TOO_LONG;
+			return false;
+		}
+		c->pos++;
+		c->nesting++;
+		if (!treecli_expr_binary(c, o, 0)) {
+			return false;
+		}
+		c->nesting--;
+		treecli_expr_skip_ws(c);
+		if (c->pos == c->end || *c->pos != ')') {
+			c->error = TREECLI_EXPR_COMPILE_SYNTAX;
+			return false;
+		}
+		c->pos++;
+		return true;
+	}
+
+	if (*c->pos >= '0' && *c->pos <= '9') {
+		uint32_t v = 0;
+		while (c->pos < c->end && *c->pos >= '0' && *c->pos <= '9') {
+			uint32_t d = (uint32_t)(*c->pos - '0');
+			/* Constants must fit the signed type used for evaluation. */
+			if (v > (INT32_MAX - d) / 10) {
+				c->error = TREECLI_EXPR_COMPILE_RANGE;
+				return false;
+			}
+			v = v * 10 + d;
+			c->pos++;
+		}
+		return treecli_expr_emit_const(c, o, c->expr->code_len, (int32_t)v);
+	}
+
+	/* Value names and paths, the same characters as in command tokens. */
+	if ((*c->pos >= 'a' && *c->pos <= 'z') || (*c->pos >= 'A' && *c->pos <= 'Z') || *c->pos == '_' || *c->pos == '.' || *c->pos == '/') {
+		const char *name = c->pos;
+		while (c->pos < c->end &&
+		       ((*c->pos >= 'a' && *c->pos <= 'z') || (*c->pos >= 'A' && *c->pos <= 'Z') || (*c->pos >= '0' && *c->pos <= '9') ||
+		        *c->pos == '_' || *c->pos == '-' || *c->pos == ':' || *c->pos == '.' || *c->pos == '/')) {
+			c->pos++;
+		}
+		return treecli_expr_ref(c, o, name, (uint32_t)(c->pos - name));
+	}
+
+	c->error = TREECLI_EXPR_COMPILE_SYNTAX;
+	return false;
+}
+
+
+static bool treecli_expr_unary(struct treecli_expr_compiler *c, struct treecli_expr_operand *o) {
+	treecli_expr_skip_ws(c);
+
+	enum treecli_expr_op op;
+	if (c->pos < c->end && *c->pos == '-') {
+		op = TREECLI_EXPR_OP_NEG;
+	} else if (c->pos < c->end && *c->pos == '~') {
+		op = TREECLI_EXPR_OP_NOT;
+	} else if (c->pos < c->end && *c->pos == '+') {
+		c->pos++;
+		return treecli_expr_unary(c, o);
+	} else {
+		return treecli_expr_primary(c, o);
+	}
+	c->pos++;
+
+	if (!treecli_expr_unary(c, o)) {
+		return false;
+	}
+	if (o->constant) {
+		int32_t r;
+		treecli_expr_apply(op, o->value, 0, &r);
+		return treecli_expr_emit_const(c, o, o->start, r);
+	}
+
+	uint8_t code = op;
+	return treecli_expr_emit(c, &code, 1);
+}
+
+
+static bool treecli_expr_binary(struct treecli_expr_compiler *c, struct treecli_expr_operand *o, uint32_t level) {
+	if (level == TREECLI_EXPR_LEVELS) {
+		return treecli_expr_unary(c, o);
+	}
+
+	if (!treecli_expr_binary(c, o, level + 1)) {
+		return false;
+	}
+
+	while (true) {
+		treecli_expr_skip_ws(c);
+
+		/* Find an operator of this level. */
+		size_t i;
+		size_t count = sizeof(treecli_expr_binary_ops) / sizeof(treecli_expr_binary_ops[0]);
+		for (i = 0; i < count; i++) {
+			size_t len = strlen(treecli_expr_binary_ops[i].str);
+			if (treecli_expr_binary_ops[i].level == level && (size_t)(c->end - c->pos) >= len &&
+			    strncmp(c->pos, treecli_expr_binary_ops[i].str, len) == 0) {
+				c->pos += len;
+				break;
+			}
+		}
+		if (i == count) {
+			return true;
+		}
+		enum treecli_expr_op op = treecli_expr_binary_ops[i].op;
+
+		struct treecli_expr_operand rhs;
+		if (!treecli_expr_binary(c, &rhs, level + 1)) {
+			return false;
+		}
+
+		if (o->constant && rhs.constant) {
+			int32_t r;
+			if (treecli_expr_apply(op, o->value, rhs.value, &r) < 0) {
+				c->error = TREECLI_EXPR_COMPILE_SYNTAX;
+				return false;
+			}
+			if (!treecli_expr_emit_const(c, o, o->start, r)) {
+				return false;
+			}
+			continue;
+		}
+
+		uint8_t code = op;
+		if (!treecli_expr_emit(c, &code, 1)) {
+			return false;
+		}
+		o->constant = false;
+		if (rhs.stack + 1 > o->stack) {
+			o->stack = rhs.stack + 1;
+		}
+		if (o->stack > TREECLI_EXPR_STACK_SIZE) {
+			c->error = TREECLI_EXPR_COMPILE_TOO_LONG;
+			return false;
+		}
+	}
+}
+
+
+int32_t treecli_expr_compile(struct treecli_parser *parser, struct treecli_expr *expr, const char *s, uint32_t len) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(expr != NULL) ||
+	    u_assert(s != NULL)) {
+		return TREECLI_EXPR_COMPILE_FAILED;
+	}
+
+	memset(expr, 0, sizeof(struct treecli_expr));
+
+	struct treecli_expr_compiler c = {
+		.parser = parser,
+		.expr = expr,
+		.pos = s,
+		.end = s + len,
+		.error = TREECLI_EXPR_COMPILE_OK,
+		.nesting = 0,
+	};
+	struct treecli_expr_operand o;
+
+	if (!treecli_expr_binary(&c, &o, 0)) {
+		return c.error;
+	}
+
+	/* The whole source must be consumed. */
+	treecli_expr_skip_ws(&c);
+	if (c.pos != c.end) {
+		return TREECLI_EXPR_COMPILE_SYNTAX;
+	}
+
+	return TREECLI_EXPR_COMPILE_OK;
+}
+
+
+int32_t treecli_expr_eval(struct treecli_parser *parser, const struct treecli_expr *expr, int32_t *result) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(expr != NULL) ||
+	    u_assert(result != NULL)) {
+		return TREECLI_EXPR_EVAL_FAILED;
+	}
+
+	int32_t stack[TREECLI_EXPR_STACK_SIZE];
+	uint32_t sp = 0;
+	uint32_t pc = 0;
+
+	while (pc < expr->code_len) {
+		enum treecli_expr_op op = expr->code[pc++];
+
+		if (op == TREECLI_EXPR_OP_CONST) {
+			if (pc + 4 > expr->code_len || sp >= TREECLI_EXPR_STACK_SIZE) {
+				return TREECLI_EXPR_EVAL_FAILED;
+			}
+			stack[sp++] = (int32_t)((uint32_t)expr->code[pc] | ((uint32_t)expr->code[pc + 1] << 8) |
+			                        ((uint32_t)expr->code[pc + 2] << 16) | ((uint32_t)expr->code[pc + 3] << 24));
+			pc += 4;
+			continue;
+		}
+
+		if (op == TREECLI_EXPR_OP_REF) {
+			if (pc >= expr->code_len || expr->code[pc] >= expr->refs_count || sp >= TREECLI_EXPR_STACK_SIZE) {
+				return TREECLI_EXPR_EVAL_FAILED;
+			}
+			const struct treecli_handle *ref = &(expr->refs[expr->code[pc++]]);
+			union {
+				int32_t i;
+				bool b;
+			} v = {0};
+			size_t len = sizeof(v);
+			if (treecli_handle_get(parser, ref, &v, &len) != TREECLI_HANDLE_GET_OK) {
+				return TREECLI_EXPR_EVAL_FAILED;
+			}
+			stack[sp++] = (ref->value->value_type == TREECLI_VALUE_BOOL) ? (int32_t)v.b : v.i;
+			continue;
+		}
+
+		if (op == TREECLI_EXPR_OP_NEG || op == TREECLI_EXPR_OP_NOT) {
+			if (sp < 1) {
+				return TREECLI_EXPR_EVAL_FAILED;
+			}
+			treecli_expr_apply(op, stack[sp - 1], 0, &(stack[sp - 1]));
+			continue;
+		}
+
+		if (sp < 2 || treecli_expr_apply(op, stack[sp - 2], stack[sp - 1], &(stack[sp - 2])) < 0) {
+			return TREECLI_EXPR_EVAL_FAILED;
+		}
+		sp--;
+	}
+
+	if (sp != 1) {
+		return TREECLI_EXPR_EVAL_FAILED;
+	}
+	*result = stack[0];
+
+	return TREECLI_EXPR_EVAL_OK;
+}
+
+
+int32_t treecli_expr_assign(struct treecli_parser *parser, const struct treecli_expr *expr, const struct treecli_handle *target) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(expr != NULL) ||
+	    u_assert(target != NULL)) {
+		return TREECLI_EXPR_ASSIGN_FAILED;
+	}
+
+	if (target->type != TREECLI_HANDLE_VALUE) {
+		return TREECLI_EXPR_ASSIGN_FAILED;
+	}
+
+	int32_t v;
+	if (treecli_expr_eval(parser, expr, &v) != TREECLI_EXPR_EVAL_OK) {
+		return TREECLI_EXPR_ASSIGN_FAILED;
+	}
+
+	switch (target->value->value_type) {
+		case TREECLI_VALUE_INT32:
+			break;
+
+		case TREECLI_VALUE_UINT32:
+		case TREECLI_VALUE_DATA:
+			if (v < 0) {
+				return TREECLI_EXPR_ASSIGN_FAILED;
+			}
+			break;
+
+		default:
+			return TREECLI_EXPR_ASSIGN_FAILED;
+	}
+
+	if (treecli_handle_set(parser, target, &v, sizeof(v)) != TREECLI_HANDLE_SET_OK) {
+		return TREECLI_EXPR_ASSIGN_FAILED;
+	}
+
+	return TREECLI_EXPR_ASSIGN_OK;
+}
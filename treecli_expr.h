@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_EXPR_H_
+#define _TREECLI_EXPR_H_
+
+#include <stdint.h>
+
+#include "treecli_parser.h"
+
+/**
+ * Maximum size of compiled expression bytecode in bytes.
+ */
+#ifndef TREECLI_EXPR_MAX_CODE
+#define TREECLI_EXPR_MAX_CODE 48
+#endif
+
+/**
+ * Maximum number of distinct values referenced by an expression.
+ */
+#ifndef TREECLI_EXPR_MAX_REFS
+#define TREECLI_EXPR_MAX_REFS 4
+#endif
+
+/**
+ * Size of the evaluation stack, it also limits nesting of parentheses.
+ */
+#ifndef TREECLI_EXPR_STACK_SIZE
+#define TREECLI_EXPR_STACK_SIZE 8
+#endif
+
+
+enum treecli_expr_op {
+	TREECLI_EXPR_OP_CONST = 0,
+	TREECLI_EXPR_OP_REF,
+	TREECLI_EXPR_OP_NEG,
+	TREECLI_EXPR_OP_NOT,
+	TREECLI_EXPR_OP_MUL,
+	TREECLI_EXPR_OP_DIV,
+	TREECLI_EXPR_OP_MOD,
+	TREECLI_EXPR_OP_ADD,
+	TREECLI_EXPR_OP_SUB,
+	TREECLI_EXPR_OP_SHL,
+	TREECLI_EXPR_OP_SHR,
+	TREECLI_EXPR_OP_AND,
+	TREECLI_EXPR_OP_XOR,
+	TREECLI_EXPR_OP_OR,
+};
+
+/**
+ * Compiled integer expression. Bytecode is evaluated using a small stack,
+ * each instruction is a single byte optionally followed by its argument -
+ * 32 bit little endian constant (TREECLI_EXPR_OP_CONST) or index to the refs
+ * array (TREECLI_EXPR_OP_REF). Constant subexpressions are folded during the
+ * compilation. Referenced values are resolved to handles only once, refs can
+ * be also used to watch the inputs of the expression.
+ */
+struct treecli_expr {
+	uint8_t code[TREECLI_EXPR_MAX_CODE];
+	uint32_t code_len;
+
+	struct treecli_handle refs[TREECLI_EXPR_MAX_REFS];
+	uint32_t refs_count;
+};
+
+
+/**
+ * Compile an expression. Expressions consist of decimal constants, references
+ * to numeric values, parentheses and C operators (unary - and ~, binary * / %
+ * + - << >> & ^ |) with the usual precedence. References are paths resolved
+ * by treecli_resolve_path relative to the current working position, eg.
+ * "(base-mtu - 28)" or "(3 * ../interval)". Names can contain dashes and
+ * slashes, operators following a name must be therefore separated by a
+ * whitespace.
+ *
+ * @param parser A parser context used to resolve references.
+ * @param expr Expression to initialize.
+ * @param s Expression source.
+ * @param len Length of the source.
+ *
+ * @return TREECLI_EXPR_COMPILE_OK if the expression was compiled or
+ *         TREECLI_EXPR_COMPILE_SYNTAX if the expression is malformed or
+ *         TREECLI_EXPR_COMPILE_NOT_FOUND if a referenced value doesn't exist or
+ *         TREECLI_EXPR_COMPILE_TOO_LONG if the expression doesn't fit or
+ *         TREECLI_EXPR_COMPILE_RANGE if a constant is greater than INT32_MAX or
+ *         TREECLI_EXPR_COMPILE_FAILED otherwise.
+ */
+int32_t treecli_expr_compile(struct treecli_parser *parser, struct treecli_expr *expr, const char *s, uint32_t len);
+#define TREECLI_EXPR_COMPILE_OK 0
+#define TREECLI_EXPR_COMPILE_FAILED -1
+#define TREECLI_EXPR_COMPILE_SYNTAX -2
+#define TREECLI_EXPR_COMPILE_NOT_FOUND -3
+#define TREECLI_EXPR_COMPILE_TOO_LONG -4
+#define TREECLI_EXPR_COMPILE_RANGE -5
+
+/**
+ * Evaluate a compiled expression. Referenced values are read using their
+ * handles, no text is parsed. Arithmetic is done on 32 bit signed integers
+ * wrapping around on overflow.
+ *
+ * @param parser A parser context.
+ * @param expr Compiled expression.
+ * @param result Result of the expression.
+ *
+ * @return TREECLI_EXPR_EVAL_OK on success or
+ *         TREECLI_EXPR_EVAL_FAILED if a value cannot be read, on division by
+ *         zero or if the expression is invalid.
+ */
+int32_t treecli_expr_eval(struct treecli_parser *parser, const struct treecli_expr *expr, int32_t *result);
+#define TREECLI_EXPR_EVAL_OK 0
+#define TREECLI_EXPR_EVAL_FAILED -1
+
+/**
+ * Evaluate a compiled expression and write the result to a value. It can be
+ * used to recompute dependent values when some of the refs changes.
+ *
+ * @param parser A parser context.
+ * @param expr Compiled expression.
+ * @param target Handle of INT32, UINT32 or DATA value to set.
+ *
+ * @return TREECLI_EXPR_ASSIGN_OK if the value was set or
+ *         TREECLI_EXPR_ASSIGN_FAILED otherwise.
+ */
+int32_t treecli_expr_assign(struct treecli_parser *parser, const struct treecli_expr *expr, const struct treecli_handle *target);
+#define TREECLI_EXPR_ASSIGN_OK 0
+#define TREECLI_EXPR_ASSIGN_FAILED -1
+
+
+#endif
@@ -0,0 +1,291 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "treecli_parser.h"
+#include "treecli_help.h"
+
+
+int32_t treecli_help_compress(const struct treecli_help_dict *dict, const char *s, char *buf, size_t len) {
+	if (u_assert(dict != NULL) ||
+	    u_assert(dict->count <= TREECLI_HELP_MAX_WORDS) ||
+	    u_assert(s != NULL) ||
+	    u_assert(buf != NULL) ||
+	    u_assert(len > 0)) {
+		return TREECLI_HELP_COMPRESS_FAILED;
+	}
+
+	if (len < 2) {
+		return TREECLI_HELP_COMPRESS_TOO_LONG;
+	}
+	buf[0] = (char)TREECLI_HELP_COMPRESSED;
+
+	size_t pos = 1;
+	while (*s != '\0') {
+		/* Find the longest dictionary word at the current position. */
+		uint32_t best = 0;
+		size_t best_len = 1;
+		for (uint32_t i = 0; i < dict->count; i++) {
+			size_t l = strlen(dict->words[i]);
+			if (l > best_len && !strncmp(s, dict->words[i], l)) {
+				best = i;
+				best_len = l;
+			}
+		}
+
+		/* Reserve space for the escape byte and the terminating zero. */
+		size_t need = (best_len == 1 && (unsigned char)*s >= TREECLI_HELP_WORD) ? 2 : 1;
+		if (pos + need + 1 > len) {
+			return TREECLI_HELP_COMPRESS_TOO_LONG;
+		}
+		if (best_len > 1) {
+			buf[pos++] = (char)(TREECLI_HELP_WORD + best);
+			s += best_len;
+		} else {
+			if ((unsigned char)*s >= TREECLI_HELP_WORD) {
+				buf[pos++] = (char)TREECLI_HELP_ESCAPE;
+			}
+			buf[pos++] = *s++;
+		}
+	}
+	buf[pos] = '\0';
+
+	return TREECLI_HELP_COMPRESS_OK;
+}
+
+
+int32_t treecli_help_print(const struct treecli_help_dict *dict, const char *s, int32_t (*print_handler)(const char *line, void *ctx), void *ctx) {
+	if (u_assert(s != NULL) ||
+	    u_assert(print_handler != NULL)) {
+		return TREECLI_HELP_PRINT_FAILED;
+	}
+
+	/* Plain strings are printed at once. */
+	if (dict == NULL || (unsigned char)s[0] != TREECLI_HELP_COMPRESSED) {
+		print_handler(s, ctx);
+		return TREECLI_HELP_PRINT_OK;
+	}
+	s++;
+
+	char chunk[TREECLI_HELP_CHUNK_LEN + 1];
+	size_t chunk_len = 0;
+	while (*s != '\0') {
+		unsigned char c = (unsigned char)*s++;
+		const char *word = NULL;
+
+		if (c == TREECLI_HELP_ESCAPE) {
+			if (*s == '\0') {
+				break;
+			}
+			c = (unsigned char)*s++;
+		} else if (c >= TREECLI_HELP_WORD && (uint32_t)(c - TREECLI_HELP_WORD) < dict->count) {
+			word = dict->words[c - TREECLI_HELP_WORD];
+		}
+
+		if (word == NULL) {
+			chunk[chunk_len++] = (char)c;
+		}
+		if (chunk_len > 0 && (word != NULL || chunk_len == TREECLI_HELP_CHUNK_LEN)) {
+			chunk[chunk_len] = '\0';
+			print_handler(chunk, ctx);
+			chunk_len = 0;
+		}
+		if (word != NULL) {
+			print_handler(word, ctx);
+		}
+	}
+	if (chunk_len > 0) {
+		chunk[chunk_len] = '\0';
+		print_handler(chunk, ctx);
+	}
+
+	return TREECLI_HELP_PRINT_OK;
+}
+
+
+/**
+ * State of the dictionary builder.
+ */
+struct treecli_help_dict_state {
+	struct treecli_help_word *words;
+	uint32_t size;
+	uint32_t count;
+	int32_t error;
+};
+
+
+/**
+ * Count words of a help string. Words which cannot be written to a C string
+ * literal as they are or which are too short to save anything are skipped.
+ */
+static void treecli_help_dict_count(struct treecli_help_dict_state *st, const char *s) {
+	if (s == NULL) {
+		return;
+	}
+
+	while (*s != '\0') {
+		while (*s == ' ') {
+			s++;
+		}
+		const char *w = s;
+		bool usable = true;
+		while (*s != '\0' && *s != ' ') {
+			unsigned char c = (unsigned char)*s;
+			if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\') {
+				usable = false;
+			}
+			s++;
+		}
+		size_t len = (size_t)(s - w);
+		if (usable == false || len < 2 || len >= TREECLI_HELP_WORD_LEN) {
+			continue;
+		}
+
+		uint32_t i;
+		for (i = 0; i < st->count; i++) {
+			if (strlen(st->words[i].word) == len && !strncmp(st->words[i].word, w, len)) {
+				break;
+			}
+		}
+		if (i == st->count) {
+			if (st->count == st->size) {
+				st->error = TREECLI_HELP_DICT_EXPORT_TOO_MANY;
+				continue;
+			}
+			memcpy(st->words[i].word, w, len);
+			st->words[i].word[len] = '\0';
+			st->words[i].count = 0;
+			st->count++;
+		}
+		st->words[i].count++;
+	}
+}
+
+
+/**
+ * Count words of all help strings in a subtree.
+ */
+static void treecli_help_dict_walk(struct treecli_help_dict_state *st, const struct treecli_node *node, uint32_t depth) {
+	treecli_help_dict_count(st, node->help);
+
+	if (node->commands != NULL) {
+		const struct treecli_command *c;
+		for (size_t i = 0; (c = (*(node->commands))[i]) != NULL; i++) {
+			treecli_help_dict_count(st, c->help);
+		}
+	}
+	if (node->values != NULL) {
+		const struct treecli_value *v;
+		for (size_t i = 0; (v = (*(node->values))[i]) != NULL; i++) {
+			treecli_help_dict_count(st, v->help);
+		}
+	}
+
+	/* Subnodes of compact trees are not static nodes. */
+	if (depth == TREECLI_TREE_MAX_DEPTH || node->subnodes == NULL || node->subnodes == &treecli_compact_subnodes) {
+		return;
+	}
+	const struct treecli_node *n;
+	for (size_t i = 0; (n = (*(node->subnodes))[i]) != NULL; i++) {
+		treecli_help_dict_walk(st, n, depth + 1);
+	}
+}
+
+
+/**
+ * Bytes saved by a dictionary word. Every occurrence is replaced by a single
+ * byte, the word itself and its pointer (4 bytes on a 32-bit target) are
+ * stored once.
+ */
+static int32_t treecli_help_dict_saving(const struct treecli_help_word *w) {
+	int32_t len = (int32_t)strlen(w->word);
+	return (int32_t)w->count * (len - 1) - (len + 1) - 4;
+}
+
+
+int32_t treecli_help_dict_export(const struct treecli_node *top, const char *name, uint32_t max_words, struct treecli_help_word *words, uint32_t size, int32_t (*print_handler)(const char *s, void *ctx), void *ctx) {
+	if (u_assert(top != NULL) ||
+	    u_assert(name != NULL) ||
+	    u_assert(max_words <= TREECLI_HELP_MAX_WORDS) ||
+	    u_assert(words != NULL) ||
+	    u_assert(print_handler != NULL)) {
+		return TREECLI_HELP_DICT_EXPORT_FAILED;
+	}
+
+	struct treecli_help_dict_state st = {
+		.words = words,
+		.size = size,
+		.count = 0,
+		.error = TREECLI_HELP_DICT_EXPORT_OK,
+	};
+	treecli_help_dict_walk(&st, top, 0);
+	if (st.error != TREECLI_HELP_DICT_EXPORT_OK) {
+		return st.error;
+	}
+
+	char buf[TREECLI_HELP_WORD_LEN + 128];
+	int32_t res = 0;
+	res |= print_handler("/* Generated by treecli_help_dict_export, do not edit. */\n\n", ctx);
+	snprintf(buf, sizeof(buf), "static const char *const %s_words[] = {\n", name);
+	res |= print_handler(buf, ctx);
+
+	/* The best remaining word is selected repeatedly, selected words
+	 * are removed by clearing their count. */
+	uint32_t selected = 0;
+	while (selected < max_words) {
+		uint32_t best = 0;
+		int32_t best_saving = 0;
+		for (uint32_t i = 0; i < st.count; i++) {
+			int32_t saving = treecli_help_dict_saving(&(words[i]));
+			if (saving > best_saving) {
+				best = i;
+				best_saving = saving;
+			}
+		}
+		if (best_saving == 0) {
+			break;
+		}
+		snprintf(buf, sizeof(buf), "\t\"%s\",\n", words[best].word);
+		res |= print_handler(buf, ctx);
+		words[best].count = 0;
+		selected++;
+	}
+	if (selected == 0) {
+		res |= print_handler("\tNULL,\n", ctx);
+	}
+
+	snprintf(buf, sizeof(buf), "};\n\nconst struct treecli_help_dict %s = {\n\t.words = %s_words,\n\t.count = %lu,\n};\n", name, name, (unsigned long)selected);
+	res |= print_handler(buf, ctx);
+
+	if (res < 0) {
+		return TREECLI_HELP_DICT_EXPORT_FAILED;
+	}
+
+	return TREECLI_HELP_DICT_EXPORT_OK;
+}
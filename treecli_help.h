@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_HELP_H_
+#define _TREECLI_HELP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Size of the chunk used to pass literal parts of a compressed string to the
+ * print handler.
+ */
+#ifndef TREECLI_HELP_CHUNK_LEN
+#define TREECLI_HELP_CHUNK_LEN 16
+#endif
+
+/**
+ * Maximum length of a word collected by the dictionary builder.
+ */
+#ifndef TREECLI_HELP_WORD_LEN
+#define TREECLI_HELP_WORD_LEN 24
+#endif
+
+/**
+ * Compressed help strings start with the TREECLI_HELP_COMPRESSED byte,
+ * strings without it are always printed as they are (they can contain any
+ * UTF-8 text). The rest of a compressed string is ASCII text with some words
+ * replaced by single bytes. Byte TREECLI_HELP_WORD + i stands for the i-th
+ * word of the dictionary, TREECLI_HELP_ESCAPE is followed by a literal byte
+ * (used for bytes with the highest bit set).
+ */
+#define TREECLI_HELP_COMPRESSED 0x01
+#define TREECLI_HELP_WORD 0x80
+#define TREECLI_HELP_ESCAPE 0xff
+#define TREECLI_HELP_MAX_WORDS (TREECLI_HELP_ESCAPE - TREECLI_HELP_WORD)
+
+struct treecli_node;
+
+/**
+ * Static dictionary shared by all compressed help strings of a tree. The same
+ * dictionary must be used to compress the strings at build time and to
+ * decode them at runtime.
+ */
+struct treecli_help_dict {
+	const char *const *words;
+	uint32_t count;
+};
+
+
+/**
+ * Word counted by the dictionary builder.
+ */
+struct treecli_help_word {
+	char word[TREECLI_HELP_WORD_LEN];
+	uint32_t count;
+};
+
+
+/**
+ * Compress a help string. Longest dictionary words are substituted greedily,
+ * words shorter than two characters are never used. The compressed string
+ * starts with the TREECLI_HELP_COMPRESSED byte.
+ *
+ * @param dict Dictionary with at most TREECLI_HELP_MAX_WORDS words.
+ * @param s Help string to compress.
+ * @param buf Buffer for the compressed string (zero terminated).
+ * @param len Size of the buffer.
+ *
+ * @return TREECLI_HELP_COMPRESS_OK if the string was compressed or
+ *         TREECLI_HELP_COMPRESS_TOO_LONG if it doesn't fit the buffer or
+ *         TREECLI_HELP_COMPRESS_FAILED otherwise.
+ */
+int32_t treecli_help_compress(const struct treecli_help_dict *dict, const char *s, char *buf, size_t len);
+#define TREECLI_HELP_COMPRESS_OK 0
+#define TREECLI_HELP_COMPRESS_FAILED -1
+#define TREECLI_HELP_COMPRESS_TOO_LONG -2
+
+/**
+ * Decode a compressed help string directly to a print handler. Dictionary
+ * words are printed as they are, literal parts are passed in chunks of
+ * TREECLI_HELP_CHUNK_LEN bytes, no buffer for the whole string is needed.
+ * Strings without the TREECLI_HELP_COMPRESSED byte are printed unchanged.
+ *
+ * @param dict Dictionary used to compress the string or NULL if no strings
+ *             are compressed.
+ * @param s Compressed or plain string.
+ * @param print_handler Handler receiving the decoded string.
+ * @param ctx Context of the print handler.
+ *
+ * @return TREECLI_HELP_PRINT_OK if the string was printed or
+ *         TREECLI_HELP_PRINT_FAILED otherwise.
+ */
+int32_t treecli_help_print(const struct treecli_help_dict *dict, const char *s, int32_t (*print_handler)(const char *line, void *ctx), void *ctx);
+#define TREECLI_HELP_PRINT_OK 0
+#define TREECLI_HELP_PRINT_FAILED -1
+
+/**
+ * Build a dictionary from help strings of a tree and generate its C source.
+ * It is meant to be run at build time on a host with the original tree
+ * linked in, the output is then used by treecli_help_compress,
+ * treecli_compact_export and treecli_parser_set_help_dict. Help of static
+ * nodes, commands and values is scanned (nested compact trees and dynamic
+ * nodes are skipped). Words are runs of printable characters separated by
+ * spaces, the ones saving the most bytes are selected.
+ *
+ * @param top Top node of the tree.
+ * @param name Name of the generated struct treecli_help_dict (C identifier).
+ * @param max_words Maximum number of words in the dictionary (up to
+ *                  TREECLI_HELP_MAX_WORDS).
+ * @param words Storage for distinct words found in the tree.
+ * @param size Number of entries in the words array.
+ * @param print_handler Handler receiving the generated source.
+ * @param ctx Context of the print handler.
+ *
+ * @return TREECLI_HELP_DICT_EXPORT_OK if the dictionary was generated or
+ *         TREECLI_HELP_DICT_EXPORT_TOO_MANY if the tree has more distinct
+ *         words than the words array can hold or
+ *         TREECLI_HELP_DICT_EXPORT_FAILED otherwise.
+ */
+int32_t treecli_help_dict_export(const struct treecli_node *top, const char *name, uint32_t max_words, struct treecli_help_word *words, uint32_t size, int32_t (*print_handler)(const char *s, void *ctx), void *ctx);
+#define TREECLI_HELP_DICT_EXPORT_OK 0
+#define TREECLI_HELP_DICT_EXPORT_FAILED -1
+#define TREECLI_HELP_DICT_EXPORT_TOO_MANY -2
+
+
+#endif
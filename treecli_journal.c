@@ -0,0 +1,786 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "treecli_parser.h"
+#include "treecli_bulk.h"
+#include "treecli_journal.h"
+
+
+/**
+ * CRC-32 (IEEE 802.3) computed bitwise, records are short.
+ */
+static uint32_t treecli_journal_crc(const uint8_t *buf, size_t len) {
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (uint32_t b = 0; b < 8; b++) {
+			crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+
+static void treecli_journal_put32(uint8_t *buf, uint32_t v) {
+	buf[0] = v & 0xff;
+	buf[1] = (v >> 8) & 0xff;
+	buf[2] = (v >> 16) & 0xff;
+	buf[3] = (v >> 24) & 0xff;
+}
+
+
+static uint32_t treecli_journal_get32(const uint8_t *buf) {
+	return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+
+int32_t treecli_journal_init(struct treecli_journal *journal, int32_t (*write)(const void *buf, size_t len, void *ctx), int32_t (*sync)(void *ctx), void *ctx) {
+	if (u_assert(journal != NULL) ||
+	    u_assert(write != NULL)) {
+		return TREECLI_JOURNAL_INIT_FAILED;
+	}
+
+	memset(journal, 0, sizeof(struct treecli_journal));
+	if (pthread_mutex_init(&(journal->lock), NULL) != 0) {
+		return TREECLI_JOURNAL_INIT_FAILED;
+	}
+	if (pthread_cond_init(&(journal->group_done), NULL) != 0) {
+		pthread_mutex_destroy(&(journal->lock));
+		return TREECLI_JOURNAL_INIT_FAILED;
+	}
+	journal->write = write;
+	journal->sync = sync;
+	journal->ctx = ctx;
+	journal->sync_policy = TREECLI_JOURNAL_SYNC_GROUP;
+	journal->seq = 1;
+
+	return TREECLI_JOURNAL_INIT_OK;
+}
+
+
+int32_t treecli_journal_free(struct treecli_journal *journal) {
+	if (u_assert(journal != NULL)) {
+		return TREECLI_JOURNAL_FREE_FAILED;
+	}
+
+	pthread_cond_destroy(&(journal->group_done));
+	pthread_mutex_destroy(&(journal->lock));
+
+	return TREECLI_JOURNAL_FREE_OK;
+}
+
+
+int32_t treecli_journal_set_sync(struct treecli_journal *journal, enum treecli_journal_sync policy, uint32_t interval) {
+	if (u_assert(journal != NULL) ||
+	    u_assert(policy != TREECLI_JOURNAL_SYNC_INTERVAL || interval > 0)) {
+		return TREECLI_JOURNAL_SET_SYNC_FAILED;
+	}
+
+	pthread_mutex_lock(&(journal->lock));
+	journal->sync_policy = policy;
+	journal->sync_interval = interval;
+	pthread_mutex_unlock(&(journal->lock));
+
+	return TREECLI_JOURNAL_SET_SYNC_OK;
+}
+
+
+/**
+ * Call the sync handler, the journal must be locked.
+ */
+static int32_t treecli_journal_do_sync(struct treecli_journal *journal) {
+	journal->unsynced = 0;
+	if (journal->sync != NULL && journal->sync(journal->ctx) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+
+int32_t treecli_journal_sync(struct treecli_journal *journal) {
+	if (u_assert(journal != NULL)) {
+		return TREECLI_JOURNAL_SYNC_FAILED;
+	}
+
+	pthread_mutex_lock(&(journal->lock));
+	int32_t res = treecli_journal_do_sync(journal);
+	pthread_mutex_unlock(&(journal->lock));
+
+	if (res < 0) {
+		return TREECLI_JOURNAL_SYNC_FAILED;
+	}
+
+	return TREECLI_JOURNAL_SYNC_OK;
+}
+
+
+int32_t treecli_journal_encode(const struct treecli_journal_record *record, uint8_t *buf) {
+	if (u_assert(record != NULL) ||
+	    u_assert(buf != NULL)) {
+		return TREECLI_JOURNAL_ENCODE_FAILED;
+	}
+
+	if (record->len > TREECLI_JOURNAL_VALUE_LEN) {
+		return TREECLI_JOURNAL_ENCODE_FAILED;
+	}
+
+	treecli_journal_put32(&(buf[0]), record->seq);
+	treecli_journal_put32(&(buf[4]), record->hash);
+	buf[8] = (uint8_t)record->type | (record->group_end ? TREECLI_JOURNAL_GROUP_END : 0);
+	buf[9] = record->len & 0xff;
+	buf[10] = (record->len >> 8) & 0xff;
+	if (record->len > 0) {
+		memcpy(&(buf[TREECLI_JOURNAL_HEADER_LEN]), record->data, record->len);
+	}
+
+	size_t len = TREECLI_JOURNAL_HEADER_LEN + record->len;
+	treecli_journal_put32(&(buf[len]), treecli_journal_crc(buf, len));
+
+	return (int32_t)(len + TREECLI_JOURNAL_CRC_LEN);
+}
+
+
+int32_t treecli_journal_decode(const uint8_t *buf, size_t len, struct treecli_journal_record *record) {
+	if (u_assert(buf != NULL || len == 0) ||
+	    u_assert(record != NULL)) {
+		return TREECLI_JOURNAL_DECODE_FAILED;
+	}
+
+	if (len < TREECLI_JOURNAL_HEADER_LEN + TREECLI_JOURNAL_CRC_LEN) {
+		return TREECLI_JOURNAL_DECODE_TRUNCATED;
+	}
+
+	/* A damaged length is caught by the CRC check unless it points past
+	 * the end of the buffer. */
+	uint16_t value_len = (uint16_t)(buf[9] | (buf[10] << 8));
+	size_t record_len = TREECLI_JOURNAL_HEADER_LEN + value_len;
+	if (value_len > TREECLI_JOURNAL_VALUE_LEN || record_len + TREECLI_JOURNAL_CRC_LEN > len) {
+		return TREECLI_JOURNAL_DECODE_TRUNCATED;
+	}
+	if (treecli_journal_get32(&(buf[record_len])) != treecli_journal_crc(buf, record_len)) {
+		return TREECLI_JOURNAL_DECODE_TRUNCATED;
+	}
+
+	record->seq = treecli_journal_get32(&(buf[0]));
+	record->hash = treecli_journal_get32(&(buf[4]));
+	record->type = (enum treecli_value_type)(buf[8] & ~TREECLI_JOURNAL_GROUP_END);
+	record->group_end = (buf[8] & TREECLI_JOURNAL_GROUP_END) != 0;
+	record->len = value_len;
+	record->data = &(buf[TREECLI_JOURNAL_HEADER_LEN]);
+
+	return (int32_t)(record_len + TREECLI_JOURNAL_CRC_LEN);
+}
+
+
+/**
+ * Write the group buffer. The journal must be locked.
+ */
+static int32_t treecli_journal_write(struct treecli_journal *journal) {
+	int32_t res = journal->write(journal->group, journal->group_len, journal->ctx);
+	journal->group_len = 0;
+	if (res < 0) {
+		journal->failed = true;
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Mark the last record as the end of the group, write the rest of the group
+ * and sync it according to the policy. The journal must be locked.
+ */
+static int32_t treecli_journal_commit(struct treecli_journal *journal) {
+	if (journal->failed) {
+		journal->group_len = 0;
+		return -1;
+	}
+	if (journal->group_len == 0) {
+		return 0;
+	}
+
+	/* The flag is covered by the CRC of the record. The last record is
+	 * always in the buffer, it is written out only when another record
+	 * is appended. */
+	uint8_t *last = &(journal->group[journal->group_last]);
+	size_t last_len = journal->group_len - journal->group_last - TREECLI_JOURNAL_CRC_LEN;
+	last[8] |= TREECLI_JOURNAL_GROUP_END;
+	treecli_journal_put32(&(last[last_len]), treecli_journal_crc(last, last_len));
+
+	if (treecli_journal_write(journal) < 0) {
+		return -1;
+	}
+
+	journal->unsynced++;
+	if (journal->sync_policy == TREECLI_JOURNAL_SYNC_GROUP ||
+	    (journal->sync_policy == TREECLI_JOURNAL_SYNC_INTERVAL && journal->unsynced >= journal->sync_interval)) {
+		if (treecli_journal_do_sync(journal) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Add a record to the current group. If the buffer is full, records are
+ * written without ending the group. The journal must be locked.
+ */
+static int32_t treecli_journal_append(struct treecli_journal *journal, struct treecli_journal_record *record) {
+	if (journal->failed) {
+		return -1;
+	}
+	if (journal->group_len + TREECLI_JOURNAL_RECORD_LEN > TREECLI_JOURNAL_GROUP_LEN) {
+		if (treecli_journal_write(journal) < 0) {
+			return -1;
+		}
+	}
+
+	record->seq = journal->seq;
+	record->group_end = false;
+	int32_t len = treecli_journal_encode(record, &(journal->group[journal->group_len]));
+	if (len < 0) {
+		return -1;
+	}
+	journal->group_last = journal->group_len;
+	journal->group_len += (size_t)len;
+	journal->seq++;
+
+	return 0;
+}
+
+
+/**
+ * Read the changed value and append it to the group of the parser. NULL
+ * value ends the group.
+ */
+static int32_t treecli_journal_changed(struct treecli_parser *parser, const struct treecli_value *value, void *ctx) {
+	struct treecli_journal *journal = (struct treecli_journal *)ctx;
+
+	/* The value is read before locking the journal. Getters may be slow
+	 * or change other values, other parsers must not wait for them. */
+	uint32_t data[(TREECLI_JOURNAL_VALUE_LEN + 3) / 4];
+	size_t len = TREECLI_JOURNAL_VALUE_LEN;
+	struct treecli_journal_record record;
+	memset(&record, 0, sizeof(record));
+	bool read_ok = true;
+	if (value != NULL) {
+		/* Getters may access the buffer as a numeric value. */
+		struct treecli_handle handle;
+		handle.type = TREECLI_HANDLE_VALUE;
+		treecli_parser_pos_copy(&(handle.pos), &(parser->pos));
+		handle.command = NULL;
+		handle.value = value;
+
+		read_ok = treecli_journal_hash(parser, &handle, &(record.hash)) == TREECLI_JOURNAL_HASH_OK &&
+		          treecli_handle_get(parser, &handle, data, &len) == TREECLI_HANDLE_GET_OK;
+	}
+
+	pthread_mutex_lock(&(journal->lock));
+	if (journal->replaying) {
+		pthread_mutex_unlock(&(journal->lock));
+		return 0;
+	}
+
+	/* Groups of different parsers are never interleaved. */
+	while (journal->owner != NULL && journal->owner != parser) {
+		pthread_cond_wait(&(journal->group_done), &(journal->lock));
+	}
+
+	int32_t res = 0;
+	if (value == NULL) {
+		if (journal->owner == parser) {
+			res = treecli_journal_commit(journal);
+			journal->owner = NULL;
+			pthread_cond_broadcast(&(journal->group_done));
+		}
+		pthread_mutex_unlock(&(journal->lock));
+		return res;
+	}
+	journal->owner = parser;
+
+	if (read_ok == false) {
+		res = -1;
+	} else {
+		record.type = value->value_type;
+		record.len = (uint16_t)len;
+		record.data = (const uint8_t *)data;
+		res = treecli_journal_append(journal, &record);
+	}
+	pthread_mutex_unlock(&(journal->lock));
+
+	return res;
+}
+
+
+int32_t treecli_journal_attach(struct treecli_journal *journal, struct treecli_parser *parser) {
+	if (u_assert(journal != NULL) ||
+	    u_assert(parser != NULL)) {
+		return TREECLI_JOURNAL_ATTACH_FAILED;
+	}
+
+	if (treecli_parser_set_change_handler(parser, treecli_journal_changed, journal) != TREECLI_PARSER_SET_CHANGE_HANDLER_OK) {
+		return TREECLI_JOURNAL_ATTACH_FAILED;
+	}
+
+	return TREECLI_JOURNAL_ATTACH_OK;
+}
+
+
+int32_t treecli_journal_detach(struct treecli_journal *journal, struct treecli_parser *parser) {
+	if (u_assert(journal != NULL) ||
+	    u_assert(parser != NULL)) {
+		return TREECLI_JOURNAL_DETACH_FAILED;
+	}
+
+	if (parser->change_handler != treecli_journal_changed || parser->change_handler_ctx != journal) {
+		return TREECLI_JOURNAL_DETACH_FAILED;
+	}
+	treecli_parser_set_change_handler(parser, NULL, NULL);
+
+	return TREECLI_JOURNAL_DETACH_OK;
+}
+
+
+/**
+ * FNV-1a hash of a string continuing from the previous hash.
+ */
+static uint32_t treecli_journal_fnv(uint32_t hash, const char *s) {
+	while (*s != '\0') {
+		hash ^= (uint8_t)*s++;
+		hash *= 16777619;
+	}
+	return hash;
+}
+
+
+int32_t treecli_journal_hash(struct treecli_parser *parser, const struct treecli_handle *handle, uint32_t *hash) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(handle != NULL) ||
+	    u_assert(hash != NULL)) {
+		return TREECLI_JOURNAL_HASH_FAILED;
+	}
+
+	if (handle->type != TREECLI_HANDLE_VALUE) {
+		return TREECLI_JOURNAL_HASH_FAILED;
+	}
+
+	uint32_t h = 2166136261;
+	for (uint32_t i = 0; i < handle->pos.depth; i++) {
+		char buf[TREECLI_DNODE_MAX_NAME_LEN];
+		const char *name;
+		if (treecli_parser_pos_name(parser, &(handle->pos), i, buf, &name) != TREECLI_PARSER_POS_NAME_OK) {
+			return TREECLI_JOURNAL_HASH_FAILED;
+		}
+		h = treecli_journal_fnv(h, "/");
+		h = treecli_journal_fnv(h, name);
+	}
+	h = treecli_journal_fnv(h, "/");
+	h = treecli_journal_fnv(h, handle->value->name);
+
+	*hash = h;
+
+	return TREECLI_JOURNAL_HASH_OK;
+}
+
+
+static int treecli_journal_index_cmp(const void *a, const void *b) {
+	uint32_t ha = ((const struct treecli_journal_index *)a)->hash;
+	uint32_t hb = ((const struct treecli_journal_index *)b)->hash;
+	return (ha > hb) - (ha < hb);
+}
+
+
+int32_t treecli_journal_index(struct treecli_parser *parser, struct treecli_bulk_item *items, struct treecli_journal_index *index, uint32_t max, uint32_t *count) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(items != NULL) ||
+	    u_assert(index != NULL) ||
+	    u_assert(count != NULL)) {
+		return TREECLI_JOURNAL_INDEX_FAILED;
+	}
+
+	int32_t res = treecli_bulk_collect(parser, NULL, items, max, count);
+	if (res == TREECLI_BULK_COLLECT_TOO_MANY) {
+		return TREECLI_JOURNAL_INDEX_TOO_MANY;
+	}
+	if (res != TREECLI_BULK_COLLECT_OK) {
+		return TREECLI_JOURNAL_INDEX_FAILED;
+	}
+
+	for (uint32_t i = 0; i < *count; i++) {
+		if (treecli_journal_hash(parser, &(items[i].handle), &(index[i].hash)) != TREECLI_JOURNAL_HASH_OK) {
+			return TREECLI_JOURNAL_INDEX_FAILED;
+		}
+		index[i].item = i;
+	}
+	qsort(index, *count, sizeof(struct treecli_journal_index), treecli_journal_index_cmp);
+
+	for (uint32_t i = 1; i < *count; i++) {
+		if (index[i].hash == index[i - 1].hash) {
+			return TREECLI_JOURNAL_INDEX_COLLISION;
+		}
+	}
+
+	return TREECLI_JOURNAL_INDEX_OK;
+}
+
+
+/**
+ * Find the item of a value with the given path hash or return -1.
+ */
+static int32_t treecli_journal_lookup(const struct treecli_journal_index *index, uint32_t count, uint32_t hash) {
+	uint32_t lo = 0;
+	uint32_t hi = count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (index[mid].hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo < count && index[lo].hash == hash) {
+		return (int32_t)index[lo].item;
+	}
+	return -1;
+}
+
+
+int32_t treecli_journal_replay(struct treecli_journal *journal, struct treecli_parser *parser, const struct treecli_bulk_item *items, const struct treecli_journal_index *index, uint32_t count, const uint8_t *buf, size_t len, size_t *end, uint32_t *rejected) {
+	if (u_assert(journal != NULL) ||
+	    u_assert(parser != NULL) ||
+	    u_assert(items != NULL || count == 0) ||
+	    u_assert(index != NULL || count == 0) ||
+	    u_assert(buf != NULL || len == 0)) {
+		return TREECLI_JOURNAL_REPLAY_FAILED;
+	}
+
+	pthread_mutex_lock(&(journal->lock));
+	journal->replaying = true;
+	uint32_t first = journal->seq;
+	uint32_t next = journal->seq;
+	pthread_mutex_unlock(&(journal->lock));
+
+	int32_t ret = TREECLI_JOURNAL_REPLAY_OK;
+	bool was_rejected = false;
+	size_t off = 0;
+	while (off < len) {
+		/* Find the end of the group, incomplete groups are not applied. */
+		size_t group_end = off;
+		bool complete = false;
+		while (group_end < len && !complete) {
+			struct treecli_journal_record record;
+			int32_t n = treecli_journal_decode(&(buf[group_end]), len - group_end, &record);
+			if (n < 0) {
+				break;
+			}
+			group_end += (size_t)n;
+			complete = record.group_end;
+		}
+		if (!complete) {
+			ret = TREECLI_JOURNAL_REPLAY_TRUNCATED;
+			break;
+		}
+
+		while (off < group_end) {
+			struct treecli_journal_record record;
+			off += (size_t)treecli_journal_decode(&(buf[off]), group_end - off, &record);
+			if (record.seq < first) {
+				continue;
+			}
+			if (record.seq >= next) {
+				next = record.seq + 1;
+			}
+
+			/* Values removed from the tree or changed in type are
+			 * skipped. */
+			int32_t item = treecli_journal_lookup(index, count, record.hash);
+			if (item < 0 || items[item].handle.value->value_type != record.type) {
+				continue;
+			}
+
+			/* Record data is not aligned. */
+			uint32_t data[(TREECLI_JOURNAL_VALUE_LEN + 3) / 4];
+			memcpy(data, record.data, record.len);
+			if (treecli_handle_set(parser, &(items[item].handle), data, record.len) != TREECLI_HANDLE_SET_OK) {
+				/* The rest of the journal is still applied, only the
+				 * first rejected record is reported. */
+				if (!was_rejected && rejected != NULL) {
+					*rejected = record.seq;
+				}
+				was_rejected = true;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&(journal->lock));
+	journal->replaying = false;
+	journal->seq = next;
+	pthread_mutex_unlock(&(journal->lock));
+
+	if (end != NULL) {
+		*end = off;
+	}
+
+	if (ret == TREECLI_JOURNAL_REPLAY_OK && was_rejected) {
+		ret = TREECLI_JOURNAL_REPLAY_REJECTED;
+	}
+
+	return ret;
+}
+
+
+int32_t treecli_journal_rotate(struct treecli_journal *journal, int32_t (*rotate)(void *ctx)) {
+	if (u_assert(journal != NULL) ||
+	    u_assert(rotate != NULL)) {
+		return TREECLI_JOURNAL_ROTATE_FAILED;
+	}
+
+	/* The sealed segment must be complete before it is compacted, the
+	 * open group is committed first. */
+	pthread_mutex_lock(&(journal->lock));
+	while (journal->owner != NULL) {
+		pthread_cond_wait(&(journal->group_done), &(journal->lock));
+	}
+	int32_t res = 0;
+	if (!journal->failed) {
+		res = treecli_journal_do_sync(journal);
+	}
+	if (res == 0) {
+		res = rotate(journal->ctx);
+	}
+	if (res == 0) {
+		journal->failed = false;
+	}
+	pthread_mutex_unlock(&(journal->lock));
+
+	if (res < 0) {
+		return TREECLI_JOURNAL_ROTATE_FAILED;
+	}
+
+	return TREECLI_JOURNAL_ROTATE_OK;
+}
+
+
+int32_t treecli_journal_compaction_init(struct treecli_journal_compaction *c, const uint8_t *const *inputs, const size_t *lens, uint32_t input_count, struct treecli_journal_slot *slots, uint32_t slot_count, int32_t (*write)(const void *buf, size_t len, void *ctx), int32_t (*commit)(void *ctx), void *ctx) {
+	if (u_assert(c != NULL) ||
+	    u_assert(inputs != NULL || input_count == 0) ||
+	    u_assert(lens != NULL || input_count == 0) ||
+	    u_assert(slots != NULL) ||
+	    u_assert(slot_count > 0 && (slot_count & (slot_count - 1)) == 0) ||
+	    u_assert(write != NULL) ||
+	    u_assert(commit != NULL)) {
+		return TREECLI_JOURNAL_COMPACTION_INIT_FAILED;
+	}
+
+	memset(c, 0, sizeof(struct treecli_journal_compaction));
+	c->inputs = inputs;
+	c->lens = lens;
+	c->input_count = input_count;
+	c->slots = slots;
+	c->slot_count = slot_count;
+	memset(slots, 0, slot_count * sizeof(struct treecli_journal_slot));
+	c->write = write;
+	c->commit = commit;
+	c->ctx = ctx;
+	c->state = TREECLI_JOURNAL_COMPACTION_SCAN;
+
+	return TREECLI_JOURNAL_COMPACTION_INIT_OK;
+}
+
+
+/**
+ * Remember the record if it is the latest one of its path.
+ */
+static int32_t treecli_journal_compaction_keep(struct treecli_journal_compaction *c, const struct treecli_journal_record *record, const uint8_t *buf) {
+	uint32_t mask = c->slot_count - 1;
+	for (uint32_t i = 0; i < c->slot_count; i++) {
+		struct treecli_journal_slot *slot = &(c->slots[(record->hash + i) & mask]);
+		if (slot->record == NULL) {
+			slot->hash = record->hash;
+			slot->seq = record->seq;
+			slot->record = buf;
+			c->used++;
+			return 0;
+		}
+		if (slot->hash == record->hash) {
+			if (record->seq >= slot->seq) {
+				slot->seq = record->seq;
+				slot->record = buf;
+			}
+			return 0;
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * Scan a single group of the current input. Incomplete groups at the end
+ * of an input are ignored the same way replay ignores them.
+ */
+static int32_t treecli_journal_compaction_scan(struct treecli_journal_compaction *c, uint32_t *processed) {
+	const uint8_t *buf = c->inputs[c->input];
+	size_t len = c->lens[c->input];
+
+	size_t group_end = c->off;
+	bool complete = false;
+	while (group_end < len && !complete) {
+		struct treecli_journal_record record;
+		int32_t n = treecli_journal_decode(&(buf[group_end]), len - group_end, &record);
+		if (n < 0) {
+			break;
+		}
+		group_end += (size_t)n;
+		complete = record.group_end;
+	}
+	if (!complete) {
+		c->input++;
+		c->off = 0;
+		return 0;
+	}
+
+	while (c->off < group_end) {
+		struct treecli_journal_record record;
+		const uint8_t *r = &(buf[c->off]);
+		c->off += (size_t)treecli_journal_decode(r, group_end - c->off, &record);
+		if (treecli_journal_compaction_keep(c, &record, r) < 0) {
+			return -1;
+		}
+		(*processed)++;
+	}
+	if (c->off == len) {
+		c->input++;
+		c->off = 0;
+	}
+
+	return 0;
+}
+
+
+static int32_t treecli_journal_compaction_flush(struct treecli_journal_compaction *c) {
+	if (c->buf_len == 0) {
+		return 0;
+	}
+	int32_t res = c->write(c->buf, c->buf_len, c->ctx);
+	c->buf_len = 0;
+	return res;
+}
+
+
+/**
+ * Write the latest record of the current slot. Every record of the snapshot
+ * is a complete group, the snapshot is valid only after it is committed.
+ */
+static int32_t treecli_journal_compaction_emit(struct treecli_journal_compaction *c) {
+	const struct treecli_journal_slot *slot = &(c->slots[c->slot++]);
+	if (slot->record == NULL) {
+		return 0;
+	}
+
+	if (c->buf_len + TREECLI_JOURNAL_RECORD_LEN > sizeof(c->buf) && treecli_journal_compaction_flush(c) < 0) {
+		return -1;
+	}
+
+	struct treecli_journal_record record;
+	treecli_journal_decode(slot->record, TREECLI_JOURNAL_RECORD_LEN, &record);
+	record.group_end = true;
+	c->buf_len += (size_t)treecli_journal_encode(&record, &(c->buf[c->buf_len]));
+
+	return 0;
+}
+
+
+int32_t treecli_journal_compaction_step(struct treecli_journal_compaction *c, uint32_t budget) {
+	if (u_assert(c != NULL)) {
+		return TREECLI_JOURNAL_COMPACTION_STEP_FAILED;
+	}
+
+	uint32_t processed = 0;
+	while (processed < budget) {
+		switch (c->state) {
+			case TREECLI_JOURNAL_COMPACTION_SCAN:
+				if (c->input == c->input_count) {
+					c->state = TREECLI_JOURNAL_COMPACTION_EMIT;
+					break;
+				}
+				if (treecli_journal_compaction_scan(c, &processed) < 0) {
+					c->state = TREECLI_JOURNAL_COMPACTION_ERROR;
+					return TREECLI_JOURNAL_COMPACTION_STEP_FULL;
+				}
+				break;
+
+			case TREECLI_JOURNAL_COMPACTION_EMIT:
+				if (c->slot == c->slot_count) {
+					c->state = TREECLI_JOURNAL_COMPACTION_COMMIT;
+					break;
+				}
+				if (treecli_journal_compaction_emit(c) < 0) {
+					c->state = TREECLI_JOURNAL_COMPACTION_ERROR;
+					return TREECLI_JOURNAL_COMPACTION_STEP_FAILED;
+				}
+				processed++;
+				break;
+
+			case TREECLI_JOURNAL_COMPACTION_COMMIT:
+				if (treecli_journal_compaction_flush(c) < 0 || c->commit(c->ctx) < 0) {
+					c->state = TREECLI_JOURNAL_COMPACTION_ERROR;
+					return TREECLI_JOURNAL_COMPACTION_STEP_FAILED;
+				}
+				c->state = TREECLI_JOURNAL_COMPACTION_DONE;
+				return TREECLI_JOURNAL_COMPACTION_STEP_DONE;
+
+			case TREECLI_JOURNAL_COMPACTION_DONE:
+				return TREECLI_JOURNAL_COMPACTION_STEP_DONE;
+
+			default:
+				return TREECLI_JOURNAL_COMPACTION_STEP_FAILED;
+		}
+	}
+
+	return TREECLI_JOURNAL_COMPACTION_STEP_MORE;
+}
+
+
+int32_t treecli_journal_compaction_run(struct treecli_journal_compaction *c) {
+	if (u_assert(c != NULL)) {
+		return TREECLI_JOURNAL_COMPACTION_STEP_FAILED;
+	}
+
+	int32_t ret;
+	while ((ret = treecli_journal_compaction_step(c, UINT32_MAX)) == TREECLI_JOURNAL_COMPACTION_STEP_MORE) {
+		;
+	}
+
+	return ret;
+}
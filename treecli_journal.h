@@ -0,0 +1,392 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_JOURNAL_H_
+#define _TREECLI_JOURNAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "treecli_parser.h"
+#include "treecli_bulk.h"
+
+/**
+ * Size of the buffer holding records of a single group commit. Larger groups
+ * are written using multiple write calls, only the last record carries the
+ * end of group flag and the group is still replayed as a whole.
+ */
+#ifndef TREECLI_JOURNAL_GROUP_LEN
+#define TREECLI_JOURNAL_GROUP_LEN 512
+#endif
+
+/**
+ * Maximum length of an encoded value. Longer values cannot be journaled,
+ * their assignments fail.
+ */
+#ifndef TREECLI_JOURNAL_VALUE_LEN
+#define TREECLI_JOURNAL_VALUE_LEN TREECLI_BULK_VALUE_LEN
+#endif
+
+/**
+ * Record layout (little endian): sequence number (4 bytes), path hash
+ * (4 bytes), value type and flags (1 byte), value length (2 bytes), value
+ * and CRC-32 of all preceding bytes of the record (4 bytes).
+ */
+#define TREECLI_JOURNAL_HEADER_LEN 11
+#define TREECLI_JOURNAL_CRC_LEN 4
+#define TREECLI_JOURNAL_RECORD_LEN (TREECLI_JOURNAL_HEADER_LEN + TREECLI_JOURNAL_VALUE_LEN + TREECLI_JOURNAL_CRC_LEN)
+
+/**
+ * Flag set in the type of the last record of a group. Groups are replayed
+ * only if they are complete.
+ */
+#define TREECLI_JOURNAL_GROUP_END 0x80
+
+
+enum treecli_journal_sync {
+	/* Records are synced only by treecli_journal_sync. */
+	TREECLI_JOURNAL_SYNC_NONE = 0,
+	/* Every group commit is synced. */
+	TREECLI_JOURNAL_SYNC_GROUP,
+	/* Every n-th group commit is synced. */
+	TREECLI_JOURNAL_SYNC_INTERVAL,
+};
+
+/**
+ * Single decoded journal record. Data points into the decoded buffer.
+ */
+struct treecli_journal_record {
+	uint32_t seq;
+	uint32_t hash;
+	enum treecli_value_type type;
+	bool group_end;
+	uint16_t len;
+	const uint8_t *data;
+};
+
+/**
+ * Journal of value changes. Every successful value assignment made by an
+ * attached parser is appended as a record. Changes of a parsed line or of
+ * a batch form a group, it is written when the line or the batch ends
+ * (group commit) and synced according to the sync policy. Only one parser
+ * can have an open group, other parsers changing values wait until it is
+ * committed.
+ */
+struct treecli_journal {
+	pthread_mutex_t lock;
+	pthread_cond_t group_done;
+
+	int32_t (*write)(const void *buf, size_t len, void *ctx);
+	int32_t (*sync)(void *ctx);
+	void *ctx;
+
+	enum treecli_journal_sync sync_policy;
+	uint32_t sync_interval;
+	uint32_t unsynced;
+
+	/* Sequence number of the next record. */
+	uint32_t seq;
+
+	uint8_t group[TREECLI_JOURNAL_GROUP_LEN];
+	size_t group_len;
+	/* Offset of the last record in the group. */
+	size_t group_last;
+	/* Parser whose group is open. */
+	struct treecli_parser *owner;
+
+	/* Changes made while replaying are not journaled. */
+	bool replaying;
+	/* A write failed, nothing is journaled until the next rotation. */
+	bool failed;
+};
+
+/**
+ * Entry of the index used to find values by their path hash during replay.
+ */
+struct treecli_journal_index {
+	uint32_t hash;
+	uint32_t item;
+};
+
+/**
+ * Latest record of a single path found by the compaction.
+ */
+struct treecli_journal_slot {
+	uint32_t hash;
+	uint32_t seq;
+	const uint8_t *record;
+};
+
+enum treecli_journal_compaction_state {
+	TREECLI_JOURNAL_COMPACTION_SCAN = 0,
+	TREECLI_JOURNAL_COMPACTION_EMIT,
+	TREECLI_JOURNAL_COMPACTION_COMMIT,
+	TREECLI_JOURNAL_COMPACTION_DONE,
+	TREECLI_JOURNAL_COMPACTION_ERROR,
+};
+
+/**
+ * Compaction folding the current base snapshot and sealed journal segments
+ * into a new base snapshot containing only the latest record of every path.
+ * It works on data which is not modified anymore, values can be changed and
+ * journaled into the current segment meanwhile.
+ */
+struct treecli_journal_compaction {
+	/* Base snapshot followed by sealed segments, oldest first. */
+	const uint8_t *const *inputs;
+	const size_t *lens;
+	uint32_t input_count;
+
+	/* Open addressing table, its size must be a power of two. */
+	struct treecli_journal_slot *slots;
+	uint32_t slot_count;
+	uint32_t used;
+
+	/* Handlers writing the new snapshot and replacing the current one. */
+	int32_t (*write)(const void *buf, size_t len, void *ctx);
+	int32_t (*commit)(void *ctx);
+	void *ctx;
+
+	enum treecli_journal_compaction_state state;
+	uint32_t input;
+	size_t off;
+	uint32_t slot;
+
+	uint8_t buf[TREECLI_JOURNAL_GROUP_LEN];
+	size_t buf_len;
+};
+
+
+/**
+ * Initialize a journal.
+ *
+ * @param journal Journal to initialize.
+ * @param write Handler appending data to the journal storage.
+ * @param sync Handler making appended data persistent (eg. fsync) or NULL.
+ * @param ctx Context passed to both handlers.
+ */
+int32_t treecli_journal_init(struct treecli_journal *journal, int32_t (*write)(const void *buf, size_t len, void *ctx), int32_t (*sync)(void *ctx), void *ctx);
+#define TREECLI_JOURNAL_INIT_OK 0
+#define TREECLI_JOURNAL_INIT_FAILED -1
+
+int32_t treecli_journal_free(struct treecli_journal *journal);
+#define TREECLI_JOURNAL_FREE_OK 0
+#define TREECLI_JOURNAL_FREE_FAILED -1
+
+/**
+ * Set when the sync handler is called.
+ *
+ * @param interval Number of group commits between syncs, used by
+ *                 TREECLI_JOURNAL_SYNC_INTERVAL only.
+ */
+int32_t treecli_journal_set_sync(struct treecli_journal *journal, enum treecli_journal_sync policy, uint32_t interval);
+#define TREECLI_JOURNAL_SET_SYNC_OK 0
+#define TREECLI_JOURNAL_SET_SYNC_FAILED -1
+
+/**
+ * Sync all committed records regardless of the policy.
+ */
+int32_t treecli_journal_sync(struct treecli_journal *journal);
+#define TREECLI_JOURNAL_SYNC_OK 0
+#define TREECLI_JOURNAL_SYNC_FAILED -1
+
+/**
+ * Journal value changes made by a parser. Multiple parsers can share
+ * a single journal. The journal is the change handler of the parser (see
+ * treecli_parser_set_change_handler), every change is appended before the
+ * assignment returns. A failed write (or sync) is reported by the parser
+ * as a failed assignment, line or batch.
+ *
+ * @param journal Journal to append to.
+ * @param parser Parser to attach.
+ */
+int32_t treecli_journal_attach(struct treecli_journal *journal, struct treecli_parser *parser);
+#define TREECLI_JOURNAL_ATTACH_OK 0
+#define TREECLI_JOURNAL_ATTACH_FAILED -1
+
+/**
+ * Stop journaling changes of the parser. It must not be called while
+ * a batch of the parser is in progress.
+ */
+int32_t treecli_journal_detach(struct treecli_journal *journal, struct treecli_parser *parser);
+#define TREECLI_JOURNAL_DETACH_OK 0
+#define TREECLI_JOURNAL_DETACH_FAILED -1
+
+/**
+ * Start a new journal segment. Records committed so far stay in the sealed
+ * segment and can be compacted while new records are appended to the new
+ * one. Rotation waits until the open group is committed, it must not be
+ * called while a batch of an attached parser is in progress in the same
+ * thread. Value changes are blocked only while the handler runs. A journal
+ * which failed to write records is usable again after a successful rotation.
+ *
+ * @param journal A journal.
+ * @param rotate Storage handler closing the current segment and opening
+ *               a new one, called with the context of the journal.
+ *
+ * @return TREECLI_JOURNAL_ROTATE_OK if a new segment was started or
+ *         TREECLI_JOURNAL_ROTATE_FAILED otherwise.
+ */
+int32_t treecli_journal_rotate(struct treecli_journal *journal, int32_t (*rotate)(void *ctx));
+#define TREECLI_JOURNAL_ROTATE_OK 0
+#define TREECLI_JOURNAL_ROTATE_FAILED -1
+
+/**
+ * Compute hash of the value path ("/node/node/value") identifying the value
+ * in journal records.
+ */
+int32_t treecli_journal_hash(struct treecli_parser *parser, const struct treecli_handle *handle, uint32_t *hash);
+#define TREECLI_JOURNAL_HASH_OK 0
+#define TREECLI_JOURNAL_HASH_FAILED -1
+
+/**
+ * Encode a record.
+ *
+ * @param buf Buffer of at least TREECLI_JOURNAL_RECORD_LEN bytes.
+ *
+ * @return Length of the encoded record or
+ *         TREECLI_JOURNAL_ENCODE_FAILED if the value is too long.
+ */
+int32_t treecli_journal_encode(const struct treecli_journal_record *record, uint8_t *buf);
+#define TREECLI_JOURNAL_ENCODE_FAILED -1
+
+/**
+ * Decode a record at the start of the buffer.
+ *
+ * @return Length of the decoded record or
+ *         TREECLI_JOURNAL_DECODE_TRUNCATED if the buffer ends inside
+ *         the record or its CRC doesn't match (torn write) or
+ *         TREECLI_JOURNAL_DECODE_FAILED otherwise.
+ */
+int32_t treecli_journal_decode(const uint8_t *buf, size_t len, struct treecli_journal_record *record);
+#define TREECLI_JOURNAL_DECODE_FAILED -1
+#define TREECLI_JOURNAL_DECODE_TRUNCATED -2
+
+/**
+ * Build an index of all values in the tree sorted by their path hashes.
+ *
+ * @param parser A parser context.
+ * @param items Array of items filled with handles of the values.
+ * @param index Array of index entries of the same size.
+ * @param max Size of both arrays.
+ * @param count Number of indexed values.
+ *
+ * @return TREECLI_JOURNAL_INDEX_OK if all values were indexed or
+ *         TREECLI_JOURNAL_INDEX_TOO_MANY if the arrays are too small or
+ *         TREECLI_JOURNAL_INDEX_COLLISION if two paths have the same hash or
+ *         TREECLI_JOURNAL_INDEX_FAILED otherwise.
+ */
+int32_t treecli_journal_index(struct treecli_parser *parser, struct treecli_bulk_item *items, struct treecli_journal_index *index, uint32_t max, uint32_t *count);
+#define TREECLI_JOURNAL_INDEX_OK 0
+#define TREECLI_JOURNAL_INDEX_FAILED -1
+#define TREECLI_JOURNAL_INDEX_TOO_MANY -2
+#define TREECLI_JOURNAL_INDEX_COLLISION -3
+
+/**
+ * Apply records of a journal (or a snapshot) to the tree. Only complete
+ * groups are applied, replay stops at the first damaged or incomplete
+ * record. Records with sequence numbers lower than the next sequence
+ * number of the journal are skipped (they are already applied), the next
+ * sequence number is advanced past the replayed records afterwards.
+ * Records of values which are not in the index are skipped. Records
+ * rejected by the value (eg. out of range after a firmware update) are
+ * skipped too, replay continues with the next record.
+ *
+ * @param journal Journal to continue appending to.
+ * @param parser Parser used to set values.
+ * @param items Items filled by treecli_journal_index.
+ * @param index Index built by treecli_journal_index.
+ * @param count Number of indexed values.
+ * @param buf Journal data.
+ * @param len Length of the journal data.
+ * @param end Length of the valid part of the data, the storage should be
+ *            truncated to it before appending new records.
+ * @param rejected Sequence number of the first rejected record, set only
+ *                 if some record is rejected. Can be NULL.
+ *
+ * @return TREECLI_JOURNAL_REPLAY_OK if the whole journal was replayed or
+ *         TREECLI_JOURNAL_REPLAY_TRUNCATED if the journal ends with
+ *         a damaged or incomplete group or
+ *         TREECLI_JOURNAL_REPLAY_REJECTED if the whole journal was
+ *         replayed but some records were rejected or
+ *         TREECLI_JOURNAL_REPLAY_FAILED otherwise.
+ */
+int32_t treecli_journal_replay(struct treecli_journal *journal, struct treecli_parser *parser, const struct treecli_bulk_item *items, const struct treecli_journal_index *index, uint32_t count, const uint8_t *buf, size_t len, size_t *end, uint32_t *rejected);
+#define TREECLI_JOURNAL_REPLAY_OK 0
+#define TREECLI_JOURNAL_REPLAY_FAILED -1
+#define TREECLI_JOURNAL_REPLAY_TRUNCATED -2
+#define TREECLI_JOURNAL_REPLAY_REJECTED -3
+
+/**
+ * Prepare a compaction. Nothing is done until the compaction is run.
+ *
+ * @param c Compaction to initialize.
+ * @param inputs Base snapshot (can be empty) and sealed segments, oldest
+ *               first. They must not change until the compaction finishes.
+ * @param lens Lengths of the inputs.
+ * @param input_count Number of inputs.
+ * @param slots Table of slots, one slot is needed for every distinct path.
+ * @param slot_count Size of the table, a power of two.
+ * @param write Handler writing the new snapshot.
+ * @param commit Handler making the new snapshot persistent and atomically
+ *               replacing the base snapshot and the sealed segments with it
+ *               (eg. fsync and rename). A crash before it completes leaves
+ *               the previous snapshot and segments intact.
+ * @param ctx Context passed to the handlers.
+ */
+int32_t treecli_journal_compaction_init(struct treecli_journal_compaction *c, const uint8_t *const *inputs, const size_t *lens, uint32_t input_count, struct treecli_journal_slot *slots, uint32_t slot_count, int32_t (*write)(const void *buf, size_t len, void *ctx), int32_t (*commit)(void *ctx), void *ctx);
+#define TREECLI_JOURNAL_COMPACTION_INIT_OK 0
+#define TREECLI_JOURNAL_COMPACTION_INIT_FAILED -1
+
+/**
+ * Run a slice of the compaction. It can be called from a cooperative
+ * scheduler loop until it is done.
+ *
+ * @param c A compaction.
+ * @param budget Maximum number of records processed in the slice.
+ *
+ * @return TREECLI_JOURNAL_COMPACTION_STEP_MORE if there is more work or
+ *         TREECLI_JOURNAL_COMPACTION_STEP_DONE if the new snapshot was
+ *         committed or
+ *         TREECLI_JOURNAL_COMPACTION_STEP_FULL if there are more paths than
+ *         slots or
+ *         TREECLI_JOURNAL_COMPACTION_STEP_FAILED if a handler failed.
+ */
+int32_t treecli_journal_compaction_step(struct treecli_journal_compaction *c, uint32_t budget);
+#define TREECLI_JOURNAL_COMPACTION_STEP_MORE 1
+#define TREECLI_JOURNAL_COMPACTION_STEP_DONE 0
+#define TREECLI_JOURNAL_COMPACTION_STEP_FAILED -1
+#define TREECLI_JOURNAL_COMPACTION_STEP_FULL -2
+
+/**
+ * Run the whole compaction, eg. in a background thread. Results are the same
+ * as of treecli_journal_compaction_step.
+ */
+int32_t treecli_journal_compaction_run(struct treecli_journal_compaction *c);
+
+
+#endif
@@ -0,0 +1,457 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "treecli_parser.h"
+#include "treecli_workspace.h"
+#include "treecli_plan.h"
+#include "treecli_load.h"
+
+
+/**
+ * Shared context of the loader. Workers take chunks of lines in order, a
+ * chunk can be reused when the chunk held before is applied. All members
+ * following the lock are protected by it.
+ */
+struct treecli_load_state {
+	/* Copy of the parser taken before loading, workers start with it. */
+	struct treecli_parser parser;
+
+	const char *text;
+	size_t len;
+	struct treecli_load_chunk *chunks;
+	uint32_t chunk_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_cond_t free;
+	size_t next_offset;
+	uint32_t next_line;
+	uint32_t next_chunk;
+	uint32_t applied;
+	bool eof;
+	bool stop;
+};
+
+
+/**
+ * Split the next line of the text. Length of the line without the line
+ * terminator is returned, offset is moved to the start of the next line.
+ */
+static size_t treecli_load_split(const char *text, size_t len, size_t *offset) {
+	const char *start = text + *offset;
+	const char *end = memchr(start, '\n', len - *offset);
+
+	size_t line_len;
+	if (end == NULL) {
+		line_len = len - *offset;
+		*offset = len;
+	} else {
+		line_len = end - start;
+		*offset += line_len + 1;
+	}
+	if (line_len > 0 && start[line_len - 1] == '\r') {
+		line_len--;
+	}
+
+	return line_len;
+}
+
+
+/**
+ * Copy a line of the text to a zero terminated buffer.
+ */
+static bool treecli_load_line(const char *text, const struct treecli_load_op *op, char *buf) {
+	if (op->len >= TREECLI_LOAD_LINE_LEN) {
+		return false;
+	}
+	memcpy(buf, text + op->offset, op->len);
+	buf[op->len] = '\0';
+
+	return true;
+}
+
+
+/**
+ * Check if a line starts at the tree root and can be resolved without knowing
+ * the position left by the preceding lines.
+ */
+static bool treecli_load_rooted(const char *s, size_t len) {
+	size_t i = 0;
+	while (i < len && (s[i] == ' ' || s[i] == '\t')) {
+		i++;
+	}
+
+	return i < len && s[i] == '/';
+}
+
+
+/**
+ * Move the position the same way treecli_execute does when the plan is
+ * executed successfully.
+ */
+static bool treecli_load_advance(struct treecli_parser_pos *pos, const struct treecli_plan *plan) {
+	struct treecli_parser_pos p;
+	treecli_parser_pos_copy(&p, pos);
+
+	bool moved = false;
+	for (uint32_t i = 0; i < plan->step_count; i++) {
+		const struct treecli_plan_step *step = &(plan->steps[i]);
+		int32_t res = TREECLI_PARSER_POS_MOVE_OK;
+
+		moved = true;
+		switch (step->type) {
+			case TREECLI_PLAN_STEP_TOP:
+				treecli_parser_pos_root(&p);
+				break;
+			case TREECLI_PLAN_STEP_UP:
+				res = treecli_parser_pos_up(&p);
+				break;
+			case TREECLI_PLAN_STEP_SUBNODE:
+				res = treecli_parser_pos_move(&p, &(struct treecli_parser_pos_level){.node = step->subnode, .dnode = NULL});
+				break;
+			case TREECLI_PLAN_STEP_DSUBNODE:
+				res = treecli_parser_pos_move(&p, &(struct treecli_parser_pos_level){.node = NULL, .dnode = step->dnode, .dnode_index = step->dnode_index});
+				break;
+			case TREECLI_PLAN_STEP_COMPACT:
+				res = treecli_parser_pos_move(&p, &(struct treecli_parser_pos_level){.node = NULL, .dnode = NULL, .compact = step->compact, .compact_index = step->compact_index});
+				break;
+			default:
+				moved = false;
+				break;
+		}
+		if (res != TREECLI_PARSER_POS_MOVE_OK) {
+			return false;
+		}
+	}
+
+	if (moved) {
+		treecli_parser_pos_copy(pos, &p);
+	}
+
+	return true;
+}
+
+
+/**
+ * Resolve lines of a chunk using a parser owned by the calling thread. The
+ * position of the parser is known at the start of the chunk only for the
+ * first chunk. It becomes known again after a resolved line starting at the
+ * tree root and unknown after every line which is not resolved.
+ */
+static void treecli_load_resolve(struct treecli_parser *parser, const char *text, struct treecli_load_chunk *chunk, bool known) {
+	char line[TREECLI_LOAD_LINE_LEN];
+
+	for (uint32_t i = 0; i < chunk->count; i++) {
+		struct treecli_load_op *op = &(chunk->ops[i]);
+		op->resolved = false;
+
+		if (treecli_load_line(text, op, line) == false) {
+			known = false;
+			continue;
+		}
+		if (known == false && treecli_load_rooted(text + op->offset, op->len) == false) {
+			continue;
+		}
+
+		/* Placeholders are not expected in the loaded text, lines
+		 * containing them are left to the parser. */
+		known = false;
+		if (treecli_prepare(parser, &(op->plan), line) != TREECLI_PREPARE_OK || op->plan.arg_count > 0) {
+			continue;
+		}
+		if (treecli_load_advance(&(parser->pos), &(op->plan)) == false) {
+			continue;
+		}
+		op->resolved = true;
+		known = true;
+	}
+}
+
+
+static void *treecli_load_worker(void *arg) {
+	struct treecli_load_state *st = (struct treecli_load_state *)arg;
+
+	/* Private copy of the parser used to resolve lines. The scratch space
+	 * cannot be shared with other threads. */
+	struct treecli_parser parser;
+	memcpy(&parser, &(st->parser), sizeof(struct treecli_parser));
+#if TREECLI_PARSER_LOW_STACK
+	struct treecli_parser_workspace workspace;
+	parser.workspace = &workspace;
+#endif
+
+	while (true) {
+		pthread_mutex_lock(&(st->lock));
+		while (st->stop == false && st->eof == false && st->next_chunk >= (st->applied + st->chunk_count)) {
+			pthread_cond_wait(&(st->free), &(st->lock));
+		}
+		if (st->stop || st->eof) {
+			pthread_mutex_unlock(&(st->lock));
+			break;
+		}
+		if (st->next_offset >= st->len) {
+			st->eof = true;
+			pthread_cond_broadcast(&(st->ready));
+			pthread_mutex_unlock(&(st->lock));
+			break;
+		}
+
+		/* Lines are split while the chunk is claimed, it is much
+		 * cheaper than resolving them. */
+		uint32_t seq = st->next_chunk++;
+		struct treecli_load_chunk *chunk = &(st->chunks[seq % st->chunk_count]);
+		chunk->count = 0;
+		while (chunk->count < TREECLI_LOAD_CHUNK_LINES && st->next_offset < st->len) {
+			struct treecli_load_op *op = &(chunk->ops[chunk->count++]);
+			op->offset = st->next_offset;
+			op->len = treecli_load_split(st->text, st->len, &(st->next_offset));
+		}
+
+		/* A full chunk is cut before its last line starting at the
+		 * root unless the next line starts there, the next chunk can
+		 * be resolved from its start then. Relative lines following
+		 * the cut would have to be parsed when applied otherwise. */
+		size_t offset = st->next_offset;
+		if (offset < st->len && treecli_load_rooted(st->text + st->next_offset, treecli_load_split(st->text, st->len, &offset)) == false) {
+			for (uint32_t i = chunk->count - 1; i > 0; i--) {
+				if (treecli_load_rooted(st->text + chunk->ops[i].offset, chunk->ops[i].len)) {
+					st->next_offset = chunk->ops[i].offset;
+					chunk->count = i;
+					break;
+				}
+			}
+		}
+		if (st->next_offset >= st->len) {
+			st->eof = true;
+		}
+		chunk->line = st->next_line;
+		st->next_line += chunk->count;
+		chunk->seq = seq;
+		chunk->ready = false;
+		pthread_mutex_unlock(&(st->lock));
+
+		/* Only the first chunk starts at a known position. */
+		treecli_parser_pos_copy(&(parser.pos), &(st->parser.pos));
+		treecli_load_resolve(&parser, st->text, chunk, seq == 0);
+
+		pthread_mutex_lock(&(st->lock));
+		chunk->ready = true;
+		pthread_cond_broadcast(&(st->ready));
+		pthread_mutex_unlock(&(st->lock));
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Apply a single line. Unresolved lines are parsed and run to completion the
+ * same way lines of shell scripts are.
+ */
+static bool treecli_load_apply(struct treecli_parser *parser, const char *text, struct treecli_load_op *op) {
+	if (op->resolved) {
+		op->plan.parser = parser;
+		return treecli_execute(&(op->plan), 0, NULL) == TREECLI_EXECUTE_OK;
+	}
+
+	char line[TREECLI_LOAD_LINE_LEN];
+	if (treecli_load_line(text, op, line) == false) {
+		return false;
+	}
+
+	int32_t ret = treecli_parser_parse_line(parser, line);
+	while (ret == TREECLI_PARSER_PARSE_LINE_PENDING && parser->generator != NULL) {
+		int32_t gen_ret = treecli_parser_generator_run(parser, 0);
+		ret = treecli_parser_resume_line(parser, &(parser->generator_completion), line, gen_ret);
+	}
+	if (ret == TREECLI_PARSER_PARSE_LINE_PENDING) {
+		treecli_parser_cancel(parser);
+		return false;
+	}
+
+	return ret == TREECLI_PARSER_PARSE_LINE_OK;
+}
+
+
+/**
+ * Apply lines in order as their chunks are resolved by the workers.
+ */
+static int32_t treecli_load_run(struct treecli_parser *parser, struct treecli_load_state *st, uint32_t *line) {
+	for (uint32_t seq = 0; ; seq++) {
+		struct treecli_load_chunk *chunk = &(st->chunks[seq % st->chunk_count]);
+
+		pthread_mutex_lock(&(st->lock));
+		while ((chunk->ready == false || chunk->seq != seq) && (st->eof == false || seq < st->next_chunk)) {
+			pthread_cond_wait(&(st->ready), &(st->lock));
+		}
+		bool done = chunk->ready == false || chunk->seq != seq;
+		pthread_mutex_unlock(&(st->lock));
+		if (done) {
+			return TREECLI_LOAD_OK;
+		}
+
+		for (uint32_t i = 0; i < chunk->count; i++) {
+			if (treecli_load_apply(parser, st->text, &(chunk->ops[i])) == false) {
+				if (line != NULL) {
+					*line = chunk->line + i + 1;
+				}
+				return TREECLI_LOAD_LINE_FAILED;
+			}
+		}
+
+		pthread_mutex_lock(&(st->lock));
+		st->applied++;
+		pthread_cond_broadcast(&(st->free));
+		pthread_mutex_unlock(&(st->lock));
+	}
+}
+
+
+/**
+ * Parse and apply all lines in the calling thread.
+ */
+static int32_t treecli_load_sequential(struct treecli_parser *parser, const char *text, size_t len, uint32_t *line) {
+	size_t offset = 0;
+	for (uint32_t n = 1; offset < len; n++) {
+		struct treecli_load_op op;
+		op.offset = offset;
+		op.len = treecli_load_split(text, len, &offset);
+		op.resolved = false;
+
+		if (treecli_load_apply(parser, text, &op) == false) {
+			if (line != NULL) {
+				*line = n;
+			}
+			return TREECLI_LOAD_LINE_FAILED;
+		}
+	}
+
+	return TREECLI_LOAD_OK;
+}
+
+
+int32_t treecli_load(struct treecli_parser *parser, const char *text, size_t len, struct treecli_load_chunk *chunks, uint32_t chunk_count, uint32_t threads, uint32_t *line) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(text != NULL || len == 0) ||
+	    u_assert(chunks != NULL || threads == 0) ||
+	    u_assert(chunk_count > 0 || threads == 0)) {
+		return TREECLI_LOAD_FAILED;
+	}
+
+	if (parser->exec_pending) {
+		return TREECLI_LOAD_FAILED;
+	}
+	if (threads > TREECLI_LOAD_MAX_THREADS) {
+		threads = TREECLI_LOAD_MAX_THREADS;
+	}
+
+	treecli_parser_read_lock(parser);
+	struct treecli_parser_pos pos_saved;
+	treecli_parser_pos_copy(&pos_saved, &(parser->pos));
+	enum treecli_parser_mode mode_saved = parser->mode;
+	treecli_parser_set_mode(parser, TREECLI_PARSER_ALLOW_EXEC);
+	treecli_parser_batch_begin(parser);
+
+	struct treecli_load_state st;
+	memset(&st, 0, sizeof(struct treecli_load_state));
+	st.text = text;
+	st.len = len;
+	st.chunks = chunks;
+	st.chunk_count = chunk_count;
+
+	/* Workers resolve using a copy of the parser taken before anything is
+	 * applied. Cache, watchers and the scratch space are not shared,
+	 * mounted subtrees are kept by the read-side section of the calling
+	 * thread. */
+	memcpy(&(st.parser), parser, sizeof(struct treecli_parser));
+	st.parser.cache = NULL;
+	st.parser.cache_size = 0;
+	st.parser.watches = NULL;
+	st.parser.mounts = NULL;
+	st.parser.workspace = NULL;
+	st.parser.change_handler = NULL;
+	st.parser.changes = NULL;
+	st.parser.changes_size = 0;
+	st.parser.changes_count = 0;
+
+	pthread_t pool[TREECLI_LOAD_MAX_THREADS];
+	uint32_t started = 0;
+	bool sync_ok = threads > 0 && pthread_mutex_init(&(st.lock), NULL) == 0;
+	if (sync_ok && pthread_cond_init(&(st.ready), NULL) != 0) {
+		pthread_mutex_destroy(&(st.lock));
+		sync_ok = false;
+	}
+	if (sync_ok && pthread_cond_init(&(st.free), NULL) != 0) {
+		pthread_cond_destroy(&(st.ready));
+		pthread_mutex_destroy(&(st.lock));
+		sync_ok = false;
+	}
+	for (uint32_t i = 0; i < chunk_count && threads > 0; i++) {
+		chunks[i].ready = false;
+	}
+	for (uint32_t i = 0; sync_ok && i < threads; i++) {
+		if (pthread_create(&(pool[started]), NULL, treecli_load_worker, (void *)&st) != 0) {
+			break;
+		}
+		started++;
+	}
+
+	/* Everything is done in the calling thread if no worker can be
+	 * started. */
+	int32_t ret;
+	if (started > 0) {
+		ret = treecli_load_run(parser, &st, line);
+
+		pthread_mutex_lock(&(st.lock));
+		st.stop = true;
+		pthread_cond_broadcast(&(st.free));
+		pthread_mutex_unlock(&(st.lock));
+		for (uint32_t i = 0; i < started; i++) {
+			pthread_join(pool[i], NULL);
+		}
+	} else {
+		ret = treecli_load_sequential(parser, text, len, line);
+	}
+	if (sync_ok) {
+		pthread_cond_destroy(&(st.free));
+		pthread_cond_destroy(&(st.ready));
+		pthread_mutex_destroy(&(st.lock));
+	}
+
+	if (treecli_parser_batch_end(parser) != TREECLI_PARSER_BATCH_END_OK && ret == TREECLI_LOAD_OK) {
+		ret = TREECLI_LOAD_FAILED;
+	}
+	treecli_parser_set_mode(parser, mode_saved);
+	treecli_parser_pos_copy(&(parser->pos), &pos_saved);
+	treecli_parser_read_unlock(parser);
+
+	return ret;
+}
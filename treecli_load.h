@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_LOAD_H_
+#define _TREECLI_LOAD_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "treecli_parser.h"
+#include "treecli_plan.h"
+
+/**
+ * Number of lines resolved by a worker at once.
+ */
+#ifndef TREECLI_LOAD_CHUNK_LINES
+#define TREECLI_LOAD_CHUNK_LINES 64
+#endif
+
+/**
+ * Maximum length of a loaded line (including the terminating zero).
+ */
+#ifndef TREECLI_LOAD_LINE_LEN
+#define TREECLI_LOAD_LINE_LEN 256
+#endif
+
+#ifndef TREECLI_LOAD_MAX_THREADS
+#define TREECLI_LOAD_MAX_THREADS 16
+#endif
+
+
+/**
+ * Single line of the loaded text. Resolved lines are applied by executing
+ * their plan, other lines are parsed again when they are applied.
+ */
+struct treecli_load_op {
+	size_t offset;
+	size_t len;
+
+	bool resolved;
+	struct treecli_plan plan;
+};
+
+/**
+ * Consecutive lines resolved by a single worker. Chunks are used as a ring,
+ * seq is the number of the chunk currently held, line is the number of its
+ * first line (starting at 0) and ready is set when all its lines are
+ * resolved.
+ */
+struct treecli_load_chunk {
+	struct treecli_load_op ops[TREECLI_LOAD_CHUNK_LINES];
+	uint32_t count;
+	uint32_t seq;
+	uint32_t line;
+	bool ready;
+};
+
+
+/**
+ * Load a configuration text, eg. the boot configuration. The text is split
+ * to chunks of lines which are tokenized and resolved into plans by a pool of
+ * worker threads. Lines are applied (values are set and commands executed)
+ * in their original order by the calling thread as soon as their chunk is
+ * resolved, workers continue with the following chunks meanwhile.
+ *
+ * Relative lines are resolved using the working position left by the
+ * preceding lines of the same chunk. Chunks are cut before a line starting
+ * with "/" if there is one, so that the position is known at the start of
+ * the next chunk. Relative lines at the beginning of a chunk which could not
+ * be cut (up to the first line starting with "/"), lines using patterns or
+ * expressions and lines which cannot be resolved ahead (eg. dnodes created
+ * by a preceding command) are parsed when they are applied, in the same way
+ * as by treecli_parser_parse_line.
+ *
+ * The tree is resolved ahead of applying, loaded commands must not remove
+ * nodes or rename dynamic nodes used by the following lines. Create callbacks
+ * of dynamic nodes are called from the workers and must be thread safe.
+ * Loading stops at the first failed line. All lines are applied in a single
+ * batch of changes (see treecli_parser_batch_begin): the change handler is
+ * called for every change as it is applied, watchers are notified when
+ * loading ends, even if it fails. The working position of the parser is not
+ * changed. Deferred commands cannot be waited for, lines starting them
+ * fail.
+ *
+ * @param parser A parser context. It must not be used until the function
+ *               returns.
+ * @param text Text to load, lines are terminated by LF or CR LF.
+ * @param len Length of the text.
+ * @param chunks Chunks used by the workers. Two chunks per thread are
+ *               enough to keep all workers busy.
+ * @param chunk_count Number of chunks.
+ * @param threads Number of worker threads, lines are parsed and applied
+ *                sequentially in the calling thread if it is 0.
+ * @param line Number of the failed line (starting at 1), set only if some
+ *             line fails. Can be NULL.
+ *
+ * @return TREECLI_LOAD_OK if all lines were applied successfully or
+ *         TREECLI_LOAD_LINE_FAILED if some line failed or
+ *         TREECLI_LOAD_FAILED otherwise.
+ */
+int32_t treecli_load(struct treecli_parser *parser, const char *text, size_t len, struct treecli_load_chunk *chunks, uint32_t chunk_count, uint32_t threads, uint32_t *line);
+#define TREECLI_LOAD_OK 0
+#define TREECLI_LOAD_FAILED -1
+#define TREECLI_LOAD_LINE_FAILED -2
+
+
+#endif
@@ -0,0 +1,398 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "treecli_parser.h"
+#include "treecli_mount.h"
+
+
+int32_t treecli_mount_init(struct treecli_mount_table *table) {
+	if (u_assert(table != NULL)) {
+		return TREECLI_MOUNT_INIT_FAILED;
+	}
+
+	memset(table, 0, sizeof(struct treecli_mount_table));
+	if (pthread_mutex_init(&(table->lock), NULL) != 0) {
+		return TREECLI_MOUNT_INIT_FAILED;
+	}
+	table->epoch = 1;
+
+	return TREECLI_MOUNT_INIT_OK;
+}
+
+
+int32_t treecli_mount_free(struct treecli_mount_table *table) {
+	if (u_assert(table != NULL)) {
+		return TREECLI_MOUNT_FREE_FAILED;
+	}
+
+	pthread_mutex_destroy(&(table->lock));
+
+	return TREECLI_MOUNT_FREE_OK;
+}
+
+
+/**
+ * Check if no reader can see an array retired at the given epoch. Readers
+ * which started before the array was retired may still use it.
+ */
+static bool treecli_mount_quiescent(struct treecli_mount_table *table, uint32_t retired) {
+	for (uint32_t i = 0; i < TREECLI_MOUNT_MAX_READERS; i++) {
+		uint32_t e = __atomic_load_n(&(table->readers[i]), __ATOMIC_SEQ_CST);
+		if (e != 0 && e < retired) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/**
+ * Return retired arrays which are not used by any reader to the pool.
+ */
+static void treecli_mount_reclaim(struct treecli_mount_table *table) {
+	for (uint32_t i = 0; i < TREECLI_MOUNT_POOL_SIZE; i++) {
+		struct treecli_mount_array *a = &(table->pool[i]);
+		if (a->used && a->retired != 0 && treecli_mount_quiescent(table, a->retired)) {
+			a->used = false;
+		}
+	}
+}
+
+
+/**
+ * Get an unused array from the pool. If all arrays are used and some of them
+ * are retired, wait for readers still using the oldest one.
+ */
+static struct treecli_mount_array *treecli_mount_alloc(struct treecli_mount_table *table) {
+	while (true) {
+		treecli_mount_reclaim(table);
+
+		uint32_t oldest = 0;
+		for (uint32_t i = 0; i < TREECLI_MOUNT_POOL_SIZE; i++) {
+			struct treecli_mount_array *a = &(table->pool[i]);
+			if (!a->used) {
+				memset(a, 0, sizeof(struct treecli_mount_array));
+				a->used = true;
+				return a;
+			}
+			if (a->retired != 0 && (oldest == 0 || a->retired < oldest)) {
+				oldest = a->retired;
+			}
+		}
+		if (oldest == 0) {
+			return NULL;
+		}
+
+		while (!treecli_mount_quiescent(table, oldest)) {
+			sched_yield();
+		}
+	}
+}
+
+
+/**
+ * Publish a new array of the mount point (or NULL if nothing is mounted
+ * anymore) and retire the previous one. The epoch is advanced after the
+ * array is published, readers which see the new epoch see the new array.
+ */
+static void treecli_mount_publish(struct treecli_mount_table *table, uint32_t point, struct treecli_mount_array *array) {
+	struct treecli_mount_array *old = table->points[point];
+
+	__atomic_store_n(&(table->points[point]), array, __ATOMIC_SEQ_CST);
+	uint32_t epoch = __atomic_add_fetch(&(table->epoch), 1, __ATOMIC_SEQ_CST);
+
+	if (old != NULL) {
+		old->retired = epoch;
+	}
+}
+
+
+/**
+ * Find the mount point of a node or a free one if parent is NULL.
+ */
+static int32_t treecli_mount_find(struct treecli_mount_table *table, const struct treecli_node *parent) {
+	for (uint32_t i = 0; i < TREECLI_MOUNT_MAX_POINTS; i++) {
+		const struct treecli_mount_array *a = table->points[i];
+		if ((parent == NULL && a == NULL) || (parent != NULL && a != NULL && a->parent == parent)) {
+			return (int32_t)i;
+		}
+	}
+	return -1;
+}
+
+
+int32_t treecli_mount_attach(struct treecli_mount_table *table, const struct treecli_node *parent, const struct treecli_node *subtree) {
+	if (u_assert(table != NULL) ||
+	    u_assert(parent != NULL) ||
+	    u_assert(subtree != NULL)) {
+		return TREECLI_MOUNT_ATTACH_FAILED;
+	}
+
+	pthread_mutex_lock(&(table->lock));
+
+	int32_t point = treecli_mount_find(table, parent);
+	const struct treecli_node *const *src = NULL;
+	uint32_t mounted = 0;
+	if (point >= 0) {
+		src = table->points[point]->subnodes;
+		mounted = table->points[point]->mounted;
+	} else {
+		if (parent->subnodes != NULL) {
+			src = *(parent->subnodes);
+		}
+		point = treecli_mount_find(table, NULL);
+	}
+
+	/* Copy current subnodes, names must stay unique. */
+	uint32_t count = 0;
+	while (src != NULL && src[count] != NULL) {
+		if (!strcmp(src[count]->name, subtree->name)) {
+			pthread_mutex_unlock(&(table->lock));
+			return TREECLI_MOUNT_ATTACH_EXISTS;
+		}
+		count++;
+	}
+
+	struct treecli_mount_array *array = NULL;
+	if (point < 0 || count >= TREECLI_MOUNT_MAX_SUBNODES || (array = treecli_mount_alloc(table)) == NULL) {
+		pthread_mutex_unlock(&(table->lock));
+		return TREECLI_MOUNT_ATTACH_FULL;
+	}
+
+	array->parent = parent;
+	for (uint32_t i = 0; i < count; i++) {
+		array->subnodes[i] = src[i];
+	}
+	array->subnodes[count] = subtree;
+	array->subnodes[count + 1] = NULL;
+	array->mounted = mounted + 1;
+	treecli_mount_publish(table, (uint32_t)point, array);
+
+	pthread_mutex_unlock(&(table->lock));
+
+	return TREECLI_MOUNT_ATTACH_OK;
+}
+
+
+int32_t treecli_mount_detach(struct treecli_mount_table *table, const struct treecli_node *parent, const struct treecli_node *subtree) {
+	if (u_assert(table != NULL) ||
+	    u_assert(parent != NULL) ||
+	    u_assert(subtree != NULL)) {
+		return TREECLI_MOUNT_DETACH_FAILED;
+	}
+
+	pthread_mutex_lock(&(table->lock));
+
+	int32_t point = treecli_mount_find(table, parent);
+	if (point < 0) {
+		pthread_mutex_unlock(&(table->lock));
+		return TREECLI_MOUNT_DETACH_NOT_FOUND;
+	}
+	const struct treecli_mount_array *old = table->points[point];
+
+	/* Static subnodes cannot be detached, they precede mounted ones. */
+	uint32_t count = 0;
+	uint32_t found = TREECLI_MOUNT_MAX_SUBNODES;
+	while (old->subnodes[count] != NULL) {
+		if (old->subnodes[count] == subtree) {
+			found = count;
+		}
+		count++;
+	}
+	if (found == TREECLI_MOUNT_MAX_SUBNODES || found < count - old->mounted) {
+		pthread_mutex_unlock(&(table->lock));
+		return TREECLI_MOUNT_DETACH_NOT_FOUND;
+	}
+
+	/* The last mounted subtree is gone, static subnodes are used again. */
+	if (old->mounted == 1) {
+		treecli_mount_publish(table, (uint32_t)point, NULL);
+		pthread_mutex_unlock(&(table->lock));
+		return TREECLI_MOUNT_DETACH_OK;
+	}
+
+	struct treecli_mount_array *array = treecli_mount_alloc(table);
+	if (array == NULL) {
+		pthread_mutex_unlock(&(table->lock));
+		return TREECLI_MOUNT_DETACH_FAILED;
+	}
+	array->parent = parent;
+	uint32_t j = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (i != found) {
+			array->subnodes[j++] = old->subnodes[i];
+		}
+	}
+	array->subnodes[j] = NULL;
+	array->mounted = old->mounted - 1;
+	treecli_mount_publish(table, (uint32_t)point, array);
+
+	pthread_mutex_unlock(&(table->lock));
+
+	return TREECLI_MOUNT_DETACH_OK;
+}
+
+
+int32_t treecli_mount_swap_top(struct treecli_mount_table *table, const struct treecli_node *top) {
+	if (u_assert(table != NULL) ||
+	    u_assert(top != NULL)) {
+		return TREECLI_MOUNT_SWAP_TOP_FAILED;
+	}
+
+	pthread_mutex_lock(&(table->lock));
+	__atomic_store_n(&(table->top), top, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&(table->epoch), 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&(table->lock));
+
+	return TREECLI_MOUNT_SWAP_TOP_OK;
+}
+
+
+int32_t treecli_mount_synchronize(struct treecli_mount_table *table) {
+	if (u_assert(table != NULL)) {
+		return TREECLI_MOUNT_SYNCHRONIZE_FAILED;
+	}
+
+	/* Readers which announced an older epoch may still see detached
+	 * subtrees. Readers never block, wait for them to leave. */
+	uint32_t epoch = __atomic_load_n(&(table->epoch), __ATOMIC_SEQ_CST);
+	while (!treecli_mount_quiescent(table, epoch)) {
+		sched_yield();
+	}
+
+	/* Parsers are remapped only by their own threads, idle ones still
+	 * reference the previous tree. */
+	int32_t ret = TREECLI_MOUNT_SYNCHRONIZE_OK;
+	pthread_mutex_lock(&(table->lock));
+	if (table->top != NULL) {
+		for (uint32_t i = 0; i < TREECLI_MOUNT_MAX_READERS; i++) {
+			if (table->readers_used[i] &&
+			    __atomic_load_n(&(table->readers_top[i]), __ATOMIC_ACQUIRE) != table->top) {
+				ret = TREECLI_MOUNT_SYNCHRONIZE_PENDING;
+			}
+		}
+	}
+	treecli_mount_reclaim(table);
+	pthread_mutex_unlock(&(table->lock));
+
+	return ret;
+}
+
+
+int32_t treecli_mount_reader_register(struct treecli_mount_table *table, struct treecli_parser *parser, uint32_t *reader) {
+	if (u_assert(table != NULL) ||
+	    u_assert(parser != NULL) ||
+	    u_assert(reader != NULL)) {
+		return TREECLI_MOUNT_READER_REGISTER_FAILED;
+	}
+
+	int32_t ret = TREECLI_MOUNT_READER_REGISTER_FAILED;
+	pthread_mutex_lock(&(table->lock));
+	for (uint32_t i = 0; i < TREECLI_MOUNT_MAX_READERS; i++) {
+		if (!table->readers_used[i]) {
+			table->readers_used[i] = true;
+			table->readers[i] = 0;
+			table->readers_top[i] = parser->top;
+			*reader = i;
+			ret = TREECLI_MOUNT_READER_REGISTER_OK;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&(table->lock));
+
+	return ret;
+}
+
+
+int32_t treecli_mount_reader_unregister(struct treecli_mount_table *table, uint32_t reader) {
+	if (u_assert(table != NULL) ||
+	    u_assert(reader < TREECLI_MOUNT_MAX_READERS)) {
+		return TREECLI_MOUNT_READER_UNREGISTER_FAILED;
+	}
+
+	pthread_mutex_lock(&(table->lock));
+	__atomic_store_n(&(table->readers[reader]), 0, __ATOMIC_SEQ_CST);
+	table->readers_used[reader] = false;
+	table->readers_top[reader] = NULL;
+	pthread_mutex_unlock(&(table->lock));
+
+	return TREECLI_MOUNT_READER_UNREGISTER_OK;
+}
+
+
+int32_t treecli_mount_read_lock(struct treecli_mount_table *table, uint32_t reader, uint32_t *epoch) {
+	if (u_assert(table != NULL) ||
+	    u_assert(reader < TREECLI_MOUNT_MAX_READERS) ||
+	    u_assert(epoch != NULL)) {
+		return TREECLI_MOUNT_READ_LOCK_FAILED;
+	}
+
+	/* Announce the epoch before any array is read. Writers reuse only
+	 * arrays retired before the oldest announced epoch. */
+	uint32_t e = __atomic_load_n(&(table->epoch), __ATOMIC_ACQUIRE);
+	__atomic_store_n(&(table->readers[reader]), e, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	*epoch = e;
+
+	return TREECLI_MOUNT_READ_LOCK_OK;
+}
+
+
+int32_t treecli_mount_read_unlock(struct treecli_mount_table *table, uint32_t reader) {
+	if (u_assert(table != NULL) ||
+	    u_assert(reader < TREECLI_MOUNT_MAX_READERS)) {
+		return TREECLI_MOUNT_READ_UNLOCK_FAILED;
+	}
+
+	__atomic_store_n(&(table->readers[reader]), 0, __ATOMIC_RELEASE);
+
+	return TREECLI_MOUNT_READ_UNLOCK_OK;
+}
+
+
+int32_t treecli_mount_subnodes(struct treecli_mount_table *table, const struct treecli_node *parent, const struct treecli_node *const **subnodes) {
+	if (u_assert(table != NULL) ||
+	    u_assert(subnodes != NULL)) {
+		return TREECLI_MOUNT_SUBNODES_FAILED;
+	}
+
+	*subnodes = NULL;
+	for (uint32_t i = 0; i < TREECLI_MOUNT_MAX_POINTS; i++) {
+		const struct treecli_mount_array *a = __atomic_load_n(&(table->points[i]), __ATOMIC_ACQUIRE);
+		if (a != NULL && a->parent == parent) {
+			*subnodes = a->subnodes;
+			break;
+		}
+	}
+
+	return TREECLI_MOUNT_SUBNODES_OK;
+}
@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_MOUNT_H_
+#define _TREECLI_MOUNT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "treecli_parser.h"
+
+/**
+ * Maximum number of nodes with subtrees mounted at the same time.
+ */
+#ifndef TREECLI_MOUNT_MAX_POINTS
+#define TREECLI_MOUNT_MAX_POINTS 8
+#endif
+
+/**
+ * Maximum number of subnodes (static and mounted) of a mount point.
+ */
+#ifndef TREECLI_MOUNT_MAX_SUBNODES
+#define TREECLI_MOUNT_MAX_SUBNODES 16
+#endif
+
+/**
+ * Maximum number of parsers reading the tree.
+ */
+#ifndef TREECLI_MOUNT_MAX_READERS
+#define TREECLI_MOUNT_MAX_READERS 8
+#endif
+
+/**
+ * Number of subnode arrays including the retired ones waiting for readers
+ * to finish.
+ */
+#ifndef TREECLI_MOUNT_POOL_SIZE
+#define TREECLI_MOUNT_POOL_SIZE (2 * TREECLI_MOUNT_MAX_POINTS)
+#endif
+
+
+/**
+ * Subnodes of a mount point. Arrays are never modified after they are
+ * published, every change publishes a new array and retires the old one.
+ */
+struct treecli_mount_array {
+	const struct treecli_node *parent;
+	const struct treecli_node *subnodes[TREECLI_MOUNT_MAX_SUBNODES + 1];
+	uint32_t mounted;
+
+	bool used;
+	/* Epoch at which the array was retired or 0 if it is published. */
+	uint32_t retired;
+};
+
+/**
+ * Table of subtrees attached to static nodes at runtime. A single table is
+ * shared by all parsers reading the tree.
+ *
+ * Readers don't take any locks. A parser announces the epoch it started
+ * reading at and reads published arrays directly. Writers are serialized
+ * by a mutex, they publish new arrays atomically and reuse retired arrays
+ * only after all readers which could see them have finished.
+ */
+struct treecli_mount_table {
+	pthread_mutex_t lock;
+
+	struct treecli_mount_array pool[TREECLI_MOUNT_POOL_SIZE];
+	struct treecli_mount_array *points[TREECLI_MOUNT_MAX_POINTS];
+
+	/* Top node of the tree published by treecli_mount_swap_top or NULL. */
+	const struct treecli_node *top;
+
+	uint32_t epoch;
+	/* Epoch of every active reader, 0 if the reader is not reading. */
+	uint32_t readers[TREECLI_MOUNT_MAX_READERS];
+	bool readers_used[TREECLI_MOUNT_MAX_READERS];
+	/* Top node every reader has moved to. Parsers remap themselves, the
+	 * previous tree is in use until all readers reach the current one. */
+	const struct treecli_node *readers_top[TREECLI_MOUNT_MAX_READERS];
+};
+
+
+int32_t treecli_mount_init(struct treecli_mount_table *table);
+#define TREECLI_MOUNT_INIT_OK 0
+#define TREECLI_MOUNT_INIT_FAILED -1
+
+int32_t treecli_mount_free(struct treecli_mount_table *table);
+#define TREECLI_MOUNT_FREE_OK 0
+#define TREECLI_MOUNT_FREE_FAILED -1
+
+/**
+ * Attach a subtree as a subnode of a statically defined node. Parsers
+ * see the subtree as soon as they start their next operation, no reader
+ * is blocked. If all arrays of the pool wait to be reclaimed, the call
+ * waits for readers still using them (attach and detach must not be
+ * called by a reader).
+ *
+ * @param table Mount table shared by parsers.
+ * @param parent Statically defined node (or the top node) to attach to.
+ * @param subtree Top node of the subtree. It must stay valid until it is
+ *                detached and treecli_mount_synchronize returns.
+ *
+ * @return TREECLI_MOUNT_ATTACH_OK if the subtree was attached or
+ *         TREECLI_MOUNT_ATTACH_EXISTS if the parent already has a subnode
+ *         with the same name or
+ *         TREECLI_MOUNT_ATTACH_FULL if there is no space for another mount or
+ *         TREECLI_MOUNT_ATTACH_FAILED otherwise.
+ */
+int32_t treecli_mount_attach(struct treecli_mount_table *table, const struct treecli_node *parent, const struct treecli_node *subtree);
+#define TREECLI_MOUNT_ATTACH_OK 0
+#define TREECLI_MOUNT_ATTACH_FAILED -1
+#define TREECLI_MOUNT_ATTACH_EXISTS -2
+#define TREECLI_MOUNT_ATTACH_FULL -3
+
+/**
+ * Detach a previously attached subtree. Parsers positioned inside the
+ * subtree are moved to its parent when they start their next operation.
+ * Handles and plans referencing the subtree must not be used anymore.
+ *
+ * @return TREECLI_MOUNT_DETACH_OK if the subtree was detached or
+ *         TREECLI_MOUNT_DETACH_NOT_FOUND if it is not attached to the parent or
+ *         TREECLI_MOUNT_DETACH_FAILED otherwise.
+ */
+int32_t treecli_mount_detach(struct treecli_mount_table *table, const struct treecli_node *parent, const struct treecli_node *subtree);
+#define TREECLI_MOUNT_DETACH_OK 0
+#define TREECLI_MOUNT_DETACH_FAILED -1
+#define TREECLI_MOUNT_DETACH_NOT_FOUND -2
+
+/**
+ * Replace the whole tree used by all parsers reading the table. Parsers
+ * move to the new tree when they start their next operation, their working
+ * positions are remapped to nodes with the same path (or to the root if the
+ * path doesn't exist in the new tree).
+ *
+ * Subtrees mounted to nodes of the previous tree are not visible in the new
+ * one, they should be detached before the previous tree is released.
+ *
+ * @param table Mount table shared by parsers.
+ * @param top Top node of the new tree. It must stay valid until it is
+ *            replaced again and treecli_mount_synchronize returns
+ *            TREECLI_MOUNT_SYNCHRONIZE_OK.
+ *
+ * @return TREECLI_MOUNT_SWAP_TOP_OK if the tree was published or
+ *         TREECLI_MOUNT_SWAP_TOP_FAILED otherwise.
+ */
+int32_t treecli_mount_swap_top(struct treecli_mount_table *table, const struct treecli_node *top);
+#define TREECLI_MOUNT_SWAP_TOP_OK 0
+#define TREECLI_MOUNT_SWAP_TOP_FAILED -1
+
+/**
+ * Wait until all readers active at the time of the call finish. Memory of
+ * detached subtrees can be released afterwards. It must not be called by
+ * a reader.
+ *
+ * If the tree was replaced, every parser is remapped by its own thread when
+ * it starts its next operation. Idle parsers are not waited for, the call
+ * reports them instead. The previous tree can be released only after the
+ * call returns TREECLI_MOUNT_SYNCHRONIZE_OK.
+ *
+ * @return TREECLI_MOUNT_SYNCHRONIZE_OK if no parser uses a previous tree or
+ *         TREECLI_MOUNT_SYNCHRONIZE_PENDING if some parsers have not moved
+ *         to the current tree yet (call it again later) or
+ *         TREECLI_MOUNT_SYNCHRONIZE_FAILED otherwise.
+ */
+int32_t treecli_mount_synchronize(struct treecli_mount_table *table);
+#define TREECLI_MOUNT_SYNCHRONIZE_OK 0
+#define TREECLI_MOUNT_SYNCHRONIZE_FAILED -1
+#define TREECLI_MOUNT_SYNCHRONIZE_PENDING -2
+
+/**
+ * Register a reader. Every parser using the table needs its own reader
+ * (done by treecli_parser_set_mounts). It must be called by the thread
+ * owning the parser.
+ */
+int32_t treecli_mount_reader_register(struct treecli_mount_table *table, struct treecli_parser *parser, uint32_t *reader);
+#define TREECLI_MOUNT_READER_REGISTER_OK 0
+#define TREECLI_MOUNT_READER_REGISTER_FAILED -1
+
+int32_t treecli_mount_reader_unregister(struct treecli_mount_table *table, uint32_t reader);
+#define TREECLI_MOUNT_READER_UNREGISTER_OK 0
+#define TREECLI_MOUNT_READER_UNREGISTER_FAILED -1
+
+/**
+ * Enter and leave a read-side section. Published arrays and nodes reachable
+ * from them stay valid until the section is left.
+ *
+ * @param epoch Epoch of the table at the start of the section, it changes
+ *              with every attach and detach.
+ */
+int32_t treecli_mount_read_lock(struct treecli_mount_table *table, uint32_t reader, uint32_t *epoch);
+#define TREECLI_MOUNT_READ_LOCK_OK 0
+#define TREECLI_MOUNT_READ_LOCK_FAILED -1
+
+int32_t treecli_mount_read_unlock(struct treecli_mount_table *table, uint32_t reader);
+#define TREECLI_MOUNT_READ_UNLOCK_OK 0
+#define TREECLI_MOUNT_READ_UNLOCK_FAILED -1
+
+/**
+ * Get subnodes of a node including mounted subtrees. It can be called only
+ * inside a read-side section.
+ *
+ * @param subnodes NULL terminated array of subnodes, set to NULL if the node
+ *                 has no subtrees mounted (its static subnodes are used).
+ */
+int32_t treecli_mount_subnodes(struct treecli_mount_table *table, const struct treecli_node *parent, const struct treecli_node *const **subnodes);
+#define TREECLI_MOUNT_SUBNODES_OK 0
+#define TREECLI_MOUNT_SUBNODES_FAILED -1
+
+
+#endif
@@ -29,6 +29,11 @@
 #include <string.h>
 
 #include "treecli_parser.h"
+#include "treecli_expr.h"
+#include "treecli_help.h"
+#include "treecli_workspace.h"
+#include "treecli_mount.h"
+#include "treecli_trace.h"
 
 
 int __attribute__((weak)) u_assert_func(const char *a, const char *f, int n) {
@@ -37,6 +42,18 @@ int __attribute__((weak)) u_assert_func(const char *a, const char *f, int n) {
 	return 1;
 }
 
+
+/**
+ * Call the create callback of a dynamic node.
+ */
+static int32_t treecli_parser_dnode_create(struct treecli_parser *parser, const struct treecli_dnode *d, uint32_t index, struct treecli_node *node) {
+	TREECLI_TRACE_BEGIN(TREECLI_TRACE_CREATE);
+	int32_t ret = d->create(parser, index, node, d->create_context);
+	TREECLI_TRACE_END(TREECLI_TRACE_CREATE);
+
+	return ret;
+}
+
 /*
 int32_t treecli_print_tree(const struct treecli_node *top, int32_t indent) {
 	if (u_assert(top != NULL)) {
@@ -60,12 +77,86 @@ int32_t treecli_print_tree(const struct treecli_node *top, int32_t indent) {
 }
 */
 
+const struct treecli_node *treecli_compact_subnodes[1] = {NULL};
+
+
+/**
+ * Fill a node structure describing a node of a compact tree. Tables of the
+ * tree are referenced directly, nothing is copied.
+ */
+static void treecli_parser_compact_node(const struct treecli_compact *compact, uint32_t index, struct treecli_node *node) {
+	const struct treecli_compact_node *n = &(compact->nodes[index]);
+
+	memset(node, 0, sizeof(struct treecli_node));
+	node->name = (char *)&(compact->strings[n->name]);
+	if (compact->help != NULL && compact->help[index] != TREECLI_COMPACT_NONE) {
+		node->help = (char *)&(compact->help_strings[compact->help[index]]);
+	}
+	if (n->values != TREECLI_COMPACT_NONE) {
+		node->values = (const struct treecli_value *(*)[])&(compact->values[n->values]);
+	}
+	if (n->commands != TREECLI_COMPACT_NONE) {
+		node->commands = (const struct treecli_command *(*)[])&(compact->commands[n->commands]);
+	}
+	if (n->dsubnodes != TREECLI_COMPACT_NONE) {
+		node->dsubnodes = (const struct treecli_dnode *(*)[])&(compact->dsubnodes[n->dsubnodes]);
+	}
+}
+
+
+/**
+ * Find the first subnode of a compact node which name is not lower than the
+ * prefix. Subnodes are sorted by their names, binary search is used.
+ */
+static uint32_t treecli_parser_compact_seek(const struct treecli_compact *compact, uint32_t index, const char *prefix, uint32_t len) {
+	uint32_t lo = compact->nodes[index].subnodes;
+	uint32_t hi = lo + compact->nodes[index].subnodes_count;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (strncmp(&(compact->strings[compact->nodes[mid].name]), prefix, len) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+
+/**
+ * Get the compact tree the node at the given depth of a position belongs to
+ * (or NULL if it is not a node of a compact tree) and index of the node in
+ * the tree. Nodes below the top of a compact tree are compact levels, the
+ * top node itself is a static node embedded in the tree structure.
+ */
+static const struct treecli_compact *treecli_parser_level_compact(struct treecli_parser *parser, const struct treecli_parser_pos *pos, uint32_t depth, uint32_t *index) {
+	const struct treecli_node *node = parser->top;
+	*index = 0;
+	if (depth > 0) {
+		if (pos->levels[depth - 1].compact != NULL) {
+			*index = pos->levels[depth - 1].compact_index;
+			return pos->levels[depth - 1].compact;
+		}
+		node = pos->levels[depth - 1].node;
+	}
+
+	if (node == NULL || node->subnodes != &treecli_compact_subnodes) {
+		return NULL;
+	}
+	return (const struct treecli_compact *)((const char *)node - offsetof(struct treecli_compact, top));
+}
+
+
 int32_t treecli_parser_pos_print(struct treecli_parser *parser, bool no_delimiter) {
 	if (u_assert(parser != NULL) ||
 	    u_assert(parser->print_handler != NULL)) {
 		return TREECLI_PARSER_POS_PRINT_FAILED;
 	}
 
+	treecli_parser_read_lock(parser);
+
 	uint32_t len = 0;
 	if (no_delimiter == false) {
 		parser->print_handler("/", parser->print_handler_ctx);
@@ -81,6 +172,14 @@ int32_t treecli_parser_pos_print(struct treecli_parser *parser, bool no_delimite
 			}
 			len += 1;
 		}
+		uint32_t index;
+		const struct treecli_compact *compact = treecli_parser_level_compact(parser, &(parser->pos), i + 1, &index);
+		if (compact != NULL) {
+			const char *name = &(compact->strings[compact->nodes[index].name]);
+			parser->print_handler(name, parser->print_handler_ctx);
+			len += strlen(name);
+			continue;
+		}
 		if (parser->pos.levels[i].node != NULL) {
 			parser->print_handler(parser->pos.levels[i].node->name, parser->print_handler_ctx);
 			len += strlen(parser->pos.levels[i].node->name);
@@ -88,15 +187,10 @@ int32_t treecli_parser_pos_print(struct treecli_parser *parser, bool no_delimite
 		}
 		if (parser->pos.levels[i].dnode != NULL) {
 			/* construct dynamic node */
-			struct treecli_node dnode;
-			memset(&dnode, 0, sizeof(dnode));
-			char dnode_name[100];
-			dnode.name = dnode_name;
-
-			if (parser->pos.levels[i].dnode->create != NULL &&
-			    parser->pos.levels[i].dnode->create(parser, parser->pos.levels[i].dnode_index, &dnode, parser->pos.levels[i].dnode->create_context) >= 0) {
-				parser->print_handler(dnode.name, parser->print_handler_ctx);
-				len += strlen(dnode.name);
+			TREECLI_PARSER_SCRATCH_ARRAY(parser, char, dnode_name, print_name, TREECLI_DNODE_MAX_NAME_LEN);
+			if (treecli_parser_dnode_get_name(parser, parser->pos.levels[i].dnode, parser->pos.levels[i].dnode_index, dnode_name) == TREECLI_PARSER_DNODE_GET_NAME_OK) {
+				parser->print_handler(dnode_name, parser->print_handler_ctx);
+				len += strlen(dnode_name);
 			} else {
 				parser->print_handler("<?>", parser->print_handler_ctx);
 				len += 3;
@@ -108,18 +202,17 @@ int32_t treecli_parser_pos_print(struct treecli_parser *parser, bool no_delimite
 		u_assert(0);
 	}
 
+	treecli_parser_read_unlock(parser);
+
 	return len;
 }
 
 
-int32_t treecli_token_get(struct treecli_parser *parser, const char **pos, const char **token, uint32_t *len) {
-	if (u_assert(parser != NULL) ||
-	    u_assert(pos != NULL) ||
-	    u_assert(token != NULL) ||
-	    u_assert(len != NULL)) {
-		return TREECLI_TOKEN_GET_FAILED;
-	}
-
+/**
+ * Find the next token of the line, see treecli_token_get. Pattern suffixes
+ * are recognized only if patterns is set.
+ */
+static int32_t treecli_token_scan(const char **pos, const char **token, uint32_t *len, bool patterns) {
 	/* eat all whitespaces */
 	while (**pos == ' ' || **pos == '\t') {
 		(*pos)++;
@@ -132,7 +225,24 @@ int32_t treecli_token_get(struct treecli_parser *parser, const char **pos, const
 
 	/* mark start of the token */
 	*token = *pos;
-	if (**pos == '(' || **pos == ')' || **pos == '=' || **pos == '/' || **pos == '?') {
+	if ((**pos == '+' || **pos == '-' || **pos == '|' || **pos == '&' || **pos == '^') && (*pos)[1] == '=') {
+		/* Compound assignment operators. */
+		(*pos) += 2;
+	} else if (**pos == '(') {
+		/* Expressions in parentheses. */
+		uint32_t nesting = 0;
+		do {
+			if (**pos == '(') {
+				nesting++;
+			} else if (**pos == ')') {
+				nesting--;
+			} else if (**pos == '\0') {
+				*len = *pos - *token;
+				return TREECLI_TOKEN_GET_MALFORMED;
+			}
+			(*pos)++;
+		} while (nesting > 0);
+	} else if (**pos == ')' || **pos == '=' || **pos == '/' || **pos == '?') {
 		/* Single character tokens. */
 		(*pos)++;
 	} else if ((**pos >= '0' && **pos <= '9') || **pos == '-' || **pos == '.') {
@@ -144,7 +254,25 @@ int32_t treecli_token_get(struct treecli_parser *parser, const char **pos, const
 	} else if ((**pos >= 'a' && **pos <= 'z') || (**pos >= 'A' && **pos <= 'Z') || **pos == '_') {
 		/* Alphanumeric tokens. */
 		(*pos)++;
-		while ((**pos >= 'a' && **pos <= 'z') || (**pos >= 'A' && **pos <= 'Z') || (**pos >= '0' && **pos <= '9') || **pos == '_' || **pos == '-' || **pos == ':') {
+		while ((**pos >= 'a' && **pos <= 'z') || (**pos >= 'A' && **pos <= 'Z') || (**pos >= '0' && **pos <= '9') || **pos == '_' || **pos == ':' ||
+		       (**pos == '-' && (*pos)[1] != '=')) {
+			(*pos)++;
+		}
+		/* Optional pattern suffix selecting multiple dynamic nodes,
+		 * eg. "if*", "if[0-23]" or "if{1,5,9}". */
+		if (!patterns) {
+			/* Not a node name, no pattern. */
+		} else if (**pos == '*') {
+			(*pos)++;
+		} else if (**pos == '[' || **pos == '{') {
+			char close = (**pos == '[') ? ']' : '}';
+			while (**pos != close) {
+				if (**pos == '\0' || **pos == ' ' || **pos == '\t') {
+					*len = *pos - *token;
+					return TREECLI_TOKEN_GET_MALFORMED;
+				}
+				(*pos)++;
+			}
 			(*pos)++;
 		}
 	} else if (**pos == '.') {
@@ -177,6 +305,23 @@ int32_t treecli_token_get(struct treecli_parser *parser, const char **pos, const
 }
 
 
+int32_t treecli_token_get(struct treecli_parser *parser, const char **pos, const char **token, uint32_t *len) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(pos != NULL) ||
+	    u_assert(token != NULL) ||
+	    u_assert(len != NULL)) {
+		return TREECLI_TOKEN_GET_FAILED;
+	}
+
+	TREECLI_TRACE_BEGIN(TREECLI_TRACE_TOKEN);
+	/* Patterns can replace node names only. */
+	int32_t ret = treecli_token_scan(pos, token, len, parser->parsing_context == TREECLI_PARSER_CONTEXT_NODE);
+	TREECLI_TRACE_END(TREECLI_TRACE_TOKEN);
+
+	return ret;
+}
+
+
 int32_t treecli_parser_init(struct treecli_parser *parser, const struct treecli_node *top) {
 	if (u_assert(parser != NULL) ||
 	    u_assert(top != NULL)) {
@@ -201,36 +346,298 @@ int32_t treecli_parser_free(struct treecli_parser *parser) {
 		return TREECLI_PARSER_FREE_FAILED;
 	}
 
+	treecli_parser_set_mounts(parser, NULL);
+
 	return TREECLI_PARSER_FREE_OK;
 }
 
 
-int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *line) {
-	if (u_assert(parser != NULL) ||
-	    u_assert(line != NULL)) {
+/**
+ * Get length of the name prefix of a pattern token (position of the first
+ * pattern character). It is equal to len if the token is not a pattern.
+ */
+static uint32_t treecli_parser_pattern_start(const char *token, uint32_t len) {
+	uint32_t i = 0;
+	while (i < len && token[i] != '*' && token[i] != '[' && token[i] != '{') {
+		i++;
+	}
+	return i;
+}
+
+
+/**
+ * Match a name of dynamic node instance against a pattern token. Pattern
+ * consists of a name prefix followed by "*" (any suffix), "[0-3,7]" (decimal
+ * suffix within one of the ranges) or "{a,b}" (one of the listed suffixes).
+ *
+ * @return 1 if the name matches, 0 if it doesn't or -1 if the pattern is
+ *         malformed.
+ */
+static int32_t treecli_parser_pattern_match(const char *token, uint32_t len, const char *name) {
+	uint32_t prefix = treecli_parser_pattern_start(token, len);
+	if (prefix == len) {
+		return -1;
+	}
+
+	/* strncmp stops at the end of the name, suffix is valid if the prefix
+	 * matches. */
+	bool prefix_ok = (strncmp(token, name, prefix) == 0);
+	const char *suffix = prefix_ok ? (name + prefix) : "";
+	const char *p = token + prefix + 1;
+	const char *end = token + len - 1;
+
+	if (token[prefix] == '*') {
+		if (prefix + 1 != len) {
+			return -1;
+		}
+		return prefix_ok ? 1 : 0;
+	}
+
+	if (*end != ((token[prefix] == '[') ? ']' : '}')) {
+		return -1;
+	}
+
+	if (token[prefix] == '{') {
+		size_t suffix_len = strlen(suffix);
+		while (p <= end) {
+			const char *item = p;
+			while (p < end && *p != ',') {
+				p++;
+			}
+			if (prefix_ok && (size_t)(p - item) == suffix_len && strncmp(item, suffix, suffix_len) == 0) {
+				return 1;
+			}
+			p++;
+		}
+		return 0;
+	}
+
+	/* Numeric ranges, the whole suffix must be a decimal number. */
+	bool number = (*suffix != '\0');
+	uint32_t n = 0;
+	for (const char *s = suffix; *s != '\0'; s++) {
+		if (*s < '0' || *s > '9') {
+			number = false;
+			break;
+		}
+		n = n * 10 + (uint32_t)(*s - '0');
+	}
+
+	bool match = false;
+	while (p < end) {
+		uint32_t from = 0;
+		if (*p < '0' || *p > '9') {
+			return -1;
+		}
+		while (p < end && *p >= '0' && *p <= '9') {
+			from = from * 10 + (uint32_t)(*p - '0');
+			p++;
+		}
+		uint32_t to = from;
+		if (p < end && *p == '-') {
+			p++;
+			if (p == end || *p < '0' || *p > '9') {
+				return -1;
+			}
+			to = 0;
+			while (p < end && *p >= '0' && *p <= '9') {
+				to = to * 10 + (uint32_t)(*p - '0');
+				p++;
+			}
+		}
+		if (p < end) {
+			if (*p != ',') {
+				return -1;
+			}
+			p++;
+		}
+		if (prefix_ok && number && n >= from && n <= to) {
+			match = true;
+		}
+	}
+
+	return match ? 1 : 0;
+}
+
+
+/**
+ * Check if a token in the node context is a pattern. Only names can be
+ * patterns, quoted strings and expressions may contain the pattern
+ * characters too. Names which don't parse as a pattern are matched
+ * exactly.
+ */
+static bool treecli_parser_pattern_token(const char *token, uint32_t len) {
+	if (!((*token >= 'a' && *token <= 'z') || (*token >= 'A' && *token <= 'Z') || *token == '_')) {
+		return false;
+	}
+	if (treecli_parser_pattern_start(token, len) == len) {
+		return false;
+	}
+	return treecli_parser_pattern_match(token, len, "") >= 0;
+}
+
+
+void treecli_parser_exec_drop(struct treecli_parser *parser) {
+	parser->exec_pending = false;
+	parser->exec_id++;
+	parser->exec_cancel = NULL;
+	parser->exec_cancel_ctx = NULL;
+	parser->generator = NULL;
+}
+
+
+static int32_t treecli_parser_parse(struct treecli_parser *parser, const char *line, const char *pos, struct treecli_parser_pos *parser_pos_saved);
+
+/**
+ * Parse the rest of the line once for a single target of a pattern. Working
+ * position must be already set to the target. Deferred commands cannot be
+ * resumed in the middle of the expansion, they are cancelled. That includes
+ * output generators, they could not wait for a blocked print handler.
+ */
+static int32_t treecli_parser_parse_target(struct treecli_parser *parser, const char *line, const char *pos, struct treecli_parser_pos *base) {
+	int32_t ret = treecli_parser_parse(parser, line, pos, base);
+
+	if (ret == TREECLI_PARSER_PARSE_LINE_PENDING) {
+		treecli_parser_cancel(parser);
+		return TREECLI_PARSER_PARSE_LINE_COMMAND_FAILED;
+	}
+
+	return ret;
+}
+
+
+/**
+ * Expand a pattern token over dynamic nodes at the current working position.
+ * The instances are enumerated only once and the rest of the line is parsed
+ * for every matching one, starting at the current working position. All
+ * targets are processed in a single batch, result of each of them is passed
+ * to the target handler. Without TREECLI_PARSER_ALLOW_EXEC the rest of the
+ * line is parsed for the first target only. Working position is always
+ * restored to parser_pos_saved.
+ */
+static int32_t __attribute__((noinline)) treecli_parser_parse_pattern(struct treecli_parser *parser, const char *line, const char *pos, const char *token, uint32_t len, struct treecli_parser_pos *parser_pos_saved) {
+	struct treecli_node node;
+	int32_t res = treecli_parser_get_current_node(parser, &node);
+	if (res == TREECLI_PARSER_GET_CURRENT_NODE_ROOT) {
+		memcpy(&node, parser->top, sizeof(struct treecli_node));
+	} else if (res == TREECLI_PARSER_GET_CURRENT_NODE_FAILED) {
+		treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 		return TREECLI_PARSER_PARSE_LINE_FAILED;
 	}
 
+	/* Every target starts at the position the pattern was found at. */
+	struct treecli_parser_pos base;
+	treecli_parser_pos_copy(&base, &(parser->pos));
+	uint32_t pattern_pos = parser->error_pos;
+	uint32_t pattern_len = parser->error_len;
+
+	uint32_t prefix = treecli_parser_pattern_start(token, len);
+	bool exec = (parser->mode & TREECLI_PARSER_ALLOW_EXEC);
+	bool done = false;
+	uint32_t targets = 0;
+	int32_t ret = TREECLI_PARSER_PARSE_LINE_OK;
+	uint32_t error_pos = 0;
+	uint32_t error_len = 0;
+
+	treecli_parser_batch_begin(parser);
+
+	if (node.dsubnodes != NULL) {
+		const struct treecli_dnode *d;
+		for (size_t j = 0; (d = (*(node.dsubnodes))[j]) != NULL && !done; j++) {
+			uint32_t i = 0;
+			bool sorted = false;
+			if (d->seek != NULL) {
+				if (d->seek(parser, token, prefix, &i, d->create_context) < 0) {
+					continue;
+				}
+				sorted = true;
+			}
+			for (; i < TREECLI_DNODE_MAX_COUNT && !done; i++) {
+				char name[TREECLI_DNODE_MAX_NAME_LEN];
+				if (treecli_parser_dnode_get_name(parser, d, i, name) != TREECLI_PARSER_DNODE_GET_NAME_OK) {
+					break;
+				}
+				if (sorted && strncmp(token, name, prefix) != 0) {
+					/* No more instances starting with the prefix. */
+					break;
+				}
+				if (treecli_parser_pattern_match(token, len, name) != 1) {
+					continue;
+				}
+				targets++;
+
+				struct treecli_parser_pos_level target = {.node = NULL, .dnode = d, .dnode_index = i};
+				int32_t result;
+				treecli_parser_pos_copy(&(parser->pos), &base);
+				if (treecli_parser_pos_move(&(parser->pos), &target) != TREECLI_PARSER_POS_MOVE_OK) {
+					result = TREECLI_PARSER_PARSE_LINE_CANNOT_MOVE;
+				} else {
+					result = treecli_parser_parse_target(parser, line, pos, &base);
+				}
+
+				/* Report the result with the working position set
+				 * to the target. */
+				if (exec && parser->target_handler != NULL) {
+					treecli_parser_pos_copy(&(parser->pos), &base);
+					treecli_parser_pos_move(&(parser->pos), &target);
+					parser->target_handler(parser, result, parser->target_handler_ctx);
+				}
+
+				/* The first failure is returned. */
+				if (result < 0 && ret == TREECLI_PARSER_PARSE_LINE_OK) {
+					ret = result;
+					error_pos = parser->error_pos;
+					error_len = parser->error_len;
+				}
+
+				if (!exec) {
+					done = true;
+				}
+			}
+		}
+	}
+
+	if (treecli_parser_batch_end(parser) != TREECLI_PARSER_BATCH_END_OK && ret == TREECLI_PARSER_PARSE_LINE_OK) {
+		ret = TREECLI_PARSER_PARSE_LINE_FAILED;
+	}
+	treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
+
+	if (targets == 0) {
+		parser->error_pos = pattern_pos;
+		parser->error_len = pattern_len;
+		return TREECLI_PARSER_PARSE_LINE_NO_MATCHES;
+	}
+	if (ret < 0) {
+		parser->error_pos = error_pos;
+		parser->error_len = error_len;
+	}
+
+	return ret;
+}
+
+
+/**
+ * Parse the line starting at pos. Working position is restored to
+ * parser_pos_saved if the line fails or if it doesn't end with a tree
+ * traversal action.
+ */
+static int32_t treecli_parser_parse(struct treecli_parser *parser, const char *line, const char *pos, struct treecli_parser_pos *parser_pos_saved) {
 	int32_t res;
-	const char *pos = line;
 	const char *token = NULL;
-	uint32_t len;
-
-	/* save current position in case we will need to rollback the whole command */
-	struct treecli_parser_pos parser_pos_saved;
-	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+	uint32_t len = 0;
 
 	/* We need an information if the last matched action was a tree traversal
 	 * action or not. We are setting this to 1 when we move in the tree. */
 	int last_match_subnode = 0;
 
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_matches, matches, matches);
+
 	parser->parsing_context = TREECLI_PARSER_CONTEXT_NODE;
 
 	/* Iterate over the whole command and get all tokens */
 	while ((res = treecli_token_get(parser, &pos, &token, &len)) == TREECLI_TOKEN_GET_OK) {
 
 		last_match_subnode = 0;
-		struct treecli_matches matches;
 
 		/* these status variables are used to determine position of last
 		 * matched token (whether it was successful or not). Can be used
@@ -238,39 +645,56 @@ int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *lin
 		parser->error_pos = (uint32_t)(pos - line) - len;
 		parser->error_len = len;
 
-		int32_t ret = treecli_parser_get_matches(parser, token, len, &matches);
+		/* Name directly followed by a question mark requests help
+		 * for entries starting with the name only. */
+		if (parser->parsing_context == TREECLI_PARSER_CONTEXT_NODE && *pos == '?' &&
+		    ((*token >= 'a' && *token <= 'z') || (*token >= 'A' && *token <= 'Z') || *token == '_')) {
+			pos++;
+			if (parser->mode & TREECLI_PARSER_ALLOW_EXEC) {
+				treecli_parser_help_filter(parser, token, len);
+			}
+			continue;
+		}
+
+		/* Patterns select multiple dynamic nodes, the rest of the
+		 * line is parsed for each of them. */
+		if (parser->parsing_context == TREECLI_PARSER_CONTEXT_NODE && treecli_parser_pattern_token(token, len)) {
+			return treecli_parser_parse_pattern(parser, line, pos, token, len, parser_pos_saved);
+		}
+
+		int32_t ret = treecli_parser_get_matches(parser, token, len, matches);
 
 		/* We requested matches for a token we got previously. Now lets
 		 * handle all uncommon states (failed, no matches, multiple matches).
 		 * In all these cases we need to go back to position at which
 		 * we started parsing. */
 		if (ret == TREECLI_PARSER_GET_MATCHES_FAILED) {
-			treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+			treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 			return TREECLI_PARSER_PARSE_LINE_FAILED;
 		}
 
 		if (ret == TREECLI_PARSER_GET_MATCHES_NONE) {
-			treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+			treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 			return TREECLI_PARSER_PARSE_LINE_NO_MATCHES;
 		}
 		if (ret == TREECLI_PARSER_GET_MATCHES_MULTIPLE) {
 			/* This case is slightly different. We need to know the best
 			 * match that occured for the purpose of possible autocompletion. */
 			if ((parser->mode & TREECLI_PARSER_ALLOW_BEST_MATCH) && parser->best_match_handler) {
-				parser->best_match_handler(matches.best_match, matches.best_match_len, parser->error_pos, parser->error_len, parser->best_match_handler_ctx);
+				parser->best_match_handler(matches->best_match, matches->best_match_len, parser->error_pos, parser->error_len, parser->best_match_handler_ctx);
 			}
-			treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+			treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 			return TREECLI_PARSER_PARSE_LINE_MULTIPLE_MATCHES;
 		}
 
 		/* Now handle all "normal" states - only one match occured. We are
 		 * not returning in these cases. */
-		if (matches.count == 1) {
+		if (matches->count == 1) {
 
 			/* One single match is also the one that is the best. Call
 			 * best match handler if requested. */
 			if ((parser->mode & TREECLI_PARSER_ALLOW_BEST_MATCH) && parser->best_match_handler) {
-				parser->best_match_handler(matches.best_match, matches.best_match_len, parser->error_pos, parser->error_len, parser->best_match_handler_ctx);
+				parser->best_match_handler(matches->best_match, matches->best_match_len, parser->error_pos, parser->error_len, parser->best_match_handler_ctx);
 			}
 
 			/* Following tokens make tree traversal actions - going to
@@ -280,7 +704,7 @@ int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *lin
 			 * to 1 to indicate that tree traversal action occured. */
 			if (ret == TREECLI_PARSER_GET_MATCHES_TOP) {
 				if (treecli_parser_pos_root(&(parser->pos)) != TREECLI_PARSER_POS_ROOT_OK) {
-					treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+					treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 					return TREECLI_PARSER_PARSE_LINE_CANNOT_MOVE;
 				}
 				last_match_subnode = 1;
@@ -288,23 +712,31 @@ int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *lin
 
 			if (ret == TREECLI_PARSER_GET_MATCHES_UP) {
 				if (treecli_parser_pos_up(&(parser->pos)) != TREECLI_PARSER_POS_UP_OK) {
-					treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+					treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 					return TREECLI_PARSER_PARSE_LINE_CANNOT_MOVE;
 				}
 				last_match_subnode = 1;
 			}
 
 			if (ret == TREECLI_PARSER_GET_MATCHES_SUBNODE) {
-				if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = matches.subnode, .dnode = NULL}) != TREECLI_PARSER_POS_MOVE_OK) {
-					treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+				if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = matches->subnode, .dnode = NULL}) != TREECLI_PARSER_POS_MOVE_OK) {
+					treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 					return TREECLI_PARSER_PARSE_LINE_CANNOT_MOVE;
 				}
 				last_match_subnode = 1;
 			}
 
 			if (ret == TREECLI_PARSER_GET_MATCHES_DSUBNODE) {
-				if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = matches.dsubnode, .dnode_index = matches.dsubnode_index}) != TREECLI_PARSER_POS_MOVE_OK) {
-					treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+				if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = matches->dsubnode, .dnode_index = matches->dsubnode_index}) != TREECLI_PARSER_POS_MOVE_OK) {
+					treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
+					return TREECLI_PARSER_PARSE_LINE_CANNOT_MOVE;
+				}
+				last_match_subnode = 1;
+			}
+
+			if (ret == TREECLI_PARSER_GET_MATCHES_COMPACT) {
+				if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = NULL, .compact = matches->compact, .compact_index = matches->compact_index}) != TREECLI_PARSER_POS_MOVE_OK) {
+					treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 					return TREECLI_PARSER_PARSE_LINE_CANNOT_MOVE;
 				}
 				last_match_subnode = 1;
@@ -315,9 +747,25 @@ int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *lin
 			 * Return value is also checked and need to be nonnegative.
 			 * Otherwise we assume that command execution failed. */
 			if (ret == TREECLI_PARSER_GET_MATCHES_COMMAND) {
-				if ((parser->mode & TREECLI_PARSER_ALLOW_EXEC) && matches.command->exec != NULL) {
-					if (matches.command->exec(parser, matches.command->exec_context) < 0) {
-						treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+				if ((parser->mode & TREECLI_PARSER_ALLOW_EXEC) && matches->command->exec != NULL) {
+					TREECLI_TRACE_BEGIN(TREECLI_TRACE_EXEC);
+					int32_t exec_ret = matches->command->exec(parser, matches->command->exec_context);
+					TREECLI_TRACE_END(TREECLI_TRACE_EXEC);
+
+					/* Command continues asynchronously. Save the
+					 * parsing state, it is resumed when the command
+					 * completes. */
+					if (exec_ret == TREECLI_PARSER_EXEC_PENDING && parser->exec_pending) {
+						parser->exec_line_pos = (uint32_t)(pos - line);
+						treecli_parser_pos_copy(&(parser->exec_pos_saved), parser_pos_saved);
+						return TREECLI_PARSER_PARSE_LINE_PENDING;
+					}
+					if (parser->exec_pending) {
+						treecli_parser_exec_drop(parser);
+					}
+
+					if (exec_ret < 0) {
+						treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 						return TREECLI_PARSER_PARSE_LINE_COMMAND_FAILED;
 					};
 				}
@@ -325,20 +773,26 @@ int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *lin
 
 			if (ret == TREECLI_PARSER_GET_MATCHES_VALUE) {
 				if (parser->mode & TREECLI_PARSER_ALLOW_EXEC) {
-					parser->parsing_value = matches.value;
+					parser->parsing_value = matches->value;
 				}
 			}
 
 			if (ret == TREECLI_PARSER_GET_MATCHES_VALUE_OPERATOR) {
-				/** @todo Always assignment for now. Add code for multiple operators. */
 				if (parser->mode & TREECLI_PARSER_ALLOW_EXEC) {
+					parser->parsing_operator = matches->value_operator;
 				}
 			}
 
 			if (ret == TREECLI_PARSER_GET_MATCHES_VALUE_LITERAL) {
 				if (parser->mode & TREECLI_PARSER_ALLOW_EXEC) {
-					if (treecli_parser_str_to_value(parser, parser->parsing_value, token, len) != TREECLI_PARSER_STR_TO_VALUE_OK) {
-						treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+					int32_t value_ret;
+					if (parser->parsing_operator == TREECLI_VALUE_OP_ASSIGN) {
+						value_ret = treecli_parser_str_to_value(parser, parser->parsing_value, token, len);
+					} else {
+						value_ret = treecli_parser_str_update_value(parser, parser->parsing_value, parser->parsing_operator, token, len);
+					}
+					if (value_ret < 0) {
+						treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 						return TREECLI_PARSER_PARSE_LINE_VALUE_FAILED;
 					}
 				}
@@ -358,14 +812,14 @@ int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *lin
 	 * suggestions. */
 	if (parser->mode & TREECLI_PARSER_ALLOW_SUGGESTIONS) {
 		treecli_parser_set_mode(parser, TREECLI_PARSER_ALLOW_MATCHES);
-		struct treecli_matches matches;
-		treecli_parser_get_matches(parser, "", 0, &matches);
+		treecli_parser_get_matches(parser, "", 0, matches);
 	}
 
-	/* Reset the position if command execution was disabled or if the last
-	 * executed action was not tree traversal */
-	if (last_match_subnode == 0 || !(parser->mode & TREECLI_PARSER_ALLOW_EXEC)) {
-		treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+	/* Reset the position if command execution was disabled, if the last
+	 * executed action was not tree traversal or if the line ended with
+	 * a malformed token. */
+	if (last_match_subnode == 0 || !(parser->mode & TREECLI_PARSER_ALLOW_EXEC) || res == TREECLI_TOKEN_GET_MALFORMED) {
+		treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
 	}
 
 	/* Handle some special cases, eg. no value literal at the end. Save position
@@ -390,78 +844,293 @@ int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *lin
 }
 
 
-int32_t treecli_parser_set_print_handler(struct treecli_parser *parser, int32_t (*print_handler)(const char *line, void *ctx), void *ctx) {
+int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *line) {
 	if (u_assert(parser != NULL) ||
-	    u_assert(print_handler != NULL)) {
-		return TREECLI_PARSER_SET_PRINT_HANDLER_FAILED;
+	    u_assert(line != NULL) ||
+	    TREECLI_PARSER_NO_WORKSPACE(parser)) {
+		return TREECLI_PARSER_PARSE_LINE_FAILED;
 	}
 
-	parser->print_handler = print_handler;
-	parser->print_handler_ctx = ctx;
+	/* Nothing can be parsed until the pending command completes. */
+	if (parser->exec_pending) {
+		return TREECLI_PARSER_PARSE_LINE_FAILED;
+	}
 
-	return TREECLI_PARSER_SET_PRINT_HANDLER_OK;
-}
+	/* Mounted subtrees cannot be released while the line is parsed. */
+	treecli_parser_read_lock(parser);
 
+	/* save current position in case we will need to rollback the whole command */
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_parser_pos, parser_pos_saved, line_pos);
+	treecli_parser_pos_copy(parser_pos_saved, &(parser->pos));
 
-int32_t treecli_parser_set_match_handler(struct treecli_parser *parser, int32_t (*match_handler)(const char *token, enum treecli_match_type match_type, void *ctx), void *ctx) {
-	if (u_assert(parser != NULL) ||
-	    u_assert(match_handler != NULL)) {
-		return TREECLI_PARSER_SET_MATCH_HANDLER_FAILED;
+	int32_t ret = treecli_parser_parse(parser, line, line, parser_pos_saved);
+	if (treecli_parser_flush_changes(parser) != TREECLI_PARSER_FLUSH_CHANGES_OK && ret == TREECLI_PARSER_PARSE_LINE_OK) {
+		ret = TREECLI_PARSER_PARSE_LINE_FAILED;
 	}
 
-	parser->match_handler = match_handler;
-	parser->match_handler_ctx = ctx;
+	treecli_parser_read_unlock(parser);
 
-	return TREECLI_PARSER_SET_MATCH_HANDLER_OK;
+	return ret;
 }
 
 
-int32_t treecli_parser_set_best_match_handler(struct treecli_parser *parser, int32_t (*best_match_handler)(const char *token, uint32_t token_len, uint32_t match_pos, uint32_t match_len, void *ctx), void *ctx) {
+int32_t treecli_parser_exec_defer(struct treecli_parser *parser, struct treecli_completion *completion, void (*cancel)(void *ctx), void *ctx) {
 	if (u_assert(parser != NULL) ||
-	    u_assert(best_match_handler != NULL)) {
-		return TREECLI_PARSER_SET_BEST_MATCH_HANDLER_FAILED;
+	    u_assert(completion != NULL)) {
+		return TREECLI_PARSER_EXEC_DEFER_FAILED;
 	}
 
-	parser->best_match_handler = best_match_handler;
-	parser->best_match_handler_ctx = ctx;
+	if (parser->exec_pending) {
+		return TREECLI_PARSER_EXEC_DEFER_FAILED;
+	}
 
-	return TREECLI_PARSER_SET_BEST_MATCH_HANDLER_OK;
+	parser->exec_pending = true;
+	parser->exec_id++;
+	parser->exec_cancel = cancel;
+	parser->exec_cancel_ctx = ctx;
+
+	completion->parser = parser;
+	completion->id = parser->exec_id;
+
+	return TREECLI_PARSER_EXEC_PENDING;
 }
 
 
-uint32_t treecli_parser_strmatch(const char *s1, const char *s2) {
-	if(u_assert(s1 != NULL) ||
-	   u_assert(s2 != NULL)) {
-		return 0;
+/**
+ * Continue parsing the line after the completed command. The caller holds
+ * the read-side section.
+ */
+static int32_t treecli_parser_resume(struct treecli_parser *parser, const struct treecli_completion *completion, const char *line, int32_t result) {
+	/* Ignore completions of cancelled or already finished commands. */
+	if (parser->exec_pending == false || completion->parser != parser || completion->id != parser->exec_id) {
+		return TREECLI_PARSER_PARSE_LINE_FAILED;
 	}
+	parser->exec_pending = false;
 
-	int32_t p = 0;
-	while (*s1 && *s2 && *s1 == *s2) {
-		s1++;
-		s2++;
-		p++;
+	/* The saved position is overwritten if another command of the line
+	 * is deferred, it is kept on the stack. */
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->exec_pos_saved));
+
+	if (result < 0) {
+		/* error_pos still points to the failed command. */
+		treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+		return TREECLI_PARSER_PARSE_LINE_COMMAND_FAILED;
 	}
 
-	return p;
+	int32_t ret = treecli_parser_parse(parser, line, line + parser->exec_line_pos, &parser_pos_saved);
+	if (treecli_parser_flush_changes(parser) != TREECLI_PARSER_FLUSH_CHANGES_OK && ret == TREECLI_PARSER_PARSE_LINE_OK) {
+		ret = TREECLI_PARSER_PARSE_LINE_FAILED;
+	}
+
+	return ret;
 }
 
 
-int32_t treecli_parser_resolve_match(struct treecli_parser *parser, struct treecli_matches *matches, const char *token) {
-	if(u_assert(parser != NULL) ||
-	   u_assert(token != NULL) ||
-	   u_assert(matches != NULL)) {
-		return TREECLI_PARSER_RESOLVE_MATCH_FAILED;
+int32_t treecli_parser_resume_line(struct treecli_parser *parser, const struct treecli_completion *completion, const char *line, int32_t result) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(completion != NULL) ||
+	    u_assert(line != NULL)) {
+		return TREECLI_PARSER_PARSE_LINE_FAILED;
 	}
 
-	if (parser->mode & TREECLI_PARSER_ALLOW_MATCHES) {
+	treecli_parser_read_lock(parser);
+	int32_t ret = treecli_parser_resume(parser, completion, line, result);
+	treecli_parser_read_unlock(parser);
 
-		/** @todo determine the match type */
-		if (parser->match_handler) {
-			parser->match_handler(token, TREECLI_MATCH_TYPE_NODE, parser->match_handler_ctx);
-		}
+	return ret;
+}
+
+
+int32_t treecli_parser_cancel(struct treecli_parser *parser) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_CANCEL_FAILED;
 	}
 
-	/* Find out if the current match is better than the previously saved
+	if (parser->exec_pending == false) {
+		return TREECLI_PARSER_CANCEL_FAILED;
+	}
+	parser->exec_pending = false;
+
+	if (parser->exec_cancel != NULL) {
+		parser->exec_cancel(parser->exec_cancel_ctx);
+	}
+	parser->generator = NULL;
+	treecli_parser_pos_copy(&(parser->pos), &(parser->exec_pos_saved));
+
+	return TREECLI_PARSER_CANCEL_OK;
+}
+
+
+int32_t treecli_parser_exec_generator(struct treecli_parser *parser, int32_t (*generator)(struct treecli_parser *parser, void *ctx), void *ctx) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(generator != NULL)) {
+		return TREECLI_PARSER_EXEC_GENERATOR_FAILED;
+	}
+
+	if (treecli_parser_exec_defer(parser, &(parser->generator_completion), NULL, NULL) != TREECLI_PARSER_EXEC_PENDING) {
+		return TREECLI_PARSER_EXEC_GENERATOR_FAILED;
+	}
+	parser->generator = generator;
+	parser->generator_ctx = ctx;
+	treecli_parser_pos_copy(&(parser->generator_pos), &(parser->pos));
+
+	return TREECLI_PARSER_EXEC_PENDING;
+}
+
+
+int32_t treecli_parser_generator_run(struct treecli_parser *parser, uint32_t budget) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_GENERATOR_RUN_FAILED;
+	}
+
+	if (parser->generator == NULL || TREECLI_PARSER_NO_WORKSPACE(parser)) {
+		return TREECLI_PARSER_GENERATOR_RUN_FAILED;
+	}
+
+	/* The working position may have been changed since the command was
+	 * executed. Generators run at the command's node. */
+	treecli_parser_read_lock(parser);
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_parser_pos, pos_saved, generator_pos);
+	treecli_parser_pos_copy(pos_saved, &(parser->pos));
+	treecli_parser_pos_copy(&(parser->pos), &(parser->generator_pos));
+
+	int32_t ret = TREECLI_PARSER_GENERATOR_MORE;
+	parser->print_blocked = false;
+	for (uint32_t i = 0; budget == 0 || i < budget; i++) {
+		if (budget != 0 && parser->print_blocked) {
+			break;
+		}
+
+		ret = parser->generator(parser, parser->generator_ctx);
+		if (ret != TREECLI_PARSER_GENERATOR_MORE) {
+			parser->generator = NULL;
+			break;
+		}
+	}
+
+	treecli_parser_pos_copy(&(parser->pos), pos_saved);
+	treecli_parser_read_unlock(parser);
+
+	return ret;
+}
+
+
+int32_t treecli_parser_print(struct treecli_parser *parser, const char *line) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(line != NULL)) {
+		return TREECLI_PARSER_PRINT_FAILED;
+	}
+
+	if (parser->print_handler == NULL) {
+		return TREECLI_PARSER_PRINT_FAILED;
+	}
+
+	TREECLI_TRACE_BEGIN(TREECLI_TRACE_PRINT);
+	int32_t ret = parser->print_handler(line, parser->print_handler_ctx);
+	TREECLI_TRACE_END(TREECLI_TRACE_PRINT);
+	if (ret == TREECLI_PRINT_WOULD_BLOCK) {
+		parser->print_blocked = true;
+	}
+
+	return ret;
+}
+
+
+int32_t treecli_parser_set_print_handler(struct treecli_parser *parser, int32_t (*print_handler)(const char *line, void *ctx), void *ctx) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(print_handler != NULL)) {
+		return TREECLI_PARSER_SET_PRINT_HANDLER_FAILED;
+	}
+
+	parser->print_handler = print_handler;
+	parser->print_handler_ctx = ctx;
+
+	return TREECLI_PARSER_SET_PRINT_HANDLER_OK;
+}
+
+
+int32_t treecli_parser_set_match_handler(struct treecli_parser *parser, int32_t (*match_handler)(const char *token, enum treecli_match_type match_type, void *ctx), void *ctx) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(match_handler != NULL)) {
+		return TREECLI_PARSER_SET_MATCH_HANDLER_FAILED;
+	}
+
+	parser->match_handler = match_handler;
+	parser->match_handler_ctx = ctx;
+
+	return TREECLI_PARSER_SET_MATCH_HANDLER_OK;
+}
+
+
+int32_t treecli_parser_set_best_match_handler(struct treecli_parser *parser, int32_t (*best_match_handler)(const char *token, uint32_t token_len, uint32_t match_pos, uint32_t match_len, void *ctx), void *ctx) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(best_match_handler != NULL)) {
+		return TREECLI_PARSER_SET_BEST_MATCH_HANDLER_FAILED;
+	}
+
+	parser->best_match_handler = best_match_handler;
+	parser->best_match_handler_ctx = ctx;
+
+	return TREECLI_PARSER_SET_BEST_MATCH_HANDLER_OK;
+}
+
+
+int32_t treecli_parser_set_target_handler(struct treecli_parser *parser, int32_t (*target_handler)(struct treecli_parser *parser, int32_t result, void *ctx), void *ctx) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_SET_TARGET_HANDLER_FAILED;
+	}
+
+	parser->target_handler = target_handler;
+	parser->target_handler_ctx = ctx;
+
+	return TREECLI_PARSER_SET_TARGET_HANDLER_OK;
+}
+
+
+uint32_t treecli_parser_strmatch(const char *s1, const char *s2) {
+	if(u_assert(s1 != NULL) ||
+	   u_assert(s2 != NULL)) {
+		return 0;
+	}
+
+	int32_t p = 0;
+	while (*s1 && *s2 && *s1 == *s2) {
+		s1++;
+		s2++;
+		p++;
+	}
+
+	return p;
+}
+
+
+int32_t treecli_parser_resolve_match(struct treecli_parser *parser, struct treecli_matches *matches, const char *token) {
+	if(u_assert(parser != NULL) ||
+	   u_assert(token != NULL) ||
+	   u_assert(matches != NULL)) {
+		return TREECLI_PARSER_RESOLVE_MATCH_FAILED;
+	}
+
+	if (parser->mode & TREECLI_PARSER_ALLOW_MATCHES) {
+
+		/* Do not flood the output with suggestions, only a limited
+		 * number of them is reported. Indicate that some were omitted. */
+		if (parser->help_limit > 0 && parser->matches_reported >= parser->help_limit) {
+			if (parser->matches_truncated == false && parser->print_handler) {
+				parser->print_handler(TREECLI_PARSER_MATCHES_MORE, parser->print_handler_ctx);
+			}
+			parser->matches_truncated = true;
+		} else {
+			/** @todo determine the match type */
+			if (parser->match_handler) {
+				parser->match_handler(token, TREECLI_MATCH_TYPE_NODE, parser->match_handler_ctx);
+			}
+			parser->matches_reported++;
+		}
+	}
+
+	/* Find out if the current match is better than the previously saved
 	 * best match. If yes, save it. */
 	if (matches->count <= 1) {
 		strcpy(matches->best_match, token);
@@ -496,28 +1165,89 @@ int32_t treecli_parser_try_match(struct treecli_parser *parser, struct treecli_m
 }
 
 
-int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *token, uint32_t len, struct treecli_matches *matches) {
-	if (u_assert(parser != NULL) ||
-	    u_assert(token != NULL) ||
-	    u_assert(matches != NULL)) {
+/**
+ * Determine if there is any reason to continue enumerating candidates for
+ * the token. Enumeration can stop if the token is already ambiguous (it
+ * cannot become unambiguous again) and:
+ *
+ * - suggestions are not requested or they don't fit within the help limit
+ * - the best match is not requested or it cannot get shorter (all
+ *   candidates are prefixed by the token)
+ */
+static bool treecli_parser_matches_done(struct treecli_parser *parser, struct treecli_matches *matches, uint32_t len) {
+	if (matches->count < 2) {
+		return false;
+	}
+	if ((parser->mode & TREECLI_PARSER_ALLOW_MATCHES) && !parser->matches_truncated) {
+		return false;
+	}
+	if ((parser->mode & TREECLI_PARSER_ALLOW_BEST_MATCH) && matches->best_match_len > len) {
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Value operators and their tokens.
+ */
+static const struct {
+	const char *name;
+	enum treecli_value_operator op;
+} treecli_parser_operators[] = {
+	{"=", TREECLI_VALUE_OP_ASSIGN},
+	{"+=", TREECLI_VALUE_OP_ADD},
+	{"-=", TREECLI_VALUE_OP_SUB},
+	{"|=", TREECLI_VALUE_OP_OR},
+	{"&=", TREECLI_VALUE_OP_AND},
+	{"^=", TREECLI_VALUE_OP_XOR},
+};
+
+
+/**
+ * Check if compound operators can be applied to the value. It must either
+ * have the update callback or it must be a plain INT32/UINT32/DATA variable
+ * (a 32 bit word) without a getter and a setter which can be modified
+ * atomically.
+ */
+static bool treecli_parser_value_updatable(const struct treecli_value *value) {
+	if (value->value_type != TREECLI_VALUE_INT32 && value->value_type != TREECLI_VALUE_UINT32 && value->value_type != TREECLI_VALUE_DATA) {
+		return false;
+	}
+	if (value->update != NULL) {
+		return true;
+	}
+
+	return value->value != NULL && value->get == NULL && value->set == NULL;
+}
+
+
+static int32_t treecli_parser_match_level(struct treecli_parser *parser, const char *token, uint32_t len, struct treecli_matches *matches) {
+	if (TREECLI_PARSER_NO_WORKSPACE(parser)) {
 		return TREECLI_PARSER_GET_MATCHES_FAILED;
 	}
 
 	/* We are trying to get matches of different types. Match count will
 	 * be modified if a match occurs. */
 	matches->count = 0;
+	parser->matches_reported = 0;
+	parser->matches_truncated = false;
 
 	int32_t ret = TREECLI_PARSER_GET_MATCHES_NONE;
 
 	/* Get current working position - we are matching only at this level. */
-	struct treecli_node node;
-	int32_t res = treecli_parser_get_current_node(parser, &node);
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_node, node, node);
+	int32_t res = treecli_parser_get_current_node(parser, node);
 	if (res == TREECLI_PARSER_GET_CURRENT_NODE_ROOT) {
-		memcpy(&node, parser->top, sizeof(struct treecli_node));
+		memcpy(node, parser->top, sizeof(struct treecli_node));
 	} else if (res == TREECLI_PARSER_GET_CURRENT_NODE_FAILED) {
 		return TREECLI_PARSER_GET_MATCHES_FAILED;
 	}
 
+	/* Names of dynamic nodes being matched. */
+	TREECLI_PARSER_SCRATCH_NAME(parser, name);
+
 	if (parser->parsing_context == TREECLI_PARSER_CONTEXT_VALUE_LITERAL) {
 		/** @todo add matches of numbers, enums, etc. */
 		ret = TREECLI_PARSER_GET_MATCHES_VALUE_LITERAL;
@@ -538,16 +1268,26 @@ int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *to
 		}
 
 		/* Match value operators. */
-		if (parser->parsing_context == TREECLI_PARSER_CONTEXT_VALUE_OPERATOR &&
-		    treecli_parser_try_match(parser, matches, token, len, "=") == TREECLI_PARSER_TRY_MATCH_OK) {
-			ret = TREECLI_PARSER_GET_MATCHES_VALUE_OPERATOR;
-			parser->parsing_context = TREECLI_PARSER_CONTEXT_VALUE_LITERAL;
+		if (parser->parsing_context == TREECLI_PARSER_CONTEXT_VALUE_OPERATOR) {
+			for (size_t i = 0; i < sizeof(treecli_parser_operators) / sizeof(treecli_parser_operators[0]); i++) {
+				/* Offer compound operators only if they can be applied. */
+				if (treecli_parser_operators[i].op != TREECLI_VALUE_OP_ASSIGN && !treecli_parser_value_updatable(parser->parsing_value)) {
+					continue;
+				}
+				if (treecli_parser_try_match(parser, matches, token, len, treecli_parser_operators[i].name) == TREECLI_PARSER_TRY_MATCH_OK) {
+					matches->value_operator = treecli_parser_operators[i].op;
+					ret = TREECLI_PARSER_GET_MATCHES_VALUE_OPERATOR;
+					parser->parsing_context = TREECLI_PARSER_CONTEXT_VALUE_LITERAL;
+				}
+			}
 		}
 
-		/* Match all statically set subnodes. */
-		if (node.subnodes != NULL) {
+		/* Match all statically set and mounted subnodes. */
+		const struct treecli_node *const *subnodes;
+		treecli_parser_current_subnodes(parser, node, &subnodes);
+		if (subnodes != NULL) {
 			const struct treecli_node *n;
-			for (size_t i = 0; (n = (*(node.subnodes))[i]) != NULL; i++) {
+			for (size_t i = 0; (n = subnodes[i]) != NULL && !treecli_parser_matches_done(parser, matches, len); i++) {
 				if (treecli_parser_try_match(parser, matches, token, len, n->name) == TREECLI_PARSER_TRY_MATCH_OK) {
 					matches->subnode = n;
 					ret = TREECLI_PARSER_GET_MATCHES_SUBNODE;
@@ -555,13 +1295,35 @@ int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *to
 			}
 		}
 
+		/* Match subnodes of a compact tree. They are sorted, only those
+		 * starting with the token are tried. */
+		uint32_t index;
+		const struct treecli_compact *compact = treecli_parser_level_compact(parser, &(parser->pos), parser->pos.depth, &index);
+		if (compact != NULL) {
+			uint32_t end = compact->nodes[index].subnodes + compact->nodes[index].subnodes_count;
+			for (uint32_t i = treecli_parser_compact_seek(compact, index, token, len); i < end && !treecli_parser_matches_done(parser, matches, len); i++) {
+				if (treecli_parser_try_match(parser, matches, token, len, &(compact->strings[compact->nodes[i].name])) != TREECLI_PARSER_TRY_MATCH_OK) {
+					break;
+				}
+				matches->compact = compact;
+				matches->compact_index = i;
+				ret = TREECLI_PARSER_GET_MATCHES_COMPACT;
+			}
+		}
+
 		/* Match all dynamically constructed subnodes */
-		if (node.dsubnodes != NULL) {
+		if (node->dsubnodes != NULL) {
 			const struct treecli_dnode *d;
-			for (size_t j = 0; (d = (*(node.dsubnodes))[j]) != NULL; j++) {
+			for (size_t j = 0; (d = (*(node->dsubnodes))[j]) != NULL && !treecli_parser_matches_done(parser, matches, len); j++) {
 				uint32_t i = 0;
-				while (i < TREECLI_DNODE_MAX_COUNT) {
-					char name[TREECLI_DNODE_MAX_NAME_LEN];
+				bool sorted = false;
+				if (d->seek != NULL) {
+					if (d->seek(parser, token, len, &i, d->create_context) < 0) {
+						continue;
+					}
+					sorted = true;
+				}
+				while (i < TREECLI_DNODE_MAX_COUNT && !treecli_parser_matches_done(parser, matches, len)) {
 					if (treecli_parser_dnode_get_name(parser, d, i, name) != TREECLI_PARSER_DNODE_GET_NAME_OK) {
 						break;
 					}
@@ -570,6 +1332,9 @@ int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *to
 						matches->dsubnode = d;
 						matches->dsubnode_index = i;
 						ret = TREECLI_PARSER_GET_MATCHES_DSUBNODE;
+					} else if (sorted) {
+						/* No more matching instances. */
+						break;
 					}
 					i++;
 				}
@@ -577,12 +1342,13 @@ int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *to
 		}
 
 		/* Match values at current position/level. */
-		if (node.values != NULL) {
+		if (node->values != NULL) {
 			const struct treecli_value *v;
-			for (size_t i = 0; (v = (*(node.values))[i]) != NULL; i++) {
+			for (size_t i = 0; (v = (*(node->values))[i]) != NULL && !treecli_parser_matches_done(parser, matches, len); i++) {
 
 				if (treecli_parser_try_match(parser, matches, token, len, v->name) == TREECLI_PARSER_TRY_MATCH_OK) {
 					matches->value = v;
+					parser->parsing_value = v;
 					parser->parsing_context = TREECLI_PARSER_CONTEXT_VALUE_OPERATOR;
 					ret = TREECLI_PARSER_GET_MATCHES_VALUE;
 				}
@@ -590,9 +1356,9 @@ int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *to
 		}
 
 		/* And match commands at current position/level. */
-		if (node.commands != NULL) {
+		if (node->commands != NULL) {
 			const struct treecli_command *c;
-			for (size_t i = 0; (c = (*(node.commands))[i]) != NULL; i++) {
+			for (size_t i = 0; (c = (*(node->commands))[i]) != NULL && !treecli_parser_matches_done(parser, matches, len); i++) {
 
 				if (treecli_parser_try_match(parser, matches, token, len, c->name) == TREECLI_PARSER_TRY_MATCH_OK) {
 					matches->command = c;
@@ -615,6 +1381,23 @@ int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *to
 }
 
 
+int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *token, uint32_t len, struct treecli_matches *matches) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(token != NULL) ||
+	    u_assert(matches != NULL)) {
+		return TREECLI_PARSER_GET_MATCHES_FAILED;
+	}
+
+	treecli_parser_read_lock(parser);
+	TREECLI_TRACE_BEGIN(TREECLI_TRACE_MATCH);
+	int32_t ret = treecli_parser_match_level(parser, token, len, matches);
+	TREECLI_TRACE_END(TREECLI_TRACE_MATCH);
+	treecli_parser_read_unlock(parser);
+
+	return ret;
+}
+
+
 int32_t treecli_parser_pos_move(struct treecli_parser_pos *pos, struct treecli_parser_pos_level *level) {
 	if (u_assert(pos != NULL) ||
 	    u_assert(level != NULL)) {
@@ -687,10 +1470,18 @@ int32_t treecli_parser_get_current_node(struct treecli_parser *parser, struct tr
 
 	struct treecli_parser_pos *pos = &(parser->pos);
 
+	uint32_t index;
+	const struct treecli_compact *compact = treecli_parser_level_compact(parser, pos, pos->depth, &index);
+
 	if (pos->depth == 0) {
 		return TREECLI_PARSER_GET_CURRENT_NODE_ROOT;
 	} else {
-		if (pos->levels[pos->depth - 1].node != NULL) {
+		if (compact != NULL) {
+
+			treecli_parser_compact_node(compact, index, node);
+			return TREECLI_PARSER_GET_CURRENT_NODE_OK;
+
+		} else if (pos->levels[pos->depth - 1].node != NULL) {
 
 			memcpy(node, pos->levels[pos->depth - 1].node, sizeof(struct treecli_node));
 			return TREECLI_PARSER_GET_CURRENT_NODE_OK;
@@ -704,7 +1495,7 @@ int32_t treecli_parser_get_current_node(struct treecli_parser *parser, struct tr
 			memset(&dnode, 0, sizeof(dnode));
 
 			if (d->create != NULL) {
-				if (d->create(parser, pos->levels[pos->depth - 1].dnode_index, &dnode, d->create_context) >= 0) {
+				if (treecli_parser_dnode_create(parser, d, pos->levels[pos->depth - 1].dnode_index, &dnode) >= 0) {
 					memcpy(node, &dnode, sizeof(struct treecli_node));
 					return TREECLI_PARSER_GET_CURRENT_NODE_OK;
 				}
@@ -720,242 +1511,1920 @@ int32_t treecli_parser_get_current_node(struct treecli_parser *parser, struct tr
 }
 
 
-int32_t treecli_parser_help(struct treecli_parser *parser) {
-	if (u_assert(parser != NULL)) {
+/**
+ * State of a single help listing page.
+ */
+struct treecli_parser_help_state {
+	uint32_t index;
+	uint32_t printed;
+	const char *header;
+	bool header_printed;
+};
+
+
+static void treecli_parser_help_section(struct treecli_parser *parser, struct treecli_parser_help_state *st, const char *header) {
+	st->header = header;
+	st->header_printed = false;
+
+	/* Section headers are always printed on the first page of unfiltered
+	 * help. Otherwise they are printed only if there are some entries. */
+	if (parser->help_offset == 0 && parser->help_prefix_len == 0) {
+		parser->print_handler(header, parser->print_handler_ctx);
+		st->header_printed = true;
+	}
+}
+
+
+/**
+ * Print a single help entry if it matches the prefix and belongs to the current
+ * page. Returns false if the page is already full and enumeration should stop.
+ */
+static bool treecli_parser_help_entry(struct treecli_parser *parser, struct treecli_parser_help_state *st, const char *name, const char *help) {
+	if (strncmp(name, parser->help_prefix, parser->help_prefix_len)) {
+		return true;
+	}
+
+	/* Skip entries printed on previous pages. */
+	if (st->index < parser->help_offset) {
+		st->index++;
+		return true;
+	}
+
+	/* There is at least one more entry which doesn't fit on this page. */
+	if (parser->help_limit > 0 && st->printed >= parser->help_limit) {
+		return false;
+	}
+	st->index++;
+	st->printed++;
+
+	if (st->header_printed == false) {
+		parser->print_handler(st->header, parser->print_handler_ctx);
+		st->header_printed = true;
+	}
+	parser->print_handler("\t", parser->print_handler_ctx);
+	parser->print_handler(name, parser->print_handler_ctx);
+	parser->print_handler(" - ", parser->print_handler_ctx);
+	if (help != NULL) {
+		treecli_help_print(parser->help_dict, help, parser->print_handler, parser->print_handler_ctx);
+	} else {
+		parser->print_handler(TREECLI_PARSER_HELP_UNAVAILABLE, parser->print_handler_ctx);
+	}
+	parser->print_handler("\n", parser->print_handler_ctx);
+
+	return true;
+}
+
+
+/**
+ * Print one page of help entries starting at help_offset.
+ */
+static int32_t treecli_parser_help_page(struct treecli_parser *parser) {
+	if (u_assert(parser->print_handler != NULL) ||
+	    TREECLI_PARSER_NO_WORKSPACE(parser)) {
 		return TREECLI_PARSER_HELP_FAILED;
 	}
 
-	struct treecli_node node;
-	int32_t res = treecli_parser_get_current_node(parser, &node);
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_node, node, node);
+	int32_t res = treecli_parser_get_current_node(parser, node);
 	if (res == TREECLI_PARSER_GET_CURRENT_NODE_ROOT) {
-		memcpy(&node, parser->top, sizeof(struct treecli_node));
+		memcpy(node, parser->top, sizeof(struct treecli_node));
 	} else if (res == TREECLI_PARSER_GET_CURRENT_NODE_FAILED) {
 		return TREECLI_PARSER_HELP_FAILED;
 	}
 
-	parser->print_handler(TREECLI_PARSER_AVAILABLE_SUBNODES, parser->print_handler_ctx);
-	const struct treecli_node *n;
-	for (size_t i = 0; (n = (*(node.subnodes))[i]) != NULL; i++) {
-		parser->print_handler("\t", parser->print_handler_ctx);
-		parser->print_handler(n->name, parser->print_handler_ctx);
-		parser->print_handler(" - ", parser->print_handler_ctx);
-		if (n->help != NULL) {
-			parser->print_handler(n->help, parser->print_handler_ctx);
-		} else {
-			parser->print_handler(TREECLI_PARSER_HELP_UNAVAILABLE, parser->print_handler_ctx);
+	/* Compact and dynamic subnodes are constructed to get their names
+	 * and help strings. */
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_node, entry, entry);
+	TREECLI_PARSER_SCRATCH_NAME(parser, name);
+
+	struct treecli_parser_help_state st;
+	memset(&st, 0, sizeof(st));
+
+	/* Set if the page is full and there are more entries to print. */
+	bool more = false;
+
+	treecli_parser_help_section(parser, &st, TREECLI_PARSER_AVAILABLE_SUBNODES);
+	const struct treecli_node *const *subnodes;
+	treecli_parser_current_subnodes(parser, node, &subnodes);
+	if (subnodes != NULL) {
+		const struct treecli_node *n;
+		for (size_t i = 0; !more && (n = subnodes[i]) != NULL; i++) {
+			more = !treecli_parser_help_entry(parser, &st, n->name, n->help);
 		}
-		parser->print_handler("\n", parser->print_handler_ctx);
 	}
 
-	parser->print_handler(TREECLI_PARSER_AVAILABLE_COMMANDS, parser->print_handler_ctx);
-	const struct treecli_command *c;
-	for (size_t i = 0; (c = (*(node.commands))[i]) != NULL; i++) {
-		parser->print_handler("\t", parser->print_handler_ctx);
-		parser->print_handler(c->name, parser->print_handler_ctx);
-		parser->print_handler(" - ", parser->print_handler_ctx);
-		if (c->help != NULL) {
-			parser->print_handler(c->help, parser->print_handler_ctx);
-		} else {
-			parser->print_handler(TREECLI_PARSER_HELP_UNAVAILABLE, parser->print_handler_ctx);
+	uint32_t index;
+	const struct treecli_compact *compact = treecli_parser_level_compact(parser, &(parser->pos), parser->pos.depth, &index);
+	if (compact != NULL) {
+		uint32_t first = compact->nodes[index].subnodes;
+		uint32_t end = first + compact->nodes[index].subnodes_count;
+		for (uint32_t i = first; !more && i < end; i++) {
+			treecli_parser_compact_node(compact, i, entry);
+			more = !treecli_parser_help_entry(parser, &st, entry->name, entry->help);
 		}
-		parser->print_handler("\n", parser->print_handler_ctx);
 	}
 
-	return TREECLI_PARSER_HELP_OK;
-}
-
+	if (node->dsubnodes != NULL) {
+		const struct treecli_dnode *d;
+		for (size_t j = 0; !more && (d = (*(node->dsubnodes))[j]) != NULL; j++) {
+			uint32_t i = 0;
+			bool sorted = false;
+			if (d->seek != NULL && parser->help_prefix_len > 0) {
+				if (d->seek(parser, parser->help_prefix, parser->help_prefix_len, &i, d->create_context) < 0) {
+					continue;
+				}
+				sorted = true;
+			}
+			for (; !more && i < TREECLI_DNODE_MAX_COUNT; i++) {
+				memset(entry, 0, sizeof(struct treecli_node));
+				entry->name = name;
+				snprintf(name, TREECLI_DNODE_MAX_NAME_LEN, "%s%u", d->name, (unsigned)i);
 
-int32_t treecli_parser_dnode_get_name(struct treecli_parser *parser, const struct treecli_dnode *dnode, uint32_t index, char *name) {
-	if (u_assert(parser != NULL) ||
-	    u_assert(dnode != NULL) ||
-	    u_assert(name != NULL)) {
-		return TREECLI_PARSER_DNODE_GET_NAME_FAILED;
+				if (d->create == NULL || treecli_parser_dnode_create(parser, d, i, entry) < 0) {
+					break;
+				}
+				if (sorted && strncmp(entry->name, parser->help_prefix, parser->help_prefix_len)) {
+					break;
+				}
+				more = !treecli_parser_help_entry(parser, &st, entry->name, entry->help);
+			}
+		}
 	}
 
-	/* allocate node structure and name */
-	struct treecli_node node;
-	memset(&node, 0, sizeof(node));
-	node.name = name;
-
-	/* default name is created */
-	sprintf(node.name, "%s%d", dnode->name, (int)index);
+	if (!more) {
+		treecli_parser_help_section(parser, &st, TREECLI_PARSER_AVAILABLE_COMMANDS);
+	}
+	if (node->commands != NULL) {
+		const struct treecli_command *c;
+		for (size_t i = 0; !more && (c = (*(node->commands))[i]) != NULL; i++) {
+			/* Commands of compact nodes have their help in the pool. */
+			const char *help = c->help;
+			if (compact != NULL && compact->command_help != NULL) {
+				uint32_t slot = (uint32_t)(&((*(node->commands))[i]) - compact->commands);
+				if (compact->command_help[slot] != TREECLI_COMPACT_NONE) {
+					help = &(compact->help_strings[compact->command_help[slot]]);
+				}
+			}
+			more = !treecli_parser_help_entry(parser, &st, c->name, help);
+		}
+	}
 
-	if (dnode->create != NULL && dnode->create(parser, index, &node, dnode->create_context) >= 0) {
-		return TREECLI_PARSER_DNODE_GET_NAME_OK;
+	if (more) {
+		/* Remember where to continue. */
+		parser->print_handler(TREECLI_PARSER_HELP_MORE, parser->print_handler_ctx);
+		parser->help_offset += st.printed;
+		parser->help_more = true;
+	} else {
+		/* The whole listing is complete. Print total number of entries
+		 * if it was split to multiple pages. */
+		if (parser->help_offset > 0) {
+			char total[32];
+			snprintf(total, sizeof(total), TREECLI_PARSER_HELP_TOTAL, (unsigned)st.index);
+			parser->print_handler(total, parser->print_handler_ctx);
+		}
+		parser->help_offset = 0;
+		parser->help_more = false;
 	}
 
-	return TREECLI_PARSER_DNODE_GET_NAME_FAILED;
+	return TREECLI_PARSER_HELP_OK;
 }
 
 
-int32_t treecli_parser_set_mode(struct treecli_parser *parser, enum treecli_parser_mode mode) {
+int32_t treecli_parser_help(struct treecli_parser *parser) {
 	if (u_assert(parser != NULL)) {
-		return TREECLI_PARSER_SET_MODE_FAILED;
+		return TREECLI_PARSER_HELP_FAILED;
 	}
 
-	parser->mode = mode;
-
-	return TREECLI_PARSER_SET_MODE_OK;
+	return treecli_parser_help_filter(parser, "", 0);
 }
 
 
-int32_t treecli_parser_value_to_str(struct treecli_parser *parser, char *s, const struct treecli_value *value, uint32_t max) {
+int32_t treecli_parser_help_filter(struct treecli_parser *parser, const char *prefix, uint32_t len) {
 	if (u_assert(parser != NULL) ||
-	    u_assert(s != NULL) ||
-	    u_assert(value != NULL) ||
-	    u_assert(value->value != NULL)) {
-		return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+	    u_assert(prefix != NULL)) {
+		return TREECLI_PARSER_HELP_FAILED;
 	}
 
-	/* TODO: time and date */
-	switch (value->value_type) {
-		case TREECLI_VALUE_INT32:
-			snprintf(s, max, "%ld", *(int32_t *)value->value);
-			s[max - 1] = '\0';
-			break;
+	if (len >= TREECLI_PARSER_HELP_PREFIX_LEN) {
+		return TREECLI_PARSER_HELP_FAILED;
+	}
+
+	treecli_parser_read_lock(parser);
+
+	/* Start a new listing. */
+	treecli_parser_pos_copy(&(parser->help_pos), &(parser->pos));
+	memcpy(parser->help_prefix, prefix, len);
+	parser->help_prefix[len] = '\0';
+	parser->help_prefix_len = len;
+	parser->help_offset = 0;
+
+	int32_t ret = treecli_parser_help_page(parser);
+
+	treecli_parser_read_unlock(parser);
+
+	return ret;
+}
+
+
+int32_t treecli_parser_help_more(struct treecli_parser *parser) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_HELP_FAILED;
+	}
+
+	if (parser->help_more == false) {
+		return TREECLI_PARSER_HELP_FAILED;
+	}
+
+	/* The listing position is moved up if its subtree was detached. */
+	treecli_parser_read_lock(parser);
+
+	/* Continue at the position where the listing was started. */
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+	treecli_parser_pos_copy(&(parser->pos), &(parser->help_pos));
+
+	int32_t ret = treecli_parser_help_page(parser);
+
+	treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+	treecli_parser_read_unlock(parser);
+
+	return ret;
+}
+
+
+int32_t treecli_parser_set_help_limit(struct treecli_parser *parser, uint32_t limit) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_SET_HELP_LIMIT_FAILED;
+	}
+
+	parser->help_limit = limit;
+
+	return TREECLI_PARSER_SET_HELP_LIMIT_OK;
+}
+
+
+int32_t treecli_parser_set_help_dict(struct treecli_parser *parser, const struct treecli_help_dict *dict) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_SET_HELP_DICT_FAILED;
+	}
+
+	parser->help_dict = dict;
+
+	return TREECLI_PARSER_SET_HELP_DICT_OK;
+}
+
+
+int32_t treecli_parser_set_workspace(struct treecli_parser *parser, struct treecli_parser_workspace *workspace) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_SET_WORKSPACE_FAILED;
+	}
+
+	parser->workspace = workspace;
+
+	return TREECLI_PARSER_SET_WORKSPACE_OK;
+}
+
+
+/**
+ * Get the statically defined node at the given depth of a position or NULL
+ * if the node is dynamic or compact (nothing can be mounted there).
+ */
+static const struct treecli_node *treecli_parser_level_node(struct treecli_parser *parser, const struct treecli_parser_pos *pos, uint32_t depth) {
+	if (depth == 0) {
+		return parser->top;
+	}
+
+	/* Only the top node of a compact tree is a static node. */
+	uint32_t index;
+	if (treecli_parser_level_compact(parser, pos, depth, &index) != NULL && index != 0) {
+		return NULL;
+	}
+	return pos->levels[depth - 1].node;
+}
+
+
+/**
+ * Get subnodes of a statically defined node. Mounted subtrees replace
+ * the static array of their parent.
+ */
+static const struct treecli_node *const *treecli_parser_node_subnodes(struct treecli_parser *parser, const struct treecli_node *parent, const struct treecli_node *copy) {
+	const struct treecli_node *const *subnodes = NULL;
+	if (copy->subnodes != NULL) {
+		subnodes = *(copy->subnodes);
+	}
+
+	if (parser->mounts != NULL && parent != NULL) {
+		const struct treecli_node *const *mounted;
+		treecli_mount_subnodes(parser->mounts, parent, &mounted);
+		if (mounted != NULL) {
+			subnodes = mounted;
+		}
+	}
+
+	return subnodes;
+}
+
+
+/**
+ * Truncate the position at the first node which is not a subnode of its
+ * parent anymore (its subtree was detached).
+ */
+static void treecli_parser_pos_validate(struct treecli_parser *parser, struct treecli_parser_pos *pos) {
+	for (uint32_t i = 0; i < pos->depth; i++) {
+		const struct treecli_node *parent = treecli_parser_level_node(parser, pos, i);
+		if (treecli_parser_level_node(parser, pos, i + 1) == NULL || parent == NULL) {
+			continue;
+		}
+
+		const struct treecli_node *const *subnodes = treecli_parser_node_subnodes(parser, parent, parent);
+		size_t j = 0;
+		while (subnodes != NULL && subnodes[j] != NULL && subnodes[j] != pos->levels[i].node) {
+			j++;
+		}
+		if (subnodes == NULL || subnodes[j] == NULL) {
+			pos->depth = i;
+			return;
+		}
+	}
+}
+
+
+int32_t treecli_parser_current_subnodes(struct treecli_parser *parser, const struct treecli_node *node, const struct treecli_node *const **subnodes) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(node != NULL) ||
+	    u_assert(subnodes != NULL)) {
+		return TREECLI_PARSER_CURRENT_SUBNODES_FAILED;
+	}
+
+	*subnodes = treecli_parser_node_subnodes(parser, treecli_parser_level_node(parser, &(parser->pos), parser->pos.depth), node);
+
+	return TREECLI_PARSER_CURRENT_SUBNODES_OK;
+}
+
+
+int32_t treecli_parser_current_compact(struct treecli_parser *parser, const struct treecli_compact **compact, uint32_t *index) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(compact != NULL) ||
+	    u_assert(index != NULL)) {
+		return TREECLI_PARSER_CURRENT_COMPACT_FAILED;
+	}
+
+	*compact = treecli_parser_level_compact(parser, &(parser->pos), parser->pos.depth, index);
+
+	return TREECLI_PARSER_CURRENT_COMPACT_OK;
+}
+
+
+int32_t treecli_parser_set_mounts(struct treecli_parser *parser, struct treecli_mount_table *mounts) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(parser->mount_nesting == 0)) {
+		return TREECLI_PARSER_SET_MOUNTS_FAILED;
+	}
+
+	if (parser->mounts != NULL) {
+		treecli_mount_reader_unregister(parser->mounts, parser->mount_reader);
+		parser->mounts = NULL;
+	}
+
+	if (mounts != NULL) {
+		if (treecli_mount_reader_register(mounts, parser, &(parser->mount_reader)) != TREECLI_MOUNT_READER_REGISTER_OK) {
+			return TREECLI_PARSER_SET_MOUNTS_FAILED;
+		}
+		parser->mounts = mounts;
+		parser->mount_epoch = 0;
+	}
+
+	return TREECLI_PARSER_SET_MOUNTS_OK;
+}
+
+
+int32_t treecli_parser_read_lock(struct treecli_parser *parser) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_READ_LOCK_FAILED;
+	}
+
+	if (parser->mounts == NULL || parser->mount_nesting++ > 0) {
+		return TREECLI_PARSER_READ_LOCK_OK;
+	}
+
+	uint32_t epoch;
+	if (treecli_mount_read_lock(parser->mounts, parser->mount_reader, &epoch) != TREECLI_MOUNT_READ_LOCK_OK) {
+		parser->mount_nesting--;
+		return TREECLI_PARSER_READ_LOCK_FAILED;
+	}
+
+	/* Something was attached or detached since the last section, saved
+	 * positions may point to detached subtrees. If the tree was replaced,
+	 * the parser is remapped here by its own thread and the writer is told
+	 * it doesn't use the previous tree anymore. */
+	if (epoch != parser->mount_epoch) {
+		const struct treecli_node *top = __atomic_load_n(&(parser->mounts->top), __ATOMIC_ACQUIRE);
+		if (top != NULL) {
+			if (top != parser->top) {
+				treecli_parser_set_top(parser, top);
+			}
+			__atomic_store_n(&(parser->mounts->readers_top[parser->mount_reader]), top, __ATOMIC_RELEASE);
+		}
+		treecli_parser_pos_validate(parser, &(parser->pos));
+		treecli_parser_pos_validate(parser, &(parser->help_pos));
+		treecli_parser_pos_validate(parser, &(parser->exec_pos_saved));
+		treecli_parser_pos_validate(parser, &(parser->generator_pos));
+		parser->mount_epoch = epoch;
+	}
+
+	return TREECLI_PARSER_READ_LOCK_OK;
+}
+
+
+int32_t treecli_parser_read_unlock(struct treecli_parser *parser) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_READ_UNLOCK_FAILED;
+	}
+
+	if (parser->mounts == NULL) {
+		return TREECLI_PARSER_READ_UNLOCK_OK;
+	}
+	if (u_assert(parser->mount_nesting > 0)) {
+		return TREECLI_PARSER_READ_UNLOCK_FAILED;
+	}
+
+	if (--parser->mount_nesting == 0) {
+		treecli_mount_read_unlock(parser->mounts, parser->mount_reader);
+	}
+
+	return TREECLI_PARSER_READ_UNLOCK_OK;
+}
+
+
+int32_t treecli_parser_dnode_get_name(struct treecli_parser *parser, const struct treecli_dnode *dnode, uint32_t index, char *name) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(dnode != NULL) ||
+	    u_assert(name != NULL)) {
+		return TREECLI_PARSER_DNODE_GET_NAME_FAILED;
+	}
+
+	/* allocate node structure and name */
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_node, node, name_node);
+	memset(node, 0, sizeof(struct treecli_node));
+	node->name = name;
+
+	/* default name is created */
+	sprintf(node->name, "%s%d", dnode->name, (int)index);
+
+	if (dnode->create != NULL && treecli_parser_dnode_create(parser, dnode, index, node) >= 0) {
+		return TREECLI_PARSER_DNODE_GET_NAME_OK;
+	}
+
+	return TREECLI_PARSER_DNODE_GET_NAME_FAILED;
+}
+
+
+int32_t treecli_parser_set_mode(struct treecli_parser *parser, enum treecli_parser_mode mode) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_SET_MODE_FAILED;
+	}
+
+	parser->mode = mode;
+
+	return TREECLI_PARSER_SET_MODE_OK;
+}
+
+
+static size_t treecli_parser_value_size(const struct treecli_value *value) {
+	switch (value->value_type) {
+		case TREECLI_VALUE_INT32:
+		case TREECLI_VALUE_UINT32:
+		case TREECLI_VALUE_TIME:
+		case TREECLI_VALUE_DATE:
+		case TREECLI_VALUE_DATA:
+		case TREECLI_VALUE_PHYS:
+			return sizeof(uint32_t);
+
+		case TREECLI_VALUE_BOOL:
+			return sizeof(bool);
+
+		default:
+			/* Variable length values (strings). */
+			return 0;
+	}
+}
+
+
+/**
+ * Check if the prefix position is an ancestor of (or equal to) the position.
+ */
+static bool treecli_parser_pos_prefix(const struct treecli_parser_pos *prefix, const struct treecli_parser_pos *pos) {
+	if (prefix->depth > pos->depth) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < prefix->depth; i++) {
+		if (prefix->levels[i].node != pos->levels[i].node ||
+		    prefix->levels[i].dnode != pos->levels[i].dnode ||
+		    prefix->levels[i].dnode_index != pos->levels[i].dnode_index ||
+		    prefix->levels[i].compact != pos->levels[i].compact ||
+		    prefix->levels[i].compact_index != pos->levels[i].compact_index) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Check if two positions are equal.
+ */
+static bool treecli_parser_pos_equal(const struct treecli_parser_pos *a, const struct treecli_parser_pos *b) {
+	if (a->depth != b->depth) {
+		return false;
+	}
+
+	return treecli_parser_pos_prefix(a, b);
+}
+
+
+/**
+ * Check if the changed value matches the watcher filter.
+ */
+static bool treecli_parser_watch_match(const struct treecli_watch *watch, const struct treecli_value *value, const struct treecli_parser_pos *pos) {
+	if (watch->filter.type == TREECLI_HANDLE_VALUE) {
+		return watch->filter.value == value && treecli_parser_pos_equal(&(watch->filter.pos), pos);
+	}
+
+	return treecli_parser_pos_prefix(&(watch->filter.pos), pos);
+}
+
+
+/**
+ * Record a value change at the current position. The change handler is
+ * called first. Repeated changes of the same value are coalesced (except
+ * with changes being delivered right now). If there is no space left in the
+ * queue, matching watchers are marked as overflowed.
+ */
+static int32_t treecli_parser_value_changed(struct treecli_parser *parser, const struct treecli_value *value) {
+	int32_t ret = 0;
+	if (parser->change_handler != NULL) {
+		parser->change_handler_pending = true;
+		if (parser->change_handler(parser, value, parser->change_handler_ctx) < 0) {
+			ret = -1;
+		}
+	}
+
+	if (parser->watches == NULL) {
+		return ret;
+	}
+
+	for (uint32_t i = parser->changes_round; i < parser->changes_count; i++) {
+		if (parser->changes[i].value == value && treecli_parser_pos_equal(&(parser->changes[i].pos), &(parser->pos))) {
+			return ret;
+		}
+	}
+
+	if (parser->changes_count == parser->changes_size) {
+		for (struct treecli_watch *w = parser->watches; w != NULL; w = w->next) {
+			if (treecli_parser_watch_match(w, value, &(parser->pos))) {
+				w->overflow = true;
+			}
+		}
+		return ret;
+	}
+
+	struct treecli_handle *change = &(parser->changes[parser->changes_count++]);
+	change->type = TREECLI_HANDLE_VALUE;
+	treecli_parser_pos_copy(&(change->pos), &(parser->pos));
+	change->command = NULL;
+	change->value = value;
+
+	return ret;
+}
+
+
+/**
+ * Get TTL of the cache policy for the value or zero if the value is not
+ * cached.
+ */
+static uint32_t treecli_parser_cache_ttl(struct treecli_parser *parser, const struct treecli_value *value) {
+	for (uint32_t i = 0; i < TREECLI_PARSER_CACHE_POLICIES; i++) {
+		if (parser->cache_policies[i].value == value) {
+			return parser->cache_policies[i].ttl;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Find the cache entry of the value at the current position. NULL is
+ * returned if the value is not cached or it has no entry yet.
+ */
+static struct treecli_cache_entry *treecli_parser_cache_lookup(struct treecli_parser *parser, const struct treecli_value *value) {
+	if (parser->cache == NULL || parser->time_handler == NULL) {
+		return NULL;
+	}
+
+	uint32_t ttl = treecli_parser_cache_ttl(parser, value);
+	if (ttl == 0) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < parser->cache_size; i++) {
+		struct treecli_cache_entry *e = &(parser->cache[i]);
+		if (e->value == value && treecli_parser_pos_equal(&(e->pos), &(parser->pos))) {
+			e->ttl = ttl;
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+
+static bool treecli_parser_cache_fresh(struct treecli_parser *parser, const struct treecli_cache_entry *entry) {
+	return entry->valid && (parser->time_handler(parser->time_handler_ctx) - entry->time) < entry->ttl;
+}
+
+
+/**
+ * Store a value returned by its getter to the cache entry found by
+ * treecli_parser_cache_lookup. If there was none, a new entry is allocated
+ * now: free or invalid entries are reused first, the oldest entry is
+ * replaced otherwise. Values which don't fit are not cached.
+ */
+static void treecli_parser_cache_store(struct treecli_parser *parser, const struct treecli_value *value, struct treecli_cache_entry *entry, const void *buf, size_t len) {
+	if (parser->cache == NULL || parser->time_handler == NULL) {
+		return;
+	}
+
+	uint32_t ttl = treecli_parser_cache_ttl(parser, value);
+	if (ttl == 0 || len > sizeof(entry->data)) {
+		if (entry != NULL) {
+			entry->valid = false;
+		}
+		return;
+	}
+
+	uint32_t now = parser->time_handler(parser->time_handler_ctx);
+	if (entry == NULL) {
+		for (uint32_t i = 0; i < parser->cache_size; i++) {
+			struct treecli_cache_entry *e = &(parser->cache[i]);
+			if (entry == NULL || (entry->valid && (e->valid == false || (now - e->time) > (now - entry->time)))) {
+				entry = e;
+			}
+		}
+		if (entry == NULL) {
+			return;
+		}
+		entry->value = value;
+		treecli_parser_pos_copy(&(entry->pos), &(parser->pos));
+	}
+
+	memcpy(entry->data, buf, len);
+	entry->len = len;
+	entry->ttl = ttl;
+	entry->time = now;
+	entry->valid = true;
+}
+
+
+/**
+ * Invalidate cached value at the current position (after it was written).
+ */
+static void treecli_parser_cache_drop(struct treecli_parser *parser, const struct treecli_value *value) {
+	if (parser->cache == NULL) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < parser->cache_size; i++) {
+		struct treecli_cache_entry *e = &(parser->cache[i]);
+		if (e->value == value && treecli_parser_pos_equal(&(e->pos), &(parser->pos))) {
+			e->valid = false;
+		}
+	}
+}
+
+
+/**
+ * Check if the cache entry matches the handle (value handle matches
+ * a single value, node handle matches the whole subtree).
+ */
+static bool treecli_parser_cache_match(const struct treecli_cache_entry *entry, const struct treecli_handle *handle) {
+	if (handle == NULL) {
+		return true;
+	}
+	if (handle->type == TREECLI_HANDLE_VALUE) {
+		return entry->value == handle->value && treecli_parser_pos_equal(&(entry->pos), &(handle->pos));
+	}
+
+	return treecli_parser_pos_prefix(&(handle->pos), &(entry->pos));
+}
+
+
+/**
+ * Write a new value to the referenced variable (fixed size types only) and
+ * call the value setter if it is defined. The previous content of the
+ * variable is restored if the setter fails.
+ */
+static int32_t treecli_parser_value_write(struct treecli_parser *parser, const struct treecli_value *value, const void *buf, size_t len) {
+	size_t size = treecli_parser_value_size(value);
+	uint8_t saved[sizeof(uint32_t)];
+
+	if (size > 0) {
+		if (len != size) {
+			return -1;
+		}
+		if (value->value != NULL) {
+			memcpy(saved, value->value, size);
+			memcpy(value->value, buf, size);
+		}
+	}
+
+	if (value->set != NULL) {
+		/* Setters of BOOL values always got a 4 byte long buffer. */
+		union {
+			bool b;
+			uint32_t u;
+		} bool_buf = {.u = 0};
+		const void *set_buf = buf;
+		size_t set_len = len;
+		if (value->value_type == TREECLI_VALUE_BOOL) {
+			bool_buf.b = *(const bool *)buf;
+			set_buf = &bool_buf;
+			set_len = sizeof(bool_buf.u);
+		}
+
+		TREECLI_TRACE_BEGIN(TREECLI_TRACE_SET);
+		int32_t set_ret = value->set(parser, value->get_set_context, (struct treecli_value *)value, (void *)set_buf, set_len);
+		TREECLI_TRACE_END(TREECLI_TRACE_SET);
+		if (set_ret < 0) {
+			if (size > 0 && value->value != NULL) {
+				memcpy(value->value, saved, size);
+			}
+			return -1;
+		}
+	}
+
+	treecli_parser_cache_drop(parser, value);
+	if (treecli_parser_value_changed(parser, value) < 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Read actual value using the value getter if it is defined or by copying the
+ * referenced variable. Len contains size of the buffer on input and length
+ * of the value on output.
+ */
+static int32_t treecli_parser_value_read(struct treecli_parser *parser, const struct treecli_value *value, void *buf, size_t *len) {
+	if (value->get != NULL) {
+		/* Serve the value from the cache if it is fresh enough. */
+		struct treecli_cache_entry *entry = treecli_parser_cache_lookup(parser, value);
+		if (entry != NULL && treecli_parser_cache_fresh(parser, entry)) {
+			if (entry->len > *len) {
+				return -1;
+			}
+			memcpy(buf, entry->data, entry->len);
+			*len = entry->len;
+			return 0;
+		}
+
+		size_t size = *len;
+		TREECLI_TRACE_BEGIN(TREECLI_TRACE_GET);
+		int32_t get_ret = value->get(parser, value->get_set_context, (struct treecli_value *)value, buf, len);
+		TREECLI_TRACE_END(TREECLI_TRACE_GET);
+		if (get_ret < 0) {
+			return -1;
+		}
+		if (*len > size) {
+			return -1;
+		}
+
+		treecli_parser_cache_store(parser, value, entry, buf, *len);
+		return 0;
+	}
+
+	if (value->value == NULL) {
+		return -1;
+	}
+
+	size_t size = treecli_parser_value_size(value);
+	if (size == 0) {
+		/* Strings are copied including the terminating zero. */
+		size = strlen((const char *)value->value) + 1;
+	}
+	if (size > *len) {
+		return -1;
+	}
+	memcpy(buf, value->value, size);
+	*len = size;
+
+	return 0;
+}
+
+
+int32_t treecli_parser_value_to_str(struct treecli_parser *parser, char *s, const struct treecli_value *value, uint32_t max) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(s != NULL) ||
+	    u_assert(value != NULL) ||
+	    u_assert(max > 0)) {
+		return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+	}
+
+	/* Value is read using its getter (possibly cached) or from the
+	 * referenced variable. */
+	union {
+		int32_t i;
+		uint32_t u;
+	} v;
+	size_t len = sizeof(v);
+	if (value->value_type != TREECLI_VALUE_STR) {
+		if (treecli_parser_value_read(parser, value, &v, &len) < 0) {
+			return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+		}
+	}
+
+	/* TODO: time and date */
+	switch (value->value_type) {
+		case TREECLI_VALUE_INT32:
+			snprintf(s, max, "%ld", (long)v.i);
+			s[max - 1] = '\0';
+			break;
+
+		case TREECLI_VALUE_UINT32:
+			snprintf(s, max, "%lu", (unsigned long)v.u);
+			s[max - 1] = '\0';
+			break;
+
+		case TREECLI_VALUE_STR:
+			if (value->get == NULL && value->value != NULL) {
+				strncpy(s, (char *)value->value, max);
+			} else {
+				len = max;
+				if (treecli_parser_value_read(parser, value, s, &len) < 0) {
+					return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+				}
+			}
+			s[max - 1] = '\0';
+			break;
+
+		case TREECLI_VALUE_PHYS:
+			if (u_assert(value->units != NULL)) {
+				return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+			}
+			snprintf(s, max, "%ld%s", (long)v.i, value->units);
+			s[max - 1] = '\0';
+			break;
+
+		case TREECLI_VALUE_DATA:
+			if (v.u > (1024 * 1024)) {
+				snprintf(s, max, "%luMiB", (unsigned long)v.u / 1024 / 1024);
+			} else if (v.u > (1024)) {
+				snprintf(s, max, "%luKiB", (unsigned long)v.u / 1024);
+			} else {
+				snprintf(s, max, "%luB", (unsigned long)v.u);
+			}
+			break;
+
+		default:
+			return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+	}
+
+
+	return TREECLI_PARSER_VALUE_TO_STR_OK;
+}
+
+
+int32_t treecli_parser_str_to_value(struct treecli_parser *parser, const struct treecli_value *value, const char *s, uint32_t len) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(s != NULL) ||
+	    u_assert(value != NULL)) {
+		return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+	}
+
+	/* Numeric values can be assigned a result of an expression. */
+	if ((value->value_type == TREECLI_VALUE_INT32 || value->value_type == TREECLI_VALUE_UINT32 || value->value_type == TREECLI_VALUE_DATA) &&
+	    len > 0 && s[0] == '(') {
+		if (treecli_parser_str_update_value(parser, value, TREECLI_VALUE_OP_ASSIGN, s, len) != TREECLI_PARSER_STR_UPDATE_VALUE_OK) {
+			return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+		}
+		return TREECLI_PARSER_STR_TO_VALUE_OK;
+	}
+
+	switch (value->value_type) {
+		case TREECLI_VALUE_INT32: {
+				int32_t v = 0;
+				bool negative = false;
+				for (uint32_t i = 0; i < len; i++) {
+					if (s[i] == '-') {
+						negative = true;
+					} else if (s[i] >= '0' && s[i] <= '9') {
+						v = v * 10 + (s[i] - '0');
+					} else {
+						return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+					}
+				}
+				if (negative) {
+					v = -v;
+				}
+				if (treecli_parser_value_write(parser, value, &v, sizeof(v)) < 0) {
+					return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+				}
+			}
+			break;
 
 		case TREECLI_VALUE_UINT32:
-			snprintf(s, max, "%lu", *(uint32_t *)value->value);
-			s[max - 1] = '\0';
+		case TREECLI_VALUE_DATA: {
+				uint32_t v = 0;
+				for (uint32_t i = 0; i < len; i++) {
+					if (s[i] >= '0' && s[i] <= '9') {
+						v = v * 10 + (s[i] - '0');
+					} else {
+						return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+					}
+				}
+				if (treecli_parser_value_write(parser, value, &v, sizeof(v)) < 0) {
+					return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+				}
+			}
 			break;
 
-		case TREECLI_VALUE_STR:
-			strncpy(s, (char *)value->value, max);
-			s[max - 1] = '\0';
+		case TREECLI_VALUE_STR: {
+				/* Strip the leading and trailing double qoutes. */
+				if (len >= 2 && s[0] == '"' && s[len - 1] == '"') {
+					s += 1;
+					len -= 2;
+				}
+				if (treecli_parser_value_write(parser, value, s, len) < 0) {
+					return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+				}
+			}
 			break;
 
-		case TREECLI_VALUE_PHYS:
-			if (u_assert(value->units != NULL)) {
-				return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+		case TREECLI_VALUE_BOOL: {
+				bool v = false;
+				if (len == 1) {
+					if (s[0] == 'f' || s[0] == 'F' || s[0] == '0' || s[0] == 'n' || s[0] == 'N') {
+						v = false;
+					}
+					if (s[0] == 't' || s[0] == 'T' || s[0] == '1' || s[0] == 'y' || s[0] == 'Y') {
+						v = true;
+					}
+				}
+				if (len == 2 && (strncmp(s, "no", 2) != 0)) {
+					v = false;
+				}
+				if (len == 3 && (strncmp(s, "yes", 3) != 0)) {
+					v = true;
+				}
+				if (len == 4 && (strncmp(s, "true", 4) != 0)) {
+					v = true;
+				}
+				if (len == 5 && (strncmp(s, "false", 5) != 0)) {
+					v = false;
+				}
+
+				if (treecli_parser_value_write(parser, value, &v, sizeof(v)) < 0) {
+					return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+				}
 			}
-			snprintf(s, max, "%ld%s", *(int32_t *)value->value, value->units);
-			s[max - 1] = '\0';
 			break;
 
-		case TREECLI_VALUE_DATA:
-			if ((*(uint32_t *)value->value) > (1024 * 1024)) {
-				snprintf(s, max, "%luMiB", (*(uint32_t *)value->value) / 1024 / 1024);
-			} else if ((*(uint32_t *)value->value) > (1024)) {
-				snprintf(s, max, "%luKiB", (*(uint32_t *)value->value) / 1024);
-			} else {
-				snprintf(s, max, "%luB", *(uint32_t *)value->value);
+		default:
+			return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+	}
+
+	return TREECLI_PARSER_STR_TO_VALUE_OK;
+}
+
+
+/**
+ * Apply an operator to a numeric value. The update callback is used if it is
+ * set, plain variables are modified atomically. Compound operators cannot be
+ * applied to other values as their read-modify-write sequence would race with
+ * concurrent modifications. Operand is an INT32 or UINT32 depending on the
+ * value type.
+ */
+static int32_t treecli_parser_value_apply(struct treecli_parser *parser, const struct treecli_value *value, enum treecli_value_operator op, uint32_t operand) {
+	if (op == TREECLI_VALUE_OP_ASSIGN) {
+		return treecli_parser_value_write(parser, value, &operand, sizeof(operand));
+	}
+	if (!treecli_parser_value_updatable(value)) {
+		return -1;
+	}
+
+	/* Values with the update callback are modified in a single driver
+	 * operation. */
+	if (value->update != NULL) {
+		TREECLI_TRACE_BEGIN(TREECLI_TRACE_SET);
+		int32_t update_ret = value->update(parser, value->get_set_context, (struct treecli_value *)value, op, &operand, sizeof(operand));
+		TREECLI_TRACE_END(TREECLI_TRACE_SET);
+		if (update_ret < 0) {
+			return -1;
+		}
+	} else {
+		/* All arithmetic is done on unsigned integers (wrapping around). */
+		uint32_t *v = (uint32_t *)value->value;
+		switch (op) {
+			case TREECLI_VALUE_OP_ADD:
+				__atomic_fetch_add(v, operand, __ATOMIC_SEQ_CST);
+				break;
+			case TREECLI_VALUE_OP_SUB:
+				__atomic_fetch_sub(v, operand, __ATOMIC_SEQ_CST);
+				break;
+			case TREECLI_VALUE_OP_OR:
+				__atomic_fetch_or(v, operand, __ATOMIC_SEQ_CST);
+				break;
+			case TREECLI_VALUE_OP_AND:
+				__atomic_fetch_and(v, operand, __ATOMIC_SEQ_CST);
+				break;
+			case TREECLI_VALUE_OP_XOR:
+				__atomic_fetch_xor(v, operand, __ATOMIC_SEQ_CST);
+				break;
+			default:
+				return -1;
+		}
+	}
+
+	treecli_parser_cache_drop(parser, value);
+	if (treecli_parser_value_changed(parser, value) < 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int32_t treecli_parser_num_update_value(struct treecli_parser *parser, const struct treecli_value *value, enum treecli_value_operator op, int32_t operand) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(value != NULL)) {
+		return TREECLI_PARSER_NUM_UPDATE_VALUE_FAILED;
+	}
+
+	if (value->value_type != TREECLI_VALUE_INT32 && value->value_type != TREECLI_VALUE_UINT32 && value->value_type != TREECLI_VALUE_DATA) {
+		return TREECLI_PARSER_NUM_UPDATE_VALUE_FAILED;
+	}
+
+	/* Negative operands are allowed for compound operators only. */
+	if (value->value_type != TREECLI_VALUE_INT32 && op == TREECLI_VALUE_OP_ASSIGN && operand < 0) {
+		return TREECLI_PARSER_NUM_UPDATE_VALUE_FAILED;
+	}
+
+	if (treecli_parser_value_apply(parser, value, op, (uint32_t)operand) < 0) {
+		return TREECLI_PARSER_NUM_UPDATE_VALUE_FAILED;
+	}
+
+	return TREECLI_PARSER_NUM_UPDATE_VALUE_OK;
+}
+
+
+/**
+ * Compile and evaluate an expression in parentheses and apply the result to
+ * a numeric value. References are resolved relative to the current working
+ * position (the node containing the value).
+ */
+static int32_t treecli_parser_expr_apply(struct treecli_parser *parser, const struct treecli_value *value, enum treecli_value_operator op, const char *s, uint32_t len) {
+	if (TREECLI_PARSER_NO_WORKSPACE(parser)) {
+		return -1;
+	}
+
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_expr, expr, expr);
+	if (treecli_expr_compile(parser, expr, s, len) != TREECLI_EXPR_COMPILE_OK) {
+		return -1;
+	}
+
+	int32_t v;
+	if (treecli_expr_eval(parser, expr, &v) != TREECLI_EXPR_EVAL_OK) {
+		return -1;
+	}
+
+	if (treecli_parser_num_update_value(parser, value, op, v) != TREECLI_PARSER_NUM_UPDATE_VALUE_OK) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int32_t treecli_parser_str_update_value(struct treecli_parser *parser, const struct treecli_value *value, enum treecli_value_operator op, const char *s, uint32_t len) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(s != NULL) ||
+	    u_assert(value != NULL)) {
+		return TREECLI_PARSER_STR_UPDATE_VALUE_FAILED;
+	}
+
+	if (value->value_type != TREECLI_VALUE_INT32 && value->value_type != TREECLI_VALUE_UINT32 && value->value_type != TREECLI_VALUE_DATA) {
+		return TREECLI_PARSER_STR_UPDATE_VALUE_FAILED;
+	}
+
+	if (len > 0 && s[0] == '(') {
+		if (treecli_parser_expr_apply(parser, value, op, s, len) < 0) {
+			return TREECLI_PARSER_STR_UPDATE_VALUE_FAILED;
+		}
+		return TREECLI_PARSER_STR_UPDATE_VALUE_OK;
+	}
+
+	/* Parse the operand. Only INT32 operands can be negative. */
+	uint32_t operand = 0;
+	bool negative = false;
+	uint32_t i = 0;
+	if (len > 0 && s[0] == '-' && value->value_type == TREECLI_VALUE_INT32) {
+		negative = true;
+		i++;
+	}
+	if (i == len) {
+		return TREECLI_PARSER_STR_UPDATE_VALUE_FAILED;
+	}
+	/* The operand must fit the value type. */
+	uint32_t limit = UINT32_MAX;
+	if (value->value_type == TREECLI_VALUE_INT32) {
+		limit = negative ? (uint32_t)INT32_MAX + 1 : (uint32_t)INT32_MAX;
+	}
+	for (; i < len; i++) {
+		if (s[i] < '0' || s[i] > '9') {
+			return TREECLI_PARSER_STR_UPDATE_VALUE_FAILED;
+		}
+		uint32_t d = (uint32_t)(s[i] - '0');
+		if (operand > (limit - d) / 10) {
+			return TREECLI_PARSER_STR_UPDATE_VALUE_FAILED;
+		}
+		operand = operand * 10 + d;
+	}
+	if (negative) {
+		operand = 0 - operand;
+	}
+
+	if (treecli_parser_value_apply(parser, value, op, operand) < 0) {
+		return TREECLI_PARSER_STR_UPDATE_VALUE_FAILED;
+	}
+
+	return TREECLI_PARSER_STR_UPDATE_VALUE_OK;
+}
+
+
+int32_t treecli_parser_set_context(struct treecli_parser *parser, void *context) {
+	if (u_assert(parser != NULL && context != NULL)) {
+		return TREECLI_PARSER_SET_CONTEXT_FAILED;
+	}
+
+	parser->context = context;
+
+	return TREECLI_PARSER_SET_CONTEXT_OK;
+}
+
+
+/**
+ * Find an item in the current node with a name matching the token exactly.
+ * Match type is returned using the same codes as treecli_parser_get_matches
+ * does, the matched item is saved in the matches structure.
+ */
+static int32_t treecli_parser_find_exact(struct treecli_parser *parser, const char *token, uint32_t len, struct treecli_matches *matches) {
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_node, node, exact_node);
+	int32_t res = treecli_parser_get_current_node(parser, node);
+	if (res == TREECLI_PARSER_GET_CURRENT_NODE_ROOT) {
+		memcpy(node, parser->top, sizeof(struct treecli_node));
+	} else if (res == TREECLI_PARSER_GET_CURRENT_NODE_FAILED) {
+		return TREECLI_PARSER_GET_MATCHES_FAILED;
+	}
+
+	const struct treecli_node *const *subnodes;
+	treecli_parser_current_subnodes(parser, node, &subnodes);
+	if (subnodes != NULL) {
+		const struct treecli_node *n;
+		for (size_t i = 0; (n = subnodes[i]) != NULL; i++) {
+			if (strlen(n->name) == len && !strncmp(token, n->name, len)) {
+				matches->subnode = n;
+				return TREECLI_PARSER_GET_MATCHES_SUBNODE;
+			}
+		}
+	}
+
+	uint32_t index;
+	const struct treecli_compact *compact = treecli_parser_level_compact(parser, &(parser->pos), parser->pos.depth, &index);
+	if (compact != NULL) {
+		uint32_t i = treecli_parser_compact_seek(compact, index, token, len);
+		uint32_t end = compact->nodes[index].subnodes + compact->nodes[index].subnodes_count;
+		if (i < end) {
+			const char *name = &(compact->strings[compact->nodes[i].name]);
+			if (strlen(name) == len && !strncmp(token, name, len)) {
+				matches->compact = compact;
+				matches->compact_index = i;
+				return TREECLI_PARSER_GET_MATCHES_COMPACT;
+			}
+		}
+	}
+
+	if (node->dsubnodes != NULL) {
+		const struct treecli_dnode *d;
+		for (size_t j = 0; (d = (*(node->dsubnodes))[j]) != NULL; j++) {
+			uint32_t i = 0;
+			bool sorted = false;
+			if (d->seek != NULL) {
+				if (d->seek(parser, token, len, &i, d->create_context) < 0) {
+					continue;
+				}
+				sorted = true;
+			}
+			for (; i < TREECLI_DNODE_MAX_COUNT; i++) {
+				TREECLI_PARSER_SCRATCH_ARRAY(parser, char, name, exact_name, TREECLI_DNODE_MAX_NAME_LEN);
+				if (treecli_parser_dnode_get_name(parser, d, i, name) != TREECLI_PARSER_DNODE_GET_NAME_OK) {
+					break;
+				}
+				if (strlen(name) == len && !strncmp(token, name, len)) {
+					matches->dsubnode = d;
+					matches->dsubnode_index = i;
+					return TREECLI_PARSER_GET_MATCHES_DSUBNODE;
+				}
+				if (sorted && strncmp(token, name, len)) {
+					break;
+				}
+			}
+		}
+	}
+
+	if (node->values != NULL) {
+		const struct treecli_value *v;
+		for (size_t i = 0; (v = (*(node->values))[i]) != NULL; i++) {
+			if (strlen(v->name) == len && !strncmp(token, v->name, len)) {
+				matches->value = v;
+				return TREECLI_PARSER_GET_MATCHES_VALUE;
+			}
+		}
+	}
+
+	if (node->commands != NULL) {
+		const struct treecli_command *c;
+		for (size_t i = 0; (c = (*(node->commands))[i]) != NULL; i++) {
+			if (strlen(c->name) == len && !strncmp(token, c->name, len)) {
+				matches->command = c;
+				return TREECLI_PARSER_GET_MATCHES_COMMAND;
+			}
+		}
+	}
+
+	return TREECLI_PARSER_GET_MATCHES_NONE;
+}
+
+
+int32_t treecli_parser_pos_name(struct treecli_parser *parser, const struct treecli_parser_pos *pos, uint32_t depth, char *buf, const char **name) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(pos != NULL) ||
+	    u_assert(depth < pos->depth) ||
+	    u_assert(buf != NULL) ||
+	    u_assert(name != NULL) ||
+	    TREECLI_PARSER_NO_WORKSPACE(parser)) {
+		return TREECLI_PARSER_POS_NAME_FAILED;
+	}
+
+	const struct treecli_parser_pos_level *level = &(pos->levels[depth]);
+	uint32_t index;
+	const struct treecli_compact *compact = treecli_parser_level_compact(parser, pos, depth + 1, &index);
+	if (compact != NULL) {
+		*name = &(compact->strings[compact->nodes[index].name]);
+		return TREECLI_PARSER_POS_NAME_OK;
+	}
+	if (level->node != NULL) {
+		*name = level->node->name;
+		return TREECLI_PARSER_POS_NAME_OK;
+	}
+	if (level->dnode == NULL) {
+		return TREECLI_PARSER_POS_NAME_FAILED;
+	}
+
+	/* Dynamic nodes are created with the parser positioned at their
+	 * parent, the same way as when they are matched. */
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_parser_pos, parser_pos_saved, name_pos);
+	treecli_parser_pos_copy(parser_pos_saved, &(parser->pos));
+	treecli_parser_pos_copy(&(parser->pos), (struct treecli_parser_pos *)pos);
+	parser->pos.depth = depth;
+
+	int32_t res = treecli_parser_dnode_get_name(parser, level->dnode, level->dnode_index, buf);
+
+	treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
+
+	if (res != TREECLI_PARSER_DNODE_GET_NAME_OK) {
+		return TREECLI_PARSER_POS_NAME_FAILED;
+	}
+	*name = buf;
+
+	return TREECLI_PARSER_POS_NAME_OK;
+}
+
+
+/**
+ * Find the position with the same path in the new tree. Names of the levels
+ * are taken from the previous tree (dynamic nodes may need the parser
+ * positioned in it to create their names).
+ */
+static void treecli_parser_pos_remap(struct treecli_parser *parser, const struct treecli_node *top, struct treecli_parser_pos *pos) {
+	const struct treecli_node *top_saved = parser->top;
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_parser_pos, parser_pos_saved, remap_saved);
+	treecli_parser_pos_copy(parser_pos_saved, &(parser->pos));
+
+	/* The position can be the working position of the parser itself. */
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_parser_pos, old, remap_old);
+	treecli_parser_pos_copy(old, pos);
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_parser_pos, remapped, remap_new);
+	treecli_parser_pos_init(remapped);
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_matches, matches, remap_matches);
+	TREECLI_PARSER_SCRATCH_ARRAY(parser, char, name, remap_name, TREECLI_DNODE_MAX_NAME_LEN);
+
+	for (uint32_t i = 0; i < old->depth; i++) {
+		const char *n;
+		parser->top = top_saved;
+		if (treecli_parser_pos_name(parser, old, i, name, &n) != TREECLI_PARSER_POS_NAME_OK) {
+			remapped->depth = 0;
+			break;
+		}
+
+		parser->top = top;
+		treecli_parser_pos_copy(&(parser->pos), remapped);
+		memset(matches, 0, sizeof(struct treecli_matches));
+		int32_t res = treecli_parser_find_exact(parser, n, strlen(n), matches);
+
+		struct treecli_parser_pos_level found;
+		memset(&found, 0, sizeof(found));
+		if (res == TREECLI_PARSER_GET_MATCHES_SUBNODE) {
+			found.node = matches->subnode;
+		} else if (res == TREECLI_PARSER_GET_MATCHES_DSUBNODE) {
+			found.dnode = matches->dsubnode;
+			found.dnode_index = matches->dsubnode_index;
+		} else if (res == TREECLI_PARSER_GET_MATCHES_COMPACT) {
+			found.compact = matches->compact;
+			found.compact_index = matches->compact_index;
+		} else {
+			/* The path doesn't exist anymore. */
+			remapped->depth = 0;
+			break;
+		}
+		treecli_parser_pos_move(remapped, &found);
+	}
+
+	parser->top = top_saved;
+	treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
+	treecli_parser_pos_copy(pos, remapped);
+}
+
+
+int32_t treecli_parser_set_top(struct treecli_parser *parser, const struct treecli_node *top) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(top != NULL) ||
+	    TREECLI_PARSER_NO_WORKSPACE(parser)) {
+		return TREECLI_PARSER_SET_TOP_FAILED;
+	}
+
+	treecli_parser_pos_remap(parser, top, &(parser->pos));
+	treecli_parser_pos_remap(parser, top, &(parser->help_pos));
+	treecli_parser_pos_remap(parser, top, &(parser->exec_pos_saved));
+	treecli_parser_pos_remap(parser, top, &(parser->generator_pos));
+
+	/* Writers check the top of idle parsers, it is changed last. */
+	__atomic_store_n(&(parser->top), top, __ATOMIC_RELEASE);
+
+	return TREECLI_PARSER_SET_TOP_OK;
+}
+
+
+int32_t treecli_resolve_path(struct treecli_parser *parser, const char *path, struct treecli_handle *handle) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(path != NULL) ||
+	    u_assert(handle != NULL) ||
+	    TREECLI_PARSER_NO_WORKSPACE(parser)) {
+		return TREECLI_RESOLVE_PATH_FAILED;
+	}
+
+	treecli_parser_read_lock(parser);
+
+	/* The path is resolved by moving the parser position. Save it to be
+	 * able to restore it afterwards. */
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_parser_pos, parser_pos_saved, path_pos);
+	treecli_parser_pos_copy(parser_pos_saved, &(parser->pos));
+
+	memset(handle, 0, sizeof(struct treecli_handle));
+	handle->type = TREECLI_HANDLE_NODE;
+
+	if (*path == '/') {
+		treecli_parser_pos_root(&(parser->pos));
+	}
+
+	TREECLI_PARSER_SCRATCH(parser, struct treecli_matches, matches, path_matches);
+
+	int32_t ret = TREECLI_RESOLVE_PATH_OK;
+	const char *s = path;
+	while (*s != '\0') {
+		/* Skip delimiters, empty components are ignored. */
+		while (*s == '/') {
+			s++;
+		}
+		const char *name = s;
+		while (*s != '/' && *s != '\0') {
+			s++;
+		}
+		uint32_t len = s - name;
+		if (len == 0) {
+			break;
+		}
+
+		/* Value or command must be the last component of the path. */
+		if (handle->type != TREECLI_HANDLE_NODE) {
+			ret = TREECLI_RESOLVE_PATH_NOT_FOUND;
+			break;
+		}
+
+		if (len == 2 && !strncmp(name, "..", 2)) {
+			if (treecli_parser_pos_up(&(parser->pos)) != TREECLI_PARSER_POS_UP_OK) {
+				ret = TREECLI_RESOLVE_PATH_NOT_FOUND;
+				break;
+			}
+			continue;
+		}
+
+		int32_t res = treecli_parser_find_exact(parser, name, len, matches);
+
+		if (res == TREECLI_PARSER_GET_MATCHES_SUBNODE) {
+			if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = matches->subnode, .dnode = NULL}) != TREECLI_PARSER_POS_MOVE_OK) {
+				ret = TREECLI_RESOLVE_PATH_FAILED;
+				break;
 			}
+		} else if (res == TREECLI_PARSER_GET_MATCHES_DSUBNODE) {
+			if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = matches->dsubnode, .dnode_index = matches->dsubnode_index}) != TREECLI_PARSER_POS_MOVE_OK) {
+				ret = TREECLI_RESOLVE_PATH_FAILED;
+				break;
+			}
+		} else if (res == TREECLI_PARSER_GET_MATCHES_COMPACT) {
+			if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = NULL, .compact = matches->compact, .compact_index = matches->compact_index}) != TREECLI_PARSER_POS_MOVE_OK) {
+				ret = TREECLI_RESOLVE_PATH_FAILED;
+				break;
+			}
+		} else if (res == TREECLI_PARSER_GET_MATCHES_VALUE) {
+			handle->type = TREECLI_HANDLE_VALUE;
+			handle->value = matches->value;
+		} else if (res == TREECLI_PARSER_GET_MATCHES_COMMAND) {
+			handle->type = TREECLI_HANDLE_COMMAND;
+			handle->command = matches->command;
+		} else if (res == TREECLI_PARSER_GET_MATCHES_NONE) {
+			ret = TREECLI_RESOLVE_PATH_NOT_FOUND;
+			break;
+		} else {
+			ret = TREECLI_RESOLVE_PATH_FAILED;
 			break;
+		}
+	}
 
-		default:
-			return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+	if (ret == TREECLI_RESOLVE_PATH_OK) {
+		treecli_parser_pos_copy(&(handle->pos), &(parser->pos));
 	}
+	treecli_parser_pos_copy(&(parser->pos), parser_pos_saved);
+	treecli_parser_read_unlock(parser);
 
+	return ret;
+}
 
-	return TREECLI_PARSER_VALUE_TO_STR_OK;
+
+int32_t treecli_handle_get(struct treecli_parser *parser, const struct treecli_handle *handle, void *buf, size_t *len) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(handle != NULL) ||
+	    u_assert(buf != NULL) ||
+	    u_assert(len != NULL)) {
+		return TREECLI_HANDLE_GET_FAILED;
+	}
+
+	if (handle->type != TREECLI_HANDLE_VALUE) {
+		return TREECLI_HANDLE_GET_FAILED;
+	}
+
+	/* Value getter is called at the position where the value was found.
+	 * Mounted subtrees are not detached until it returns. */
+	treecli_parser_read_lock(parser);
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+	treecli_parser_pos_copy(&(parser->pos), (struct treecli_parser_pos *)&(handle->pos));
+
+	int32_t res = treecli_parser_value_read(parser, handle->value, buf, len);
+
+	treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+	treecli_parser_read_unlock(parser);
+
+	if (res < 0) {
+		return TREECLI_HANDLE_GET_FAILED;
+	}
+
+	return TREECLI_HANDLE_GET_OK;
 }
 
 
-int32_t treecli_parser_str_to_value(struct treecli_parser *parser, const struct treecli_value *value, const char *s, uint32_t len) {
+int32_t treecli_handle_set(struct treecli_parser *parser, const struct treecli_handle *handle, const void *buf, size_t len) {
 	if (u_assert(parser != NULL) ||
-	    u_assert(s != NULL) ||
-	    u_assert(value != NULL)) {
-		return TREECLI_PARSER_STR_TO_VALUE_FAILED;
+	    u_assert(handle != NULL) ||
+	    u_assert(buf != NULL)) {
+		return TREECLI_HANDLE_SET_FAILED;
 	}
 
-	switch (value->value_type) {
-		case TREECLI_VALUE_INT32: {
-				int32_t v = 0;
-				bool negative = false;
-				for (uint32_t i = 0; i < len; i++) {
-					if (s[i] == '-') {
-						negative = true;
-					} else if (s[i] >= '0' && s[i] <= '9') {
-						v = v * 10 + (s[i] - '0');
-					} else {
-						return TREECLI_PARSER_STR_TO_VALUE_FAILED;
-					}
-				}
-				if (negative) {
-					v = -v;
-				}
-				if (value->value != NULL) {
-					*(int32_t *)value->value = v;
-				}
-				if (value->set != NULL) {
-					value->set(parser, value->get_set_context, value, (void *)&v, 4);
-				}
-			}
-			break;
+	if (handle->type != TREECLI_HANDLE_VALUE) {
+		return TREECLI_HANDLE_SET_FAILED;
+	}
 
-		case TREECLI_VALUE_UINT32: {
-				uint32_t v = 0;
-				for (uint32_t i = 0; i < len; i++) {
-					if (s[i] >= '0' && s[i] <= '9') {
-						v = v * 10 + (s[i] - '0');
-					} else {
-						return TREECLI_PARSER_STR_TO_VALUE_FAILED;
-					}
-				}
-				if (value->value != NULL) {
-					*(uint32_t *)value->value = v;
-				}
-				if (value->set != NULL) {
-					value->set(parser, value->get_set_context, value, (void *)&v, 4);
-				}
+	treecli_parser_read_lock(parser);
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+	treecli_parser_pos_copy(&(parser->pos), (struct treecli_parser_pos *)&(handle->pos));
+
+	int32_t res = treecli_parser_value_write(parser, handle->value, buf, len);
+
+	treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+	if (treecli_parser_flush_changes(parser) != TREECLI_PARSER_FLUSH_CHANGES_OK) {
+		res = -1;
+	}
+	treecli_parser_read_unlock(parser);
+
+	if (res < 0) {
+		return TREECLI_HANDLE_SET_FAILED;
+	}
+
+	return TREECLI_HANDLE_SET_OK;
+}
+
+
+int32_t treecli_handle_exec(struct treecli_parser *parser, const struct treecli_handle *handle) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(handle != NULL)) {
+		return TREECLI_HANDLE_EXEC_FAILED;
+	}
+
+	if (handle->type != TREECLI_HANDLE_COMMAND || handle->command->exec == NULL) {
+		return TREECLI_HANDLE_EXEC_FAILED;
+	}
+
+	/* A line waiting for its command owns the pending state. */
+	if (parser->exec_pending) {
+		return TREECLI_HANDLE_EXEC_FAILED;
+	}
+
+	treecli_parser_read_lock(parser);
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+	treecli_parser_pos_copy(&(parser->pos), (struct treecli_parser_pos *)&(handle->pos));
+
+	TREECLI_TRACE_BEGIN(TREECLI_TRACE_EXEC);
+	int32_t res = handle->command->exec(parser, handle->command->exec_context);
+	TREECLI_TRACE_END(TREECLI_TRACE_EXEC);
+
+	if (res != TREECLI_PARSER_EXEC_PENDING && parser->exec_pending) {
+		treecli_parser_exec_drop(parser);
+	}
+
+	if (res == TREECLI_PARSER_EXEC_PENDING && parser->exec_pending) {
+		parser->exec_pending = false;
+
+		if (parser->generator != NULL) {
+			/* Output generators are run until they finish, the
+			 * caller is responsible for its print handler. */
+			res = treecli_parser_generator_run(parser, 0);
+		} else {
+			/* There is no line to resume, completion is reported by
+			 * the command directly to the caller. */
+			treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+			treecli_parser_read_unlock(parser);
+			return TREECLI_HANDLE_EXEC_PENDING;
+		}
+	}
+
+	treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+	treecli_parser_read_unlock(parser);
+
+	if (res < 0) {
+		return TREECLI_HANDLE_EXEC_FAILED;
+	}
+
+	return TREECLI_HANDLE_EXEC_OK;
+}
+
+
+int32_t treecli_parser_watch(struct treecli_parser *parser, struct treecli_watch *watch, const struct treecli_handle *filter, void (*notify)(struct treecli_parser *parser, const struct treecli_handle changes[], uint32_t count, void *ctx), void *ctx) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(watch != NULL) ||
+	    u_assert(notify != NULL)) {
+		return TREECLI_PARSER_WATCH_FAILED;
+	}
+
+	if (filter != NULL && filter->type == TREECLI_HANDLE_COMMAND) {
+		return TREECLI_PARSER_WATCH_FAILED;
+	}
+
+	/* Without a filter, the watcher watches the subtree of the root. */
+	memset(watch, 0, sizeof(struct treecli_watch));
+	if (filter != NULL) {
+		memcpy(&(watch->filter), filter, sizeof(struct treecli_handle));
+	} else {
+		watch->filter.type = TREECLI_HANDLE_NODE;
+		treecli_parser_pos_root(&(watch->filter.pos));
+	}
+	watch->notify = notify;
+	watch->ctx = ctx;
+
+	watch->next = parser->watches;
+	parser->watches = watch;
+
+	return TREECLI_PARSER_WATCH_OK;
+}
+
+
+int32_t treecli_parser_unwatch(struct treecli_parser *parser, struct treecli_watch *watch) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(watch != NULL)) {
+		return TREECLI_PARSER_UNWATCH_FAILED;
+	}
+
+	struct treecli_watch **w = &(parser->watches);
+	while (*w != NULL) {
+		if (*w == watch) {
+			*w = watch->next;
+			watch->next = NULL;
+			return TREECLI_PARSER_UNWATCH_OK;
+		}
+		w = &((*w)->next);
+	}
+
+	return TREECLI_PARSER_UNWATCH_FAILED;
+}
+
+
+int32_t treecli_parser_batch_begin(struct treecli_parser *parser) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_BATCH_BEGIN_FAILED;
+	}
+
+	parser->batch_depth++;
+
+	return TREECLI_PARSER_BATCH_BEGIN_OK;
+}
+
+
+int32_t treecli_parser_batch_end(struct treecli_parser *parser) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_BATCH_END_FAILED;
+	}
+
+	if (parser->batch_depth == 0) {
+		return TREECLI_PARSER_BATCH_END_FAILED;
+	}
+	parser->batch_depth--;
+	if (treecli_parser_flush_changes(parser) != TREECLI_PARSER_FLUSH_CHANGES_OK) {
+		return TREECLI_PARSER_BATCH_END_FAILED;
+	}
+
+	return TREECLI_PARSER_BATCH_END_OK;
+}
+
+
+/**
+ * Swap two handles in place.
+ */
+static void treecli_parser_handle_swap(struct treecli_handle *a, struct treecli_handle *b) {
+	uint8_t *x = (uint8_t *)a;
+	uint8_t *y = (uint8_t *)b;
+	for (size_t i = 0; i < sizeof(struct treecli_handle); i++) {
+		uint8_t t = x[i];
+		x[i] = y[i];
+		y[i] = t;
+	}
+}
+
+
+int32_t treecli_parser_flush_changes(struct treecli_parser *parser) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_FLUSH_CHANGES_FAILED;
+	}
+
+	/* Changes made by watchers are recorded and delivered in the next
+	 * round. */
+	if (parser->batch_depth > 0 || parser->changes_flushing) {
+		return TREECLI_PARSER_FLUSH_CHANGES_OK;
+	}
+	parser->changes_flushing = true;
+
+	int32_t ret = TREECLI_PARSER_FLUSH_CHANGES_OK;
+	while (true) {
+		/* The batch ends before watchers are notified, changes made
+		 * by watchers form a new one. */
+		if (parser->change_handler_pending) {
+			parser->change_handler_pending = false;
+			if (parser->change_handler != NULL && parser->change_handler(parser, NULL, parser->change_handler_ctx) < 0) {
+				ret = TREECLI_PARSER_FLUSH_CHANGES_FAILED;
 			}
+		}
+
+		bool overflow = false;
+		for (struct treecli_watch *w = parser->watches; w != NULL; w = w->next) {
+			overflow = overflow || w->overflow;
+		}
+		if (parser->changes_count == 0 && !overflow) {
 			break;
+		}
+		parser->changes_round = parser->changes_count;
+
+		/* The callback may remove its own watcher. */
+		struct treecli_watch *next = NULL;
+		for (struct treecli_watch *w = parser->watches; w != NULL; w = next) {
+			next = w->next;
+
+			/* The filter handle covers all changes of the watcher. */
+			if (w->overflow) {
+				w->overflow = false;
+				w->notify(parser, &(w->filter), 1, w->ctx);
+				continue;
+			}
 
-		case TREECLI_VALUE_STR: {
-				if (value->set != NULL) {
-					/* Strip the leading and trailing double qoutes. */
-					if (s[0] == '"' && s[len - 1] == '"') {
-						s += 1;
-						len -= 2;
+			/* Move matching changes to the beginning of the queue,
+			 * their order is kept. */
+			uint32_t matched = 0;
+			for (uint32_t i = 0; i < parser->changes_round; i++) {
+				if (treecli_parser_watch_match(w, parser->changes[i].value, &(parser->changes[i].pos))) {
+					if (i != matched) {
+						treecli_parser_handle_swap(&(parser->changes[i]), &(parser->changes[matched]));
 					}
-					value->set(parser, value->get_set_context, value, (void *)s, len);
+					matched++;
 				}
 			}
-			break;
+			if (matched > 0) {
+				w->notify(parser, parser->changes, matched, w->ctx);
+			}
+		}
 
-		case TREECLI_VALUE_BOOL: {
-				bool v = false;
-				if (len == 1) {
-					if (s[0] == 'f' || s[0] == 'F' || s[0] == '0' || s[0] == 'n' || s[0] == 'N') {
-						v = false;
-					}
-					if (s[0] == 't' || s[0] == 'T' || s[0] == '1' || s[0] == 'y' || s[0] == 'Y') {
-						v = true;
-					}
-				}
-				if (len == 2 && (strncmp(s, "no", 2) != 0)) {
-					v = false;
-				}
-				if (len == 3 && (strncmp(s, "yes", 3) != 0)) {
-					v = true;
-				}
-				if (len == 4 && (strncmp(s, "true", 4) != 0)) {
-					v = true;
-				}
-				if (len == 5 && (strncmp(s, "false", 5) != 0)) {
-					v = false;
-				}
+		/* Keep changes recorded during the delivery. */
+		uint32_t count = parser->changes_round;
+		if (count > 0) {
+			memmove(&(parser->changes[0]), &(parser->changes[count]), (parser->changes_count - count) * sizeof(struct treecli_handle));
+			parser->changes_count -= count;
+		}
+		parser->changes_round = 0;
+	}
 
-				if (value->set != NULL) {
-					value->set(parser, value->get_set_context, value, (void *)&v, 4);
-				}
+	parser->changes_flushing = false;
+
+	return ret;
+}
+
+
+int32_t treecli_parser_set_change_handler(struct treecli_parser *parser, int32_t (*change_handler)(struct treecli_parser *parser, const struct treecli_value *value, void *ctx), void *ctx) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_SET_CHANGE_HANDLER_FAILED;
+	}
+
+	parser->change_handler = change_handler;
+	parser->change_handler_ctx = ctx;
+	parser->change_handler_pending = false;
+
+	return TREECLI_PARSER_SET_CHANGE_HANDLER_OK;
+}
+
+
+int32_t treecli_parser_set_changes(struct treecli_parser *parser, struct treecli_handle *changes, uint32_t count) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(changes != NULL || count == 0)) {
+		return TREECLI_PARSER_SET_CHANGES_FAILED;
+	}
+
+	if (parser->changes_flushing) {
+		return TREECLI_PARSER_SET_CHANGES_FAILED;
+	}
+
+	/* Pending changes are not moved to the new queue, all watchers
+	 * have to read their values again. */
+	if (parser->changes_count > 0) {
+		for (struct treecli_watch *w = parser->watches; w != NULL; w = w->next) {
+			w->overflow = true;
+		}
+	}
+	parser->changes = changes;
+	parser->changes_size = count;
+	parser->changes_count = 0;
+
+	return TREECLI_PARSER_SET_CHANGES_OK;
+}
+
+
+int32_t treecli_parser_set_time_handler(struct treecli_parser *parser, uint32_t (*time_handler)(void *ctx), void *ctx) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(time_handler != NULL)) {
+		return TREECLI_PARSER_SET_TIME_HANDLER_FAILED;
+	}
+
+	parser->time_handler = time_handler;
+	parser->time_handler_ctx = ctx;
+
+	return TREECLI_PARSER_SET_TIME_HANDLER_OK;
+}
+
+
+int32_t treecli_parser_set_cache(struct treecli_parser *parser, struct treecli_cache_entry *entries, uint32_t count) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(entries != NULL || count == 0)) {
+		return TREECLI_PARSER_SET_CACHE_FAILED;
+	}
+
+	if (entries != NULL) {
+		memset(entries, 0, count * sizeof(struct treecli_cache_entry));
+	}
+	parser->cache = entries;
+	parser->cache_size = count;
+
+	return TREECLI_PARSER_SET_CACHE_OK;
+}
+
+
+int32_t treecli_parser_cache_policy(struct treecli_parser *parser, const struct treecli_value *value, uint32_t ttl) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(value != NULL)) {
+		return TREECLI_PARSER_CACHE_POLICY_FAILED;
+	}
+
+	/* Update an existing policy or remove it. */
+	struct treecli_cache_policy *free_policy = NULL;
+	for (uint32_t i = 0; i < TREECLI_PARSER_CACHE_POLICIES; i++) {
+		struct treecli_cache_policy *p = &(parser->cache_policies[i]);
+		if (p->value == value) {
+			p->ttl = ttl;
+			if (ttl == 0) {
+				p->value = NULL;
 			}
-			break;
+			return TREECLI_PARSER_CACHE_POLICY_OK;
+		}
+		if (p->value == NULL && free_policy == NULL) {
+			free_policy = p;
+		}
+	}
 
-		default:
-			return TREECLI_PARSER_VALUE_TO_STR_FAILED;
+	if (ttl == 0) {
+		return TREECLI_PARSER_CACHE_POLICY_OK;
+	}
+	if (free_policy == NULL) {
+		return TREECLI_PARSER_CACHE_POLICY_FAILED;
 	}
+	free_policy->value = value;
+	free_policy->ttl = ttl;
 
-	return TREECLI_PARSER_STR_TO_VALUE_OK;
+	return TREECLI_PARSER_CACHE_POLICY_OK;
 }
 
 
-int32_t treecli_parser_set_context(struct treecli_parser *parser, void *context) {
-	if (u_assert(parser != NULL && context != NULL)) {
-		return TREECLI_PARSER_SET_CONTEXT_FAILED;
+int32_t treecli_parser_cache_invalidate(struct treecli_parser *parser, const struct treecli_handle *handle) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_CACHE_INVALIDATE_FAILED;
 	}
 
-	parser->context = context;
+	for (uint32_t i = 0; i < parser->cache_size; i++) {
+		struct treecli_cache_entry *e = &(parser->cache[i]);
+		if (e->value != NULL && treecli_parser_cache_match(e, handle)) {
+			e->valid = false;
+		}
+	}
 
-	return TREECLI_PARSER_SET_CONTEXT_OK;
+	return TREECLI_PARSER_CACHE_INVALIDATE_OK;
+}
+
+
+int32_t treecli_parser_cache_refresh(struct treecli_parser *parser, const struct treecli_handle *handle) {
+	if (u_assert(parser != NULL)) {
+		return TREECLI_PARSER_CACHE_REFRESH_FAILED;
+	}
+
+	if (parser->time_handler == NULL) {
+		return TREECLI_PARSER_CACHE_REFRESH_FAILED;
+	}
+
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+
+	int32_t ret = TREECLI_PARSER_CACHE_REFRESH_OK;
+	for (uint32_t i = 0; i < parser->cache_size; i++) {
+		struct treecli_cache_entry *e = &(parser->cache[i]);
+		if (e->value == NULL || treecli_parser_cache_fresh(parser, e) || !treecli_parser_cache_match(e, handle)) {
+			continue;
+		}
+
+		/* Getters see the same position as if the value was read by
+		 * the parser. Entries which cannot be read are released. */
+		treecli_parser_pos_copy(&(parser->pos), &(e->pos));
+		size_t len = sizeof(e->data);
+		TREECLI_TRACE_BEGIN(TREECLI_TRACE_GET);
+		int32_t get_ret = e->value->get(parser, e->value->get_set_context, (struct treecli_value *)e->value, e->data, &len);
+		TREECLI_TRACE_END(TREECLI_TRACE_GET);
+		if (get_ret < 0 || len > sizeof(e->data)) {
+			e->value = NULL;
+			e->valid = false;
+			ret = TREECLI_PARSER_CACHE_REFRESH_FAILED;
+			continue;
+		}
+		e->len = len;
+		e->time = parser->time_handler(parser->time_handler_ctx);
+		e->valid = true;
+	}
+
+	treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+
+	return ret;
 }
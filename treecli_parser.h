@@ -29,6 +29,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 
 /**
@@ -43,6 +44,14 @@
 #define TREECLI_TREE_MAX_DEPTH 8
 #endif
 
+/**
+ * Keep large temporary structures used during parsing in a workspace set by
+ * treecli_parser_set_workspace instead of the stack.
+ */
+#ifndef TREECLI_PARSER_LOW_STACK
+#define TREECLI_PARSER_LOW_STACK 0
+#endif
+
 #ifndef TREECLI_PARSER_AVAILABLE_SUBNODES
 #define TREECLI_PARSER_AVAILABLE_SUBNODES "Available subnodes:\n"
 #endif
@@ -55,6 +64,34 @@
 #define TREECLI_PARSER_HELP_UNAVAILABLE "<help unavailable>"
 #endif
 
+#ifndef TREECLI_PARSER_HELP_MORE
+#define TREECLI_PARSER_HELP_MORE "--More--\n"
+#endif
+
+#ifndef TREECLI_PARSER_HELP_TOTAL
+#define TREECLI_PARSER_HELP_TOTAL "(%u entries)\n"
+#endif
+
+#ifndef TREECLI_PARSER_MATCHES_MORE
+#define TREECLI_PARSER_MATCHES_MORE "..."
+#endif
+
+/**
+ * Maximum number of values with a cache policy and size of the largest value
+ * which can be cached.
+ */
+#ifndef TREECLI_PARSER_CACHE_POLICIES
+#define TREECLI_PARSER_CACHE_POLICIES 8
+#endif
+
+#ifndef TREECLI_PARSER_CACHE_VALUE_LEN
+#define TREECLI_PARSER_CACHE_VALUE_LEN 16
+#endif
+
+#ifndef TREECLI_PARSER_HELP_PREFIX_LEN
+#define TREECLI_PARSER_HELP_PREFIX_LEN 32
+#endif
+
 #ifndef TREECLI_DNODE_MAX_COUNT
 #define TREECLI_DNODE_MAX_COUNT 100
 #endif
@@ -75,10 +112,27 @@ enum treecli_value_type {
 	TREECLI_VALUE_BOOL,
 };
 
+/**
+ * Operators used to modify values. Compound operators (all except the
+ * assignment) are supported by INT32, UINT32 and DATA values only.
+ */
+enum treecli_value_operator {
+	TREECLI_VALUE_OP_ASSIGN = 0,
+	TREECLI_VALUE_OP_ADD,
+	TREECLI_VALUE_OP_SUB,
+	TREECLI_VALUE_OP_OR,
+	TREECLI_VALUE_OP_AND,
+	TREECLI_VALUE_OP_XOR,
+};
+
 
 struct treecli_parser;
 struct treecli_parser_pos;
 struct treecli_parser_pos_level;
+struct treecli_compact;
+struct treecli_help_dict;
+struct treecli_parser_workspace;
+struct treecli_mount_table;
 
 
 struct treecli_command {
@@ -87,6 +141,11 @@ struct treecli_command {
 	const char *help;
 	const struct treecli_command *next;
 
+	/**
+	 * Returns a negative value if the command failed. Long running commands
+	 * may call treecli_parser_exec_defer and return its result
+	 * (TREECLI_PARSER_EXEC_PENDING) to complete asynchronously.
+	 */
 	int32_t (*exec)(struct treecli_parser *parser, void *exec_context);
 	void *exec_context;
 };
@@ -128,9 +187,20 @@ struct treecli_value {
 	 * */
 	int32_t (*get)(struct treecli_parser *parser, void *ctx, struct treecli_value *value, void *buf, size_t *len);
 	int32_t (*set)(struct treecli_parser *parser, void *ctx, struct treecli_value *value, void *buf, size_t len);
+
 	void *get_set_context;
 
 	const struct treecli_value *next;
+
+	/**
+	 * Optional callback applying a compound operator (eg. "+=") to the value
+	 * in a single operation. The operand is passed in the same format as
+	 * the value passed to the setter. Without it compound operators can be
+	 * applied only to plain INT32/UINT32/DATA variables without a getter
+	 * and a setter, which are modified atomically. It is also called with
+	 * get_set_context.
+	 */
+	int32_t (*update)(struct treecli_parser *parser, void *ctx, struct treecli_value *value, enum treecli_value_operator op, const void *operand, size_t len);
 };
 
 /**
@@ -152,6 +222,57 @@ struct treecli_node {
 };
 
 
+#define TREECLI_COMPACT_NONE 0xffff
+
+/**
+ * Node of a compact tree. Names are offsets to the string pool of the tree,
+ * subnodes of a node are stored contiguously (sorted by their names) and
+ * referenced by index of the first one and their count. Values, commands and
+ * dynamic subnodes are offsets of NULL terminated runs in the tables of the
+ * tree (or TREECLI_COMPACT_NONE).
+ */
+struct treecli_compact_node {
+	uint16_t name;
+	uint16_t subnodes;
+	uint16_t subnodes_count;
+	uint16_t values;
+	uint16_t commands;
+	uint16_t dsubnodes;
+};
+
+/**
+ * Packed read-only tree layout generated by treecli_compact_export. Help
+ * strings are kept apart from the nodes and names, they are referenced by
+ * node index (TREECLI_COMPACT_NONE if the node has no help). Help of commands
+ * is stored in the same pool, command_help is indexed the same way as the
+ * commands table and it is used instead of the help of the command structure.
+ *
+ * The top node of the tree (node 0) is also available as a static node
+ * which can be used anywhere a static node is used. Its subnodes array is
+ * treecli_compact_subnodes, which marks it as the top of a compact tree.
+ */
+struct treecli_compact {
+	struct treecli_node top;
+
+	const struct treecli_compact_node *nodes;
+	uint32_t nodes_count;
+	const char *strings;
+
+	const uint16_t *help;
+	const char *help_strings;
+	const uint16_t *command_help;
+
+	const struct treecli_value *const *values;
+	const struct treecli_command *const *commands;
+	const struct treecli_dnode *const *dsubnodes;
+};
+
+/**
+ * Empty subnodes array of compact tree top nodes.
+ */
+extern const struct treecli_node *treecli_compact_subnodes[1];
+
+
 /**
  * Dnode specifies how are node childs generated during runtime. It can be used
  * to dynamically generate configuration subtrees for components not known at
@@ -164,17 +285,31 @@ struct treecli_dnode {
 	void *create_context;
 
 	const struct treecli_dnode *next;
+
+	/**
+	 * Optional callback for dnodes with instances sorted by their names. It
+	 * sets index to the first instance which name is not lower than the
+	 * prefix (binary search can be used) and returns a negative value if
+	 * there is no such instance. Matching then starts at this index and
+	 * stops at the first instance not starting with the prefix instead of
+	 * enumerating all instances. It is called with create_context as ctx.
+	 */
+	int32_t (*seek)(struct treecli_parser *parser, const char *prefix, uint32_t len, uint32_t *index, void *ctx);
 };
 
 
 /**
  * One level in hierarchical tree structure can be described by a statically
- * initialized node or dynamically created node (dnode specification and its index).
+ * initialized node, dynamically created node (dnode specification and its index)
+ * or a node of a compact tree (the tree and index of the node in it, node and
+ * dnode are NULL). The top node of a compact tree is a static node.
  */
 struct treecli_parser_pos_level {
 	const struct treecli_node *node;
 	const struct treecli_dnode *dnode;
 	uint32_t dnode_index;
+	const struct treecli_compact *compact;
+	uint32_t compact_index;
 };
 
 /**
@@ -211,6 +346,78 @@ enum treecli_match_type {
 	TREECLI_MATCH_TYPE_COMMAND,
 };
 
+enum treecli_handle_type {
+	TREECLI_HANDLE_NODE = 0,
+	TREECLI_HANDLE_VALUE,
+	TREECLI_HANDLE_COMMAND,
+};
+
+/**
+ * Handle is a resolved reference to a single node, value or command in the
+ * tree. Position of the item (or of the node containing the value or command)
+ * is saved together with the item itself. It is restored whenever a callback
+ * is called through the handle, callbacks therefore see the same position as
+ * if the path was parsed by treecli_parser_parse_line. Handles stay valid as
+ * long as the tree (and dynamic nodes on the path) are not changed.
+ */
+struct treecli_handle {
+	enum treecli_handle_type type;
+	struct treecli_parser_pos pos;
+	const struct treecli_command *command;
+	const struct treecli_value *value;
+};
+
+/**
+ * Subscription to value changes. It is allocated by the caller and registered
+ * with treecli_parser_watch. The filter handle selects either a single value
+ * or the whole subtree of a node. Changes are coalesced and delivered in
+ * batches, each changed value (at a given position) is reported only once
+ * per batch. Handles of changed values are passed to the notify callback,
+ * actual values can be read using treecli_handle_get. If a change cannot be
+ * queued, the watcher is marked as overflowed and its filter handle is
+ * delivered instead of the individual values (ie. everything matching the
+ * filter has to be read again).
+ */
+struct treecli_watch {
+	struct treecli_handle filter;
+
+	void (*notify)(struct treecli_parser *parser, const struct treecli_handle changes[], uint32_t count, void *ctx);
+	void *ctx;
+	bool overflow;
+
+	struct treecli_watch *next;
+};
+
+/**
+ * Values read using getters can be cached for ttl milliseconds. Policies are
+ * set per value, cached values are stored in entries provided by the caller
+ * and keyed by the value and its position.
+ */
+struct treecli_cache_policy {
+	const struct treecli_value *value;
+	uint32_t ttl;
+};
+
+struct treecli_cache_entry {
+	const struct treecli_value *value;
+	struct treecli_parser_pos pos;
+	bool valid;
+	uint32_t time;
+	uint32_t ttl;
+	size_t len;
+	uint8_t data[TREECLI_PARSER_CACHE_VALUE_LEN];
+};
+
+/**
+ * Handle identifying a deferred command execution. It is filled by
+ * treecli_parser_exec_defer and passed back to the parser when the
+ * command completes.
+ */
+struct treecli_completion {
+	struct treecli_parser *parser;
+	uint32_t id;
+};
+
 struct treecli_parser {
 	const struct treecli_node *top;
 	struct treecli_parser_pos pos;
@@ -224,24 +431,142 @@ struct treecli_parser {
 	int32_t (*best_match_handler)(const char *token, uint32_t token_len, uint32_t match_pos, uint32_t match_len, void *ctx);
 	void *best_match_handler_ctx;
 
+	/**
+	 * Called with result of every target of a pattern (eg. "if*") with
+	 * working position set to the target.
+	 */
+	int32_t (*target_handler)(struct treecli_parser *parser, int32_t result, void *ctx);
+	void *target_handler_ctx;
+
 	uint32_t error_pos;
 	uint32_t error_len;
 
 	enum treecli_parser_mode mode;
 
 	const struct treecli_value *parsing_value;
+	enum treecli_value_operator parsing_operator;
 	enum treecli_parser_context parsing_context;
 
+	/**
+	 * Maximum number of entries printed at once by the help and maximum
+	 * number of suggestions passed to the match handler. Zero means no
+	 * limit. Help output can be resumed at help_offset if help_more is set,
+	 * position and prefix used to filter help entries are saved for that
+	 * purpose.
+	 */
+	uint32_t help_limit;
+	uint32_t help_offset;
+	bool help_more;
+	struct treecli_parser_pos help_pos;
+	char help_prefix[TREECLI_PARSER_HELP_PREFIX_LEN];
+	uint32_t help_prefix_len;
+
+	/**
+	 * Dictionary used to decode compressed help strings or NULL if help
+	 * strings are stored as plain text.
+	 */
+	const struct treecli_help_dict *help_dict;
+
+	/**
+	 * Scratch space used instead of the stack if the parser is built
+	 * with TREECLI_PARSER_LOW_STACK.
+	 */
+	struct treecli_parser_workspace *workspace;
+
+	/**
+	 * Number of matches passed to the match handler during the last
+	 * treecli_parser_get_matches call. matches_truncated is set if some
+	 * of them were omitted because of the help_limit.
+	 */
+	uint32_t matches_reported;
+	bool matches_truncated;
+
+	/**
+	 * State of a command completing asynchronously. Parsing of the line
+	 * continues at exec_line_pos when the command completes, exec_pos_saved
+	 * is the position to return to if the line fails. exec_id is
+	 * incremented for every deferred command to detect stale completions.
+	 */
+	bool exec_pending;
+	uint32_t exec_id;
+	uint32_t exec_line_pos;
+	struct treecli_parser_pos exec_pos_saved;
+	void (*exec_cancel)(void *ctx);
+	void *exec_cancel_ctx;
+
+	/**
+	 * Output generator of the pending command registered by
+	 * treecli_parser_exec_generator and the working position of the
+	 * command set during generator calls. print_blocked is set when the
+	 * print handler returns TREECLI_PRINT_WOULD_BLOCK.
+	 */
+	int32_t (*generator)(struct treecli_parser *parser, void *ctx);
+	void *generator_ctx;
+	struct treecli_parser_pos generator_pos;
+	struct treecli_completion generator_completion;
+	bool print_blocked;
+
+	/**
+	 * Registered value change watchers and changes waiting to be delivered.
+	 * Changes are delivered at the end of every parsed line or when the
+	 * outermost batch ends. Storage of the queue is provided by the caller,
+	 * changes_round is the number of changes being delivered.
+	 */
+	struct treecli_watch *watches;
+	struct treecli_handle *changes;
+	uint32_t changes_size;
+	uint32_t changes_count;
+	uint32_t changes_round;
+	uint32_t batch_depth;
+	bool changes_flushing;
+
+	/**
+	 * Handler called synchronously on every value change and at the end
+	 * of every batch of changes (see treecli_parser_set_change_handler).
+	 */
+	int32_t (*change_handler)(struct treecli_parser *parser, const struct treecli_value *value, void *ctx);
+	void *change_handler_ctx;
+	bool change_handler_pending;
+
+	/**
+	 * Cache of values read using getters. Time handler returns actual
+	 * time in milliseconds.
+	 */
+	uint32_t (*time_handler)(void *ctx);
+	void *time_handler_ctx;
+	struct treecli_cache_policy cache_policies[TREECLI_PARSER_CACHE_POLICIES];
+	struct treecli_cache_entry *cache;
+	uint32_t cache_size;
+
+	/**
+	 * Subtrees mounted at runtime. mount_reader is the reader registered
+	 * in the table, mount_nesting counts nested read-side sections and
+	 * mount_epoch is the table epoch positions were validated at.
+	 */
+	struct treecli_mount_table *mounts;
+	uint32_t mount_reader;
+	uint32_t mount_nesting;
+	uint32_t mount_epoch;
+
 	void *context;
 };
 
+/**
+ * Result of matching a single token. Enumeration of candidates is stopped as
+ * soon as the result is known to be ambiguous and neither suggestions nor the
+ * best match are requested. count is not exact in this case (it is always
+ * at least 2 for ambiguous tokens).
+ */
 struct treecli_matches {
 	uint32_t count;
 	const struct treecli_node *subnode;
 	const struct treecli_dnode *dsubnode;
 	uint32_t dsubnode_index;
+	const struct treecli_compact *compact;
+	uint32_t compact_index;
 	const struct treecli_command *command;
 	const struct treecli_value *value;
+	enum treecli_value_operator value_operator;
 
 	char best_match[100];
 	uint32_t best_match_len;
@@ -259,7 +584,10 @@ int32_t treecli_parser_pos_print(struct treecli_parser *parser, bool no_delimite
 /**
  * Search command line and try to get next token. Token is a word describing one
  * subnode, command or value name consisting of alphanumeric characters (lower and
- * uppoer case), underscore, dash, dot and slash.
+ * uppoer case), underscore, dash, dot and slash. Where a node name is
+ * expected (TREECLI_PARSER_CONTEXT_NODE), names can be followed by a pattern
+ * suffix ("*", "[...]" or "{...}"). Expressions in parentheses are returned
+ * as a single token.
  * Input line position is being incremented during search and after execution it
  * points to a position where the search can continue (this apply also if function
  * fails).
@@ -313,12 +641,27 @@ int32_t treecli_parser_free(struct treecli_parser *parser);
  * to set active node for command execution, sets or reads values and executes
  * commands (if requested).
  *
+ * Name of a dynamic node can be replaced by a pattern selecting multiple
+ * instances - "if*" (any suffix), "if[0-3,7]" (numeric suffix ranges) or
+ * "if{1,5,9}" (list of suffixes). The rest of the line is then parsed once
+ * for every selected instance in a single batch of value changes. Results
+ * of individual targets are passed to the target handler, the first failure
+ * is returned. Working position is not changed by lines containing patterns.
+ * Commands completing asynchronously (including output generators) fail
+ * when they are executed for a pattern target. Names which are not valid
+ * patterns (eg. "if[a]") are matched exactly, quoted tokens are never
+ * patterns.
+ *
  * @param parser A parser context used to do command parsing.
  * @param line String with node names, commands and value set/get specifications.
  *
- * @return TREECLI_PARSER_PARSE_LINE_OK if the whole line was parsed successfully.
+ * @return TREECLI_PARSER_PARSE_LINE_OK if the whole line was parsed successfully or
+ *         TREECLI_PARSER_PARSE_LINE_PENDING if a command is completing
+ *         asynchronously. The line must be kept unchanged and passed to
+ *         treecli_parser_resume_line when the command completes.
  */
 int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *line);
+#define TREECLI_PARSER_PARSE_LINE_PENDING 1
 #define TREECLI_PARSER_PARSE_LINE_OK 0
 #define TREECLI_PARSER_PARSE_LINE_FAILED -1
 #define TREECLI_PARSER_PARSE_LINE_NO_MATCHES -2
@@ -330,10 +673,120 @@ int32_t treecli_parser_parse_line(struct treecli_parser *parser, const char *lin
 #define TREECLI_PARSER_PARSE_LINE_UNEXPECTED_TOKEN -8
 #define TREECLI_PARSER_PARSE_LINE_MALFORMED_TOKEN -9
 
+/**
+ * Defer completion of the currently executed command. It must be called from
+ * the command exec callback which then returns TREECLI_PARSER_EXEC_PENDING.
+ * The operation continues elsewhere (in a worker thread, in a state machine
+ * driven by the event loop) and its result is reported using the completion
+ * handle. Only one command can be pending at a time.
+ *
+ * @param parser A parser context.
+ * @param completion Completion handle to fill.
+ * @param cancel Optional callback used to abort the operation.
+ * @param ctx Context passed to the cancel callback.
+ *
+ * @return TREECLI_PARSER_EXEC_PENDING if the completion was registered or
+ *         TREECLI_PARSER_EXEC_DEFER_FAILED otherwise.
+ */
+int32_t treecli_parser_exec_defer(struct treecli_parser *parser, struct treecli_completion *completion, void (*cancel)(void *ctx), void *ctx);
+#define TREECLI_PARSER_EXEC_PENDING 1
+#define TREECLI_PARSER_EXEC_DEFER_FAILED -1
+
+/**
+ * Report completion of a deferred command and continue parsing the rest of
+ * the line which was interrupted by the command.
+ *
+ * @param parser A parser context.
+ * @param completion Completion handle filled by treecli_parser_exec_defer.
+ * @param line The same line previously passed to treecli_parser_parse_line.
+ * @param result Result of the command, negative value if it failed.
+ *
+ * @return The same values as treecli_parser_parse_line or
+ *         TREECLI_PARSER_PARSE_LINE_FAILED if the completion is stale.
+ */
+int32_t treecli_parser_resume_line(struct treecli_parser *parser, const struct treecli_completion *completion, const char *line, int32_t result);
+
+/**
+ * Cancel the pending command. Its cancel callback is called and the working
+ * position is restored. Later completion of the command is ignored.
+ *
+ * @param parser A parser context.
+ *
+ * @return TREECLI_PARSER_CANCEL_OK if a pending command was cancelled or
+ *         TREECLI_PARSER_CANCEL_FAILED if there is no command pending.
+ */
+int32_t treecli_parser_cancel(struct treecli_parser *parser);
+#define TREECLI_PARSER_CANCEL_OK 0
+#define TREECLI_PARSER_CANCEL_FAILED -1
+
+/**
+ * Register an output generator of the currently executed command and defer
+ * its completion. Commands producing large output call it from their exec
+ * callback and return its result instead of printing everything at once.
+ * The generator is called repeatedly by treecli_parser_generator_run, it
+ * should print a small chunk of output using treecli_parser_print on every
+ * call and return TREECLI_PARSER_GENERATOR_MORE until all output is printed.
+ * It returns TREECLI_PARSER_GENERATOR_DONE afterwards or a negative value
+ * if the command failed. Working position is set to the command's node
+ * during generator calls and restored afterwards.
+ *
+ * @param parser A parser context.
+ * @param generator Generator function.
+ * @param ctx Context passed to the generator.
+ *
+ * @return TREECLI_PARSER_EXEC_PENDING if the generator was registered or
+ *         TREECLI_PARSER_EXEC_GENERATOR_FAILED otherwise.
+ */
+int32_t treecli_parser_exec_generator(struct treecli_parser *parser, int32_t (*generator)(struct treecli_parser *parser, void *ctx), void *ctx);
+#define TREECLI_PARSER_EXEC_GENERATOR_FAILED -1
+#define TREECLI_PARSER_GENERATOR_MORE 1
+#define TREECLI_PARSER_GENERATOR_DONE 0
+
+/**
+ * Call the registered output generator until it finishes, the print handler
+ * would block or the budget is exhausted. Completion of the command must be
+ * reported afterwards using parser->generator_completion if the generator
+ * is finished.
+ *
+ * @param parser A parser context.
+ * @param budget Maximum number of generator calls. Zero means to run the
+ *               generator until it finishes regardless of the print handler
+ *               blocking.
+ *
+ * @return TREECLI_PARSER_GENERATOR_MORE if the generator is not finished yet or
+ *         TREECLI_PARSER_GENERATOR_DONE if it finished successfully or
+ *         a negative value returned by the generator or
+ *         TREECLI_PARSER_GENERATOR_RUN_FAILED if there is no generator.
+ */
+int32_t treecli_parser_generator_run(struct treecli_parser *parser, uint32_t budget);
+#define TREECLI_PARSER_GENERATOR_RUN_FAILED -1
+
+/**
+ * Print handlers return a negative value on error, zero if the output was
+ * written or TREECLI_PRINT_WOULD_BLOCK if the output was accepted but the
+ * output channel is full. Output generators are not called until the channel
+ * becomes writable again.
+ */
+#define TREECLI_PRINT_WOULD_BLOCK 1
+
 int32_t treecli_parser_set_print_handler(struct treecli_parser *parser, int32_t (*print_handler)(const char *line, void *ctx), void *ctx);
 #define TREECLI_PARSER_SET_PRINT_HANDLER_OK 0
 #define TREECLI_PARSER_SET_PRINT_HANDLER_FAILED -1
 
+/**
+ * Print a string using the parser print handler. Commands should use it
+ * instead of calling the print handler directly to let the parser know
+ * about the output channel being full.
+ *
+ * @param parser A parser context.
+ * @param line String to print.
+ *
+ * @return Value returned by the print handler or
+ *         TREECLI_PARSER_PRINT_FAILED if no print handler is set.
+ */
+int32_t treecli_parser_print(struct treecli_parser *parser, const char *line);
+#define TREECLI_PARSER_PRINT_FAILED -1
+
 int32_t treecli_parser_set_match_handler(struct treecli_parser *parser, int32_t (*match_handler)(const char *token, enum treecli_match_type match_type, void *ctx), void *ctx);
 #define TREECLI_PARSER_SET_MATCH_HANDLER_OK 0
 #define TREECLI_PARSER_SET_MATCH_HANDLER_FAILED -1
@@ -342,6 +795,21 @@ int32_t treecli_parser_set_best_match_handler(struct treecli_parser *parser, int
 #define TREECLI_PARSER_SET_BEST_MATCH_HANDLER_OK 0
 #define TREECLI_PARSER_SET_BEST_MATCH_HANDLER_FAILED -1
 
+/**
+ * Set a handler receiving results of individual targets of patterns. The
+ * handler is called once for every dynamic node selected by a pattern with
+ * the working position set to the node. NULL disables reporting.
+ *
+ * @param parser A parser context.
+ * @param target_handler Handler to call or NULL.
+ * @param ctx Context passed to the handler.
+ *
+ * @return TREECLI_PARSER_SET_TARGET_HANDLER_OK.
+ */
+int32_t treecli_parser_set_target_handler(struct treecli_parser *parser, int32_t (*target_handler)(struct treecli_parser *parser, int32_t result, void *ctx), void *ctx);
+#define TREECLI_PARSER_SET_TARGET_HANDLER_OK 0
+#define TREECLI_PARSER_SET_TARGET_HANDLER_FAILED -1
+
 uint32_t treecli_parser_strmatch(const char *s1, const char *s2);
 
 int32_t treecli_parser_resolve_match(struct treecli_parser *parser, struct treecli_matches *matches, const char *token);
@@ -353,6 +821,7 @@ int32_t treecli_parser_try_match(struct treecli_parser *parser, struct treecli_m
 #define TREECLI_PARSER_TRY_MATCH_FAILED -1
 
 int32_t treecli_parser_get_matches(struct treecli_parser *parser, const char *token, uint32_t len, struct treecli_matches *matches);
+#define TREECLI_PARSER_GET_MATCHES_COMPACT 9
 #define TREECLI_PARSER_GET_MATCHES_VALUE_LITERAL 8
 #define TREECLI_PARSER_GET_MATCHES_VALUE_OPERATOR 7
 #define TREECLI_PARSER_GET_MATCHES_HELP 6
@@ -386,15 +855,190 @@ int32_t treecli_parser_pos_init(struct treecli_parser_pos *pos);
 #define TREECLI_PARSER_POS_INIT_OK 0
 #define TREECLI_PARSER_POS_INIT_FAILED -1
 
+/**
+ * Get name of a single level of a position.
+ *
+ * @param parser A parser context.
+ * @param pos Position in the tree.
+ * @param depth Level of the position, it must be lower than its depth.
+ * @param buf Buffer of TREECLI_DNODE_MAX_NAME_LEN bytes used to create names
+ *            of dynamic nodes.
+ * @param name Pointer to the name (either static or the buffer).
+ *
+ * @return TREECLI_PARSER_POS_NAME_OK on success or
+ *         TREECLI_PARSER_POS_NAME_FAILED if the name cannot be determined.
+ */
+int32_t treecli_parser_pos_name(struct treecli_parser *parser, const struct treecli_parser_pos *pos, uint32_t depth, char *buf, const char **name);
+#define TREECLI_PARSER_POS_NAME_OK 0
+#define TREECLI_PARSER_POS_NAME_FAILED -1
+
 int32_t treecli_parser_get_current_node(struct treecli_parser *parser, struct treecli_node *node);
 #define TREECLI_PARSER_GET_CURRENT_NODE_OK 0
 #define TREECLI_PARSER_GET_CURRENT_NODE_ROOT -1
 #define TREECLI_PARSER_GET_CURRENT_NODE_FAILED -2
 
+/**
+ * Get subnodes of the node at the current position including subtrees
+ * mounted at runtime.
+ *
+ * @param parser A parser context.
+ * @param node Current node as returned by treecli_parser_get_current_node.
+ * @param subnodes NULL terminated array of subnodes or NULL if there are none.
+ *
+ * @return TREECLI_PARSER_CURRENT_SUBNODES_OK on success or
+ *         TREECLI_PARSER_CURRENT_SUBNODES_FAILED otherwise.
+ */
+int32_t treecli_parser_current_subnodes(struct treecli_parser *parser, const struct treecli_node *node, const struct treecli_node *const **subnodes);
+#define TREECLI_PARSER_CURRENT_SUBNODES_OK 0
+#define TREECLI_PARSER_CURRENT_SUBNODES_FAILED -1
+
+/**
+ * Get the compact tree the node at the current position belongs to.
+ *
+ * @param parser A parser context.
+ * @param compact The compact tree or NULL if the node is not compact.
+ * @param index Index of the node in the compact tree.
+ *
+ * @return TREECLI_PARSER_CURRENT_COMPACT_OK on success or
+ *         TREECLI_PARSER_CURRENT_COMPACT_FAILED otherwise.
+ */
+int32_t treecli_parser_current_compact(struct treecli_parser *parser, const struct treecli_compact **compact, uint32_t *index);
+#define TREECLI_PARSER_CURRENT_COMPACT_OK 0
+#define TREECLI_PARSER_CURRENT_COMPACT_FAILED -1
+
+/**
+ * Print all subnodes (including dynamically created ones) and commands
+ * available at the current position together with their help strings. If
+ * the help limit is set, only the first page of entries is printed.
+ *
+ * @param parser A parser context.
+ *
+ * @return TREECLI_PARSER_HELP_OK on success or
+ *         TREECLI_PARSER_HELP_FAILED otherwise.
+ */
 int32_t treecli_parser_help(struct treecli_parser *parser);
 #define TREECLI_PARSER_HELP_OK 0
 #define TREECLI_PARSER_HELP_FAILED -1
 
+/**
+ * Print help for entries starting with the given prefix only. Enumeration of
+ * the entries stops as soon as a page of entries is printed (if the help
+ * limit is set). TREECLI_PARSER_HELP_MORE is printed in this case and the
+ * listing can be resumed with treecli_parser_help_more.
+ *
+ * @param parser A parser context.
+ * @param prefix Prefix of entry names to print.
+ * @param len Length of the prefix.
+ *
+ * @return TREECLI_PARSER_HELP_OK on success or
+ *         TREECLI_PARSER_HELP_FAILED otherwise.
+ */
+int32_t treecli_parser_help_filter(struct treecli_parser *parser, const char *prefix, uint32_t len);
+
+/**
+ * Print next page of help entries if the previous listing was interrupted.
+ *
+ * @param parser A parser context.
+ *
+ * @return TREECLI_PARSER_HELP_OK if the next page was printed or
+ *         TREECLI_PARSER_HELP_FAILED if there is nothing to continue with.
+ */
+int32_t treecli_parser_help_more(struct treecli_parser *parser);
+
+/**
+ * Set maximum number of help entries printed at once and number of suggestions
+ * passed to the match handler during a single match. Zero disables the limit.
+ *
+ * @param parser A parser context.
+ * @param limit Number of entries in one page.
+ *
+ * @return TREECLI_PARSER_SET_HELP_LIMIT_OK on success or
+ *         TREECLI_PARSER_SET_HELP_LIMIT_FAILED otherwise.
+ */
+int32_t treecli_parser_set_help_limit(struct treecli_parser *parser, uint32_t limit);
+#define TREECLI_PARSER_SET_HELP_LIMIT_OK 0
+#define TREECLI_PARSER_SET_HELP_LIMIT_FAILED -1
+
+/**
+ * Set dictionary used to decode help strings compressed by
+ * treecli_help_compress. Strings which are not compressed (they don't start
+ * with TREECLI_HELP_COMPRESSED) are printed unchanged even if a dictionary
+ * is set.
+ *
+ * @param parser A parser context.
+ * @param dict Help dictionary or NULL to print help strings as they are.
+ *
+ * @return TREECLI_PARSER_SET_HELP_DICT_OK on success or
+ *         TREECLI_PARSER_SET_HELP_DICT_FAILED otherwise.
+ */
+int32_t treecli_parser_set_help_dict(struct treecli_parser *parser, const struct treecli_help_dict *dict);
+#define TREECLI_PARSER_SET_HELP_DICT_OK 0
+#define TREECLI_PARSER_SET_HELP_DICT_FAILED -1
+
+/**
+ * Set workspace used for temporary structures during parsing. It must be set
+ * before the parser is used if it is built with TREECLI_PARSER_LOW_STACK,
+ * the workspace is not used otherwise.
+ *
+ * @param parser A parser context.
+ * @param workspace Workspace allocated by the caller (treecli_workspace.h).
+ *
+ * @return TREECLI_PARSER_SET_WORKSPACE_OK on success or
+ *         TREECLI_PARSER_SET_WORKSPACE_FAILED otherwise.
+ */
+int32_t treecli_parser_set_workspace(struct treecli_parser *parser, struct treecli_parser_workspace *workspace);
+#define TREECLI_PARSER_SET_WORKSPACE_OK 0
+#define TREECLI_PARSER_SET_WORKSPACE_FAILED -1
+
+/**
+ * Use a table of subtrees mounted at runtime. The parser is registered as
+ * a reader of the table, passing NULL unregisters it.
+ *
+ * @param parser A parser context.
+ * @param mounts Mount table shared by all parsers of the tree or NULL.
+ *
+ * @return TREECLI_PARSER_SET_MOUNTS_OK on success or
+ *         TREECLI_PARSER_SET_MOUNTS_FAILED if no more readers can be
+ *         registered.
+ */
+int32_t treecli_parser_set_mounts(struct treecli_parser *parser, struct treecli_mount_table *mounts);
+#define TREECLI_PARSER_SET_MOUNTS_OK 0
+#define TREECLI_PARSER_SET_MOUNTS_FAILED -1
+
+/**
+ * Replace the tree the parser operates on. Working position and positions
+ * saved by the parser are remapped to nodes with the same path in the new
+ * tree or to the root if the path doesn't exist there.
+ *
+ * @param parser A parser context.
+ * @param top Top node of the new tree.
+ *
+ * @return TREECLI_PARSER_SET_TOP_OK on success or
+ *         TREECLI_PARSER_SET_TOP_FAILED otherwise.
+ */
+int32_t treecli_parser_set_top(struct treecli_parser *parser, const struct treecli_node *top);
+#define TREECLI_PARSER_SET_TOP_OK 0
+#define TREECLI_PARSER_SET_TOP_FAILED -1
+
+/**
+ * Enter and leave a read-side section of the mount table. Subtrees detached
+ * in the meantime are not released before the section ends. Sections can
+ * be nested, parser functions enter them internally. Positions pointing
+ * to detached subtrees are moved to the nearest attached node when the
+ * outermost section is entered.
+ *
+ * If the whole tree was replaced (treecli_mount_swap_top), the parser is
+ * moved to the new tree when the outermost section is entered. Until then
+ * it keeps using the previous tree.
+ */
+int32_t treecli_parser_read_lock(struct treecli_parser *parser);
+#define TREECLI_PARSER_READ_LOCK_OK 0
+#define TREECLI_PARSER_READ_LOCK_FAILED -1
+
+int32_t treecli_parser_read_unlock(struct treecli_parser *parser);
+#define TREECLI_PARSER_READ_UNLOCK_OK 0
+#define TREECLI_PARSER_READ_UNLOCK_FAILED -1
+
 int32_t treecli_parser_dnode_get_name(struct treecli_parser *parser, const struct treecli_dnode *dnode, uint32_t index, char *name);
 #define TREECLI_PARSER_DNODE_GET_NAME_OK 0
 #define TREECLI_PARSER_DNODE_GET_NAME_FAILED -1
@@ -411,9 +1055,278 @@ int32_t treecli_parser_str_to_value(struct treecli_parser *parser, const struct
 #define TREECLI_PARSER_STR_TO_VALUE_OK 0
 #define TREECLI_PARSER_STR_TO_VALUE_FAILED -1
 
+/**
+ * Apply a compound operator to a numeric value. The operand is parsed from
+ * the string and the value is modified using its update callback if it is
+ * set. Plain INT32/UINT32/DATA variables without a getter and a setter are
+ * modified atomically, other values are refused. The operand must fit the
+ * value type.
+ *
+ * @param parser A parser context.
+ * @param value INT32, UINT32 or DATA value to modify.
+ * @param op Operator to apply.
+ * @param s Decimal operand (signed for INT32 values).
+ * @param len Length of the operand.
+ *
+ * @return TREECLI_PARSER_STR_UPDATE_VALUE_OK if the value was modified or
+ *         TREECLI_PARSER_STR_UPDATE_VALUE_FAILED otherwise.
+ */
+int32_t treecli_parser_str_update_value(struct treecli_parser *parser, const struct treecli_value *value, enum treecli_value_operator op, const char *s, uint32_t len);
+#define TREECLI_PARSER_STR_UPDATE_VALUE_OK 0
+#define TREECLI_PARSER_STR_UPDATE_VALUE_FAILED -1
+
+/**
+ * Apply an operator to a numeric value using an already evaluated operand,
+ * eg. a result of a compiled expression. The value is modified the same way
+ * as by treecli_parser_str_update_value.
+ *
+ * @param parser A parser context.
+ * @param value INT32, UINT32 or DATA value to modify.
+ * @param op Operator to apply.
+ * @param operand Operand of the operator. It can be negative for UINT32 and
+ *                DATA values only if op is not TREECLI_VALUE_OP_ASSIGN.
+ *
+ * @return TREECLI_PARSER_NUM_UPDATE_VALUE_OK if the value was modified or
+ *         TREECLI_PARSER_NUM_UPDATE_VALUE_FAILED otherwise.
+ */
+int32_t treecli_parser_num_update_value(struct treecli_parser *parser, const struct treecli_value *value, enum treecli_value_operator op, int32_t operand);
+#define TREECLI_PARSER_NUM_UPDATE_VALUE_OK 0
+#define TREECLI_PARSER_NUM_UPDATE_VALUE_FAILED -1
+
 int32_t treecli_parser_set_context(struct treecli_parser *parser, void *context);
 #define TREECLI_PARSER_SET_CONTEXT_OK 0
 #define TREECLI_PARSER_SET_CONTEXT_FAILED -1
 
+/**
+ * Resolve a path to a node, value or command and save the result as a handle.
+ * Path components are delimited by slashes and must match names exactly (no
+ * prefix matching is done). Paths starting with a slash are resolved from the
+ * root node, others from the current working position. ".." can be used to
+ * reference the parent node. Value or command can be only the last component.
+ * Working position of the parser is not changed.
+ *
+ * @param parser A parser context used to resolve the path.
+ * @param path Path to resolve, eg. "/interface/if3/enabled".
+ * @param handle Handle to be filled in on success.
+ *
+ * @return TREECLI_RESOLVE_PATH_OK if the path was resolved or
+ *         TREECLI_RESOLVE_PATH_NOT_FOUND if some of the path components doesn't exist or
+ *         TREECLI_RESOLVE_PATH_FAILED otherwise.
+ */
+int32_t treecli_resolve_path(struct treecli_parser *parser, const char *path, struct treecli_handle *handle);
+#define TREECLI_RESOLVE_PATH_OK 0
+#define TREECLI_RESOLVE_PATH_FAILED -1
+#define TREECLI_RESOLVE_PATH_NOT_FOUND -2
+
+/**
+ * Read a value referenced by the handle. Value getter is used if it is
+ * defined, referenced variable is copied otherwise. The getter runs inside
+ * a read-side section, mounted subtrees are not detached until it returns.
+ *
+ * @param parser A parser context.
+ * @param handle Value handle obtained from treecli_resolve_path.
+ * @param buf Buffer where the value is stored.
+ * @param len Size of the buffer on input, length of the value on output.
+ *
+ * @return TREECLI_HANDLE_GET_OK on success or
+ *         TREECLI_HANDLE_GET_FAILED otherwise.
+ */
+int32_t treecli_handle_get(struct treecli_parser *parser, const struct treecli_handle *handle, void *buf, size_t *len);
+#define TREECLI_HANDLE_GET_OK 0
+#define TREECLI_HANDLE_GET_FAILED -1
+
+/**
+ * Write a value referenced by the handle. Referenced variable is updated (if
+ * present) and value setter is called afterwards (if defined). The variable
+ * is restored if the setter fails. BOOL values are passed as bool, their
+ * setters get the value in a 4 byte long buffer as before. The setter runs
+ * inside a read-side section like getters of treecli_handle_get.
+ *
+ * @param parser A parser context.
+ * @param handle Value handle obtained from treecli_resolve_path.
+ * @param buf New value of the same type as the referenced value.
+ * @param len Length of the new value.
+ *
+ * @return TREECLI_HANDLE_SET_OK on success or
+ *         TREECLI_HANDLE_SET_FAILED otherwise.
+ */
+int32_t treecli_handle_set(struct treecli_parser *parser, const struct treecli_handle *handle, const void *buf, size_t len);
+#define TREECLI_HANDLE_SET_OK 0
+#define TREECLI_HANDLE_SET_FAILED -1
+
+/**
+ * Execute a command referenced by the handle inside a read-side section
+ * (see treecli_handle_get).
+ *
+ * @param parser A parser context.
+ * @param handle Command handle obtained from treecli_resolve_path.
+ *
+ * @return TREECLI_HANDLE_EXEC_OK if the command was executed successfully or
+ *         TREECLI_HANDLE_EXEC_PENDING if the command completes asynchronously
+ *         (its result is reported by the command itself) or
+ *         TREECLI_HANDLE_EXEC_FAILED otherwise (also while a command of
+ *         a parsed line is pending).
+ */
+int32_t treecli_handle_exec(struct treecli_parser *parser, const struct treecli_handle *handle);
+#define TREECLI_HANDLE_EXEC_PENDING 1
+#define TREECLI_HANDLE_EXEC_OK 0
+#define TREECLI_HANDLE_EXEC_FAILED -1
+
+/**
+ * Register a value change watcher. Notify callback of the watcher is called
+ * with all changed values matching the filter after each parsed line, after
+ * a value is set using a handle or when the outermost batch ends.
+ *
+ * @param parser A parser context.
+ * @param watch Watcher structure allocated by the caller. It must stay valid
+ *              until the watcher is removed.
+ * @param filter Value handle to watch a single value, node handle to watch
+ *               the whole subtree or NULL to watch all values (the filter
+ *               is a node handle of the root in this case).
+ * @param notify Notification callback.
+ * @param ctx Context passed to the notification callback.
+ *
+ * @return TREECLI_PARSER_WATCH_OK if the watcher was registered or
+ *         TREECLI_PARSER_WATCH_FAILED otherwise.
+ */
+int32_t treecli_parser_watch(struct treecli_parser *parser, struct treecli_watch *watch, const struct treecli_handle *filter, void (*notify)(struct treecli_parser *parser, const struct treecli_handle changes[], uint32_t count, void *ctx), void *ctx);
+#define TREECLI_PARSER_WATCH_OK 0
+#define TREECLI_PARSER_WATCH_FAILED -1
+
+int32_t treecli_parser_unwatch(struct treecli_parser *parser, struct treecli_watch *watch);
+#define TREECLI_PARSER_UNWATCH_OK 0
+#define TREECLI_PARSER_UNWATCH_FAILED -1
+
+/**
+ * Start a batch of changes (eg. when loading a configuration). Changes are not
+ * delivered to watchers until the matching treecli_parser_batch_end call.
+ * Batches can be nested. treecli_parser_batch_end fails if there is no batch
+ * in progress or if the change handler failed to end the batch.
+ */
+int32_t treecli_parser_batch_begin(struct treecli_parser *parser);
+#define TREECLI_PARSER_BATCH_BEGIN_OK 0
+#define TREECLI_PARSER_BATCH_BEGIN_FAILED -1
+
+int32_t treecli_parser_batch_end(struct treecli_parser *parser);
+#define TREECLI_PARSER_BATCH_END_OK 0
+#define TREECLI_PARSER_BATCH_END_FAILED -1
+
+/**
+ * Deliver pending value changes to watchers unless a batch is in progress.
+ *
+ * @param parser A parser context.
+ *
+ * @return TREECLI_PARSER_FLUSH_CHANGES_OK or
+ *         TREECLI_PARSER_FLUSH_CHANGES_FAILED if the change handler failed.
+ */
+int32_t treecli_parser_flush_changes(struct treecli_parser *parser);
+#define TREECLI_PARSER_FLUSH_CHANGES_OK 0
+#define TREECLI_PARSER_FLUSH_CHANGES_FAILED -1
+
+/**
+ * Set a handler called synchronously after every successful value change at
+ * the position of the value (unlike watchers, no change is ever coalesced or
+ * lost) and with NULL value when the batch of changes ends (at the same time
+ * as changes are delivered to watchers). If the handler fails, the assignment
+ * (or the flush) is reported as failed, although the value has already been
+ * changed. It is used eg. to journal all changes.
+ *
+ * @param parser A parser context.
+ * @param change_handler Handler to call or NULL.
+ * @param ctx Context passed to the handler.
+ *
+ * @return TREECLI_PARSER_SET_CHANGE_HANDLER_OK or
+ *         TREECLI_PARSER_SET_CHANGE_HANDLER_FAILED.
+ */
+int32_t treecli_parser_set_change_handler(struct treecli_parser *parser, int32_t (*change_handler)(struct treecli_parser *parser, const struct treecli_value *value, void *ctx), void *ctx);
+#define TREECLI_PARSER_SET_CHANGE_HANDLER_OK 0
+#define TREECLI_PARSER_SET_CHANGE_HANDLER_FAILED -1
+
+/**
+ * Provide storage for the queue of value changes waiting for delivery to
+ * watchers. Repeated changes of a value are coalesced, each distinct value
+ * changed in a batch takes one entry. Changes which do not fit are not
+ * lost, matching watchers are marked as overflowed instead (see struct
+ * treecli_watch). Without a queue every watcher overflows on the first
+ * change in a batch.
+ *
+ * @param parser A parser context.
+ * @param changes Array of handles, NULL removes the queue.
+ * @param count Number of handles.
+ *
+ * @return TREECLI_PARSER_SET_CHANGES_OK or TREECLI_PARSER_SET_CHANGES_FAILED.
+ */
+int32_t treecli_parser_set_changes(struct treecli_parser *parser, struct treecli_handle *changes, uint32_t count);
+#define TREECLI_PARSER_SET_CHANGES_OK 0
+#define TREECLI_PARSER_SET_CHANGES_FAILED -1
+
+/**
+ * Set a function returning actual time in milliseconds. It is required for
+ * caching of values.
+ */
+int32_t treecli_parser_set_time_handler(struct treecli_parser *parser, uint32_t (*time_handler)(void *ctx), void *ctx);
+#define TREECLI_PARSER_SET_TIME_HANDLER_OK 0
+#define TREECLI_PARSER_SET_TIME_HANDLER_FAILED -1
+
+/**
+ * Provide storage for cached values. Values with a cache policy are read
+ * using their getters only if they are not in the cache or if the cached
+ * value is older than its TTL. Entries are taken only when a getter
+ * succeeds, the oldest entry is replaced if there is no free entry.
+ *
+ * @param parser A parser context.
+ * @param entries Array of cache entries, NULL disables the cache.
+ * @param count Number of entries.
+ *
+ * @return TREECLI_PARSER_SET_CACHE_OK or TREECLI_PARSER_SET_CACHE_FAILED.
+ */
+int32_t treecli_parser_set_cache(struct treecli_parser *parser, struct treecli_cache_entry *entries, uint32_t count);
+#define TREECLI_PARSER_SET_CACHE_OK 0
+#define TREECLI_PARSER_SET_CACHE_FAILED -1
+
+/**
+ * Set cache policy of a getter backed value.
+ *
+ * @param parser A parser context.
+ * @param value Value to cache.
+ * @param ttl Time in milliseconds the value is served from the cache. Zero
+ *            removes the policy.
+ *
+ * @return TREECLI_PARSER_CACHE_POLICY_OK if the policy was set or
+ *         TREECLI_PARSER_CACHE_POLICY_FAILED if there is no space left.
+ */
+int32_t treecli_parser_cache_policy(struct treecli_parser *parser, const struct treecli_value *value, uint32_t ttl);
+#define TREECLI_PARSER_CACHE_POLICY_OK 0
+#define TREECLI_PARSER_CACHE_POLICY_FAILED -1
+
+/**
+ * Invalidate cached values. Values are invalidated automatically when they are
+ * set through the parser.
+ *
+ * @param parser A parser context.
+ * @param handle Value handle to invalidate a single value, node handle to
+ *               invalidate the whole subtree or NULL to invalidate everything.
+ *
+ * @return TREECLI_PARSER_CACHE_INVALIDATE_OK.
+ */
+int32_t treecli_parser_cache_invalidate(struct treecli_parser *parser, const struct treecli_handle *handle);
+#define TREECLI_PARSER_CACHE_INVALIDATE_OK 0
+#define TREECLI_PARSER_CACHE_INVALIDATE_FAILED -1
+
+/**
+ * Read all stale (expired or invalidated) cached values in one pass, eg.
+ * before a status page is rendered.
+ *
+ * @param parser A parser context.
+ * @param handle Node handle to refresh the subtree only or NULL to refresh
+ *               the whole cache.
+ *
+ * @return TREECLI_PARSER_CACHE_REFRESH_OK if all stale values were read or
+ *         TREECLI_PARSER_CACHE_REFRESH_FAILED if some getter failed.
+ */
+int32_t treecli_parser_cache_refresh(struct treecli_parser *parser, const struct treecli_handle *handle);
+#define TREECLI_PARSER_CACHE_REFRESH_OK 0
+#define TREECLI_PARSER_CACHE_REFRESH_FAILED -1
+
 
 #endif
@@ -0,0 +1,563 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "treecli_parser.h"
+#include "treecli_workspace.h"
+#include "treecli_plan.h"
+#include "treecli_expr.h"
+#include "treecli_trace.h"
+
+
+/**
+ * Get the node at current parser position (root node included).
+ */
+static int32_t treecli_plan_current_node(struct treecli_parser *parser, struct treecli_node *node) {
+	int32_t res = treecli_parser_get_current_node(parser, node);
+	if (res == TREECLI_PARSER_GET_CURRENT_NODE_ROOT) {
+		memcpy(node, parser->top, sizeof(struct treecli_node));
+		return 0;
+	}
+	if (res == TREECLI_PARSER_GET_CURRENT_NODE_FAILED) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Find position of an item in a NULL terminated array of pointers.
+ */
+static uint32_t treecli_plan_slot(const void * const *array, const void *item) {
+	uint32_t i = 0;
+	if (array != NULL) {
+		while (array[i] != NULL && array[i] != item) {
+			i++;
+		}
+	}
+
+	return i;
+}
+
+
+int32_t treecli_prepare(struct treecli_parser *parser, struct treecli_plan *plan, const char *line) {
+	if (u_assert(parser != NULL) ||
+	    u_assert(plan != NULL) ||
+	    u_assert(line != NULL)) {
+		return TREECLI_PREPARE_FAILED;
+	}
+
+	memset(plan, 0, sizeof(struct treecli_plan));
+	plan->parser = parser;
+	treecli_parser_read_lock(parser);
+
+	/* Template is resolved by moving the parser in the tree the same way
+	 * the parser does. Save the current state to restore it afterwards. */
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+	enum treecli_parser_mode mode_saved = parser->mode;
+	treecli_parser_set_mode(parser, TREECLI_PARSER_DEFAULT);
+	parser->parsing_context = TREECLI_PARSER_CONTEXT_NODE;
+
+	int32_t ret = TREECLI_PREPARE_OK;
+	int32_t res;
+	bool bound = false;
+	const char *pos = line;
+	const char *token = NULL;
+	uint32_t len;
+
+	while ((res = treecli_token_get(parser, &pos, &token, &len)) == TREECLI_TOKEN_GET_OK) {
+		if (plan->step_count >= TREECLI_PLAN_MAX_STEPS) {
+			ret = TREECLI_PREPARE_FAILED;
+			break;
+		}
+		struct treecli_plan_step *step = &(plan->steps[plan->step_count]);
+
+		struct treecli_node node;
+		if (treecli_plan_current_node(parser, &node) < 0) {
+			ret = TREECLI_PREPARE_FAILED;
+			break;
+		}
+
+		/* Dnode name directly followed by a question mark is a placeholder
+		 * for dynamic node index. */
+		if (parser->parsing_context == TREECLI_PARSER_CONTEXT_NODE && *pos == '?' && *token != '?') {
+			pos++;
+
+			const struct treecli_dnode *d = NULL;
+			if (node.dsubnodes != NULL) {
+				for (size_t j = 0; (d = (*(node.dsubnodes))[j]) != NULL; j++) {
+					if (strlen(d->name) == len && !strncmp(token, d->name, len)) {
+						step->slot = j;
+						break;
+					}
+				}
+			}
+			if (d == NULL) {
+				ret = TREECLI_PREPARE_NO_MATCHES;
+				break;
+			}
+
+			/* The rest of the template is resolved using the first
+			 * existing instance of the dynamic node. */
+			uint32_t i = 0;
+			char name[TREECLI_DNODE_MAX_NAME_LEN];
+			while (i < TREECLI_DNODE_MAX_COUNT && treecli_parser_dnode_get_name(parser, d, i, name) != TREECLI_PARSER_DNODE_GET_NAME_OK) {
+				i++;
+			}
+			if (i == TREECLI_DNODE_MAX_COUNT) {
+				ret = TREECLI_PREPARE_NO_MATCHES;
+				break;
+			}
+
+			step->type = TREECLI_PLAN_STEP_DSUBNODE;
+			step->dnode = d;
+			step->arg = plan->arg_count++;
+			bound = true;
+			if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = d, .dnode_index = i}) != TREECLI_PARSER_POS_MOVE_OK) {
+				ret = TREECLI_PREPARE_FAILED;
+				break;
+			}
+			plan->step_count++;
+			continue;
+		}
+
+		struct treecli_matches matches;
+		int32_t m = treecli_parser_get_matches(parser, token, len, &matches);
+
+		if (m == TREECLI_PARSER_GET_MATCHES_NONE) {
+			ret = TREECLI_PREPARE_NO_MATCHES;
+			break;
+		}
+		if (m == TREECLI_PARSER_GET_MATCHES_MULTIPLE) {
+			ret = TREECLI_PREPARE_MULTIPLE_MATCHES;
+			break;
+		}
+
+		if (m == TREECLI_PARSER_GET_MATCHES_TOP) {
+			step->type = TREECLI_PLAN_STEP_TOP;
+			step->arg = -1;
+			treecli_parser_pos_root(&(parser->pos));
+			plan->step_count++;
+			continue;
+		}
+
+		if (m == TREECLI_PARSER_GET_MATCHES_UP) {
+			step->type = TREECLI_PLAN_STEP_UP;
+			step->arg = -1;
+			if (treecli_parser_pos_up(&(parser->pos)) != TREECLI_PARSER_POS_UP_OK) {
+				ret = TREECLI_PREPARE_FAILED;
+				break;
+			}
+			plan->step_count++;
+			continue;
+		}
+
+		if (m == TREECLI_PARSER_GET_MATCHES_SUBNODE) {
+			step->type = TREECLI_PLAN_STEP_SUBNODE;
+			step->subnode = matches.subnode;
+			step->slot = treecli_plan_slot((const void * const *)node.subnodes, matches.subnode);
+			step->arg = -1;
+			if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = matches.subnode, .dnode = NULL}) != TREECLI_PARSER_POS_MOVE_OK) {
+				ret = TREECLI_PREPARE_FAILED;
+				break;
+			}
+			plan->step_count++;
+			continue;
+		}
+
+		if (m == TREECLI_PARSER_GET_MATCHES_DSUBNODE) {
+			step->type = TREECLI_PLAN_STEP_DSUBNODE;
+			step->dnode = matches.dsubnode;
+			step->dnode_index = matches.dsubnode_index;
+			step->slot = treecli_plan_slot((const void * const *)node.dsubnodes, matches.dsubnode);
+			step->arg = -1;
+			if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = matches.dsubnode, .dnode_index = matches.dsubnode_index}) != TREECLI_PARSER_POS_MOVE_OK) {
+				ret = TREECLI_PREPARE_FAILED;
+				break;
+			}
+			plan->step_count++;
+			continue;
+		}
+
+		/* Nodes of compact trees are static, no lookup is needed. */
+		if (m == TREECLI_PARSER_GET_MATCHES_COMPACT) {
+			step->type = TREECLI_PLAN_STEP_COMPACT;
+			step->compact = matches.compact;
+			step->compact_index = matches.compact_index;
+			step->arg = -1;
+			if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = NULL, .compact = matches.compact, .compact_index = matches.compact_index}) != TREECLI_PARSER_POS_MOVE_OK) {
+				ret = TREECLI_PREPARE_FAILED;
+				break;
+			}
+			plan->step_count++;
+			continue;
+		}
+
+		if (m == TREECLI_PARSER_GET_MATCHES_COMMAND) {
+			step->type = TREECLI_PLAN_STEP_COMMAND;
+			step->command = matches.command;
+			step->slot = treecli_plan_slot((const void * const *)node.commands, matches.command);
+			step->arg = -1;
+			plan->step_count++;
+			continue;
+		}
+
+		/* Value step is completed when its literal is found. */
+		if (m == TREECLI_PARSER_GET_MATCHES_VALUE) {
+			step->type = TREECLI_PLAN_STEP_VALUE;
+			step->value = matches.value;
+			step->slot = treecli_plan_slot((const void * const *)node.values, matches.value);
+			step->arg = -1;
+			step->expr = -1;
+			continue;
+		}
+
+		if (m == TREECLI_PARSER_GET_MATCHES_VALUE_OPERATOR) {
+			step->op = matches.value_operator;
+			continue;
+		}
+
+		if (m == TREECLI_PARSER_GET_MATCHES_VALUE_LITERAL) {
+			enum treecli_value_type type = step->value->value_type;
+			if (len == 1 && *token == '?') {
+				step->arg = plan->arg_count++;
+			} else if (*token == '(' && (type == TREECLI_VALUE_INT32 || type == TREECLI_VALUE_UINT32 || type == TREECLI_VALUE_DATA)) {
+				/* Expressions are compiled now, execution only
+				 * evaluates them. */
+				if (plan->expr_count >= TREECLI_PLAN_MAX_EXPRS) {
+					ret = TREECLI_PREPARE_FAILED;
+					break;
+				}
+				struct treecli_expr *expr = &(plan->exprs[plan->expr_count]);
+				if (treecli_expr_compile(parser, expr, token, len) != TREECLI_EXPR_COMPILE_OK) {
+					ret = TREECLI_PREPARE_FAILED;
+					break;
+				}
+				if (bound && expr->refs_count > 0) {
+					ret = TREECLI_PREPARE_FAILED;
+					break;
+				}
+				step->expr = plan->expr_count++;
+			} else {
+				if ((plan->literals_len + len + 1) > TREECLI_PLAN_LITERALS_LEN) {
+					ret = TREECLI_PREPARE_FAILED;
+					break;
+				}
+				memcpy(&(plan->literals[plan->literals_len]), token, len);
+				step->literal = plan->literals_len;
+				step->literal_len = len;
+				plan->literals_len += len;
+				plan->literals[plan->literals_len++] = '\0';
+			}
+			plan->step_count++;
+			continue;
+		}
+
+		/* Help and all other tokens cannot be prepared. */
+		ret = TREECLI_PREPARE_FAILED;
+		break;
+	}
+
+	if (ret == TREECLI_PREPARE_OK && res != TREECLI_TOKEN_GET_NONE) {
+		ret = TREECLI_PREPARE_FAILED;
+	}
+
+	/* Value without a literal at the end of the template. */
+	if (ret == TREECLI_PREPARE_OK && parser->parsing_context != TREECLI_PARSER_CONTEXT_NODE) {
+		ret = TREECLI_PREPARE_FAILED;
+	}
+
+	treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+	treecli_parser_set_mode(parser, mode_saved);
+	parser->parsing_context = TREECLI_PARSER_CONTEXT_NODE;
+	treecli_parser_read_unlock(parser);
+
+	return ret;
+}
+
+
+/**
+ * Get the item of the plan step. Statically defined nodes cannot change, the
+ * resolved item is used directly. Children of dynamic nodes are looked up
+ * again in the dynamically created node using their saved position.
+ */
+static const void *treecli_plan_lookup(struct treecli_parser *parser, const struct treecli_plan_step *step, const void *item, const char *name) {
+	struct treecli_parser_pos *pos = &(parser->pos);
+
+	if (pos->depth == 0 || pos->levels[pos->depth - 1].dnode == NULL) {
+		return item;
+	}
+
+	struct treecli_node node;
+	if (treecli_plan_current_node(parser, &node) < 0) {
+		return NULL;
+	}
+
+	const void * const *array = NULL;
+	switch (step->type) {
+		case TREECLI_PLAN_STEP_SUBNODE:
+			array = (const void * const *)node.subnodes;
+			break;
+		case TREECLI_PLAN_STEP_DSUBNODE:
+			array = (const void * const *)node.dsubnodes;
+			break;
+		case TREECLI_PLAN_STEP_VALUE:
+			array = (const void * const *)node.values;
+			break;
+		case TREECLI_PLAN_STEP_COMMAND:
+			array = (const void * const *)node.commands;
+			break;
+		default:
+			return NULL;
+	}
+	if (array == NULL) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < step->slot; i++) {
+		if (array[i] == NULL) {
+			return NULL;
+		}
+	}
+	const void *found = array[step->slot];
+	if (found == NULL) {
+		return NULL;
+	}
+
+	/* All item structures start with their name. */
+	if (found != item && strcmp(*(const char * const *)found, name)) {
+		return NULL;
+	}
+
+	return found;
+}
+
+
+int32_t treecli_execute(struct treecli_plan *plan, uint32_t argc, const char *argv[]) {
+	if (u_assert(plan != NULL) ||
+	    u_assert(plan->parser != NULL) ||
+	    u_assert(argc == 0 || argv != NULL)) {
+		return TREECLI_EXECUTE_FAILED;
+	}
+
+	if (argc != plan->arg_count) {
+		return TREECLI_EXECUTE_FAILED;
+	}
+
+	struct treecli_parser *parser = plan->parser;
+
+	/* Nothing can be executed until the pending command completes. */
+	if (parser->exec_pending) {
+		return TREECLI_EXECUTE_FAILED;
+	}
+
+	treecli_parser_read_lock(parser);
+
+	struct treecli_parser_pos parser_pos_saved;
+	treecli_parser_pos_copy(&parser_pos_saved, &(parser->pos));
+
+	int32_t ret = TREECLI_EXECUTE_OK;
+	bool moved = false;
+
+	for (uint32_t i = 0; i < plan->step_count && ret == TREECLI_EXECUTE_OK; i++) {
+		const struct treecli_plan_step *step = &(plan->steps[i]);
+		moved = false;
+
+		switch (step->type) {
+			case TREECLI_PLAN_STEP_TOP:
+				treecli_parser_pos_root(&(parser->pos));
+				moved = true;
+				break;
+
+			case TREECLI_PLAN_STEP_UP:
+				if (treecli_parser_pos_up(&(parser->pos)) != TREECLI_PARSER_POS_UP_OK) {
+					ret = TREECLI_EXECUTE_FAILED;
+				}
+				moved = true;
+				break;
+
+			case TREECLI_PLAN_STEP_SUBNODE: {
+				const struct treecli_node *n = treecli_plan_lookup(parser, step, step->subnode, step->subnode->name);
+				if (n == NULL) {
+					ret = TREECLI_EXECUTE_NOT_FOUND;
+					break;
+				}
+				if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = n, .dnode = NULL}) != TREECLI_PARSER_POS_MOVE_OK) {
+					ret = TREECLI_EXECUTE_FAILED;
+				}
+				moved = true;
+				break;
+			}
+
+			case TREECLI_PLAN_STEP_DSUBNODE: {
+				const struct treecli_dnode *d = treecli_plan_lookup(parser, step, step->dnode, step->dnode->name);
+				if (d == NULL) {
+					ret = TREECLI_EXECUTE_NOT_FOUND;
+					break;
+				}
+
+				uint32_t index = step->dnode_index;
+				if (step->arg >= 0) {
+					const char *s = argv[step->arg];
+					if (u_assert(s != NULL) || *s == '\0') {
+						ret = TREECLI_EXECUTE_FAILED;
+						break;
+					}
+					index = 0;
+					for (; *s != '\0'; s++) {
+						if (*s < '0' || *s > '9') {
+							break;
+						}
+						index = index * 10 + (*s - '0');
+					}
+					if (*s != '\0' || index >= TREECLI_DNODE_MAX_COUNT) {
+						ret = TREECLI_EXECUTE_NOT_FOUND;
+						break;
+					}
+				}
+
+				if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = d, .dnode_index = index}) != TREECLI_PARSER_POS_MOVE_OK) {
+					ret = TREECLI_EXECUTE_FAILED;
+					break;
+				}
+
+				/* Following steps check the existence of the dynamic node
+				 * when its children are looked up. Do it explicitly if
+				 * there is nothing more to do. */
+				if ((i + 1) == plan->step_count) {
+					struct treecli_node node;
+					if (treecli_plan_current_node(parser, &node) < 0) {
+						ret = TREECLI_EXECUTE_NOT_FOUND;
+					}
+				}
+				moved = true;
+				break;
+			}
+
+			case TREECLI_PLAN_STEP_COMPACT:
+				if (treecli_parser_pos_move(&(parser->pos), &(struct treecli_parser_pos_level){.node = NULL, .dnode = NULL, .compact = step->compact, .compact_index = step->compact_index}) != TREECLI_PARSER_POS_MOVE_OK) {
+					ret = TREECLI_EXECUTE_FAILED;
+				}
+				moved = true;
+				break;
+
+			case TREECLI_PLAN_STEP_VALUE: {
+				const struct treecli_value *v = treecli_plan_lookup(parser, step, step->value, step->value->name);
+				if (v == NULL) {
+					ret = TREECLI_EXECUTE_NOT_FOUND;
+					break;
+				}
+
+				if (step->expr >= 0) {
+					int32_t result;
+					if (treecli_expr_eval(parser, &(plan->exprs[step->expr]), &result) != TREECLI_EXPR_EVAL_OK ||
+					    treecli_parser_num_update_value(parser, v, step->op, result) != TREECLI_PARSER_NUM_UPDATE_VALUE_OK) {
+						ret = TREECLI_EXECUTE_VALUE_FAILED;
+					}
+					break;
+				}
+
+				const char *s = &(plan->literals[step->literal]);
+				uint32_t len = step->literal_len;
+				if (step->arg >= 0) {
+					s = argv[step->arg];
+					if (u_assert(s != NULL)) {
+						ret = TREECLI_EXECUTE_FAILED;
+						break;
+					}
+					len = strlen(s);
+				}
+
+				int32_t value_ret;
+				if (step->op == TREECLI_VALUE_OP_ASSIGN) {
+					value_ret = treecli_parser_str_to_value(parser, v, s, len);
+				} else {
+					value_ret = treecli_parser_str_update_value(parser, v, step->op, s, len);
+				}
+				if (value_ret < 0) {
+					ret = TREECLI_EXECUTE_VALUE_FAILED;
+				}
+				break;
+			}
+
+			case TREECLI_PLAN_STEP_COMMAND: {
+				const struct treecli_command *c = treecli_plan_lookup(parser, step, step->command, step->command->name);
+				if (c == NULL) {
+					ret = TREECLI_EXECUTE_NOT_FOUND;
+					break;
+				}
+				if (c->exec == NULL) {
+					break;
+				}
+				TREECLI_TRACE_BEGIN(TREECLI_TRACE_EXEC);
+				int32_t exec_ret = c->exec(parser, c->exec_context);
+				TREECLI_TRACE_END(TREECLI_TRACE_EXEC);
+				if (exec_ret != TREECLI_PARSER_EXEC_PENDING && parser->exec_pending) {
+					/* The command registered a completion but
+					 * finished anyway, its id is not valid. */
+					treecli_parser_exec_drop(parser);
+				}
+				if (exec_ret == TREECLI_PARSER_EXEC_PENDING && parser->exec_pending) {
+					parser->exec_pending = false;
+					if (parser->generator == NULL) {
+						/* Plans cannot be resumed, the command
+						 * reports its result directly to the
+						 * caller. */
+						ret = TREECLI_EXECUTE_PENDING;
+						break;
+					}
+					/* Output generators are run until they finish. */
+					exec_ret = treecli_parser_generator_run(parser, 0);
+				}
+				if (exec_ret < 0) {
+					ret = TREECLI_EXECUTE_COMMAND_FAILED;
+				}
+				break;
+			}
+
+			default:
+				ret = TREECLI_EXECUTE_FAILED;
+				break;
+		}
+	}
+
+	/* Keep the new working position only if the plan ends with a tree
+	 * traversal action and everything went well. */
+	if (ret != TREECLI_EXECUTE_OK || moved == false) {
+		treecli_parser_pos_copy(&(parser->pos), &parser_pos_saved);
+	}
+	if (treecli_parser_flush_changes(parser) != TREECLI_PARSER_FLUSH_CHANGES_OK && ret == TREECLI_EXECUTE_OK) {
+		ret = TREECLI_EXECUTE_FAILED;
+	}
+	treecli_parser_read_unlock(parser);
+
+	return ret;
+}
@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_PLAN_H_
+#define _TREECLI_PLAN_H_
+
+#include <stdint.h>
+
+#include "treecli_parser.h"
+#include "treecli_expr.h"
+
+#ifndef TREECLI_PLAN_MAX_STEPS
+#define TREECLI_PLAN_MAX_STEPS 16
+#endif
+
+#ifndef TREECLI_PLAN_LITERALS_LEN
+#define TREECLI_PLAN_LITERALS_LEN 64
+#endif
+
+/**
+ * Maximum number of expression literals compiled into a single plan.
+ */
+#ifndef TREECLI_PLAN_MAX_EXPRS
+#define TREECLI_PLAN_MAX_EXPRS 1
+#endif
+
+
+enum treecli_plan_step_type {
+	TREECLI_PLAN_STEP_TOP = 0,
+	TREECLI_PLAN_STEP_UP,
+	TREECLI_PLAN_STEP_SUBNODE,
+	TREECLI_PLAN_STEP_DSUBNODE,
+	TREECLI_PLAN_STEP_COMPACT,
+	TREECLI_PLAN_STEP_VALUE,
+	TREECLI_PLAN_STEP_COMMAND,
+};
+
+/**
+ * Single resolved action of a prepared command line.
+ */
+struct treecli_plan_step {
+	enum treecli_plan_step_type type;
+
+	const struct treecli_node *subnode;
+	const struct treecli_dnode *dnode;
+	uint32_t dnode_index;
+	const struct treecli_compact *compact;
+	uint32_t compact_index;
+	const struct treecli_command *command;
+	const struct treecli_value *value;
+
+	/**
+	 * Position of the item in the subnode/dnode/value/command array of its
+	 * parent node. Items of dynamically created nodes are looked up again
+	 * using this index when the plan is executed.
+	 */
+	uint32_t slot;
+
+	/**
+	 * Index of the argument bound to this step (dnode index or value
+	 * literal) or -1 if the step has no argument. Value steps without
+	 * an argument use literal saved in the plan. Values are modified using
+	 * the operator op.
+	 */
+	int32_t arg;
+	enum treecli_value_operator op;
+	uint32_t literal;
+	uint32_t literal_len;
+
+	/**
+	 * Index of the compiled expression used instead of the literal or -1
+	 * if the literal is not an expression.
+	 */
+	int32_t expr;
+};
+
+/**
+ * Prepared command line. It is resolved only once by treecli_prepare and can
+ * be executed many times afterwards with different arguments bound to its
+ * placeholders. No token matching is done during execution. Plans resolved
+ * into a subtree mounted at runtime are invalid after it is detached.
+ */
+struct treecli_plan {
+	struct treecli_parser *parser;
+
+	struct treecli_plan_step steps[TREECLI_PLAN_MAX_STEPS];
+	uint32_t step_count;
+	uint32_t arg_count;
+
+	char literals[TREECLI_PLAN_LITERALS_LEN];
+	uint32_t literals_len;
+
+	struct treecli_expr exprs[TREECLI_PLAN_MAX_EXPRS];
+	uint32_t expr_count;
+};
+
+
+/**
+ * Resolve a command line template into a plan. The template uses the same
+ * syntax as lines passed to treecli_parser_parse_line with two kinds of
+ * placeholders:
+ *
+ * - dnode name directly followed by a question mark (eg. "if?") is bound to
+ *   an argument containing decimal index of the dynamic node
+ * - question mark used as a value literal (eg. "enabled=?") is bound to an
+ *   argument containing the literal
+ *
+ * Placeholders are numbered from left to right. The template is resolved
+ * relative to the current working position of the parser. Expression
+ * literals of numeric values (eg. "mtu=(base-mtu - 28)") are compiled here,
+ * their references are resolved only once. Expressions with references
+ * cannot follow a dnode placeholder as they would be bound to the instance
+ * used to resolve the template.
+ *
+ * @param parser Parser used to resolve and later execute the plan.
+ * @param plan Plan to initialize.
+ * @param line Command line template, eg. "interface if? enabled=?".
+ *
+ * @return TREECLI_PREPARE_OK if the template was resolved successfully or
+ *         TREECLI_PREPARE_NO_MATCHES if some of the tokens cannot be matched or
+ *         TREECLI_PREPARE_MULTIPLE_MATCHES if some of the tokens is ambiguous or
+ *         TREECLI_PREPARE_FAILED otherwise.
+ */
+int32_t treecli_prepare(struct treecli_parser *parser, struct treecli_plan *plan, const char *line);
+#define TREECLI_PREPARE_OK 0
+#define TREECLI_PREPARE_FAILED -1
+#define TREECLI_PREPARE_NO_MATCHES -2
+#define TREECLI_PREPARE_MULTIPLE_MATCHES -3
+
+/**
+ * Execute previously prepared plan with arguments bound to its placeholders.
+ * Commands are executed and values are set regardless of the parser mode.
+ * Working position is updated only if the plan ends with a tree traversal
+ * action, the same way treecli_parser_parse_line does.
+ *
+ * @param plan Plan prepared by treecli_prepare.
+ * @param argc Number of arguments, must match the number of placeholders.
+ * @param argv Array of arguments.
+ *
+ * @return TREECLI_EXECUTE_OK if all actions were executed successfully or
+ *         TREECLI_EXECUTE_PENDING if a command completes asynchronously
+ *         (remaining actions of the plan are not executed) or
+ *         TREECLI_EXECUTE_NOT_FOUND if a bound dynamic node doesn't exist or
+ *         TREECLI_EXECUTE_COMMAND_FAILED if a command failed or
+ *         TREECLI_EXECUTE_VALUE_FAILED if a value cannot be set or
+ *         TREECLI_EXECUTE_FAILED otherwise (also while a command of a
+ *         parsed line is pending).
+ */
+int32_t treecli_execute(struct treecli_plan *plan, uint32_t argc, const char *argv[]);
+#define TREECLI_EXECUTE_PENDING 1
+#define TREECLI_EXECUTE_OK 0
+#define TREECLI_EXECUTE_FAILED -1
+#define TREECLI_EXECUTE_NOT_FOUND -2
+#define TREECLI_EXECUTE_COMMAND_FAILED -3
+#define TREECLI_EXECUTE_VALUE_FAILED -4
+
+
+#endif
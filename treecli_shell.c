@@ -26,11 +26,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 
 #include "lineedit.h"
 #include "treecli_parser.h"
 #include "treecli_shell.h"
+#include "treecli_trace.h"
 
 int32_t treecli_shell_init(struct treecli_shell *sh, const struct treecli_node *top) {
 	assert(sh != NULL);
@@ -43,11 +45,29 @@ int32_t treecli_shell_init(struct treecli_shell *sh, const struct treecli_node *
 	sh->hostname = TREECLI_SHELL_DEFAULT_HOSTNAME;
 	sh->prompt_color = TREECLI_SHELL_DEFAULT_PROMPT_COLOR;
 	sh->error_color = TREECLI_SHELL_DEFAULT_ERROR_COLOR;
+	sh->exec_line = NULL;
+	sh->output_buffered = false;
+	sh->output_len = 0;
+	sh->exec_quiet = false;
+	sh->paste = false;
+	sh->refresh_pending = false;
+	sh->script_depth = 0;
+	sh->script_name = NULL;
+	sh->script_line = 0;
+	sh->record_write = NULL;
+	sh->record_time = NULL;
+	sh->record_ctx = NULL;
+	sh->record_feed = false;
 
 	/* initialize embedded command parser */
 	if (treecli_parser_init(&(sh->parser), top) != TREECLI_PARSER_INIT_OK) {
 		return TREECLI_SHELL_INIT_FAILED;
 	}
+#if TREECLI_PARSER_LOW_STACK
+	if (treecli_parser_set_workspace(&(sh->parser), &(sh->workspace)) != TREECLI_PARSER_SET_WORKSPACE_OK) {
+		return TREECLI_SHELL_INIT_FAILED;
+	}
+#endif
 	if (treecli_parser_set_print_handler(&(sh->parser), treecli_shell_print_handler, (void *)sh) != TREECLI_PARSER_SET_PRINT_HANDLER_OK) {
 		return TREECLI_SHELL_INIT_FAILED;
 	}
@@ -57,6 +77,12 @@ int32_t treecli_shell_init(struct treecli_shell *sh, const struct treecli_node *
 	if (treecli_parser_set_best_match_handler(&(sh->parser), treecli_shell_best_match_handler, (void *)sh) != TREECLI_PARSER_SET_BEST_MATCH_HANDLER_OK) {
 		return TREECLI_SHELL_INIT_FAILED;
 	}
+	if (treecli_parser_set_target_handler(&(sh->parser), treecli_shell_target_handler, (void *)sh) != TREECLI_PARSER_SET_TARGET_HANDLER_OK) {
+		return TREECLI_SHELL_INIT_FAILED;
+	}
+	if (treecli_parser_set_help_limit(&(sh->parser), TREECLI_SHELL_HELP_LIMIT) != TREECLI_PARSER_SET_HELP_LIMIT_OK) {
+		return TREECLI_SHELL_INIT_FAILED;
+	}
 
 	/* initialize line editing library */
 	if (lineedit_init(&(sh->line), TREECLI_SHELL_LINE_LEN) != LINEEDIT_INIT_OK) {
@@ -122,8 +148,8 @@ int32_t treecli_shell_prompt_callback(struct lineedit *le, void *ctx) {
 		/* TODO: system/host name should be printed instead */
 		lineedit_escape_print(le, ESC_COLOR, sh->prompt_color);
 		lineedit_escape_print(le, ESC_BOLD, 0);
-		sh->print_handler(sh->hostname, sh->print_handler_ctx);
-		sh->print_handler(" ", sh->print_handler_ctx);
+		treecli_shell_print_handler(sh->hostname, (void *)sh);
+		treecli_shell_print_handler(" ", (void *)sh);
 		len += 1 + strlen(sh->hostname);
 
 		lineedit_escape_print(le, ESC_DEFAULT, 0);
@@ -136,7 +162,7 @@ int32_t treecli_shell_prompt_callback(struct lineedit *le, void *ctx) {
 		}
 
 		lineedit_escape_print(le, ESC_BOLD, 0);
-		sh->print_handler(" > ", sh->print_handler_ctx);
+		treecli_shell_print_handler(" > ", (void *)sh);
 		lineedit_escape_print(le, ESC_DEFAULT, 0);
 		len += 3;
 
@@ -149,17 +175,89 @@ int32_t treecli_shell_prompt_callback(struct lineedit *le, void *ctx) {
 }
 
 
+/**
+ * Write a record of the session if the recorder is set.
+ */
+static void treecli_shell_record(struct treecli_shell *sh, enum treecli_shell_record_type type, uint32_t time, const void *data, size_t len) {
+	const uint8_t *d = (const uint8_t *)data;
+
+	while (sh->record_write != NULL && len > 0) {
+		uint32_t chunk = (len > TREECLI_SHELL_RECORD_MAX_DATA) ? TREECLI_SHELL_RECORD_MAX_DATA : len;
+
+		uint8_t header[TREECLI_SHELL_RECORD_HEADER_LEN];
+		header[0] = (uint8_t)type;
+		for (uint32_t i = 0; i < 4; i++) {
+			header[1 + i] = (uint8_t)(time >> (8 * i));
+		}
+		header[5] = (uint8_t)chunk;
+		header[6] = (uint8_t)(chunk >> 8);
+
+		if (sh->record_write(header, sizeof(header), sh->record_ctx) < 0 ||
+		    sh->record_write(d, chunk, sh->record_ctx) < 0) {
+			sh->record_write = NULL;
+		}
+		d += chunk;
+		len -= chunk;
+	}
+}
+
+
+/**
+ * Write output using the print handler.
+ */
+static int32_t treecli_shell_output(struct treecli_shell *sh, const char *s) {
+	if (sh->record_write != NULL) {
+		treecli_shell_record(sh, TREECLI_SHELL_RECORD_OUTPUT, sh->record_time(sh->record_ctx), s, strlen(s));
+	}
+
+	TREECLI_TRACE_BEGIN(TREECLI_TRACE_PRINT);
+	int32_t ret = sh->print_handler(s, sh->print_handler_ctx);
+	TREECLI_TRACE_END(TREECLI_TRACE_PRINT);
+
+	return ret;
+}
+
+
+/**
+ * Write buffered output using the print handler.
+ */
+static int32_t treecli_shell_flush(struct treecli_shell *sh) {
+	if (sh->output_len == 0) {
+		return 0;
+	}
+	sh->output[sh->output_len] = '\0';
+	sh->output_len = 0;
+
+	return treecli_shell_output(sh, sh->output);
+}
+
+
 int32_t treecli_shell_print_handler(const char *line, void *ctx) {
 	assert(line != NULL);
 	assert(ctx != NULL);
 
 	struct treecli_shell *sh = (struct treecli_shell *)ctx;
 
-	if (sh->print_handler) {
-		sh->print_handler(line, sh->print_handler_ctx);
+	if (sh->print_handler == NULL) {
+		return 0;
 	}
 
-	return 0;
+	/* Output is collected and written at once while a chunk of input is
+	 * being processed. */
+	if (sh->output_buffered) {
+		int32_t ret = 0;
+		while (*line != '\0') {
+			if (sh->output_len == TREECLI_SHELL_OUTPUT_BUF_LEN) {
+				ret = treecli_shell_flush(sh);
+			}
+			sh->output[sh->output_len++] = *line++;
+		}
+		return ret;
+	}
+
+	/* Return value is forwarded to let the parser know if the output
+	 * channel is full. */
+	return treecli_shell_output(sh, line);
 }
 
 
@@ -211,58 +309,208 @@ int32_t treecli_shell_best_match_handler(const char *token, uint32_t token_len,
 }
 
 
+/**
+ * Get a message describing the parser error or NULL if there is no error.
+ */
+static const char *treecli_shell_error_str(int32_t res) {
+	switch (res) {
+		case TREECLI_PARSER_PARSE_LINE_FAILED:
+			return "error: command parsing failed\n";
+		case TREECLI_PARSER_PARSE_LINE_MULTIPLE_MATCHES:
+			return "error: multiple matches\n";
+		case TREECLI_PARSER_PARSE_LINE_NO_MATCHES:
+			return "error: no match\n";
+		case TREECLI_PARSER_PARSE_LINE_CANNOT_MOVE:
+			return "error: cannot change working position\n";
+		case TREECLI_PARSER_PARSE_LINE_EXPECTING_VALUE:
+			return "error: value expected\n";
+		case TREECLI_PARSER_PARSE_LINE_UNEXPECTED_TOKEN:
+			return "error: unexpected token\n";
+		case TREECLI_PARSER_PARSE_LINE_COMMAND_FAILED:
+			return "error: command execution failed\n";
+		case TREECLI_PARSER_PARSE_LINE_VALUE_FAILED:
+			return "error: value parsing failed\n";
+		case TREECLI_PARSER_PARSE_LINE_MALFORMED_TOKEN:
+			return "error: malformed token\n";
+		default:
+			return NULL;
+	}
+}
+
+
+/**
+ * Print a line marking the error position shifted by indent characters
+ * followed by the error message.
+ */
+static void treecli_shell_print_error(struct treecli_shell *sh, int32_t res, uint32_t indent) {
+	/* Scripts are executed without any terminal escapes. */
+	if (sh->script_depth == 0) {
+		lineedit_escape_print(&(sh->line), ESC_COLOR, sh->error_color);
+		//~ lineedit_escape_print(&(sh->line), ESC_BOLD, 0);
+	}
+	for (uint32_t i = 0; i < (sh->parser.error_pos + indent); i++) {
+		treecli_shell_print_handler("-", (void *)sh);
+	}
+	treecli_shell_print_handler("^\n", (void *)sh);
+
+	/* Errors in scripts are prefixed with the script name and line
+	 * number. */
+	if (sh->script_depth > 0) {
+		char num[12];
+		snprintf(num, sizeof(num), ":%u: ", (unsigned int)sh->script_line);
+		treecli_shell_print_handler(sh->script_name, (void *)sh);
+		treecli_shell_print_handler(num, (void *)sh);
+	}
+
+	const char *msg = treecli_shell_error_str(res);
+	if (msg != NULL) {
+		treecli_shell_print_handler(msg, (void *)sh);
+	}
+	if (sh->script_depth == 0) {
+		lineedit_escape_print(&(sh->line), ESC_DEFAULT, 0);
+	}
+}
+
+
+int32_t treecli_shell_target_handler(struct treecli_parser *parser, int32_t result, void *ctx) {
+	assert(parser != NULL);
+	assert(ctx != NULL);
+
+	struct treecli_shell *sh = (struct treecli_shell *)ctx;
+
+	const char *msg = treecli_shell_error_str(result);
+	if (msg == NULL) {
+		return 0;
+	}
+
+	if (sh->script_depth == 0) {
+		lineedit_escape_print(&(sh->line), ESC_COLOR, sh->error_color);
+	}
+	treecli_parser_pos_print(parser, false);
+	treecli_shell_print_handler(": ", (void *)sh);
+	treecli_shell_print_handler(msg, (void *)sh);
+	if (sh->script_depth == 0) {
+		lineedit_escape_print(&(sh->line), ESC_DEFAULT, 0);
+	}
+
+	return 0;
+}
+
+
 int32_t treecli_shell_print_parser_result(struct treecli_shell *sh, int32_t res) {
 	assert(sh != NULL);
 	if (sh->print_handler == NULL) {
 		return TREECLI_SHELL_KEYPRESS_FAILED;
 	}
 
-	if (res == TREECLI_PARSER_PARSE_LINE_OK) {
-		/* Everything went good, do not print anything, just move on. */
+	if (res == TREECLI_PARSER_PARSE_LINE_OK || res == TREECLI_PARSER_PARSE_LINE_PENDING) {
+		/* Everything went good (or the result is not known yet), do
+		 * not print anything, just move on. */
 		return TREECLI_SHELL_PRINT_PARSER_RESULT_OK;
-	} else {
-		/* Error occured, print error position.
-		 * TODO: shift depending on prompt length*/
-		lineedit_escape_print(&(sh->line), ESC_COLOR, sh->error_color);
-		//~ lineedit_escape_print(&(sh->line), ESC_BOLD, 0);
-		for (uint32_t i = 0; i < (sh->parser.error_pos + sh->line.prompt_len); i++) {
-			sh->print_handler("-", sh->print_handler_ctx);
-		}
-		sh->print_handler("^\n", sh->print_handler_ctx);
+	}
 
-		if (res == TREECLI_PARSER_PARSE_LINE_FAILED) {
-			sh->print_handler("error: command parsing failed\n", sh->print_handler_ctx);
-		}
-		if (res == TREECLI_PARSER_PARSE_LINE_MULTIPLE_MATCHES) {
-			sh->print_handler("error: multiple matches\n", sh->print_handler_ctx);
-		}
-		if (res == TREECLI_PARSER_PARSE_LINE_NO_MATCHES) {
-			sh->print_handler("error: no match\n", sh->print_handler_ctx);
-		}
-		if (res == TREECLI_PARSER_PARSE_LINE_CANNOT_MOVE) {
-			sh->print_handler("error: cannot change working position\n", sh->print_handler_ctx);
-		}
-		if (res == TREECLI_PARSER_PARSE_LINE_EXPECTING_VALUE) {
-			sh->print_handler("error: value expected\n", sh->print_handler_ctx);
-		}
-		if (res == TREECLI_PARSER_PARSE_LINE_UNEXPECTED_TOKEN) {
-			sh->print_handler("error: unexpected token\n", sh->print_handler_ctx);
-		}
-		if (res == TREECLI_PARSER_PARSE_LINE_COMMAND_FAILED) {
-			sh->print_handler("error: command execution failed\n", sh->print_handler_ctx);
-		}
-		if (res == TREECLI_PARSER_PARSE_LINE_VALUE_FAILED) {
-			sh->print_handler("error: value parsing failed\n", sh->print_handler_ctx);
-		}
-		if (res == TREECLI_PARSER_PARSE_LINE_MALFORMED_TOKEN) {
-			sh->print_handler("error: malformed token\n", sh->print_handler_ctx);
+	/* Error occured, print error position below the edited line. */
+	treecli_shell_print_error(sh, res, sh->line.prompt_len);
+
+	return TREECLI_SHELL_PRINT_PARSER_RESULT_OK;
+}
+
+
+/**
+ * Display the prompt if it was omitted by silent execution.
+ */
+static void treecli_shell_refresh_pending(struct treecli_shell *sh) {
+	if (sh->refresh_pending) {
+		sh->refresh_pending = false;
+		lineedit_clear(&(sh->line));
+		lineedit_refresh(&(sh->line));
+	}
+}
+
+
+/**
+ * Print result of the parsed line and prepare lineedit for a new command.
+ */
+static void treecli_shell_line_done(struct treecli_shell *sh, int32_t parser_ret) {
+	/* Lines executed silently were not echoed. Print the line to show
+	 * where the error is, the prompt is refreshed after the input ends. */
+	if (sh->exec_quiet) {
+		if (parser_ret != TREECLI_PARSER_PARSE_LINE_OK) {
+			treecli_shell_print_handler(sh->exec_line, (void *)sh);
+			treecli_shell_print_handler("\r\n", (void *)sh);
+			treecli_shell_print_error(sh, parser_ret, 0);
 		}
-		lineedit_escape_print(&(sh->line), ESC_DEFAULT, 0);
-		return TREECLI_SHELL_PRINT_PARSER_RESULT_OK;
+		sh->refresh_pending = true;
+		return;
+	}
+
+	treecli_shell_print_parser_result(sh, parser_ret);
+	lineedit_clear(&(sh->line));
+	lineedit_refresh(&(sh->line));
+}
 
+
+/**
+ * Check if the line is the built-in source command and find the name of the
+ * file to source. Trailing spaces of the line are cut off.
+ */
+static bool treecli_shell_source_path(char *cmd, char **path) {
+	while (*cmd == ' ') {
+		cmd++;
 	}
 
-	return TREECLI_SHELL_PRINT_PARSER_RESULT_FAILED;
+	uint32_t len = strlen(TREECLI_SHELL_SOURCE_CMD);
+	if (strncmp(cmd, TREECLI_SHELL_SOURCE_CMD, len) != 0 || cmd[len] != ' ') {
+		return false;
+	}
+	cmd += len;
+	while (*cmd == ' ') {
+		cmd++;
+	}
+
+	len = strlen(cmd);
+	while (len > 0 && cmd[len - 1] == ' ') {
+		len--;
+	}
+	if (len == 0) {
+		return false;
+	}
+	cmd[len] = '\0';
+	*path = cmd;
+
+	return true;
+}
+
+
+/**
+ * Execute a complete command line. The line must stay unchanged until the
+ * command completes if it is deferred.
+ */
+static void treecli_shell_execute(struct treecli_shell *sh, char *cmd, bool quiet) {
+	sh->exec_line = cmd;
+	sh->exec_quiet = quiet;
+
+	/* Scripts report their errors themselves. */
+	char *path;
+	if (treecli_shell_source_path(cmd, &path)) {
+		treecli_shell_source(sh, path);
+		treecli_shell_line_done(sh, TREECLI_PARSER_PARSE_LINE_OK);
+		return;
+	}
+
+	treecli_parser_set_mode(&(sh->parser), TREECLI_PARSER_ALLOW_EXEC);
+	int32_t parser_ret = treecli_parser_parse_line(&(sh->parser), cmd);
+
+	/* Keep the line until the command completes. Output of generators
+	 * is started immediately. */
+	if (parser_ret == TREECLI_PARSER_PARSE_LINE_PENDING) {
+		if (sh->parser.generator != NULL) {
+			treecli_shell_writable(sh);
+		}
+		return;
+	}
+
+	treecli_shell_line_done(sh, parser_ret);
 }
 
 
@@ -272,30 +520,61 @@ int32_t treecli_shell_keypress(struct treecli_shell *sh, int c) {
 		return TREECLI_SHELL_KEYPRESS_FAILED;
 	}
 
+	if (sh->record_write != NULL && sh->record_feed == false) {
+		uint8_t key = (uint8_t)c;
+		treecli_shell_record(sh, TREECLI_SHELL_RECORD_INPUT, sh->record_time(sh->record_ctx), &key, 1);
+	}
+
+	/* A command is still running. Input is not passed to the line editor
+	 * as the line is needed to continue parsing when the command completes.
+	 * Ctrl-C cancels the command, other keys are ignored. */
+	if (sh->parser.exec_pending) {
+		if (c == TREECLI_SHELL_CANCEL_KEY) {
+			treecli_parser_cancel(&(sh->parser));
+			treecli_shell_print_handler("^C\r\n", (void *)sh);
+			sh->refresh_pending = false;
+			lineedit_clear(&(sh->line));
+			lineedit_refresh(&(sh->line));
+		}
+		return TREECLI_SHELL_KEYPRESS_OK;
+	}
+
+	/* Keys are edited on a displayed prompt only, even if they are not
+	 * passed through treecli_shell_feed. */
+	treecli_shell_refresh_pending(sh);
+
+	/* Paged help output is continued if space or enter is pressed on
+	 * an empty line. Any other key cancels it. */
+	if (sh->parser.help_more) {
+		char *cmd;
+		lineedit_get_line(&(sh->line), &cmd);
+		if (cmd[0] == '\0' && (c == ' ' || c == '\r' || c == '\n')) {
+			treecli_shell_print_handler("\r\n", (void *)sh);
+			treecli_parser_help_more(&(sh->parser));
+			lineedit_refresh(&(sh->line));
+			return TREECLI_SHELL_KEYPRESS_OK;
+		}
+		sh->parser.help_more = false;
+	}
+
 	int32_t ret = lineedit_keypress(&(sh->line), c);
 
 	if (ret == LINEEDIT_ENTER) {
 		/* Always move to another line before parsing. */
-		sh->print_handler("\r\n", sh->print_handler_ctx);
+		treecli_shell_print_handler("\r\n", (void *)sh);
 
 		/* Line editing is finished (ENTER pressed), get line from line
 		 * edit library and try to parse it */
 		char *cmd;
 		lineedit_get_line(&(sh->line), &cmd);
-		treecli_parser_set_mode(&(sh->parser), TREECLI_PARSER_ALLOW_EXEC);
-		int32_t parser_ret = treecli_parser_parse_line(&(sh->parser), cmd);
-
-		/* Print parsing results and prepare lineedit for new command. */
-		treecli_shell_print_parser_result(sh, parser_ret);
-		lineedit_clear(&(sh->line));
-		lineedit_refresh(&(sh->line));
+		treecli_shell_execute(sh, cmd, false);
 
 		return TREECLI_SHELL_KEYPRESS_OK;
 	}
 
 	if (ret == LINEEDIT_TAB) {
 		/* always move to next line after <tab> press */
-		sh->print_handler("\r\n", sh->print_handler_ctx);
+		treecli_shell_print_handler("\r\n", (void *)sh);
 
 		/* we are autocompleting only at cursor position - get it */
 		uint32_t cursor;
@@ -324,7 +603,7 @@ int32_t treecli_shell_keypress(struct treecli_shell *sh, int c) {
 				sh->autocomplete_at = cursor;
 				parser_ret = treecli_parser_parse_line(&(sh->parser), cmd);
 
-				sh->print_handler("\r\n", sh->print_handler_ctx);
+				treecli_shell_print_handler("\r\n", (void *)sh);
 
 				/* and run the parser for the third time to
 				 * possibly autocomplete suggested tokens */
@@ -343,7 +622,7 @@ int32_t treecli_shell_keypress(struct treecli_shell *sh, int c) {
 			sh->autocomplete_at = cursor;
 			parser_ret = treecli_parser_parse_line(&(sh->parser), cmd);
 
-			sh->print_handler("\r\n", sh->print_handler_ctx);
+			treecli_shell_print_handler("\r\n", (void *)sh);
 
 			treecli_parser_set_mode(&(sh->parser), TREECLI_PARSER_ALLOW_BEST_MATCH);
 			sh->autocomplete = 1;
@@ -363,6 +642,387 @@ int32_t treecli_shell_keypress(struct treecli_shell *sh, int c) {
 }
 
 
+/**
+ * Check if the buffer starts with a complete line of printable characters
+ * which fits into the line buffer. Length of the line without the line
+ * terminator is returned or zero if there is no such line.
+ */
+static uint32_t treecli_shell_fast_line(const char *buf, uint32_t len) {
+	for (uint32_t i = 0; i < len && i < TREECLI_SHELL_LINE_LEN; i++) {
+		if (buf[i] == '\r' || buf[i] == '\n') {
+			return i;
+		}
+		if (buf[i] < ' ' || buf[i] > '~') {
+			return 0;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Check if the buffer starts with the escape sequence.
+ */
+static bool treecli_shell_match_seq(const char *buf, uint32_t len, const char *seq) {
+	uint32_t seq_len = strlen(seq);
+
+	return len >= seq_len && memcmp(buf, seq, seq_len) == 0;
+}
+
+
+int32_t treecli_shell_feed(struct treecli_shell *sh, const char *buf, uint32_t len) {
+	assert(sh != NULL);
+	assert(buf != NULL);
+	if (sh->print_handler == NULL) {
+		return TREECLI_SHELL_FEED_FAILED;
+	}
+
+	sh->output_buffered = true;
+
+	/* Input is recorded before its output. */
+	if (sh->record_write != NULL) {
+		treecli_shell_record(sh, TREECLI_SHELL_RECORD_FEED, sh->record_time(sh->record_ctx), buf, len);
+		sh->record_feed = true;
+	}
+
+	uint32_t i = 0;
+	bool busy = sh->parser.exec_pending;
+	while (i < len) {
+		/* Stop if a command from this chunk is still running, the rest
+		 * of the input must be fed again after it completes. */
+		if (busy == false && sh->parser.exec_pending) {
+			break;
+		}
+
+		/* Bracketed paste start and end sequences. */
+		if (treecli_shell_match_seq(buf + i, len - i, TREECLI_SHELL_PASTE_START)) {
+			sh->paste = true;
+			i += strlen(TREECLI_SHELL_PASTE_START);
+			continue;
+		}
+		if (treecli_shell_match_seq(buf + i, len - i, TREECLI_SHELL_PASTE_END)) {
+			sh->paste = false;
+			i += strlen(TREECLI_SHELL_PASTE_END);
+			continue;
+		}
+
+		/* A whole line typed on an empty line editor is echoed at once
+		 * and passed directly to the parser. */
+		char *cmd;
+		lineedit_get_line(&(sh->line), &cmd);
+		uint32_t line_len = 0;
+		if (cmd[0] == '\0' && sh->parser.exec_pending == false && sh->parser.help_more == false) {
+			line_len = treecli_shell_fast_line(buf + i, len - i);
+		}
+		if (line_len > 0) {
+			memcpy(sh->input, buf + i, line_len);
+			sh->input[line_len] = '\0';
+
+			/* Treat CR LF as a single line terminator. */
+			i += line_len + 1;
+			if (buf[i - 1] == '\r' && i < len && buf[i] == '\n') {
+				i++;
+			}
+
+			/* Input is arriving faster than anyone can type if
+			 * it is pasted or more input is already waiting. The
+			 * line is executed silently, only errors and command
+			 * output are printed. */
+			bool quiet = sh->paste || i < len;
+			if (quiet == false) {
+				treecli_shell_refresh_pending(sh);
+				treecli_shell_print_handler(sh->input, (void *)sh);
+				treecli_shell_print_handler("\r\n", (void *)sh);
+			}
+			treecli_shell_execute(sh, sh->input, quiet);
+			continue;
+		}
+
+		/* The line is edited interactively, display the prompt. */
+		treecli_shell_refresh_pending(sh);
+		treecli_shell_keypress(sh, (unsigned char)buf[i]);
+		i++;
+	}
+
+	/* Prompt is displayed again after the last silently executed line
+	 * unless more pasted input is expected. */
+	if (sh->paste == false && sh->parser.exec_pending == false) {
+		treecli_shell_refresh_pending(sh);
+	}
+
+	sh->output_buffered = false;
+	sh->record_feed = false;
+	treecli_shell_flush(sh);
+
+	return (int32_t)i;
+}
+
+
+int32_t treecli_shell_set_recorder(struct treecli_shell *sh, int32_t (*write)(const void *buf, size_t len, void *ctx), uint32_t (*time)(void *ctx), void *ctx) {
+	assert(sh != NULL);
+	if (write != NULL && time == NULL) {
+		return TREECLI_SHELL_SET_RECORDER_FAILED;
+	}
+
+	sh->record_write = write;
+	sh->record_time = time;
+	sh->record_ctx = ctx;
+
+	return TREECLI_SHELL_SET_RECORDER_OK;
+}
+
+
+int32_t treecli_shell_record_decode(const uint8_t *buf, size_t len, struct treecli_shell_record *record, size_t *used) {
+	if (u_assert(buf != NULL || len == 0) ||
+	    u_assert(record != NULL) ||
+	    u_assert(used != NULL)) {
+		return TREECLI_SHELL_RECORD_DECODE_FAILED;
+	}
+
+	if (len < TREECLI_SHELL_RECORD_HEADER_LEN) {
+		return TREECLI_SHELL_RECORD_DECODE_TRUNCATED;
+	}
+	if (buf[0] != TREECLI_SHELL_RECORD_INPUT && buf[0] != TREECLI_SHELL_RECORD_OUTPUT && buf[0] != TREECLI_SHELL_RECORD_FEED) {
+		return TREECLI_SHELL_RECORD_DECODE_FAILED;
+	}
+
+	uint32_t data_len = buf[5] | ((uint32_t)buf[6] << 8);
+	if ((len - TREECLI_SHELL_RECORD_HEADER_LEN) < data_len) {
+		return TREECLI_SHELL_RECORD_DECODE_TRUNCATED;
+	}
+
+	record->type = (enum treecli_shell_record_type)buf[0];
+	record->time = 0;
+	for (uint32_t i = 0; i < 4; i++) {
+		record->time |= (uint32_t)buf[1 + i] << (8 * i);
+	}
+	record->data = buf + TREECLI_SHELL_RECORD_HEADER_LEN;
+	record->len = data_len;
+	*used = TREECLI_SHELL_RECORD_HEADER_LEN + data_len;
+
+	return TREECLI_SHELL_RECORD_DECODE_OK;
+}
+
+
+/**
+ * Run a script line to completion. Output generators are run without
+ * waiting for the output channel, other deferred commands cannot be
+ * waited for and are cancelled.
+ */
+static int32_t treecli_shell_script_line(struct treecli_shell *sh, char *line) {
+	int32_t ret = treecli_parser_parse_line(&(sh->parser), line);
+
+	while (ret == TREECLI_PARSER_PARSE_LINE_PENDING && sh->parser.generator != NULL) {
+		int32_t gen_ret = treecli_parser_generator_run(&(sh->parser), 0);
+		ret = treecli_parser_resume_line(&(sh->parser), &(sh->parser.generator_completion), line, gen_ret);
+	}
+	if (ret == TREECLI_PARSER_PARSE_LINE_PENDING) {
+		treecli_parser_cancel(&(sh->parser));
+		ret = TREECLI_PARSER_PARSE_LINE_COMMAND_FAILED;
+	}
+
+	return ret;
+}
+
+
+int32_t treecli_shell_run_script(struct treecli_shell *sh, const char *name, int32_t (*read_line)(char *buf, uint32_t size, void *ctx), void *ctx) {
+	assert(sh != NULL);
+	assert(name != NULL);
+	assert(read_line != NULL);
+	if (sh->print_handler == NULL) {
+		return TREECLI_SHELL_RUN_SCRIPT_FAILED;
+	}
+
+	if (sh->script_depth >= TREECLI_SHELL_SCRIPT_MAX_DEPTH || sh->parser.exec_pending) {
+		return TREECLI_SHELL_RUN_SCRIPT_FAILED;
+	}
+
+	/* Save the state of the calling script (if any). Scripts don't change
+	 * the working position of the caller. */
+	const char *saved_name = sh->script_name;
+	uint32_t saved_line = sh->script_line;
+#if TREECLI_PARSER_LOW_STACK
+	struct treecli_parser_pos *pos_saved = &(sh->script_pos[sh->script_depth]);
+	char *line = sh->script_lines[sh->script_depth];
+#else
+	struct treecli_parser_pos pos_saved_local;
+	struct treecli_parser_pos *pos_saved = &pos_saved_local;
+	char line_local[TREECLI_SHELL_LINE_LEN];
+	char *line = line_local;
+#endif
+	treecli_parser_pos_copy(pos_saved, &(sh->parser.pos));
+
+	sh->script_depth++;
+	sh->script_name = name;
+	sh->script_line = 0;
+
+	/* Value changes are delivered to watchers once the whole script is
+	 * executed. */
+	treecli_parser_batch_begin(&(sh->parser));
+
+	int32_t ret = TREECLI_SHELL_RUN_SCRIPT_OK;
+	while (ret == TREECLI_SHELL_RUN_SCRIPT_OK) {
+		int32_t len = read_line(line, TREECLI_SHELL_LINE_LEN, ctx);
+		if (len == TREECLI_SHELL_READ_LINE_EOF) {
+			break;
+		}
+		sh->script_line++;
+
+		if (len < 0) {
+			char num[12];
+			snprintf(num, sizeof(num), ":%u: ", (unsigned int)sh->script_line);
+			treecli_shell_print_handler(name, (void *)sh);
+			treecli_shell_print_handler(num, (void *)sh);
+			treecli_shell_print_handler("error: line too long\n", (void *)sh);
+			ret = TREECLI_SHELL_RUN_SCRIPT_LINE_FAILED;
+			break;
+		}
+
+		char *path;
+		if (treecli_shell_source_path(line, &path)) {
+			if (treecli_shell_source(sh, path) != TREECLI_SHELL_SOURCE_OK) {
+				ret = TREECLI_SHELL_RUN_SCRIPT_LINE_FAILED;
+			}
+			continue;
+		}
+
+		treecli_parser_set_mode(&(sh->parser), TREECLI_PARSER_ALLOW_EXEC);
+		int32_t parser_ret = treecli_shell_script_line(sh, line);
+		if (parser_ret != TREECLI_PARSER_PARSE_LINE_OK) {
+			treecli_shell_print_handler(line, (void *)sh);
+			treecli_shell_print_handler("\n", (void *)sh);
+			treecli_shell_print_error(sh, parser_ret, 0);
+			ret = TREECLI_SHELL_RUN_SCRIPT_LINE_FAILED;
+		}
+	}
+
+	if (treecli_parser_batch_end(&(sh->parser)) != TREECLI_PARSER_BATCH_END_OK && ret == TREECLI_SHELL_RUN_SCRIPT_OK) {
+		ret = TREECLI_SHELL_RUN_SCRIPT_FAILED;
+	}
+
+	sh->script_depth--;
+	sh->script_name = saved_name;
+	sh->script_line = saved_line;
+	treecli_parser_pos_copy(&(sh->parser.pos), pos_saved);
+
+	return ret;
+}
+
+
+int32_t treecli_shell_read_file_line(char *buf, uint32_t size, void *ctx) {
+	FILE *f = (FILE *)ctx;
+
+	if (fgets(buf, size, f) == NULL) {
+		return TREECLI_SHELL_READ_LINE_EOF;
+	}
+
+	size_t len = strlen(buf);
+	if (len > 0 && buf[len - 1] == '\n') {
+		buf[--len] = '\0';
+	} else if (!feof(f)) {
+		/* Skip the rest of the line. */
+		int c;
+		while ((c = fgetc(f)) != EOF && c != '\n') {
+			;
+		}
+		return TREECLI_SHELL_READ_LINE_TOO_LONG;
+	}
+	if (len > 0 && buf[len - 1] == '\r') {
+		buf[--len] = '\0';
+	}
+
+	return (int32_t)len;
+}
+
+
+int32_t treecli_shell_source(struct treecli_shell *sh, const char *path) {
+	assert(sh != NULL);
+	assert(path != NULL);
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		treecli_shell_print_handler(path, (void *)sh);
+		treecli_shell_print_handler(": error: cannot open file\n", (void *)sh);
+		return TREECLI_SHELL_SOURCE_FAILED;
+	}
+
+	int32_t ret = treecli_shell_run_script(sh, path, treecli_shell_read_file_line, (void *)f);
+	fclose(f);
+
+	if (ret != TREECLI_SHELL_RUN_SCRIPT_OK) {
+		return TREECLI_SHELL_SOURCE_FAILED;
+	}
+
+	return TREECLI_SHELL_SOURCE_OK;
+}
+
+
+int32_t treecli_shell_exec_done(struct treecli_shell *sh, const struct treecli_completion *completion, int32_t result) {
+	assert(sh != NULL);
+	assert(completion != NULL);
+	if (sh->print_handler == NULL) {
+		return TREECLI_SHELL_EXEC_DONE_FAILED;
+	}
+
+	/* Completion of a cancelled command, ignore it. */
+	if (sh->parser.exec_pending == false || completion->id != sh->parser.exec_id) {
+		return TREECLI_SHELL_EXEC_DONE_FAILED;
+	}
+
+	/* Continue parsing the rest of the line. Another command may be
+	 * deferred, the shell stays busy in that case. */
+	int32_t parser_ret = treecli_parser_resume_line(&(sh->parser), completion, sh->exec_line, result);
+	if (parser_ret == TREECLI_PARSER_PARSE_LINE_PENDING) {
+		return TREECLI_SHELL_EXEC_DONE_OK;
+	}
+
+	treecli_shell_line_done(sh, parser_ret);
+	if (sh->paste == false) {
+		treecli_shell_refresh_pending(sh);
+	}
+
+	return TREECLI_SHELL_EXEC_DONE_OK;
+}
+
+
+int32_t treecli_shell_writable(struct treecli_shell *sh) {
+	assert(sh != NULL);
+	if (sh->print_handler == NULL) {
+		return TREECLI_SHELL_WRITABLE_FAILED;
+	}
+
+	/* Nothing to write. */
+	if (sh->parser.exec_pending == false || sh->parser.generator == NULL) {
+		return TREECLI_SHELL_WRITABLE_OK;
+	}
+
+	int32_t ret = treecli_parser_generator_run(&(sh->parser), TREECLI_SHELL_GENERATOR_BUDGET);
+	if (ret == TREECLI_PARSER_GENERATOR_MORE) {
+		return TREECLI_SHELL_WRITABLE_OK;
+	}
+
+	/* Generator finished, continue with the rest of the line. */
+	int32_t parser_ret = treecli_parser_resume_line(&(sh->parser), &(sh->parser.generator_completion), sh->exec_line, ret);
+	if (parser_ret == TREECLI_PARSER_PARSE_LINE_PENDING) {
+		return TREECLI_SHELL_WRITABLE_OK;
+	}
+
+	treecli_shell_line_done(sh, parser_ret);
+	if (sh->paste == false) {
+		treecli_shell_refresh_pending(sh);
+	}
+
+	return TREECLI_SHELL_WRITABLE_OK;
+}
+
+
+bool treecli_shell_is_busy(struct treecli_shell *sh) {
+	assert(sh != NULL);
+
+	return sh->parser.exec_pending;
+}
+
+
 int32_t treecli_shell_set_parser_context(struct treecli_shell *sh, void *context) {
 	u_assert(sh != NULL);
 	u_assert(context != NULL);
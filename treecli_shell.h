@@ -24,6 +24,7 @@
  */
 
 #include "treecli_parser.h"
+#include "treecli_workspace.h"
 #include "lineedit.h"
 
 #define assert u_assert
@@ -47,6 +48,81 @@
 #define TREECLI_SHELL_DEFAULT_ERROR_COLOR LINEEDIT_FG_COLOR_RED
 #endif
 
+/**
+ * Number of help entries and suggestions printed at once. Remaining help
+ * entries are printed page by page when space or enter is pressed on an empty
+ * line. Zero disables paging.
+ */
+#ifndef TREECLI_SHELL_HELP_LIMIT
+#define TREECLI_SHELL_HELP_LIMIT 50
+#endif
+
+/**
+ * Key used to cancel a command which is completing asynchronously (Ctrl-C).
+ */
+#ifndef TREECLI_SHELL_CANCEL_KEY
+#define TREECLI_SHELL_CANCEL_KEY 3
+#endif
+
+/**
+ * Maximum number of output generator calls done at once when the output
+ * channel is writable.
+ */
+#ifndef TREECLI_SHELL_GENERATOR_BUDGET
+#define TREECLI_SHELL_GENERATOR_BUDGET 16
+#endif
+
+/**
+ * Size of the buffer collecting shell output during treecli_shell_feed.
+ */
+#ifndef TREECLI_SHELL_OUTPUT_BUF_LEN
+#define TREECLI_SHELL_OUTPUT_BUF_LEN 128
+#endif
+
+/**
+ * Terminal escape sequences surrounding pasted text if bracketed paste mode
+ * is enabled in the terminal.
+ */
+#define TREECLI_SHELL_PASTE_START "\x1b[200~"
+#define TREECLI_SHELL_PASTE_END "\x1b[201~"
+
+/**
+ * Built-in command used to execute commands from a file. The file name
+ * follows the command separated by a space. The command is prefixed with
+ * a character not used in node names to never shadow nodes of the tree.
+ */
+#ifndef TREECLI_SHELL_SOURCE_CMD
+#define TREECLI_SHELL_SOURCE_CMD "@source"
+#endif
+
+#ifndef TREECLI_SHELL_SCRIPT_MAX_DEPTH
+#define TREECLI_SHELL_SCRIPT_MAX_DEPTH 4
+#endif
+
+/**
+ * Records written by the session recorder. Every record starts with a header
+ * containing the record type (1 byte), time of the record (4 bytes) and
+ * length of the data (2 bytes) followed by the data. Multibyte fields are
+ * little endian. Input records contain a single key passed to
+ * treecli_shell_keypress, feed records contain input passed to
+ * treecli_shell_feed (split to more records if it is too long).
+ */
+enum treecli_shell_record_type {
+	TREECLI_SHELL_RECORD_INPUT = 0,
+	TREECLI_SHELL_RECORD_OUTPUT,
+	TREECLI_SHELL_RECORD_FEED,
+};
+
+#define TREECLI_SHELL_RECORD_HEADER_LEN 7
+#define TREECLI_SHELL_RECORD_MAX_DATA 0xffff
+
+struct treecli_shell_record {
+	enum treecli_shell_record_type type;
+	uint32_t time;
+	const uint8_t *data;
+	uint32_t len;
+};
+
 /**
  * Treecli shell structure holding single shell context. The structure shouldn't
  * be accessed directly.
@@ -59,6 +135,20 @@ struct treecli_shell {
 	 */
 	struct treecli_parser parser;
 
+#if TREECLI_PARSER_LOW_STACK
+	/**
+	 * Scratch space of the parser used instead of the stack.
+	 */
+	struct treecli_parser_workspace workspace;
+
+	/**
+	 * Line and saved working position of every nesting level of running
+	 * scripts, kept here instead of the stack.
+	 */
+	char script_lines[TREECLI_SHELL_SCRIPT_MAX_DEPTH][TREECLI_SHELL_LINE_LEN];
+	struct treecli_parser_pos script_pos[TREECLI_SHELL_SCRIPT_MAX_DEPTH];
+#endif
+
 	/**
 	 * A context for the line editing library providing a convenient interface
 	 * for single line editing, autocompletion and history over simple serial
@@ -86,6 +176,53 @@ struct treecli_shell {
 	const char *hostname;
 	uint8_t prompt_color;
 	uint8_t error_color;
+
+	/**
+	 * Line being executed. It is kept until the command completes if its
+	 * execution is deferred. Complete lines passed to treecli_shell_feed
+	 * are executed directly from the input buffer.
+	 */
+	char *exec_line;
+	char input[TREECLI_SHELL_LINE_LEN];
+
+	/**
+	 * Set if the executed line was not echoed because the input arrives
+	 * faster than it can be typed (pasted or already queued input). paste
+	 * is set between bracketed paste start and end sequences. The prompt
+	 * is not displayed until the fast input ends, refresh_pending is set
+	 * in the meantime.
+	 */
+	bool exec_quiet;
+	bool paste;
+	bool refresh_pending;
+
+	/**
+	 * Name of the script being executed and number of its current line.
+	 * Used to report errors. Scripts can be nested up to
+	 * TREECLI_SHELL_SCRIPT_MAX_DEPTH levels using the @source command.
+	 */
+	uint32_t script_depth;
+	const char *script_name;
+	uint32_t script_line;
+
+	/**
+	 * Output collected while processing a chunk of input passed to
+	 * treecli_shell_feed. It is written using the print handler when
+	 * the buffer is full or the whole chunk is processed.
+	 */
+	bool output_buffered;
+	char output[TREECLI_SHELL_OUTPUT_BUF_LEN + 1];
+	uint32_t output_len;
+
+	/**
+	 * Session recorder set by treecli_shell_set_recorder. record_feed is
+	 * set while treecli_shell_feed is processing its input, keys it passes
+	 * to treecli_shell_keypress are not recorded again.
+	 */
+	int32_t (*record_write)(const void *buf, size_t len, void *ctx);
+	uint32_t (*record_time)(void *ctx);
+	void *record_ctx;
+	bool record_feed;
 };
 
 
@@ -160,7 +297,8 @@ int32_t treecli_shell_prompt_callback(struct lineedit *le, void *ctx);
  * @param line Pointer to string to print. Cannot be NULL.
  * @param ctx Context of the callback function. Cast to shell context in this case.
  *
- * @return Zero on success, negative integer on failure.
+ * @return Zero on success, TREECLI_PRINT_WOULD_BLOCK if the output channel
+ *         is full or negative integer on failure.
  */
 int32_t treecli_shell_print_handler(const char *line, void *ctx);
 
@@ -193,6 +331,20 @@ int32_t treecli_shell_match_handler(const char *token, enum treecli_match_type m
 int32_t treecli_shell_best_match_handler(const char *token, uint32_t token_len, uint32_t match_pos, uint32_t match_len, void *ctx);
 
 
+/**
+ * Shell target handler. It is called by the parser for every dynamic node
+ * selected by a pattern. Failed targets are reported one per line together
+ * with their path.
+ *
+ * @param parser Parser with working position set to the target.
+ * @param result Result of the target.
+ * @param ctx Shell context.
+ *
+ * @return Zero on success, negative integer on failure.
+ */
+int32_t treecli_shell_target_handler(struct treecli_parser *parser, int32_t result, void *ctx);
+
+
 /**
  * @brief Print parsing result with a line showing error position.
  *
@@ -224,6 +376,181 @@ int32_t treecli_shell_keypress(struct treecli_shell *sh, int c);
 #define TREECLI_SHELL_KEYPRESS_OK 0
 #define TREECLI_SHELL_KEYPRESS_FAILED -1
 
+
+/**
+ * @brief Process a chunk of input characters at once.
+ *
+ * It behaves the same as calling treecli_shell_keypress for every character
+ * of the chunk but the output is written in larger blocks. Complete lines
+ * of printable characters entered on an empty line are echoed at once and
+ * passed directly to the parser without line editing. Lines followed by more
+ * input in the same chunk or pasted using bracketed paste are executed
+ * silently without echo and prompt, only command output and errors together
+ * with the failed line are printed. Processing stops if
+ * a command completes asynchronously, the remaining input should be fed
+ * again after the shell is no longer busy.
+ *
+ * @param sh A treecli shell context. Cannot be NULL.
+ * @param buf Input characters. Cannot be NULL.
+ * @param len Number of characters in the buffer.
+ *
+ * @return Number of processed characters or
+ *         TREECLI_SHELL_FEED_FAILED on error.
+ */
+int32_t treecli_shell_feed(struct treecli_shell *sh, const char *buf, uint32_t len);
+#define TREECLI_SHELL_FEED_FAILED -1
+
+/**
+ * @brief Record the session.
+ *
+ * Input passed to treecli_shell_keypress and treecli_shell_feed and output
+ * written by the print handler are recorded with their time as records
+ * described by struct treecli_shell_record. Input is recorded before it is
+ * processed, input of treecli_shell_feed is recorded as a whole even if only
+ * a part of it is processed (the rest is recorded again when it is fed
+ * later). Longer input and output is split to multiple records. The
+ * recording can be replayed to a shell with the same configuration tree (eg.
+ * to measure latency of individual keys). The recorder is disabled if the
+ * write handler fails.
+ *
+ * @param sh A treecli shell context. Cannot be NULL.
+ * @param write Handler writing the recording or NULL to stop recording.
+ * @param time Handler returning actual time in microseconds (it may wrap).
+ *             Cannot be NULL if write is set.
+ * @param ctx Context passed to both handlers.
+ *
+ * @return TREECLI_SHELL_SET_RECORDER_OK on success or
+ *         TREECLI_SHELL_SET_RECORDER_FAILED otherwise.
+ */
+int32_t treecli_shell_set_recorder(struct treecli_shell *sh, int32_t (*write)(const void *buf, size_t len, void *ctx), uint32_t (*time)(void *ctx), void *ctx);
+#define TREECLI_SHELL_SET_RECORDER_OK 0
+#define TREECLI_SHELL_SET_RECORDER_FAILED -1
+
+/**
+ * @brief Decode a single record of a session recording.
+ *
+ * @param buf Recording.
+ * @param len Length of the recording.
+ * @param record Decoded record, its data point to buf.
+ * @param used Length of the record in the buffer.
+ *
+ * @return TREECLI_SHELL_RECORD_DECODE_OK if a record was decoded or
+ *         TREECLI_SHELL_RECORD_DECODE_TRUNCATED if the buffer doesn't contain
+ *         a complete record or
+ *         TREECLI_SHELL_RECORD_DECODE_FAILED otherwise.
+ */
+int32_t treecli_shell_record_decode(const uint8_t *buf, size_t len, struct treecli_shell_record *record, size_t *used);
+#define TREECLI_SHELL_RECORD_DECODE_OK 0
+#define TREECLI_SHELL_RECORD_DECODE_FAILED -1
+#define TREECLI_SHELL_RECORD_DECODE_TRUNCATED -2
+
+/**
+ * @brief Execute a script non-interactively.
+ *
+ * Lines are read using the read_line callback and passed directly to the
+ * parser with command execution enabled. No line editing, prompt or echo is
+ * done. Execution stops at the first failed line. The error is reported with
+ * the script name and line number followed by the failed line and the error
+ * position marker. Working position is restored after the script finishes.
+ *
+ * @param sh A treecli shell context. Cannot be NULL.
+ * @param name Name of the script used in error messages. Cannot be NULL.
+ * @param read_line Callback reading a single line to buf of size bytes
+ *                  without the line terminator. It returns length of the line
+ *                  or TREECLI_SHELL_READ_LINE_EOF at the end of the script or
+ *                  TREECLI_SHELL_READ_LINE_TOO_LONG if the line doesn't fit.
+ * @param ctx Context passed to the read_line callback.
+ *
+ * @return TREECLI_SHELL_RUN_SCRIPT_OK if all lines were executed successfully or
+ *         TREECLI_SHELL_RUN_SCRIPT_LINE_FAILED if some line failed or
+ *         TREECLI_SHELL_RUN_SCRIPT_FAILED otherwise.
+ */
+int32_t treecli_shell_run_script(struct treecli_shell *sh, const char *name, int32_t (*read_line)(char *buf, uint32_t size, void *ctx), void *ctx);
+#define TREECLI_SHELL_RUN_SCRIPT_OK 0
+#define TREECLI_SHELL_RUN_SCRIPT_FAILED -1
+#define TREECLI_SHELL_RUN_SCRIPT_LINE_FAILED -2
+#define TREECLI_SHELL_READ_LINE_EOF -1
+#define TREECLI_SHELL_READ_LINE_TOO_LONG -2
+
+
+/**
+ * @brief Line reader for treecli_shell_run_script reading from a stdio file.
+ *
+ * @param buf Buffer to read the line to.
+ * @param size Size of the buffer.
+ * @param ctx FILE pointer of the opened file.
+ *
+ * @return The same values as the read_line callback of treecli_shell_run_script.
+ */
+int32_t treecli_shell_read_file_line(char *buf, uint32_t size, void *ctx);
+
+
+/**
+ * @brief Execute commands from a file.
+ *
+ * The same as the built-in source command. The file is read using stdio and
+ * executed with treecli_shell_run_script.
+ *
+ * @param sh A treecli shell context. Cannot be NULL.
+ * @param path Path to the file. Cannot be NULL.
+ *
+ * @return TREECLI_SHELL_SOURCE_OK if the whole file was executed successfully or
+ *         TREECLI_SHELL_SOURCE_FAILED otherwise.
+ */
+int32_t treecli_shell_source(struct treecli_shell *sh, const char *path);
+#define TREECLI_SHELL_SOURCE_OK 0
+#define TREECLI_SHELL_SOURCE_FAILED -1
+
+
+/**
+ * @brief Report completion of a command deferred with treecli_parser_exec_defer.
+ *
+ * The shell is busy while the command is running. Ctrl-C cancels the command,
+ * other keypresses are ignored. This function must be called from the same
+ * thread (event loop) which calls treecli_shell_keypress. The rest of the
+ * command line is parsed and the result is printed.
+ *
+ * @param sh A treecli shell context. Cannot be NULL.
+ * @param completion Completion handle of the command. Cannot be NULL.
+ * @param result Result of the command, negative value if it failed.
+ *
+ * @return TREECLI_SHELL_EXEC_DONE_OK on success or
+ *         TREECLI_SHELL_EXEC_DONE_FAILED if the completion is stale (the
+ *         command was cancelled).
+ */
+int32_t treecli_shell_exec_done(struct treecli_shell *sh, const struct treecli_completion *completion, int32_t result);
+#define TREECLI_SHELL_EXEC_DONE_OK 0
+#define TREECLI_SHELL_EXEC_DONE_FAILED -1
+
+
+/**
+ * @brief Continue output of a command which registered an output generator.
+ *
+ * The event loop should call this function whenever the shell is busy and its
+ * output channel is writable. The generator is called until the print handler
+ * returns TREECLI_PRINT_WOULD_BLOCK or TREECLI_SHELL_GENERATOR_BUDGET calls
+ * are done to let other sessions run. The rest of the command line is parsed
+ * when the generator finishes.
+ *
+ * @param sh A treecli shell context. Cannot be NULL.
+ *
+ * @return TREECLI_SHELL_WRITABLE_OK on success or
+ *         TREECLI_SHELL_WRITABLE_FAILED otherwise.
+ */
+int32_t treecli_shell_writable(struct treecli_shell *sh);
+#define TREECLI_SHELL_WRITABLE_OK 0
+#define TREECLI_SHELL_WRITABLE_FAILED -1
+
+
+/**
+ * @brief Check if the shell is waiting for a command to complete.
+ *
+ * @param sh A treecli shell context. Cannot be NULL.
+ *
+ * @return true if a command is pending, false otherwise.
+ */
+bool treecli_shell_is_busy(struct treecli_shell *sh);
+
 int32_t treecli_shell_set_parser_context(struct treecli_shell *sh, void *context);
 #define TREECLI_SHELL_SET_PARSER_CONTEXT_OK 0
 #define TREECLI_SHELL_SET_PARSER_CONTEXT_FAILED -1
@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "treecli_parser.h"
+#include "treecli_trace.h"
+
+
+static uint64_t (*treecli_trace_clock)(void) = NULL;
+static TREECLI_TRACE_THREAD_LOCAL struct treecli_trace_ring *treecli_trace_ring = NULL;
+
+static const char *treecli_trace_names[TREECLI_TRACE_EVENTS] = {
+	"token", "match", "create", "exec", "get", "set", "print"
+};
+
+
+int32_t treecli_trace_set_clock(uint64_t (*clock)(void)) {
+	if (u_assert(clock != NULL)) {
+		return TREECLI_TRACE_SET_CLOCK_FAILED;
+	}
+
+	treecli_trace_clock = clock;
+
+	return TREECLI_TRACE_SET_CLOCK_OK;
+}
+
+
+int32_t treecli_trace_attach(struct treecli_trace_ring *ring, uint32_t tid) {
+	if (ring != NULL) {
+		if (treecli_trace_clock == NULL) {
+			return TREECLI_TRACE_ATTACH_FAILED;
+		}
+		memset(ring, 0, sizeof(struct treecli_trace_ring));
+		ring->tid = tid;
+	}
+	treecli_trace_ring = ring;
+
+	return TREECLI_TRACE_ATTACH_OK;
+}
+
+
+void treecli_trace_record(uint32_t event) {
+	struct treecli_trace_ring *ring = treecli_trace_ring;
+	if (ring == NULL) {
+		return;
+	}
+
+	/* Only the owning thread writes the ring. Records are published by
+	 * the head. Record stores are ordered after the head of the record
+	 * they overwrite, the exporter detects them using the head. */
+	uint32_t head = ring->head;
+	struct treecli_trace_record *r = &(ring->records[head & (TREECLI_TRACE_RING_LEN - 1)]);
+	__atomic_store_n(&(r->time), treecli_trace_clock(), __ATOMIC_RELEASE);
+	__atomic_store_n(&(r->event), event, __ATOMIC_RELEASE);
+	__atomic_store_n(&(ring->head), head + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Format a single record as a trace event.
+ */
+static int32_t treecli_trace_export_record(const struct treecli_trace_ring *ring, const struct treecli_trace_record *r, bool first, int32_t (*write)(const void *buf, size_t len, void *ctx), void *ctx) {
+	uint32_t type = r->event & (TREECLI_TRACE_END_FLAG - 1);
+	if (type >= TREECLI_TRACE_EVENTS) {
+		return 0;
+	}
+
+	char s[128];
+	int len = snprintf(s, sizeof(s), "%s{\"name\":\"%s\",\"cat\":\"treecli\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%u}",
+		first ? "" : ",\n",
+		treecli_trace_names[type],
+		(r->event & TREECLI_TRACE_END_FLAG) ? 'E' : 'B',
+		(unsigned long long)(r->time / 1000),
+		(unsigned int)(r->time % 1000),
+		(unsigned int)ring->tid);
+	if (len < 0 || (size_t)len >= sizeof(s)) {
+		return -1;
+	}
+
+	return write(s, len, ctx);
+}
+
+
+int32_t treecli_trace_export(struct treecli_trace_ring *const *rings, uint32_t count, int32_t (*write)(const void *buf, size_t len, void *ctx), void *ctx) {
+	if (u_assert(rings != NULL || count == 0) ||
+	    u_assert(write != NULL)) {
+		return TREECLI_TRACE_EXPORT_FAILED;
+	}
+
+	const char *start = "{\"traceEvents\":[\n";
+	if (write(start, strlen(start), ctx) < 0) {
+		return TREECLI_TRACE_EXPORT_FAILED;
+	}
+
+	bool first = true;
+	for (uint32_t i = 0; i < count; i++) {
+		struct treecli_trace_ring *ring = rings[i];
+		if (u_assert(ring != NULL)) {
+			return TREECLI_TRACE_EXPORT_FAILED;
+		}
+
+		uint32_t head = __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE);
+		uint32_t j = (head > TREECLI_TRACE_RING_LEN) ? (head - TREECLI_TRACE_RING_LEN) : 0;
+		for (; j != head; j++) {
+			const struct treecli_trace_record *slot = &(ring->records[j & (TREECLI_TRACE_RING_LEN - 1)]);
+			struct treecli_trace_record r;
+			r.time = __atomic_load_n(&(slot->time), __ATOMIC_RELAXED);
+			r.event = __atomic_load_n(&(slot->event), __ATOMIC_RELAXED);
+
+			/* The record may have been overwritten while it was
+			 * read if the writer has reached it again. */
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			uint32_t now = __atomic_load_n(&(ring->head), __ATOMIC_RELAXED);
+			if ((now - j) >= TREECLI_TRACE_RING_LEN) {
+				continue;
+			}
+
+			if (treecli_trace_export_record(ring, &r, first, write, ctx) < 0) {
+				return TREECLI_TRACE_EXPORT_FAILED;
+			}
+			first = false;
+		}
+	}
+
+	const char *end = "\n]}\n";
+	if (write(end, strlen(end), ctx) < 0) {
+		return TREECLI_TRACE_EXPORT_FAILED;
+	}
+
+	return TREECLI_TRACE_EXPORT_OK;
+}
@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_TRACE_H_
+#define _TREECLI_TRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Record trace events around tokenizing, matching and calls of user callbacks.
+ * Trace hooks compile to nothing if it is 0.
+ */
+#ifndef TREECLI_TRACE
+#define TREECLI_TRACE 0
+#endif
+
+/**
+ * Number of records kept in a trace ring, must be a power of two.
+ */
+#ifndef TREECLI_TRACE_RING_LEN
+#define TREECLI_TRACE_RING_LEN 1024
+#endif
+
+/**
+ * Storage class of the ring attached to the current thread. It can be
+ * defined empty on targets without threads.
+ */
+#ifndef TREECLI_TRACE_THREAD_LOCAL
+#define TREECLI_TRACE_THREAD_LOCAL __thread
+#endif
+
+
+enum treecli_trace_event {
+	TREECLI_TRACE_TOKEN = 0,
+	TREECLI_TRACE_MATCH,
+	TREECLI_TRACE_CREATE,
+	TREECLI_TRACE_EXEC,
+	TREECLI_TRACE_GET,
+	TREECLI_TRACE_SET,
+	TREECLI_TRACE_PRINT,
+	TREECLI_TRACE_EVENTS,
+};
+
+/**
+ * Flag of records marking the end of an event.
+ */
+#define TREECLI_TRACE_END_FLAG 0x100
+
+/**
+ * Single trace record, time is in nanoseconds.
+ */
+struct treecli_trace_record {
+	uint64_t time;
+	uint64_t event;
+};
+
+/**
+ * Ring of trace records written by a single thread. head is the number of
+ * records written so far, only the last TREECLI_TRACE_RING_LEN records are
+ * kept.
+ */
+struct treecli_trace_ring {
+	struct treecli_trace_record records[TREECLI_TRACE_RING_LEN];
+	uint32_t head;
+	uint32_t tid;
+};
+
+
+#if TREECLI_TRACE
+#define TREECLI_TRACE_BEGIN(event) treecli_trace_record((event))
+#define TREECLI_TRACE_END(event) treecli_trace_record((event) | TREECLI_TRACE_END_FLAG)
+#else
+#define TREECLI_TRACE_BEGIN(event) do {} while (0)
+#define TREECLI_TRACE_END(event) do {} while (0)
+#endif
+
+
+/**
+ * Set the clock used to timestamp trace records. It must be set before any
+ * ring is attached.
+ *
+ * @param clock Function returning monotonic time in nanoseconds.
+ *
+ * @return TREECLI_TRACE_SET_CLOCK_OK or TREECLI_TRACE_SET_CLOCK_FAILED.
+ */
+int32_t treecli_trace_set_clock(uint64_t (*clock)(void));
+#define TREECLI_TRACE_SET_CLOCK_OK 0
+#define TREECLI_TRACE_SET_CLOCK_FAILED -1
+
+/**
+ * Attach a ring to the calling thread. Trace events of the thread are written
+ * to the ring without any locking until another ring is attached. Threads
+ * without a ring are not traced.
+ *
+ * @param ring Ring to initialize and attach or NULL to stop tracing.
+ * @param tid Thread identifier used in the exported trace.
+ *
+ * @return TREECLI_TRACE_ATTACH_OK or TREECLI_TRACE_ATTACH_FAILED.
+ */
+int32_t treecli_trace_attach(struct treecli_trace_ring *ring, uint32_t tid);
+#define TREECLI_TRACE_ATTACH_OK 0
+#define TREECLI_TRACE_ATTACH_FAILED -1
+
+/**
+ * Write a record to the ring of the calling thread. Used by the trace hooks.
+ */
+void treecli_trace_record(uint32_t event);
+
+/**
+ * Export rings in the Chrome trace event format (JSON), it can be opened by
+ * chrome://tracing or Perfetto. Rings can be exported while their threads
+ * are running, records overwritten during the export are skipped.
+ *
+ * @param rings Rings to export.
+ * @param count Number of rings.
+ * @param write Handler writing the exported trace.
+ * @param ctx Context passed to the write handler.
+ *
+ * @return TREECLI_TRACE_EXPORT_OK or TREECLI_TRACE_EXPORT_FAILED.
+ */
+int32_t treecli_trace_export(struct treecli_trace_ring *const *rings, uint32_t count, int32_t (*write)(const void *buf, size_t len, void *ctx), void *ctx);
+#define TREECLI_TRACE_EXPORT_OK 0
+#define TREECLI_TRACE_EXPORT_FAILED -1
+
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2014, Marek Koza (qyx@krtko.org)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TREECLI_WORKSPACE_H_
+#define _TREECLI_WORKSPACE_H_
+
+#include <stdint.h>
+
+#include "treecli_parser.h"
+#include "treecli_expr.h"
+
+/**
+ * Scratch space of a parser built with TREECLI_PARSER_LOW_STACK. Large
+ * temporary structures which are otherwise allocated on the stack during
+ * parsing are placed here. Each member is used by a single function which
+ * is never active twice at the same time (parser functions must not be
+ * called from match and create callbacks in this mode).
+ */
+struct treecli_parser_workspace {
+	/* Position saved by treecli_parser_parse_line. */
+	struct treecli_parser_pos line_pos;
+
+	/* Matches of the token being parsed. */
+	struct treecli_matches matches;
+
+	/* Node at the current position and its subnode being listed by
+	 * treecli_parser_get_matches or by the help. */
+	struct treecli_node node;
+	struct treecli_node entry;
+	char name[TREECLI_DNODE_MAX_NAME_LEN];
+
+	/* Position and matches of treecli_resolve_path. */
+	struct treecli_parser_pos path_pos;
+	struct treecli_matches path_matches;
+
+	/* Expression assigned to a value and its reference being resolved. */
+	struct treecli_expr expr;
+	struct treecli_handle ref;
+
+	/* Positions, matches and the level name of treecli_parser_pos_remap
+	 * (remapping runs when the first read-side section after a mount
+	 * change starts, before any other member is used). */
+	struct treecli_parser_pos remap_saved;
+	struct treecli_parser_pos remap_old;
+	struct treecli_parser_pos remap_new;
+	struct treecli_matches remap_matches;
+	char remap_name[TREECLI_DNODE_MAX_NAME_LEN];
+
+	/* Position saved by treecli_parser_pos_name. */
+	struct treecli_parser_pos name_pos;
+
+	/* Position saved by treecli_parser_generator_run. */
+	struct treecli_parser_pos generator_pos;
+
+	/* Node and dnode name compared by treecli_parser_find_exact. */
+	struct treecli_node exact_node;
+	char exact_name[TREECLI_DNODE_MAX_NAME_LEN];
+
+	/* Node created by treecli_parser_dnode_get_name. */
+	struct treecli_node name_node;
+
+	/* Dnode name printed by treecli_parser_pos_print. */
+	char print_name[TREECLI_DNODE_MAX_NAME_LEN];
+};
+
+/**
+ * Declare pointer var to a scratch structure which is either a member of
+ * the workspace or a local variable.
+ */
+#if TREECLI_PARSER_LOW_STACK
+#define TREECLI_PARSER_SCRATCH(parser, type, var, member) type *var = &((parser)->workspace->member)
+#define TREECLI_PARSER_SCRATCH_NAME(parser, var) char *var = (parser)->workspace->name
+#define TREECLI_PARSER_SCRATCH_ARRAY(parser, type, var, member, len) type *var = (parser)->workspace->member
+#else
+#define TREECLI_PARSER_SCRATCH(parser, type, var, member) type var##_local; type *var = &var##_local
+#define TREECLI_PARSER_SCRATCH_NAME(parser, var) char var[TREECLI_DNODE_MAX_NAME_LEN]
+#define TREECLI_PARSER_SCRATCH_ARRAY(parser, type, var, member, len) type var[len]
+#endif
+
+/**
+ * Check if a parser built with TREECLI_PARSER_LOW_STACK has its workspace
+ * set. Always false otherwise.
+ */
+#define TREECLI_PARSER_NO_WORKSPACE(parser) (TREECLI_PARSER_LOW_STACK && u_assert((parser)->workspace != NULL))
+
+/**
+ * Forget a completion registered by a command which returned without
+ * TREECLI_PARSER_EXEC_PENDING. The command is finished, its completion id
+ * is not accepted anymore. Used by the parser and by plan execution.
+ */
+void treecli_parser_exec_drop(struct treecli_parser *parser);
+
+
+#endif